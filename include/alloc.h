@@ -6,6 +6,16 @@
 #include "panic.h"
 #include "ty.h"
 
+/*
+ * Every arena block starts with one of these. `next` is the arena that was
+ * current before this one was pushed; `sources` heads the chain of source_map
+ * slots registered for nodes allocated in this arena (see source_register()).
+ */
+typedef struct {
+        Arena next;
+        u32 sources;
+} ArenaHeader;
+
 #if 1
 #define NewArena(n)  NewArena(ty, (n))
 #define ReleaseArena(a) ReleaseArena(ty, (a))
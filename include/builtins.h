@@ -537,6 +537,7 @@ static struct {
   { .module = "thread",     .name = "channel",                  .value = BUILTIN(builtin_thread_channel)          },
   { .module = "thread",     .name = "close",                    .value = BUILTIN(builtin_thread_close)            },
   { .module = "thread",     .name = "send",                     .value = BUILTIN(builtin_thread_send)             },
+  { .module = "thread",     .name = "trySend",                  .value = BUILTIN(builtin_thread_try_send)         },
   { .module = "thread",     .name = "recv",                     .value = BUILTIN(builtin_thread_recv)             },
   { .module = "thread",     .name = "sigmask",                  .value = BUILTIN(builtin_thread_sigmask)          },
   { .module = "thread",     .name = "note",                     .value = BUILTIN(builtin_thread_note)             },
@@ -898,6 +899,43 @@ static struct {
   { .module = "ty",         .name = "definition",               .value = BUILTIN(builtin_ty_definition)          },
   { .module = "ty",         .name = "coro",                     .value = BUILTIN(builtin_ty_coro)                },
 
+  { .module = "ty/gc",      .name = "collect",                  .value = BUILTIN(builtin_ty_gc)                  },
+  { .module = "ty/gc",      .name = "snapshot",                 .value = BUILTIN(builtin_ty_gc_snapshot)         },
+  { .module = "ty/gc",      .name = "weak",                     .value = BUILTIN(builtin_ty_gc_weak)             },
+  { .module = "ty/gc",      .name = "deref",                    .value = BUILTIN(builtin_ty_gc_deref)            },
+  { .module = "ty/gc",      .name = "weakDict",                 .value = BUILTIN(builtin_ty_gc_weak_dict)        },
+  { .module = "ty/gc",      .name = "mode",                     .value = BUILTIN(builtin_ty_gc_mode)             },
+  { .module = "ty/gc",      .name = "freeze",                   .value = BUILTIN(builtin_ty_gc_freeze)           },
+  { .module = "ty/gc",      .name = "limit",                    .value = BUILTIN(builtin_ty_gc_limit)            },
+
+  { .module = "ty/persist", .name = "map",                      .value = BUILTIN(builtin_ty_persist_map)         },
+  { .module = "ty/persist", .name = "vector",                   .value = BUILTIN(builtin_ty_persist_vector)      },
+  { .module = "ty/persist", .name = "get",                      .value = BUILTIN(builtin_ty_persist_get)         },
+  { .module = "ty/persist", .name = "put",                      .value = BUILTIN(builtin_ty_persist_put)         },
+  { .module = "ty/persist", .name = "remove",                   .value = BUILTIN(builtin_ty_persist_remove)      },
+  { .module = "ty/persist", .name = "push",                     .value = BUILTIN(builtin_ty_persist_push)        },
+  { .module = "ty/persist", .name = "pop",                      .value = BUILTIN(builtin_ty_persist_pop)         },
+  { .module = "ty/persist", .name = "slice",                    .value = BUILTIN(builtin_ty_persist_slice)       },
+  { .module = "ty/persist", .name = "concat",                   .value = BUILTIN(builtin_ty_persist_concat)      },
+  { .module = "ty/persist", .name = "len",                      .value = BUILTIN(builtin_ty_persist_len)         },
+  { .module = "ty/persist", .name = "items",                    .value = BUILTIN(builtin_ty_persist_items)       },
+
+  { .module = "ty/lazy",    .name = "new",                      .value = BUILTIN(builtin_ty_lazy_new)            },
+  { .module = "ty/lazy",    .name = "map",                      .value = BUILTIN(builtin_ty_lazy_map)            },
+  { .module = "ty/lazy",    .name = "filter",                   .value = BUILTIN(builtin_ty_lazy_filter)         },
+  { .module = "ty/lazy",    .name = "take",                     .value = BUILTIN(builtin_ty_lazy_take)           },
+  { .module = "ty/lazy",    .name = "drop",                     .value = BUILTIN(builtin_ty_lazy_drop)           },
+  { .module = "ty/lazy",    .name = "zip",                      .value = BUILTIN(builtin_ty_lazy_zip)            },
+  { .module = "ty/lazy",    .name = "enumerate",                .value = BUILTIN(builtin_ty_lazy_enumerate)      },
+  { .module = "ty/lazy",    .name = "chunk",                    .value = BUILTIN(builtin_ty_lazy_chunk)          },
+  { .module = "ty/lazy",    .name = "flatMap",                  .value = BUILTIN(builtin_ty_lazy_flat_map)       },
+  { .module = "ty/lazy",    .name = "next",                     .value = BUILTIN(builtin_ty_lazy_next)           },
+  { .module = "ty/lazy",    .name = "sum",                      .value = BUILTIN(builtin_ty_lazy_sum)            },
+  { .module = "ty/lazy",    .name = "collect",                  .value = BUILTIN(builtin_ty_lazy_collect)        },
+  { .module = "ty/lazy",    .name = "each",                     .value = BUILTIN(builtin_ty_lazy_each)           },
+  { .module = "ty/lazy",    .name = "count",                    .value = BUILTIN(builtin_ty_lazy_count)          },
+  { .module = "ty/lazy",    .name = "fold",                     .value = BUILTIN(builtin_ty_lazy_fold)           },
+
   { .module = "ty/mod",     .name = "get",                       .value = BUILTIN(builtin_ty_mod_get)            },
   { .module = "ty/mod",     .name = "load",                      .value = BUILTIN(builtin_ty_mod_load)           },
   { .module = "ty/mod",     .name = "list",                      .value = BUILTIN(builtin_ty_mod_list)           },
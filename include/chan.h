@@ -4,17 +4,32 @@
 #include "ty.h"
 #include "value.h"
 
+Channel *
+chan_new(Ty *ty, usize bound);
+
 void
 chan_send(Ty *ty, Channel *chan, Value v);
 
+bool
+chan_try_send(Ty *ty, Channel *chan, Value v, u64 timeout);
+
 bool
 chan_recv(Ty *ty, Channel *chan, Value *v);
 
 bool
 chan_try_recv(Ty *ty, Channel *chan, Value *v, i64 timeout);
 
+void
+chan_close(Ty *ty, Channel *chan);
+
 void
 chan_destroy(Ty *ty, Channel *chan);
 
+void
+chan_mark(Ty *ty);
+
+bool
+chan_group_exit(ThreadGroup *group);
+
 #endif
 /* vim: set sw=8 sts=8 expandtab: */
@@ -142,6 +142,7 @@ typedef struct loop_state {
 } LoopState;
 
 typedef struct {
+        u8 kind;
         bool inclusive;
         bool reverse;
 
@@ -446,7 +447,7 @@ void *
 source_lookup(Ty *ty, u32 src);
 
 void
-ForgetSourceNodesFrom(void const *base, usize len);
+ForgetSourceNodesFrom(void const *base);
 
 void
 try_symbolize_application(Ty *ty, Scope *scope, Expr *e);
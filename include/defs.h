@@ -131,6 +131,7 @@ typedef vec(Module *)       ModuleVector;
 #define zPxx(...)   vm_panic_ex(ty, __VA_ARGS__)
 
 #define CanceledError(...) vm_xerror(ty, CLASS_CANCELED_ERROR, __VA_ARGS__)
+#define MemoryError(...)   vm_xerror(ty, CLASS_MEMORY_ERROR, __VA_ARGS__)
 
 #define mRE(...)   resize(__VA_ARGS__)
 #define mREu(...)  resize_unchecked(__VA_ARGS__)
@@ -216,7 +217,8 @@ typedef vec(Module *)       ModuleVector;
 #define vfor(...) VA_SELECT(vfor, __VA_ARGS__)
 
 #define dfor_4(_k, _v, _d, go) \
-        for (DictItem *_d_item = DictFirst((_d)); _d_item != NULL; _d_item = _d_item->next) { \
+        for (DictItem *_d_item = (_d)->items, *_d_end = DictEnd((_d)); _d_item != _d_end; ++_d_item) { \
+                if (DictItemDead(_d_item)) continue; \
                 Value *(_k) = &_d_item->k; (void)(_k);\
                 Value *(_v) = &_d_item->v; (void)(_v); \
                 go; \
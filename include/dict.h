@@ -19,6 +19,12 @@ dict_xnew(Ty *ty)
 Value *
 dict_get_value(Ty *ty, Dict *obj, Value *key);
 
+usize
+dict_mark_ephemerons(Ty *ty, Dict *d);
+
+void
+dict_sweep_weak(Ty *ty, Dict *d);
+
 void
 dict_put_value(Ty *ty, Dict *obj, Value key, Value value);
 
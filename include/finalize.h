@@ -0,0 +1,34 @@
+#ifndef FINALIZE_H_INCLUDED
+#define FINALIZE_H_INCLUDED
+
+#include "ty.h"
+
+/*
+ * Finalization
+ *
+ * Instances of classes with a __free__ method and ffi.auto() pointers are
+ * registered with their thread group when they're created. Once every thread
+ * has finished marking, finalize_process() takes the ones that weren't reached
+ * off the registry and queues them, marking them (and so everything they refer
+ * to) to keep them alive through the sweep, and reports whether it queued
+ * anything. finalize_drain() runs the queued
+ * finalizers after the collection, when the world is running again. From then
+ * on the object is ordinary garbage, freed by whichever later collection finds
+ * it unreachable, and its finalizer never runs a second time.
+ */
+
+void
+finalize_register(Ty *ty, void *p);
+
+void
+finalize_mark(Ty *ty);
+
+bool
+finalize_process(Ty *ty);
+
+void
+finalize_drain(Ty *ty);
+
+#endif
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -199,6 +199,7 @@ BUILTIN_FUNCTION(thread_id);
 BUILTIN_FUNCTION(thread_group);
 BUILTIN_FUNCTION(thread_setname);
 BUILTIN_FUNCTION(thread_send);
+BUILTIN_FUNCTION(thread_try_send);
 BUILTIN_FUNCTION(thread_recv);
 BUILTIN_FUNCTION(thread_channel);
 BUILTIN_FUNCTION(thread_close);
@@ -348,6 +349,39 @@ BUILTIN_FUNCTION(ty_strip_source);
 BUILTIN_FUNCTION(ty_get_source);
 BUILTIN_FUNCTION(ty_gensym);
 BUILTIN_FUNCTION(ty_gc);
+BUILTIN_FUNCTION(ty_gc_snapshot);
+BUILTIN_FUNCTION(ty_gc_weak);
+BUILTIN_FUNCTION(ty_gc_deref);
+BUILTIN_FUNCTION(ty_gc_weak_dict);
+BUILTIN_FUNCTION(ty_gc_mode);
+BUILTIN_FUNCTION(ty_gc_freeze);
+BUILTIN_FUNCTION(ty_gc_limit);
+BUILTIN_FUNCTION(ty_persist_map);
+BUILTIN_FUNCTION(ty_persist_vector);
+BUILTIN_FUNCTION(ty_persist_get);
+BUILTIN_FUNCTION(ty_persist_put);
+BUILTIN_FUNCTION(ty_persist_remove);
+BUILTIN_FUNCTION(ty_persist_push);
+BUILTIN_FUNCTION(ty_persist_pop);
+BUILTIN_FUNCTION(ty_persist_slice);
+BUILTIN_FUNCTION(ty_persist_concat);
+BUILTIN_FUNCTION(ty_persist_len);
+BUILTIN_FUNCTION(ty_persist_items);
+BUILTIN_FUNCTION(ty_lazy_new);
+BUILTIN_FUNCTION(ty_lazy_map);
+BUILTIN_FUNCTION(ty_lazy_filter);
+BUILTIN_FUNCTION(ty_lazy_take);
+BUILTIN_FUNCTION(ty_lazy_drop);
+BUILTIN_FUNCTION(ty_lazy_zip);
+BUILTIN_FUNCTION(ty_lazy_enumerate);
+BUILTIN_FUNCTION(ty_lazy_chunk);
+BUILTIN_FUNCTION(ty_lazy_flat_map);
+BUILTIN_FUNCTION(ty_lazy_next);
+BUILTIN_FUNCTION(ty_lazy_sum);
+BUILTIN_FUNCTION(ty_lazy_collect);
+BUILTIN_FUNCTION(ty_lazy_each);
+BUILTIN_FUNCTION(ty_lazy_count);
+BUILTIN_FUNCTION(ty_lazy_fold);
 BUILTIN_FUNCTION(ty_bt);
 BUILTIN_FUNCTION(ty_trace);
 BUILTIN_FUNCTION(ty_stack_ctx);
@@ -457,5 +491,6 @@ BUILTIN_FUNCTION(accel_mha_forward_one);
 BUILTIN_FUNCTION(accel_kv_cache_alloc);
 
 u64 NextThreadId();
+int TyCPUCount(void);
 
 #endif
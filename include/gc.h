@@ -16,6 +16,21 @@
 void
 DoGC(Ty *ty);
 
+enum {
+        GC_MODE_STOP,
+        GC_MODE_INCREMENTAL
+};
+
+extern int GCMode;
+extern u64 GCSliceBudget;
+extern isize GCHeapLimit;
+
+bool
+GCIncrementalStep(Ty *ty);
+
+void
+GCAbandonCycle(Ty *ty);
+
 u64
 TyThreadId(Ty *ty);
 
@@ -36,6 +51,8 @@ HoldingLock(Ty *ty);
 #endif
 
 
+#define GC_HEAP_SLACK (1ULL << 20)
+
 #if defined(TY_GC_STATS)
 #define AddToTotalBytes(n) TotalBytesAllocated += (n)
 #else
@@ -72,6 +89,13 @@ enum {
         GC_NOTE,
         GC_COUNTER,
         GC_CHANNEL,
+        GC_WEAK,
+        GC_WEAK_DICT,
+        GC_PERSIST_NODE,
+        GC_PERSIST_MAP,
+        GC_PERSIST_VEC,
+        GC_TUPLE_LAYOUT,
+        GC_LAZY,
         GC_ANY
 };
 
@@ -81,6 +105,71 @@ gc(Ty *ty);
 inline static void *
 mrealloc(void *p, usize n);
 
+/*
+ * Blocks of at least GC_LARGE_OBJECT bytes get a mapping of their own instead
+ * of coming from the malloc heap, so that sweeping one hands its pages straight
+ * back to the OS rather than leaving a hole the allocator may never return. A
+ * large block is recognised by its size alone, which is why the size of one
+ * saturates instead of wrapping.
+ */
+#if defined(_WIN32)
+ #define GC_LARGE_OBJECT UINT64_MAX
+#else
+ #define GC_LARGE_OBJECT (1ULL << 18)
+#endif
+
+#define GC_BLOCK_SIZE(n) ((u32)((n) > UINT32_MAX ? UINT32_MAX : (n)))
+#define GC_IS_LARGE(a)   ((a)->size >= GC_LARGE_OBJECT)
+
+struct alloc *
+gc_large_alloc(usize n);
+
+struct alloc *
+gc_large_resize(struct alloc *a, usize n);
+
+void
+gc_large_free(struct alloc *a);
+
+inline static struct alloc *
+gc_block_alloc(usize n)
+{
+        if (LIKELY(n < GC_LARGE_OBJECT)) {
+                return ty_malloc(sizeof (struct alloc) + n);
+        } else {
+                return gc_large_alloc(n);
+        }
+}
+
+inline static struct alloc *
+gc_block_alloc0(usize n)
+{
+        if (LIKELY(n < GC_LARGE_OBJECT)) {
+                return ty_calloc(1, sizeof (struct alloc) + n);
+        } else {
+                return gc_large_alloc(n);
+        }
+}
+
+inline static struct alloc *
+gc_block_resize(struct alloc *a, usize n)
+{
+        if (LIKELY(n < GC_LARGE_OBJECT && (a == NULL || !GC_IS_LARGE(a)))) {
+                return ty_realloc(a, sizeof *a + n);
+        } else {
+                return gc_large_resize(a, n);
+        }
+}
+
+inline static void
+gc_block_free(struct alloc *a)
+{
+        if (LIKELY(!GC_IS_LARGE(a))) {
+                ty_free(a);
+        } else {
+                gc_large_free(a);
+        }
+}
+
 inline static void *
 gc_resize_unchecked(Ty *ty, void *p, usize n) {
         struct alloc *a;
@@ -95,12 +184,12 @@ gc_resize_unchecked(Ty *ty, void *p, usize n) {
         MemoryUsed += n;
         AddToTotalBytes(n);
 
-        a = ty_realloc(a, sizeof *a + n);
+        a = gc_block_resize(a, n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
 
         return a->data;
 }
@@ -114,6 +203,9 @@ CheckUsed(Ty *ty)
         if ((ty->GC_OFF_COUNT == 0) && (MemoryUsed >= MemoryLimit || GC_EVERY_ALLOC)) {
 #endif
                 GCLOG("Running GC. Used = %zu MB, Limit = %zu MB", MemoryUsed / 1000000, MemoryLimit / 1000000);
+                if (UNLIKELY(GCMode == GC_MODE_INCREMENTAL) && GCIncrementalStep(ty)) {
+                        return;
+                }
                 DoGC(ty);
                 GCLOG("DoGC() returned: %zu MB still in use", MemoryUsed / 1000000);
                 while (MemoryUsed >= MemoryLimit) {
@@ -123,19 +215,37 @@ CheckUsed(Ty *ty)
         }
 }
 
+void
+GCHeapLimitExceeded(Ty *ty, usize n);
+
+/*
+ * n bytes have just been added to MemoryUsed. If that takes this thread past
+ * its share of the heap limit, GCHeapLimitExceeded() runs a full collection
+ * and throws MemoryError if the group is still over the limit. Nothing has
+ * been allocated yet, so the caller is left as it was.
+ */
+inline static void
+CheckHeap(Ty *ty, usize n)
+{
+        if (UNLIKELY(MemoryUsed > ty->heap_budget) && ty->GC_OFF_COUNT == 0) {
+                GCHeapLimitExceeded(ty, n);
+        }
+}
+
 inline static void *
 gc_alloc(Ty *ty, usize n)
 {
         MemoryUsed += n;
         AddToTotalBytes(n);
+        CheckHeap(ty, n);
         CheckUsed(ty);
 
-        struct alloc *a = ty_malloc(sizeof *a + n);
+        struct alloc *a = gc_block_alloc(n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
         a->type = GC_ANY;
         atomic_init(&a->mark, false);
         atomic_init(&a->hard, 0);
@@ -148,14 +258,15 @@ gc_alloc0(Ty *ty, usize n)
 {
         MemoryUsed += n;
         AddToTotalBytes(n);
+        CheckHeap(ty, n);
         CheckUsed(ty);
 
-        struct alloc *a = ty_calloc(1, sizeof *a + n);
+        struct alloc *a = gc_block_alloc0(n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
         a->type = GC_ANY;
 
         return a->data;
@@ -167,12 +278,12 @@ gc_alloc_unchecked(Ty *ty, usize n)
         MemoryUsed += n;
         AddToTotalBytes(n);
 
-        struct alloc *a = ty_malloc(sizeof *a + n);
+        struct alloc *a = gc_block_alloc(n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
         a->type = GC_ANY;
         atomic_init(&a->mark, false);
         atomic_init(&a->hard, 0);
@@ -186,12 +297,12 @@ gc_alloc0_unchecked(Ty *ty, usize n)
         MemoryUsed += n;
         AddToTotalBytes(n);
 
-        struct alloc *a = ty_calloc(1, sizeof *a + n);
+        struct alloc *a = gc_block_alloc0(n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
         a->type = GC_ANY;
 
         return a->data;
@@ -206,17 +317,18 @@ gc_alloc_object(Ty *ty, usize n, char type)
 
         MemoryUsed += n;
         AddToTotalBytes(n);
+        CheckHeap(ty, n);
         CheckUsed(ty);
 
-        struct alloc *a = ty_malloc(sizeof *a + n);
+        struct alloc *a = gc_block_alloc(n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
-        atomic_init(&a->mark, false);
+        atomic_init(&a->mark, ty->group->GCBlack);
         atomic_init(&a->hard, 0);
         a->type = type;
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
 
         AddAlloc(ty, a);
 
@@ -233,15 +345,15 @@ gc_alloc_object_unchecked(Ty *ty, usize n, char type)
         MemoryUsed += n;
         AddToTotalBytes(n);
 
-        struct alloc *a = ty_malloc(sizeof *a + n);
+        struct alloc *a = gc_block_alloc(n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
-        atomic_init(&a->mark, false);
+        atomic_init(&a->mark, ty->group->GCBlack);
         atomic_init(&a->hard, 0);
         a->type = type;
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
 
         AddAlloc(ty, a);
 
@@ -257,15 +369,17 @@ gc_alloc_object0(Ty *ty, usize n, char type)
 
         MemoryUsed += n;
         AddToTotalBytes(n);
+        CheckHeap(ty, n);
         CheckUsed(ty);
 
-        struct alloc *a = ty_calloc(1, sizeof *a + n);
+        struct alloc *a = gc_block_alloc0(n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
+        atomic_init(&a->mark, ty->group->GCBlack);
         a->type = type;
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
 
         AddAlloc(ty, a);
 
@@ -282,13 +396,14 @@ gc_alloc_object0_unchecked(Ty *ty, usize n, char type)
         MemoryUsed += n;
         AddToTotalBytes(n);
 
-        struct alloc *a = ty_calloc(1, sizeof *a + n);
+        struct alloc *a = gc_block_alloc0(n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
+        atomic_init(&a->mark, ty->group->GCBlack);
         a->type = type;
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
 
         AddAlloc(ty, a);
 
@@ -323,16 +438,18 @@ gc_free(Ty *ty, void *p)
                 } else {
                         MemoryUsed -= a->size;
                 }
-                ty_free(a);
+                gc_block_free(a);
         }
 }
 
 inline static void *
 gc_resize(Ty *ty, void *p, usize n) {
         struct alloc *a;
+        usize old;
 
         if (p != NULL) {
                 a = ALLOC_OF(p);
+                old = a->size;
                 if (a->size >= MemoryUsed) {
                         MemoryUsed = 0;
                 } else {
@@ -340,19 +457,24 @@ gc_resize(Ty *ty, void *p, usize n) {
                 }
         } else {
                 a = NULL;
+                old = 0;
         }
 
         MemoryUsed += n;
         AddToTotalBytes(n);
 
+        if (n > old) {
+                CheckHeap(ty, n - old);
+        }
+
         CheckUsed(ty);
 
-        a = ty_realloc(a, sizeof *a + n);
+        a = gc_block_resize(a, n);
         if (UNLIKELY(a == NULL)) {
                 panic("Out of memory!");
         }
 
-        a->size = n;
+        a->size = GC_BLOCK_SIZE(n);
 
         return a->data;
 }
@@ -374,9 +496,63 @@ GCSweepTy(Ty *ty);
 void
 GCSweep(Ty *ty, AllocList *allocs, isize *used);
 
+void
+GCFreezeAllocs(Ty *ty, AllocList *allocs, isize *used);
+
+void
+GCMarkFrozen(Ty *ty);
+
+usize
+GCFreeze(Ty *ty);
+
 void
 GCForget(Ty *ty, AllocList *allocs, isize *used);
 
+void
+GCClearMarks(AllocList *allocs);
+
+void
+GCBeginSweep(Ty *ty);
+
+bool
+GCSweepSlice(Ty *ty, u64 budget);
+
+void
+GCShade(Ty *ty, void const *p);
+
+void
+GCShadeValue(Ty *ty, Value const *v);
+
+/*
+ * Write barrier for incremental mode. While a cycle is marking, anything that
+ * overwrites, removes or reorders what the block at p refers to has to call
+ * this first. The first such write to a block the marker hasn't reached yet
+ * marks it and queues everything it refers to, so the marker still finds
+ * every value that was reachable when the cycle started (see vm.c).
+ *
+ * Blocks allocated during the cycle are born marked, so filling in a new
+ * object never gets past the first test.
+ */
+inline static void
+GCWrite(Ty *ty, void const *p)
+{
+        if (UNLIKELY(ty->group->GCBlack) && !MARKED(p)) {
+                GCShade(ty, p);
+        }
+}
+
+/*
+ * The same for a slot that isn't part of a block (e.g. a static field): the
+ * value about to be overwritten is queued instead.
+ */
+inline static void
+GCWriteValue(Ty *ty, Value const *old)
+{
+        if (UNLIKELY(ty->group->GCBlack)) {
+                GCShadeValue(ty, old);
+        }
+}
+
 void
 GCForgetObject(Ty *ty, void const *o);
 
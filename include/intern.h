@@ -6,10 +6,21 @@
 
 #include "ty.h"
 
+/*
+ * Intern sets are shared by every thread. Lookups never take a lock: entries
+ * are published into the hash table with a release store, and once published
+ * an entry never moves or changes (apart from its data, which belongs to
+ * whoever put it there). Adding a name takes the set's lock.
+ *
+ * Entry i lives in segment s = floor(log2(i / 64 + 1)), which holds 64 << s
+ * entries, so segments never have to be moved to make room.
+ */
+
 inline static void
 intern_init(InternSet *set)
 {
         memset(set, 0, sizeof *set);
+        TySpinLockInit(&set->lock);
 }
 
 InternEntry *
@@ -18,6 +29,9 @@ intern_get(InternSet *set, char const *s);
 InternEntry *
 intern_put(InternEntry *e, void *data);
 
+InternEntry *
+intern_put_as(InternEntry *e, char const *name, void *data);
+
 inline static InternEntry *
 intern(InternSet *set, char const *s)
 {
@@ -28,9 +42,9 @@ intern(InternSet *set, char const *s)
 inline static InternEntry *
 intern_entry(InternSet *set, i64 id)
 {
-        u32 key = set->index.items[id];
-        InternBucket *b = &set->set[key & 0xFF];
-        return &b->items[key >> 8u];
+        u64 k = (u64)id + (1u << INTERN_SEGMENT0_BITS);
+        int s = 63 - __builtin_clzll(k) - INTERN_SEGMENT0_BITS;
+        return &set->entries[s][k - ((u64)1 << (s + INTERN_SEGMENT0_BITS))];
 }
 
 #endif
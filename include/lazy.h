@@ -0,0 +1,106 @@
+#ifndef LAZY_H_INCLUDED
+#define LAZY_H_INCLUDED
+
+#include "ty.h"
+#include "gc.h"
+
+/*
+ * Lazy iterator pipelines
+ *
+ * A pipeline is a chain of GC_LAZY blocks. The first one pulls from a source
+ * (an array, a tuple, a string, a counted range, a generator or anything
+ * with __next__/__iter__) and every stage after it pulls from the one before
+ * it (`up`). Nothing runs until a terminal operation (sum, collect, each,
+ * count, fold) or a call to lazy_next() asks for a value, and then each
+ * element goes through the whole chain before the next one is read, so
+ * xs.lazy().map(f).filter(g).take(10) never builds the intermediate arrays
+ * that xs.map(f).filter(g) would.
+ *
+ * Stages are stateful: pulling from a stage advances everything upstream of
+ * it, the same as with any other iterator.
+ *
+ * Pipelines are handed to the language as GCPTR values and wrapped by the
+ * Lazy[T] class in the prelude.
+ */
+
+enum {
+        LAZY_ARRAY,
+        LAZY_TUPLE,
+        LAZY_BLOB,
+        LAZY_STRING,
+        LAZY_COUNT,
+        LAZY_CALL,
+        LAZY_NEXT,
+
+        LAZY_MAP,
+        LAZY_FILTER,
+        LAZY_TAKE,
+        LAZY_DROP,
+        LAZY_ZIP,
+        LAZY_ENUMERATE,
+        LAZY_CHUNK,
+        LAZY_FLAT_MAP
+};
+
+typedef struct lazy_iter LazyIter;
+
+struct lazy_iter {
+        u8 kind;
+        bool done;
+
+        /*
+         * src: the value a source reads from, or the upstream stage
+         * f:   the function a stage applies (for LAZY_NEXT, the __next__
+         *      method; for LAZY_ZIP, an Array of the other stages)
+         * cur: the inner stage LAZY_FLAT_MAP is currently draining
+         */
+        Value src;
+        Value f;
+        Value cur;
+
+        imax i;
+        imax n;
+};
+
+#define LAZY(p) GCPTR((p), (p))
+
+LazyIter *
+lazy_new(Ty *ty, Value const *xs);
+
+LazyIter *
+lazy_stage(Ty *ty, int kind, LazyIter *up, Value const *f, imax n);
+
+bool
+lazy_next(Ty *ty, LazyIter *it, Value *out);
+
+Value
+lazy_sum(Ty *ty, LazyIter *it, Value const *zero);
+
+Value
+lazy_collect(Ty *ty, LazyIter *it);
+
+Value
+lazy_fold(Ty *ty, LazyIter *it, Value const *x, Value const *f);
+
+imax
+lazy_count(Ty *ty, LazyIter *it);
+
+void
+lazy_each(Ty *ty, LazyIter *it, Value const *f);
+
+void
+lazy_mark(Ty *ty, LazyIter *it);
+
+inline static LazyIter *
+lazy_of(Value const *v)
+{
+        return (
+                (v->type == VALUE_PTR)
+             && (v->gcptr != NULL)
+             && (ALLOC_OF(v->gcptr)->type == GC_LAZY)
+        ) ? v->gcptr : NULL;
+}
+
+#endif
+
+/* vim: set sts=8 sw=8 expandtab: */
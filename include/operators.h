@@ -12,6 +12,32 @@
 #include "xd.h"
 #include "vm.h"
 
+enum { OP_SITE_WAYS = 4 };
+
+/*
+ * Inline cache for one binary operator instruction, keyed by the classes of
+ * its operands. An entry is never modified once it's been published, so a
+ * hit is a couple of loads with no locking. A miss goes through
+ * op_dispatch() and publishes a new entry with the extra way added; the old
+ * one is left alone since another thread may still be reading it. Entries
+ * from before the most recent op_add() or op_reset() are ignored.
+ */
+typedef struct op_site_entry {
+        u32 epoch;
+        i32 n;
+        struct {
+                i32 t1;
+                i32 t2;
+                i32 ref;
+        } ways[OP_SITE_WAYS];
+} OpSiteEntry;
+
+typedef struct op_site {
+        _Atomic(OpSiteEntry const *) entry;
+} OpSite;
+
+extern _Atomic(u32) OpEpoch;
+
 #define     look(i) (&STACK.items[STACK.count - 1] + i)
 #define COMPLETE(x) do { Value x__ = x; STACK.items[--STACK.count - 1] = x__; return true; } while (0)
 
@@ -506,6 +532,28 @@ op_add(int op, int t1, int t2, int ref, Expr *fun);
 int
 op_dispatch(Ty *ty, int op, int t1, int t2);
 
+i32
+op_site_miss(Ty *ty, OpSite *site, i32 op, i32 t1, i32 t2);
+
+inline static i32
+op_dispatch_at(Ty *ty, OpSite *site, i32 op, i32 t1, i32 t2)
+{
+        OpSiteEntry const *e = atomic_load_explicit(&site->entry, memory_order_acquire);
+
+        if (
+                (e != NULL)
+             && (e->epoch == atomic_load_explicit(&OpEpoch, memory_order_relaxed))
+        ) {
+                for (i32 i = 0; i < e->n; ++i) {
+                        if (e->ways[i].t1 == t1 && e->ways[i].t2 == t2) {
+                                return e->ways[i].ref;
+                        }
+                }
+        }
+
+        return op_site_miss(ty, site, op, t1, t2);
+}
+
 Expr *
 op_fun_info(int op, int t1, int t2);
 
@@ -0,0 +1,364 @@
+/*
+ * Pattern-defeating quicksort (Orson Peters), instantiated per element type.
+ *
+ * This header has no include guard: it's meant to be included once for every
+ * element type that needs a sort, with these defined beforehand:
+ *
+ *      PDQ_NAME          name of the generated sort function
+ *      PDQ_T             element type
+ *      PDQ_LESS(a, b)    strict weak ordering on two PDQ_T lvalues; `ctx`
+ *                        (the void * passed to PDQ_NAME) is in scope
+ *
+ * and it generates
+ *
+ *      static void PDQ_NAME(PDQ_T *xs, usize n, void *ctx);
+ *
+ * The macros are undefined again at the end. The sort is not stable.
+ */
+
+#define PDQ_CAT_(a, b) a##_##b
+#define PDQ_CAT(a, b) PDQ_CAT_(a, b)
+#define PDQ_FN(f) PDQ_CAT(PDQ_NAME, f)
+
+#define PDQ_INSERTION_THRESHOLD     24
+#define PDQ_NINTHER_THRESHOLD       128
+#define PDQ_PARTIAL_INSERTION_LIMIT 8
+
+inline static void
+PDQ_FN(swap)(PDQ_T *a, PDQ_T *b)
+{
+        PDQ_T t = *a;
+        *a = *b;
+        *b = t;
+}
+
+inline static void
+PDQ_FN(sort2)(PDQ_T *a, PDQ_T *b, void *ctx)
+{
+        if (PDQ_LESS(*b, *a)) {
+                PDQ_FN(swap)(a, b);
+        }
+}
+
+inline static void
+PDQ_FN(sort3)(PDQ_T *a, PDQ_T *b, PDQ_T *c, void *ctx)
+{
+        PDQ_FN(sort2)(a, b, ctx);
+        PDQ_FN(sort2)(b, c, ctx);
+        PDQ_FN(sort2)(a, b, ctx);
+}
+
+static void
+PDQ_FN(insertion)(PDQ_T *begin, PDQ_T *end, void *ctx)
+{
+        if (begin == end) {
+                return;
+        }
+
+        for (PDQ_T *cur = begin + 1; cur != end; ++cur) {
+                PDQ_T *sift = cur;
+                PDQ_T *sift_1 = cur - 1;
+
+                if (PDQ_LESS(*sift, *sift_1)) {
+                        PDQ_T t = *sift;
+                        do {
+                                *sift-- = *sift_1;
+                        } while (sift != begin && PDQ_LESS(t, *--sift_1));
+                        *sift = t;
+                }
+        }
+}
+
+/*
+ * Like insertion() but assumes there's an element before begin that's no
+ * greater than anything in [begin, end), so the inner loop needs no bounds
+ * check.
+ */
+static void
+PDQ_FN(unguarded_insertion)(PDQ_T *begin, PDQ_T *end, void *ctx)
+{
+        if (begin == end) {
+                return;
+        }
+
+        for (PDQ_T *cur = begin + 1; cur != end; ++cur) {
+                PDQ_T *sift = cur;
+                PDQ_T *sift_1 = cur - 1;
+
+                if (PDQ_LESS(*sift, *sift_1)) {
+                        PDQ_T t = *sift;
+                        do {
+                                *sift-- = *sift_1;
+                        } while (PDQ_LESS(t, *--sift_1));
+                        *sift = t;
+                }
+        }
+}
+
+/*
+ * Insertion sort that gives up after moving PDQ_PARTIAL_INSERTION_LIMIT
+ * elements. Returns whether the range ended up sorted.
+ */
+static bool
+PDQ_FN(partial_insertion)(PDQ_T *begin, PDQ_T *end, void *ctx)
+{
+        if (begin == end) {
+                return true;
+        }
+
+        usize limit = 0;
+
+        for (PDQ_T *cur = begin + 1; cur != end; ++cur) {
+                PDQ_T *sift = cur;
+                PDQ_T *sift_1 = cur - 1;
+
+                if (PDQ_LESS(*sift, *sift_1)) {
+                        PDQ_T t = *sift;
+                        do {
+                                *sift-- = *sift_1;
+                        } while (sift != begin && PDQ_LESS(t, *--sift_1));
+                        *sift = t;
+                        limit += cur - sift;
+                }
+
+                if (limit > PDQ_PARTIAL_INSERTION_LIMIT) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+static void
+PDQ_FN(sift_down)(PDQ_T *xs, usize i, usize n, void *ctx)
+{
+        for (;;) {
+                usize child = 2 * i + 1;
+
+                if (child >= n) {
+                        break;
+                }
+
+                if (child + 1 < n && PDQ_LESS(xs[child], xs[child + 1])) {
+                        child += 1;
+                }
+
+                if (!PDQ_LESS(xs[i], xs[child])) {
+                        break;
+                }
+
+                PDQ_FN(swap)(&xs[i], &xs[child]);
+                i = child;
+        }
+}
+
+static void
+PDQ_FN(heapsort)(PDQ_T *begin, PDQ_T *end, void *ctx)
+{
+        usize n = end - begin;
+
+        for (usize i = n / 2; i-- > 0;) {
+                PDQ_FN(sift_down)(begin, i, n, ctx);
+        }
+
+        while (n > 1) {
+                PDQ_FN(swap)(&begin[0], &begin[--n]);
+                PDQ_FN(sift_down)(begin, 0, n, ctx);
+        }
+}
+
+/*
+ * Partitions [begin, end) around the pivot *begin. Elements equal to the
+ * pivot go to the right. Returns the pivot's final position and sets
+ * *already if no elements had to be moved.
+ */
+static PDQ_T *
+PDQ_FN(partition_right)(PDQ_T *begin, PDQ_T *end, bool *already, void *ctx)
+{
+        PDQ_T pivot = *begin;
+        PDQ_T *first = begin;
+        PDQ_T *last = end;
+
+        while (PDQ_LESS(*++first, pivot)) {
+                ;
+        }
+
+        if (first - 1 == begin) {
+                while (first < last && !PDQ_LESS(*--last, pivot)) {
+                        ;
+                }
+        } else {
+                while (!PDQ_LESS(*--last, pivot)) {
+                        ;
+                }
+        }
+
+        *already = (first >= last);
+
+        while (first < last) {
+                PDQ_FN(swap)(first, last);
+                while (PDQ_LESS(*++first, pivot)) {
+                        ;
+                }
+                while (!PDQ_LESS(*--last, pivot)) {
+                        ;
+                }
+        }
+
+        PDQ_T *pivot_pos = first - 1;
+        *begin = *pivot_pos;
+        *pivot_pos = pivot;
+
+        return pivot_pos;
+}
+
+/*
+ * Partitions [begin, end) around the pivot *begin with elements equal to the
+ * pivot on the left. Used when the pivot equals the element before begin, so
+ * everything equal to it can be skipped over in one step.
+ */
+static PDQ_T *
+PDQ_FN(partition_left)(PDQ_T *begin, PDQ_T *end, void *ctx)
+{
+        PDQ_T pivot = *begin;
+        PDQ_T *first = begin;
+        PDQ_T *last = end;
+
+        while (PDQ_LESS(pivot, *--last)) {
+                ;
+        }
+
+        if (last + 1 == end) {
+                while (first < last && !PDQ_LESS(pivot, *++first)) {
+                        ;
+                }
+        } else {
+                while (!PDQ_LESS(pivot, *++first)) {
+                        ;
+                }
+        }
+
+        while (first < last) {
+                PDQ_FN(swap)(first, last);
+                while (PDQ_LESS(pivot, *--last)) {
+                        ;
+                }
+                while (!PDQ_LESS(pivot, *++first)) {
+                        ;
+                }
+        }
+
+        PDQ_T *pivot_pos = last;
+        *begin = *pivot_pos;
+        *pivot_pos = pivot;
+
+        return pivot_pos;
+}
+
+static void
+PDQ_FN(loop)(PDQ_T *begin, PDQ_T *end, int bad_allowed, bool leftmost, void *ctx)
+{
+        for (;;) {
+                usize size = end - begin;
+
+                if (size < PDQ_INSERTION_THRESHOLD) {
+                        if (leftmost) {
+                                PDQ_FN(insertion)(begin, end, ctx);
+                        } else {
+                                PDQ_FN(unguarded_insertion)(begin, end, ctx);
+                        }
+                        return;
+                }
+
+                usize s2 = size / 2;
+
+                if (size > PDQ_NINTHER_THRESHOLD) {
+                        PDQ_FN(sort3)(begin, begin + s2, end - 1, ctx);
+                        PDQ_FN(sort3)(begin + 1, begin + (s2 - 1), end - 2, ctx);
+                        PDQ_FN(sort3)(begin + 2, begin + (s2 + 1), end - 3, ctx);
+                        PDQ_FN(sort3)(begin + (s2 - 1), begin + s2, begin + (s2 + 1), ctx);
+                        PDQ_FN(swap)(begin, begin + s2);
+                } else {
+                        PDQ_FN(sort3)(begin + s2, begin, end - 1, ctx);
+                }
+
+                // Lots of elements equal to the pivot: put them all in place
+                if (!leftmost && !PDQ_LESS(*(begin - 1), *begin)) {
+                        begin = PDQ_FN(partition_left)(begin, end, ctx) + 1;
+                        continue;
+                }
+
+                bool already;
+                PDQ_T *pivot_pos = PDQ_FN(partition_right)(begin, end, &already, ctx);
+
+                usize l_size = pivot_pos - begin;
+                usize r_size = end - (pivot_pos + 1);
+
+                if (l_size < size / 8 || r_size < size / 8) {
+                        if (--bad_allowed == 0) {
+                                PDQ_FN(heapsort)(begin, end, ctx);
+                                return;
+                        }
+
+                        // Break up whatever pattern led to the bad pivot
+                        if (l_size >= PDQ_INSERTION_THRESHOLD) {
+                                PDQ_FN(swap)(begin, begin + l_size / 4);
+                                PDQ_FN(swap)(pivot_pos - 1, pivot_pos - l_size / 4);
+                                if (l_size > PDQ_NINTHER_THRESHOLD) {
+                                        PDQ_FN(swap)(begin + 1, begin + (l_size / 4 + 1));
+                                        PDQ_FN(swap)(begin + 2, begin + (l_size / 4 + 2));
+                                        PDQ_FN(swap)(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+                                        PDQ_FN(swap)(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+                                }
+                        }
+
+                        if (r_size >= PDQ_INSERTION_THRESHOLD) {
+                                PDQ_FN(swap)(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+                                PDQ_FN(swap)(end - 1, end - r_size / 4);
+                                if (r_size > PDQ_NINTHER_THRESHOLD) {
+                                        PDQ_FN(swap)(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+                                        PDQ_FN(swap)(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+                                        PDQ_FN(swap)(end - 2, end - (1 + r_size / 4));
+                                        PDQ_FN(swap)(end - 3, end - (2 + r_size / 4));
+                                }
+                        }
+                } else if (
+                        already
+                     && PDQ_FN(partial_insertion)(begin, pivot_pos, ctx)
+                     && PDQ_FN(partial_insertion)(pivot_pos + 1, end, ctx)
+                ) {
+                        return;
+                }
+
+                PDQ_FN(loop)(begin, pivot_pos, bad_allowed, leftmost, ctx);
+                begin = pivot_pos + 1;
+                leftmost = false;
+        }
+}
+
+static void
+PDQ_NAME(PDQ_T *xs, usize n, void *ctx)
+{
+        if (n < 2) {
+                return;
+        }
+
+        int bad_allowed = 0;
+        for (usize k = n; k > 1; k >>= 1) {
+                bad_allowed += 1;
+        }
+
+        PDQ_FN(loop)(xs, xs + n, bad_allowed, true, ctx);
+}
+
+#undef PDQ_INSERTION_THRESHOLD
+#undef PDQ_NINTHER_THRESHOLD
+#undef PDQ_PARTIAL_INSERTION_LIMIT
+#undef PDQ_FN
+#undef PDQ_CAT
+#undef PDQ_CAT_
+#undef PDQ_NAME
+#undef PDQ_T
+#undef PDQ_LESS
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -0,0 +1,94 @@
+#ifndef PERSIST_H_INCLUDED
+#define PERSIST_H_INCLUDED
+
+#include "ty.h"
+
+/*
+ * Persistent collections
+ *
+ * A persistent map is a hash array mapped trie and a persistent vector is a
+ * 32-way trie with the last (up to) 32 elements kept in a separate tail. Both
+ * are immutable: every update copies the O(log₃₂ n) nodes on the path to the
+ * change and shares the rest with the original, so keeping a snapshot of one
+ * costs nothing.
+ *
+ * The vector trie is always dense (it isn't an RRB tree), so slicing off the
+ * front or concatenating onto a short vector means rebuilding it.
+ *
+ * Nodes are GC_PERSIST_NODE blocks holding n Values. Children are referred to
+ * by GCPTR values, so marking a node is just marking its slots. In a map node
+ * the slots are key/value pairs, one for each bit set in the bitmap; a pair
+ * whose key is ZERO holds a child node in place of its value. Below the last
+ * level of hash bits, nodes have an empty bitmap and hold the colliding pairs
+ * in no particular order.
+ *
+ * The collections themselves are GC_PERSIST_MAP and GC_PERSIST_VEC headers,
+ * handed to the language as GCPTR values and wrapped by lib/persist.ty.
+ */
+
+typedef struct persist_node {
+        u32 bitmap;
+        u32 n;
+        Value slots[];
+} PersistNode;
+
+typedef struct persist_map {
+        usize count;
+        Value root;
+} PersistMap;
+
+typedef struct persist_vec {
+        usize count;
+        u32 shift;
+        Value root;
+        Value tail;
+} PersistVec;
+
+PersistMap *
+persist_map_new(Ty *ty, Value const *kvs, usize n);
+
+Value const *
+persist_map_get(Ty *ty, PersistMap const *m, Value const *k);
+
+PersistMap *
+persist_map_put(Ty *ty, PersistMap const *m, Value const *k, Value const *v);
+
+PersistMap *
+persist_map_remove(Ty *ty, PersistMap const *m, Value const *k);
+
+Value
+persist_map_items(Ty *ty, PersistMap const *m);
+
+void
+persist_map_flatten(Ty *ty, PersistMap const *m, ValueVector *out);
+
+PersistVec *
+persist_vec_new(Ty *ty, Value const *xs, usize n);
+
+Value const *
+persist_vec_get(PersistVec const *v, usize i);
+
+PersistVec *
+persist_vec_put(Ty *ty, PersistVec const *v, usize i, Value const *x);
+
+PersistVec *
+persist_vec_push(Ty *ty, PersistVec const *v, Value const *x);
+
+PersistVec *
+persist_vec_pop(Ty *ty, PersistVec const *v);
+
+PersistVec *
+persist_vec_slice(Ty *ty, PersistVec const *v, usize i, usize j);
+
+PersistVec *
+persist_vec_concat(Ty *ty, PersistVec const *a, PersistVec const *b);
+
+Value
+persist_vec_items(Ty *ty, PersistVec const *v);
+
+void
+persist_mark(Ty *ty, void *p);
+
+#endif
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -0,0 +1,114 @@
+#ifndef SHAPE_H_INCLUDED
+#define SHAPE_H_INCLUDED
+
+#include "ty.h"
+
+/*
+ * Shapes (hidden classes) for dynamic object members
+ *
+ * Members that an object gets beyond its class's declared fields live in a
+ * struct dynamic: a shape describing which members the object has and where
+ * each one is stored, and a vector holding only the values.
+ *
+ * Shapes form a tree rooted at the empty shape. Adding a member to an object
+ * moves it along the edge for that member, creating the child shape the first
+ * time anything takes that edge, so objects that gain the same members in the
+ * same order end up sharing one shape. Shared shapes are never freed and never
+ * change once they've been created (apart from growing new edges), so a shape
+ * pointer is a stable key for caching member lookups.
+ *
+ * Objects used more like dicts, with many members or members whose names vary
+ * from object to object, would grow the tree without bound. Past a certain
+ * size (or fan-out) an object gets a private shape instead, which it owns and
+ * updates in place. The same goes for every object once the tree as a whole
+ * has SHAPE_MAX_TOTAL shapes in it: the edges that exist by then keep working,
+ * but nothing new gets shared.
+ */
+
+#define SHAPE_MAX_SHARED 64
+#define SHAPE_MAX_EDGES  32
+#define SHAPE_MAX_TOTAL  (1 << 14)
+
+typedef struct shape Shape;
+
+typedef struct {
+        i32 id;
+        Shape *shape;
+} ShapeEdge;
+
+struct shape {
+        bool shared;
+        u32 count;
+        i32 *ids;
+        u32 *slots;
+        vec(ShapeEdge) next;
+};
+
+struct dynamic {
+        Shape *shape;
+        ValueVector values;
+};
+
+void
+shape_init(void);
+
+Shape *
+shape_add(Shape *s, i32 id);
+
+Value *
+dynamic_get(Ty *ty, TyObject *o, i32 id);
+
+void
+dynamic_release(Ty *ty, struct dynamic *d);
+
+/*
+ * The index of `id` in s->ids, or -1 if it isn't there. The ids are sorted.
+ */
+inline static i32
+shape_find(Shape const *s, i32 id)
+{
+        i32 lo = 0;
+        i32 hi = (i32)s->count - 1;
+
+        while (lo <= hi) {
+                i32 m = lo + (hi - lo) / 2;
+                if      (id < s->ids[m]) { hi = m - 1; }
+                else if (id > s->ids[m]) { lo = m + 1; }
+                else                     { return m;   }
+        }
+
+        return -1;
+}
+
+inline static u32
+dynamic_count(struct dynamic const *d)
+{
+        return d->shape->count;
+}
+
+/*
+ * The i-th member of d in order of member id, to match the order that the
+ * old per-object tables iterated in.
+ */
+inline static i32
+dynamic_id(struct dynamic const *d, u32 i)
+{
+        return d->shape->ids[i];
+}
+
+inline static Value *
+dynamic_value(struct dynamic const *d, u32 i)
+{
+        return v_(d->values, d->shape->slots[i]);
+}
+
+inline static Value *
+dynamic_lookup(struct dynamic const *d, i32 id)
+{
+        i32 i = shape_find(d->shape, id);
+        return (i == -1) ? NULL : dynamic_value(d, i);
+}
+
+#endif
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -0,0 +1,71 @@
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+
+#include "ty.h"
+
+/*
+ * Heap snapshots
+ *
+ * A snapshot covers the requesting thread's group. It is taken by whichever
+ * thread of that group wins the GC lock, after every thread in the group has
+ * finished marking and before anything is swept, so the world is stopped and
+ * the graph it records is exactly the live heap.
+ *
+ * The file is line-oriented text so that it can be streamed both when it is
+ * written and when it is read back:
+ *
+ *   # ty heap snapshot 1
+ *   C <class> <name>              class name, emitted before its first use
+ *   R <root-kind> <node>          edge from a GC root to a node
+ *   N <node> <class> <size> ...   a node, its shallow size and its successors
+ *
+ * Node ids are dense and start at 1. Every node is written exactly once, and
+ * the only state kept while writing is an id table and an explicit work stack,
+ * so the writer's memory use is proportional to the number of objects and not
+ * to their size.
+ */
+
+typedef struct heap_snapshot HeapSnapshot;
+
+enum {
+        SNAP_ROOT_SET,
+        SNAP_ROOT_TLS,
+        SNAP_ROOT_STACK,
+        SNAP_ROOT_TRY,
+        SNAP_ROOT_THROW,
+        SNAP_ROOT_DROP,
+        SNAP_ROOT_FRAME,
+        SNAP_ROOT_GLOBAL,
+        SNAP_ROOT_IMMORTAL,
+        SNAP_ROOT_SIGNAL,
+        SNAP_ROOT_TARGET,
+        SNAP_ROOT_KIND_COUNT
+};
+
+HeapSnapshot *
+snapshot_open(Ty *ty, char const *path);
+
+bool
+snapshot_close(Ty *ty, HeapSnapshot *snap, u64 *nodes, u64 *edges, u64 *bytes);
+
+bool
+snapshot_request(Ty *ty, HeapSnapshot *snap);
+
+bool
+snapshot_done(HeapSnapshot const *snap);
+
+HeapSnapshot *
+snapshot_claim(Ty *ty);
+
+void
+snapshot_root(Ty *ty, HeapSnapshot *snap, int kind, Value const *v);
+
+void
+snapshot_root_block(Ty *ty, HeapSnapshot *snap, int kind, void const *p);
+
+void
+snapshot_finish(Ty *ty, HeapSnapshot *snap);
+
+#endif
+
+/* vim: set sts=8 sw=8 expandtab: */
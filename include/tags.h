@@ -2,11 +2,39 @@
 #define TAGS_H_INCLUDED
 
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #include "ty.h"
 
 typedef struct class Class;
 
+enum { TAGS_SEGMENT0_BITS = 6, TAGS_SEGMENTS = 16 };
+
+/*
+ * A tag stack is a node in a trie of tags, named by its index (which is what
+ * ends up in Value.tags). Each node records its top tag and the stack under
+ * it, so popping is just a load. Pushing goes through a table of
+ * (stack, tag) -> stack transitions which is read without taking any lock;
+ * only a push that has to create a new node serialises with other writers.
+ *
+ * Nodes are allocated in segments of 64 << s so that they never move once
+ * they've been handed out.
+ */
+typedef struct tag_node {
+        int n;
+        int tag;
+        int up;
+} TagNode;
+
+typedef struct tag_edges {
+        struct tag_edges *prev;
+        u32 mask;
+        _Atomic(TagNode *) slots[];
+} TagEdges;
+
+extern TagNode *TagNodes[TAGS_SEGMENTS];
+extern _Atomic(TagEdges *) TagEdgeTable;
+
 void
 tags_init(Ty *ty);
 
@@ -26,10 +54,47 @@ bool
 tags_same(Ty *ty, int t1, int t2);
 
 int
-tags_push(Ty *ty, int n, int tag);
-
-int
-tags_pop(Ty *ty, int n);
+tags_push_slow(Ty *ty, int tags, int tag);
+
+inline static TagNode *
+tags_node(int tags)
+{
+        u32 k = (u32)tags + (1u << TAGS_SEGMENT0_BITS);
+        int s = 31 - __builtin_clz(k) - TAGS_SEGMENT0_BITS;
+        return &TagNodes[s][k - (1u << (s + TAGS_SEGMENT0_BITS))];
+}
+
+inline static u32
+tags_edge_hash(int tags, int tag)
+{
+        u64 key = ((u64)(u32)tags << 32) | (u32)tag;
+        return (u32)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+inline static int
+tags_push(Ty *ty, int tags, int tag)
+{
+        TagEdges const *t = atomic_load_explicit(&TagEdgeTable, memory_order_acquire);
+
+        for (u32 i = tags_edge_hash(tags, tag) & t->mask;; i = (i + 1) & t->mask) {
+                TagNode const *node = atomic_load_explicit(
+                        &t->slots[i],
+                        memory_order_acquire
+                );
+                if (node == NULL) {
+                        return tags_push_slow(ty, tags, tag);
+                }
+                if (node->tag == tag && node->up == tags) {
+                        return node->n;
+                }
+        }
+}
+
+inline static int
+tags_pop(Ty *ty, int tags)
+{
+        return tags_node(tags)->up;
+}
 
 bool
 tags_try_pop(Ty *ty, u16 *tags, int tag);
@@ -53,7 +53,10 @@ typedef vec(Class *)        ClassVector;
 typedef vec(Symbol *)       symbol_vector;
 typedef vec(TySavePoint *)  TySavePointVector;
 
-enum { INTERN_TABLE_SIZE = 256 };
+enum {
+        INTERN_SEGMENT0_BITS = 6,
+        INTERN_SEGMENTS      = 32
+};
 
 typedef struct {
         i64 id;
@@ -62,11 +65,13 @@ typedef struct {
         void *data;
 } InternEntry;
 
-typedef vec(InternEntry) InternBucket;
+typedef struct intern_table InternTable;
 
 typedef struct {
-        InternBucket set[INTERN_TABLE_SIZE];
-        vec(u32) index;
+        _Atomic(InternTable *) table;
+        InternEntry *entries[INTERN_SEGMENTS];
+        u32 count;
+        TySpinLock lock;
 } InternSet;
 
 typedef struct location {
@@ -306,6 +311,7 @@ enum {
         TY_F_IN_EVAL        = (1 << 3),
         TY_F_IGNORING_TYPES = (1 << 4),
         TY_F_FOREIGN        = (1 << 5),
+        TY_F_WORKER         = (1 << 6),
 };
 
 #define TY_IS(x)    (ty->flags & TY_F_ ## x)
@@ -364,7 +370,7 @@ struct value {
                 struct {
                         u8 const *str;
                         u32 bytes;
-                        bool ro;
+                        u8 ro;
                         u8 *str0;
                 };
                 struct {
@@ -400,7 +406,7 @@ struct object {
         bool          init;
         u32           nslot;
         Class         *class;
-        struct itable *dynamic;
+        struct dynamic *dynamic;
         Value         slots[];
 };
 
@@ -481,9 +487,24 @@ enum {
         GC_PHASE_WAIT  = (1 << 1),
         GC_PHASE_MARK  = (1 << 2),
         GC_PHASE_SWEEP = (1 << 3),
-        GC_PHASE_DONE  = (1 << 4)
+        GC_PHASE_DONE  = (1 << 4),
+        GC_PHASE_PARK  = (1 << 5)
 };
 
+/*
+ * State of an incremental marking cycle (see GCIncrementalStep()). Values in
+ * gray have been reached but not traced yet. It's only touched while every
+ * other thread in the group is parked.
+ */
+typedef struct {
+        bool        active;
+        bool        defer;
+        ValueVector gray;
+} GCCycle;
+
+typedef struct worker_pool WorkerPool;
+typedef struct heap_snapshot HeapSnapshot;
+
 typedef struct thread_group {
         TySpinLock Lock;
 
@@ -497,14 +518,42 @@ typedef struct thread_group {
         AllocList  DeadAllocs;
         isize      DeadUsed;
 
+        isize      HeapUsed;
+
         TySpinLock GCLock;
 
+        GCCycle    Cycle;
+        bool       GCBlack;
+        bool       GCLazySweep;
+        atomic_int Sweeping;
+
+        bool       GCFreeze;
+        AllocList  Frozen;
+        isize      FrozenUsed;
+
+        TySpinLock  WeakLock;
+        vec(void *) Weak;
+        ValueVector WeakPending;
+
+        TySpinLock  FinalLock;
+        vec(void *) Final;
+        ValueVector FinalPending;
+
+        TySpinLock  SentLock;
+        ValueVector Sent;
+        bool        Exited;
+
         atomic_bool WantGC;
         atomic_int  GCReadyCount;
         TyMutex     GCPhaseLock;
         TyCondVar   GCPhaseCond;
         int         GCPhase;
 
+        _Atomic(HeapSnapshot *) Snapshot;
+
+        TyMutex     PoolLock;
+        WorkerPool *Pool;
+
 } ThreadGroup;
 
 struct thread {
@@ -519,8 +568,23 @@ struct thread {
         bool detached;
 };
 
+/*
+ * Channels made with a capacity are bounded MPMC rings (see src/chan.c) that
+ * only touch m when a sender finds the ring full or a receiver finds it
+ * empty. Without one, messages go into a growable ring behind m.
+ */
+typedef struct {
+        _Atomic(usize) seq;
+        Value *msg;
+} ChanSlot;
+
+enum {
+        CHAN_RECV,
+        CHAN_SEND
+};
+
 struct channel {
-        bool      open;
+        atomic_bool open;
         atomic_uint_least32_t waiters;
         TyMutex      m;
         TyCondVar    c;
@@ -528,24 +592,41 @@ struct channel {
         usize     head;
         usize     tail;
         usize     cap;
+
+        ChanSlot  *ring;
+        usize      bound;
+        TyCondVar  space;
+        atomic_uint_least32_t parked[2];
+
+        // Senders and receivers each get a cache line to themselves
+        char           pad0[64];
+        _Atomic(usize) enq;
+        char           pad1[64 - sizeof (usize)];
+        _Atomic(usize) deq;
+        char           pad2[64 - sizeof (usize)];
 };
 
 typedef atomic_intmax_t TyAtomicInt;
 
+/*
+ * A Dict's entries are kept densely in insertion order in `items`, and `index`
+ * maps hash slots to entries. Both live in the one block: `items` has room for
+ * DICT_USABLE(size) entries and is followed by the index's `size` slots, each
+ * 1, 2, 4 or 8 bytes wide depending on `size`. A removed entry is left in
+ * place with a VALUE_TOMBSTONE key until the next rehash.
+ */
 struct dict_item {
         Value k;
         Value v;
         u64   h;
-        DictItem *prev;
-        DictItem *next;
 };
 
 struct dict {
         DictItem *items;
+        void     *index;
         usize     size;
         usize     count;
         usize     tombs;
-        DictItem *last;
         Value     dflt;
 };
 
@@ -720,11 +801,21 @@ typedef struct ty {
         int GC_OFF_COUNT;
 
         GCWorkStack marking;
+        ValueVector gray;
 
         isize memory_used;
         isize memory_limit;
+        isize memory_limit_base;
+        isize heap_budget;
 
         AllocList allocs;
+        struct {
+                bool  active;
+                usize next;
+                usize end;
+                usize kept;
+        } sweep;
+
         ThreadGroup *group;
         TyThreadState *blocked;
         TySpinLock *lock;
@@ -882,17 +973,28 @@ extern u64 TypeCheckTime;
 extern volatile bool GC_EVERY_ALLOC;
 #endif
 
+/*
+ * Only store to a mark byte that isn't already set: a block that is already
+ * marked (in particular anything in the permanent generation, see GCFreeze())
+ * then never has its page dirtied by the collector.
+ */
 #if defined(TY_TRACE_GC)
 extern _Thread_local u64 ThisReached;
 extern _Thread_local u64 TotalReached;
-#define MARK(v) do {                        \
-        atomic_store_explicit(              \
-                &(ALLOC_OF(v))->mark,       \
-                true,                       \
-                memory_order_relaxed        \
-        );                                  \
-        ThisReached += ALLOC_OF(v)->size;  \
-        TotalReached += ALLOC_OF(v)->size; \
+#define MARK(v) do {                          \
+        struct alloc *a_ = ALLOC_OF(v);       \
+        if (!atomic_load_explicit(            \
+                &a_->mark,                    \
+                memory_order_relaxed          \
+        )) {                                  \
+                atomic_store_explicit(        \
+                        &a_->mark,            \
+                        true,                 \
+                        memory_order_relaxed  \
+                );                            \
+        }                                     \
+        ThisReached += a_->size;              \
+        TotalReached += a_->size;             \
 } while (0)
 #define ADD_REACHED(n) do {          \
         ThisReached += (n);          \
@@ -906,12 +1008,18 @@ extern _Thread_local u64 TotalReached;
 } while (0)
 #define LOG_REACHED(...) XxLOG(__VA_ARGS__)
 #else
-#define MARK(v) do {                     \
-        atomic_store_explicit(           \
-                &(ALLOC_OF(v))->mark,    \
-                true,                    \
-                memory_order_relaxed     \
-        );                               \
+#define MARK(v) do {                          \
+        struct alloc *a_ = ALLOC_OF(v);       \
+        if (!atomic_load_explicit(            \
+                &a_->mark,                    \
+                memory_order_relaxed          \
+        )) {                                  \
+                atomic_store_explicit(        \
+                        &a_->mark,            \
+                        true,                 \
+                        memory_order_relaxed  \
+                );                            \
+        }                                     \
 } while (0)
 #define ADD_REACHED(n)
 #define RESET_REACHED()
@@ -1064,6 +1172,7 @@ extern usize TotalBytesAllocated;
         X(CLASS_OF),              \
         X(MEMBER_ACCESS),         \
         X(TRY_MEMBER_ACCESS),     \
+        X(RECORD_MEMBER),         \
         X(SELF_MEMBER_ACCESS),    \
         X(SELF_STATIC_ACCESS),    \
         X(STATIC_MEMBER_ACCESS),  \
@@ -1118,6 +1227,8 @@ extern usize TotalBytesAllocated;
         X(JGT),                   \
         X(JEQ),                   \
         X(JNE),                   \
+        X(FOR_RANGE),             \
+        X(RANGE_NEXT),            \
         X(JNI),                   \
         X(JII),                   \
         X(JUMP_AND),              \
@@ -1261,6 +1372,16 @@ enum {
 };
 #undef X
 
+/*
+ * How FOR_RANGE and RANGE_NEXT count: the loop runs while the counter is
+ * < the bound, <= the bound, or (counting down) >= the bound.
+ */
+enum {
+        RANGE_LOOP_UP,
+        RANGE_LOOP_UP_INCLUSIVE,
+        RANGE_LOOP_DOWN
+};
+
 #define INTEGER(k)               ((Value){ .type = VALUE_INTEGER,          .z              = (k),                                  .tags = 0 })
 #define REAL(f)                  ((Value){ .type = VALUE_REAL,             .real           = (f),                                  .tags = 0 })
 #define BOOLEAN(b)               ((Value){ .type = VALUE_BOOLEAN,          .boolean        = (b),                                  .tags = 0 })
@@ -360,6 +360,9 @@ type_resolve_var(Type const *t0);
 Class *
 type_guess_class_of(Ty *ty, Type const *t0);
 
+int
+type_record_slot(Ty *ty, Type const *t0, char const *name);
+
 void
 type_intersect(Ty *ty, Type **t0, Type *t1);
 
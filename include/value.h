@@ -14,6 +14,7 @@ typedef struct value Value;
 #include "object.h"
 #include "gc.h"
 #include "tags.h"
+#include "shape.h"
 #include "tthread.h"
 #include "scope.h"
 #include "compiler.h"
@@ -58,6 +59,7 @@ enum {
         CLASS_TIMEOUT_ERROR,
         CLASS_CANCELED_ERROR,
         CLASS_OS_ERROR,
+        CLASS_MEMORY_ERROR,
         CLASS_RE_MATCH,
         CLASS_INTO_PTR,
         CLASS_ITERABLE,
@@ -796,10 +798,104 @@ value_show_scratch(Ty *ty, Value const *v, u32 flags);
 Value
 value_vshow(Ty *ty, Value const *v, u32 flags);
 
+/*
+ * Every GC_STRING block of at least STRING_HASH_MIN bytes ends with a
+ * StringTrailer. Shorter strings are cheap enough to hash and copy that the
+ * extra bytes aren't worth it.
+ *
+ * The trailer caches the hash of the whole string starting at the front of
+ * the block. It's filled in the first time a Value with str == str0 is hashed,
+ * and only trusted while its length matches the Value's, so views and strings
+ * shorter than the block they were built in just hash the old way. String
+ * literals have one in front of their bytes instead (ro == STRING_LITERAL),
+ * computed once by the compiler.
+ *
+ * It also records how much of the block is in use. Bytes below that mark
+ * never change, so a string that ends exactly at it can be appended to in
+ * place, leaving every other Value pointing into the block untouched: see
+ * value_string_append().
+ *
+ * GC_STRING blocks must only come from value_string_alloc() and friends.
+ */
+#define STRING_HASH_MIN 32
+
+enum {
+        STRING_HASH_EMPTY,
+        STRING_HASH_BUSY,
+        STRING_HASH_READY
+};
+
+typedef struct {
+        u64 hash;
+        u32 bytes;
+        atomic_uint_least32_t state;
+        atomic_uint_least32_t used;
+} StringTrailer;
+
+#define STRING_LITERAL 2
+
+#define STRING_TRAILER_OFFSET(n) (((n) + 7) & ~(usize)7)
+
+inline static usize
+StringBlockSize(usize n)
+{
+        return (n < STRING_HASH_MIN)
+             ? n
+             : STRING_TRAILER_OFFSET(n) + sizeof (StringTrailer);
+}
+
+inline static void *
+StringBlockInit(u8 *str, usize n)
+{
+        if (n >= STRING_HASH_MIN) {
+                StringTrailer *t = (StringTrailer *)(str + STRING_TRAILER_OFFSET(n));
+                atomic_init(&t->state, STRING_HASH_EMPTY);
+                atomic_init(&t->used, n);
+        }
+
+        return str;
+}
+
+inline static StringTrailer *
+StringBlockTrailer(u8 const *str0)
+{
+        struct alloc *a = ALLOC_OF(str0);
+
+        if (
+                a->type != GC_STRING
+             || a->size < STRING_HASH_MIN
+             || a->size == UINT32_MAX
+        ) {
+                return NULL;
+        }
+
+        return (StringTrailer *)(a->data + a->size - sizeof (StringTrailer));
+}
+
+inline static StringTrailer *
+StringTrailerOf(Value const *v)
+{
+        if (v->ro == STRING_LITERAL) {
+                return (StringTrailer *)v->str0 - 1;
+        }
+
+        if (v->ro || v->str0 == NULL) {
+                return NULL;
+        }
+
+        return StringBlockTrailer(v->str0);
+}
+
 static inline void *
 value_string_alloc(Ty *ty, u32 n)
 {
-        return mAo(n, GC_STRING);
+        return StringBlockInit(mAo(StringBlockSize(n), GC_STRING), n);
+}
+
+static inline void *
+value_string_alloc_unchecked(Ty *ty, u32 n)
+{
+        return StringBlockInit(uAo(StringBlockSize(n), GC_STRING), n);
 }
 
 static inline void *
@@ -809,7 +905,7 @@ value_string_clone(Ty *ty, void const *src, u32 n)
                 return NULL;
         }
 
-        u8 *str = mAo(n + 1, GC_STRING);
+        u8 *str = value_string_alloc(ty, n + 1);
 
         memcpy(str, src, n);
         str[n] = '\0';
@@ -820,7 +916,7 @@ value_string_clone(Ty *ty, void const *src, u32 n)
 static inline void *
 value_string_clone_nul(Ty *ty, void const *src, u32 n)
 {
-        u8 *str = mAo(n + 1, GC_STRING);
+        u8 *str = value_string_alloc(ty, n + 1);
 
         memcpy(str, src, n);
         str[n] = '\0';
@@ -828,6 +924,11 @@ value_string_clone_nul(Ty *ty, void const *src, u32 n)
         return str;
 }
 
+char *
+value_string_literal(char const *s, u32 n);
+
+Value
+value_string_append(Ty *ty, Value const *s, Value const *x);
 
 struct array *
 value_array_clone(Ty *ty, struct array const *);
@@ -853,6 +954,24 @@ tuple_get(Value const *tuple, char const *name);
 Value *
 tuple_get_i(Value const *tuple, int id);
 
+void
+tuple_layout_init(void);
+
+i32 *
+tuple_layout(i32 const *ids, int n);
+
+i32 *
+tuple_layout_shared(i32 const *ids, int n);
+
+i32 *
+tuple_ids(Ty *ty, Value const *tuple, i32 const *ids);
+
+bool
+tuple_layout_interned(i32 const *ids);
+
+int
+tuple_slot(Value const *tuple, int id);
+
 static inline Value *
 tget_or_null(Value const *tuple, uptr k)
 {
@@ -913,6 +1032,24 @@ tuple_get_completions(Ty *ty, Value const *v, char const *prefix, char **out, in
 void
 _value_mark(Ty *ty, Value const *v);
 
+void
+value_mark_frozen(Ty *ty, struct alloc *a);
+
+bool
+value_mark_slice(Ty *ty, ValueVector *gray, u64 budget);
+
+void
+value_shade(Ty *ty, Value const *v);
+
+void
+value_shade_block(Ty *ty, void const *p);
+
+void
+value_mark_block(Ty *ty, void const *p);
+
+void
+value_mark_spill(Ty *ty, ValueVector *gray);
+
 static inline Array *
 value_array_new(Ty *ty)
 {
@@ -959,8 +1096,9 @@ static inline void
 value_array_push(Ty *ty, Array *a, Value v)
 {
         if (a->count == a->capacity) {
-                a->capacity = a->capacity ? a->capacity * 2 : 4;
-                mRE(a->items, a->capacity * sizeof (Value));
+                usize capacity = a->capacity ? a->capacity * 2 : 4;
+                mRE(a->items, capacity * sizeof (Value));
+                a->capacity = capacity;
         }
 
         a->items[a->count++] = v;
@@ -972,13 +1110,13 @@ value_array_reserve(Ty *ty, Array *a, int count)
         if (a->capacity >= count)
                 return;
 
-        if (a->capacity == 0)
-                a->capacity = 16;
+        usize capacity = (a->capacity == 0) ? 16 : a->capacity;
 
-        while (a->capacity < count)
-                a->capacity *= 2;
+        while (capacity < count)
+                capacity *= 2;
 
-        mRE(a->items, a->capacity * sizeof (Value));
+        mRE(a->items, capacity * sizeof (Value));
+        a->capacity = capacity;
 }
 
 static inline Value
@@ -992,7 +1130,7 @@ STRING_VFORMAT(Ty *ty, char const *fmt, va_list ap)
         va_copy(_ap, ap);
         scvdump(ty, &buf, fmt, _ap);
         va_end(_ap);
-        str = mAo(vN(buf) + 1, GC_STRING);
+        str = value_string_alloc(ty, vN(buf) + 1);
         memcpy(str, vv(buf), vN(buf) + 1);
         SCRATCH_RESTORE();
 
@@ -1135,6 +1273,19 @@ STRING_NOGC_C(void const *s)
         };
 }
 
+static inline Value
+STRING_NOGC_LITERAL(char const *s, u32 n)
+{
+        return (Value) {
+                .type = VALUE_STRING,
+                .tags = 0,
+                .str = (u8 const *)s,
+                .bytes = n,
+                .str0 = (u8 *)s,
+                .ro = STRING_LITERAL
+        };
+}
+
 #define STRING_EMPTY (STRING_NOGC(NULL, 0))
 
 static inline bool
@@ -1227,9 +1378,6 @@ QUADRUPLE_(Ty *ty, Value a, Value b, Value c, Value d)
 
 #define None TAG(TAG_NONE)
 
-int
-tags_push(Ty *ty, int, int);
-
 static inline Value
 Ok(Ty *ty, Value v)
 {
@@ -1463,6 +1611,52 @@ from_eval(Value const *f)
         return (*flags_of(f) & FF_FROM_EVAL);
 }
 
+/*
+ * The GC block whose mark bit decides whether v survives the current cycle,
+ * or NULL if v doesn't depend on anything the collector can free (immediates,
+ * literals, classes, functions without captures).
+ */
+static inline void const *
+value_gc_block(Value const *v)
+{
+        switch (v->type & ~VALUE_TAGGED) {
+        case VALUE_ARRAY:           return v->array;
+        case VALUE_DICT:            return v->dict;
+        case VALUE_OBJECT:          return v->object;
+        case VALUE_TUPLE:           return v->items;
+        case VALUE_BLOB:            return v->blob;
+        case VALUE_QUEUE:           return v->queue;
+        case VALUE_SHARED_QUEUE:    return v->shared_queue;
+        case VALUE_GENERATOR:       return v->gen;
+        case VALUE_THREAD:          return v->thread;
+        case VALUE_REF:             return v->ref;
+        case VALUE_TRACE:           return v->ptr;
+        case VALUE_METHOD:
+        case VALUE_BUILTIN_METHOD:  return v->this;
+        case VALUE_PTR:             return v->gcptr;
+        case VALUE_STRING:          return v->ro ? NULL : v->str0;
+        case VALUE_REGEX:           return v->regex->gc ? v->regex : NULL;
+
+        case VALUE_FUNCTION:
+        case VALUE_BOUND_FUNCTION:
+        case VALUE_NATIVE_FUNCTION:
+                if (v->info[FUN_INFO_CAPTURES] + (v->type == VALUE_BOUND_FUNCTION) > 0) {
+                        return v->env;
+                }
+                return from_eval(v) ? v->info : NULL;
+
+        default:
+                return NULL;
+        }
+}
+
+static inline bool
+value_is_marked(Value const *v)
+{
+        void const *p = value_gc_block(v);
+        return (p == NULL) || MARKED(p);
+}
+
 static inline Type *
 as_type(Value const *v)
 {
@@ -1545,16 +1739,18 @@ ArrayClone(Ty *ty, Array const *a)
         return new;
 }
 
+#define DICT_USABLE(size) ((size) - (size) / 4)
+
 static inline DictItem *
-DictFirst(Dict const *d)
+DictEnd(Dict const *d)
 {
-        DictItem *it = d->last;
-
-        while (it != NULL && it->prev != NULL) {
-                it = it->prev;
-        }
+        return d->items + d->count + d->tombs;
+}
 
-        return it;
+static inline bool
+DictItemDead(DictItem const *it)
+{
+        return it->k.type == VALUE_TOMBSTONE;
 }
 
 static inline Value
@@ -1674,12 +1870,12 @@ static inline void
                 (m < vN(c->offsets_r))
              && ((off = v__(c->offsets_r, m)) != OFF_NOT_FOUND)
         ) {
+                GCWrite(ty, v.object);
                 v.object->slots[off & OFF_MASK] = x;
         } else {
-                if (v.object->dynamic == NULL) {
-                        v.object->dynamic = mA0(sizeof (struct itable));
-                }
-                itable_add(ty, v.object->dynamic, m, x);
+                Value *vp = dynamic_get(ty, v.object, m);
+                GCWrite(ty, v.object);
+                *vp = x;
         }
 }
 
@@ -1697,7 +1893,7 @@ static inline Value *
         ) {
                 return &v.object->slots[off & OFF_MASK];
         } else if (v.object->dynamic != NULL) {
-                return itable_lookup(ty, v.object->dynamic, m);
+                return dynamic_lookup(v.object->dynamic, m);
         } else {
                 return NULL;
         }
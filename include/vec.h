@@ -60,14 +60,19 @@ fit2(vec_z cap, vec_z min)
         (v).items = NULL;       \
 } while (0)
 
+/*
+ * The capacity is only updated once rsz() has returned: a checked resize can
+ * throw (see CheckHeap()), and the vector has to be left intact when it does.
+ */
 #define vec_push_(v, item, rsz) (                                                       \
           UNLIKELY(vec_full(v))                                                         \
         ? (                                                                             \
                 rsz(                                                                    \
                         (v).items,                                                      \
-                        ((v).capacity = vec_new_capacity(v)) * (sizeof (*(v).items)),   \
+                        vec_new_capacity(v) * (sizeof (*(v).items)),                    \
                         ((v).count * (sizeof (*(v).items)))                             \
                 ),                                                                      \
+                ((v).capacity = vec_new_capacity(v)),                                   \
                 ((v).items[(v).count] = (item)),                                        \
                 ((v).count += 1),                                                       \
                 ((v).items + (v).count - 1)                                             \
@@ -83,12 +88,16 @@ fit2(vec_z cap, vec_z min)
         ? (                                                             \
                 rsz(                                                    \
                         (v).items,                                      \
-                        (sizeof *((v).items)) * ((v).capacity = fit2(   \
+                        (sizeof *((v).items)) * fit2(                   \
                                 vec_new_capacity(v),                    \
                                 ((v).count + (n))                       \
-                        )),                                             \
+                        ),                                              \
                         ((v).count * (sizeof (*(v).items)))             \
                 ),                                                      \
+                ((v).capacity = fit2(                                   \
+                        vec_new_capacity(v),                            \
+                        ((v).count + (n))                               \
+                )),                                                     \
                 __builtin_memcpy(                                       \
                         (v).items + (v).count,                          \
                         (elements),                                     \
@@ -134,12 +143,12 @@ fit2(vec_z cap, vec_z min)
 #define vec_reserve_(v, n, rsz) (                               \
         ((v).capacity < (n)) &&                                 \
         (                                                       \
-                ((v).capacity = (n)),                           \
                 rsz(                                            \
                         (v).items,                              \
-                        (v).capacity * (sizeof (*(v).items)),   \
-                        (v).count    * (sizeof (*(v).items))    \
-                )                                               \
+                        (n)       * (sizeof (*(v).items)),      \
+                        (v).count * (sizeof (*(v).items))       \
+                ),                                              \
+                ((v).capacity = (n))                            \
         )                                                       \
 )
 
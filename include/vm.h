@@ -13,6 +13,8 @@
 #include "tthread.h"
 #include "log.h"
 
+typedef struct op_site OpSite;
+
 extern bool PrintResult;
 extern volatile sig_atomic_t JitInterruptFlag;
 
@@ -73,6 +75,21 @@ DoCheckMatch(Ty *ty, bool exec);
 void
 NewThread(Ty *ty, Thread *thread, Value *ctx, Value *name, bool sigma);
 
+/*
+ * A unit of work for vm_parallel(). It gets the Ty of whichever thread runs
+ * it, which may or may not be the caller's.
+ */
+typedef void ParallelTask(Ty *ty, void *ctx, usize i);
+
+void
+vm_parallel(Ty *ty, usize n, ParallelTask *f, void *ctx);
+
+usize
+vm_parallel_width(Ty *ty);
+
+void
+vm_free_group(ThreadGroup *group);
+
 void
 vm_set_sigfn(Ty *ty, int sig, Value const *f);
 
@@ -351,9 +368,37 @@ DoMutShl(Ty *ty, bool exec);
 void
 DoMutShr(Ty *ty, bool exec);
 
+/*
+ * Whether a counted loop (FOR_RANGE / RANGE_NEXT) has run past its bound.
+ * The bounds are almost always Ints, but anything with a <=> still works,
+ * same as it did when these loops were compiled to generic comparisons.
+ */
+inline static bool
+RangeLoopDone(Ty *ty, Value const *stop, Value const *i, int kind)
+{
+        if (LIKELY(i->type == VALUE_INTEGER && stop->type == VALUE_INTEGER)) {
+                switch (kind) {
+                case RANGE_LOOP_UP:           return i->z >= stop->z;
+                case RANGE_LOOP_UP_INCLUSIVE: return i->z >  stop->z;
+                default:                      return i->z <  stop->z;
+                }
+        }
+
+        int c = value_compare(ty, i, stop);
+
+        switch (kind) {
+        case RANGE_LOOP_UP:           return c >= 0;
+        case RANGE_LOOP_UP_INCLUSIVE: return c >  0;
+        default:                      return c <  0;
+        }
+}
+
 void
 DoBinaryOp(Ty *ty, int op, bool exec);
 
+void
+DoBinaryOpAt(Ty *ty, int op, OpSite *site, bool exec);
+
 void
 IncValue(Ty *ty, Value *v);
 
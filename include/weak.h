@@ -0,0 +1,71 @@
+#ifndef WEAK_H_INCLUDED
+#define WEAK_H_INCLUDED
+
+#include "ty.h"
+
+/*
+ * Weak references and ephemeron tables
+ *
+ * A WeakRef is a GC_WEAK block holding a value that marking doesn't trace
+ * through. A weak dict is an ordinary Dict allocated as GC_WEAK_DICT: its
+ * keys are weak, and each value is only traced once its key is known to be
+ * reachable some other way.
+ *
+ * Both kinds of block are registered with their thread group when they're
+ * created. Once every thread has finished marking, weak_process() runs the
+ * ephemeron fixpoint, clears references to anything still unmarked, and
+ * queues the callbacks of references it cleared. That happens before
+ * finalization, so a finalizer never sees a weak reference to an object
+ * that was unreachable. weak_prune() then deals with whatever weak blocks
+ * the queued finalizers kept alive and drops the rest from the registry.
+ * weak_drain() runs the callbacks after the collection, when the world is
+ * running again.
+ *
+ * While an incremental cycle is in flight, anything read out of a weak block
+ * has to go through weak_gray() (see weak.c). For a weak dict that means any
+ * key or value handed back to the program, other than a key it passed in.
+ */
+
+typedef struct weak_ref {
+        Value target;
+        Value callback;
+} WeakRef;
+
+WeakRef *
+weak_ref_new(Ty *ty, Value const *target, Value const *callback);
+
+Value
+weak_ref_get(Ty *ty, WeakRef const *ref);
+
+Dict *
+weak_dict_new(Ty *ty);
+
+void
+weak_gray(Ty *ty, Value const *v);
+
+void
+weak_gray_dict(Ty *ty, Dict const *d, Value const *v);
+
+inline static void
+weak_dict_read(Ty *ty, Dict const *d, Value const *v)
+{
+        if (UNLIKELY(ty->group->GCBlack)) {
+                weak_gray_dict(ty, d, v);
+        }
+}
+
+void
+weak_ref_mark(Ty *ty, WeakRef *ref);
+
+void
+weak_process(Ty *ty);
+
+void
+weak_prune(Ty *ty, bool revived);
+
+void
+weak_drain(Ty *ty);
+
+#endif
+
+/* vim: set sts=8 sw=8 expandtab: */
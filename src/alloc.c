@@ -6,7 +6,7 @@
 #define A ty->arena
 
 enum {
-        RESERVED = sizeof (Arena)
+        RESERVED = sizeof (ArenaHeader)
 };
 
 inline static void
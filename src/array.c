@@ -42,30 +42,6 @@ compare_default(void *ty, void const *v1, void const *v2)
         return value_compare(ty, v1, v2);
 }
 
-static int
-#if defined(__linux__)
-compare_by(void const *v1, void const *v2, void *ctx_)
-#else
-compare_by(void *ctx_, void const *v1, void const *v2)
-#endif
-{
-        SortContext *ctx = ctx_;
-        Ty *ty = ctx->ty;
-
-        Value k1 = vm_call1(ty, &ctx->f, (Value *)v1);
-        gP(&k1);
-
-        Value k2 = vm_call1(ty, &ctx->f, (Value *)v2);
-        gP(&k2);
-
-        int result = value_compare(ty, &k1, &k2);
-
-        gX();
-        gX();
-
-        return result;
-}
-
 static int
 #if defined(__linux__)
 compare_by2(void const *v1, void const *v2, void *ctx_)
@@ -91,6 +67,583 @@ compare_by2(void *ctx_, void const *v1, void const *v2)
         return result;
 }
 
+/*
+ * Arrays of nothing but untagged Ints or nothing but untagged Floats are
+ * radix sorted on an order-preserving encoding of their bits, and arrays of
+ * nothing but Strings get a pdqsort with the String comparison inlined.
+ * Anything else still goes through value_compare(), which dispatches on the
+ * types of both operands for every comparison.
+ *
+ * With a key function (by= or sortOn), each key is computed exactly once up
+ * front and the element indices are sorted by key, ties broken by index so
+ * that elements with equal keys keep their order. The elements are permuted
+ * into place at the end.
+ */
+
+#define SORT_SIGN      (1ULL << 63)
+#define SORT_RADIX_MIN 256
+
+typedef struct {
+        u64 k;
+        u64 i;
+} SortKey;
+
+typedef struct {
+        Ty *ty;
+        Value const *keys;
+} SortKeyContext;
+
+inline static u64
+IntBits(imax z)
+{
+        return (u64)z ^ SORT_SIGN;
+}
+
+inline static imax
+BitsInt(u64 k)
+{
+        return (imax)(k ^ SORT_SIGN);
+}
+
+// Negative floats have every bit flipped and the rest just the sign bit, so
+// the encodings order like the numbers they represent. Every NaN, whatever
+// its sign, is made the positive quiet NaN first so that they all sort last
+inline static u64
+FloatBits(double x)
+{
+        if (isnan(x)) {
+                x = NAN;
+        }
+
+        u64 b;
+        memcpy(&b, &x, sizeof b);
+        return (b & SORT_SIGN) ? ~b : (b | SORT_SIGN);
+}
+
+inline static double
+BitsFloat(u64 k)
+{
+        u64 b = (k & SORT_SIGN) ? (k ^ SORT_SIGN) : ~k;
+        double x;
+        memcpy(&x, &b, sizeof x);
+        return x;
+}
+
+inline static int
+StrCmp(Value const *a, Value const *b)
+{
+        int c = memcmp(ss(*a), ss(*b), min(sN(*a), sN(*b)));
+        return (c != 0) ? c : (sN(*a) > sN(*b)) - (sN(*a) < sN(*b));
+}
+
+inline static bool
+StrKeyLess(void *ctx, u64 i, u64 j)
+{
+        Value const *keys = ((SortKeyContext *)ctx)->keys;
+        int c = StrCmp(&keys[i], &keys[j]);
+        return (c != 0) ? (c < 0) : (i < j);
+}
+
+inline static bool
+ValueKeyLess(void *ctx, u64 i, u64 j)
+{
+        SortKeyContext *kc = ctx;
+        int c = value_compare(kc->ty, &kc->keys[i], &kc->keys[j]);
+        return (c != 0) ? (c < 0) : (i < j);
+}
+
+#define PDQ_NAME       SortBits
+#define PDQ_T          u64
+#define PDQ_LESS(a, b) ((a) < (b))
+#include "pdqsort.h"
+
+#define PDQ_NAME       SortKeys
+#define PDQ_T          SortKey
+#define PDQ_LESS(a, b) ((a).k < (b).k || ((a).k == (b).k && (a).i < (b).i))
+#include "pdqsort.h"
+
+#define PDQ_NAME       SortStrings
+#define PDQ_T          Value
+#define PDQ_LESS(a, b) (StrCmp(&(a), &(b)) < 0)
+#include "pdqsort.h"
+
+#define PDQ_NAME       SortStringKeys
+#define PDQ_T          u64
+#define PDQ_LESS(a, b) StrKeyLess(ctx, (a), (b))
+#include "pdqsort.h"
+
+#define PDQ_NAME       SortValueKeys
+#define PDQ_T          u64
+#define PDQ_LESS(a, b) ValueKeyLess(ctx, (a), (b))
+#include "pdqsort.h"
+
+/*
+ * LSD radix sort on 8-bit digits. All eight histograms are built in one pass
+ * up front, and a digit that's the same for every element (e.g. the high
+ * bytes of small Ints) costs nothing beyond that.
+ */
+#define DEFINE_RADIX_SORT(name, T, KEY)                                         \
+        static void                                                             \
+        name(T *xs, T *tmp, usize n)                                            \
+        {                                                                       \
+                usize counts[8][256] = {0};                                     \
+                                                                                \
+                for (usize i = 0; i < n; ++i) {                                 \
+                        u64 k = KEY(xs[i]);                                     \
+                        for (int d = 0; d < 8; ++d) {                           \
+                                counts[d][(k >> (8 * d)) & 0xFF] += 1;          \
+                        }                                                       \
+                }                                                               \
+                                                                                \
+                T *src = xs;                                                    \
+                T *dst = tmp;                                                   \
+                                                                                \
+                for (int d = 0; d < 8; ++d) {                                   \
+                        usize *count = counts[d];                               \
+                        if (count[(KEY(src[0]) >> (8 * d)) & 0xFF] == n) {      \
+                                continue;                                       \
+                        }                                                       \
+                        usize off = 0;                                          \
+                        for (int b = 0; b < 256; ++b) {                         \
+                                usize c = count[b];                             \
+                                count[b] = off;                                 \
+                                off += c;                                       \
+                        }                                                       \
+                        for (usize i = 0; i < n; ++i) {                         \
+                                dst[count[(KEY(src[i]) >> (8 * d)) & 0xFF]++]   \
+                                        = src[i];                               \
+                        }                                                       \
+                        T *t = src;                                             \
+                        src = dst;                                              \
+                        dst = t;                                                \
+                }                                                               \
+                                                                                \
+                if (src != xs) {                                                \
+                        memcpy(xs, src, n * sizeof (T));                        \
+                }                                                               \
+        }
+
+#define BITS_KEY(x) (x)
+#define SORT_KEY(x) ((x).k)
+DEFINE_RADIX_SORT(RadixSortBits, u64, BITS_KEY)
+DEFINE_RADIX_SORT(RadixSortKeys, SortKey, SORT_KEY)
+#undef BITS_KEY
+#undef SORT_KEY
+
+/*
+ * VALUE_INTEGER, VALUE_REAL or VALUE_STRING if every value is an untagged
+ * value of that type, otherwise VALUE_NONE.
+ */
+inline static int
+SortKind(Value const *xs, usize n)
+{
+        int kind = xs[0].type;
+
+        if (kind != VALUE_INTEGER && kind != VALUE_REAL && kind != VALUE_STRING) {
+                return VALUE_NONE;
+        }
+
+        for (usize i = 1; i < n; ++i) {
+                if (xs[i].type != kind) {
+                        return VALUE_NONE;
+                }
+        }
+
+        return kind;
+}
+
+static void
+SortNumbers(Ty *ty, Value *xs, usize n, int kind)
+{
+        u64 *bits = mA(2 * n * sizeof (u64));
+
+        for (usize i = 0; i < n; ++i) {
+                bits[i] = (kind == VALUE_INTEGER) ? IntBits(xs[i].z) : FloatBits(xs[i].real);
+        }
+
+        if (n >= SORT_RADIX_MIN) {
+                RadixSortBits(bits, bits + n, n);
+        } else {
+                SortBits(bits, n, NULL);
+        }
+
+        for (usize i = 0; i < n; ++i) {
+                xs[i] = (kind == VALUE_INTEGER) ? INTEGER(BitsInt(bits[i])) : REAL(BitsFloat(bits[i]));
+        }
+
+        mF(bits);
+}
+
+static void
+SortValues(Ty *ty, Value *xs, usize n)
+{
+        if (n < 2) {
+                return;
+        }
+
+        switch (SortKind(xs, n)) {
+        case VALUE_INTEGER:
+        case VALUE_REAL:
+                SortNumbers(ty, xs, n, xs[0].type);
+                break;
+
+        case VALUE_STRING:
+                SortStrings(xs, n, NULL);
+                break;
+
+        default:
+                rqsort(xs, n, sizeof (Value), compare_default, ty);
+        }
+}
+
+/*
+ * Sorts xs[i0 .. i0 + n) by f(x), calling f once per element.
+ */
+static void
+SortValuesOn(Ty *ty, Array *xs, usize i0, usize n, Value const *f)
+{
+        if (n < 2) {
+                return;
+        }
+
+        usize len = vN(*xs);
+
+        Array *keys = value_array_new_sized(ty, n);
+        Value kv = ARRAY(keys);
+
+        gP(&kv);
+
+        for (usize i = 0; i < n; ++i) {
+                if (vN(*xs) != len) {
+                        zP("Array.sort(): array modified by the key function");
+                }
+                Value k = vm_call1(ty, f, v_(*xs, i0 + i));
+                vAp(keys, k);
+        }
+
+        if (vN(*xs) != len) {
+                zP("Array.sort(): array modified by the key function");
+        }
+
+        int kind = SortKind(vv(*keys), n);
+        u64 *order = mA(n * sizeof (u64));
+
+        if (kind == VALUE_INTEGER || kind == VALUE_REAL) {
+                SortKey *ks = mA(2 * n * sizeof (SortKey));
+                for (usize i = 0; i < n; ++i) {
+                        ks[i].k = (kind == VALUE_INTEGER)
+                                ? IntBits(v__(*keys, i).z)
+                                : FloatBits(v__(*keys, i).real);
+                        ks[i].i = i;
+                }
+                if (n >= SORT_RADIX_MIN) {
+                        RadixSortKeys(ks, ks + n, n);
+                } else {
+                        SortKeys(ks, n, NULL);
+                }
+                for (usize i = 0; i < n; ++i) {
+                        order[i] = ks[i].i;
+                }
+                mF(ks);
+        } else {
+                SortKeyContext ctx = {
+                        .ty = ty,
+                        .keys = vv(*keys)
+                };
+                for (usize i = 0; i < n; ++i) {
+                        order[i] = i;
+                }
+                if (kind == VALUE_STRING) {
+                        SortStringKeys(order, n, &ctx);
+                } else {
+                        SortValueKeys(order, n, &ctx);
+                }
+        }
+
+        if (vN(*xs) != len) {
+                mF(order);
+                zP("Array.sort(): array modified during sort");
+        }
+
+        Value *tmp = mA(n * sizeof (Value));
+        memcpy(tmp, v_(*xs, i0), n * sizeof (Value));
+
+        for (usize i = 0; i < n; ++i) {
+                *v_(*xs, i0 + i) = tmp[order[i]];
+        }
+
+        mF(tmp);
+        mF(order);
+
+        gX();
+}
+
+/*
+ * Parallel variants (psort, pmap, pfilter, preduce)
+ *
+ * Work is split into chunks of PAR_CHUNK elements, 32 KiB worth of Values, so
+ * that a worker's slice of the input stays in cache while it's being worked
+ * on, and the chunks are spread over the thread group's worker pool by
+ * vm_parallel(). Arrays shorter than PAR_MIN aren't worth waking the pool
+ * for and are done serially.
+ *
+ * psort sorts one run per thread with SortValues() and then merges pairs of
+ * runs until one is left. Every merge is cut into PAR_MERGE-element pieces at
+ * split points found by binary search, so the last rounds, with only one or
+ * two merges left, still keep every worker busy.
+ */
+
+#define PAR_MIN   ((usize)1 << 14)
+#define PAR_CHUNK ((32 * 1024) / sizeof (Value))
+#define PAR_MERGE ((usize)1 << 16)
+
+typedef struct {
+        Value const *f;
+        Value const *xs;
+        Value *out;
+        bool *keep;
+        usize n;
+} ParallelContext;
+
+typedef struct {
+        usize a;
+        usize m;
+        usize b;
+        usize k0;
+        usize k1;
+} MergeTask;
+
+typedef struct {
+        Value *src;
+        Value *dst;
+        usize const *runs;
+        MergeTask const *merges;
+        int kind;
+} ParallelSort;
+
+inline static usize
+ChunkCount(usize n)
+{
+        return (n + PAR_CHUNK - 1) / PAR_CHUNK;
+}
+
+/*
+ * Runs f on each PAR_CHUNK-sized chunk of an n-element array, on the worker
+ * pool if there's enough of it.
+ */
+static void
+ParallelChunks(Ty *ty, usize n, ParallelTask *f, void *ctx)
+{
+        if (n >= PAR_MIN) {
+                vm_parallel(ty, ChunkCount(n), f, ctx);
+        } else for (usize t = 0; t < ChunkCount(n); ++t) {
+                f(ty, ctx, t);
+        }
+}
+
+static void
+ParallelMapTask(Ty *ty, void *ctx, usize t)
+{
+        ParallelContext *pc = ctx;
+
+        for (usize i = t * PAR_CHUNK, end = min(i + PAR_CHUNK, pc->n); i < end; ++i) {
+                pc->out[i] = vm_call1(ty, pc->f, &pc->xs[i]);
+        }
+}
+
+static void
+ParallelFilterTask(Ty *ty, void *ctx, usize t)
+{
+        ParallelContext *pc = ctx;
+
+        for (usize i = t * PAR_CHUNK, end = min(i + PAR_CHUNK, pc->n); i < end; ++i) {
+                pc->keep[i] = value_apply_predicate(ty, (Value *)pc->f, (Value *)&pc->xs[i]);
+        }
+}
+
+static void
+ParallelReduceTask(Ty *ty, void *ctx, usize t)
+{
+        ParallelContext *pc = ctx;
+        usize i = t * PAR_CHUNK;
+        usize end = min(i + PAR_CHUNK, pc->n);
+        Value acc = pc->xs[i];
+
+        gP(&acc);
+
+        while (++i < end) {
+                acc = vm_eval_function(ty, pc->f, &acc, &pc->xs[i], NULL);
+                *vvL(RootSet) = acc;
+        }
+
+        pc->out[t] = acc;
+
+        gX();
+}
+
+/*
+ * The ordering SortValues() uses for an array of the given SortKind().
+ */
+inline static int
+SortCompare(Ty *ty, int kind, Value const *a, Value const *b)
+{
+        u64 x;
+        u64 y;
+
+        switch (kind) {
+        case VALUE_INTEGER:
+                return (a->z > b->z) - (a->z < b->z);
+
+        case VALUE_REAL:
+                x = FloatBits(a->real);
+                y = FloatBits(b->real);
+                return (x > y) - (x < y);
+
+        case VALUE_STRING:
+                return StrCmp(a, b);
+
+        default:
+                return value_compare(ty, a, b);
+        }
+}
+
+/*
+ * How many of the first k elements of the (stable) merge of xs[0 .. nx) and
+ * ys[0 .. ny) come from xs.
+ */
+static usize
+CoRank(Ty *ty, int kind, Value const *xs, usize nx, Value const *ys, usize ny, usize k)
+{
+        usize lo = (k > ny) ? k - ny : 0;
+        usize hi = min(k, nx);
+
+        while (lo < hi) {
+                usize i = lo + (hi - lo) / 2;
+                usize j = k - i;
+                if (j > 0 && SortCompare(ty, kind, &ys[j - 1], &xs[i]) >= 0) {
+                        lo = i + 1;
+                } else {
+                        hi = i;
+                }
+        }
+
+        return lo;
+}
+
+static void
+ParallelSortRunTask(Ty *ty, void *ctx, usize t)
+{
+        ParallelSort *ps = ctx;
+        SortValues(ty, ps->src + ps->runs[t], ps->runs[t + 1] - ps->runs[t]);
+}
+
+static void
+ParallelMergeTask(Ty *ty, void *ctx, usize t)
+{
+        ParallelSort *ps = ctx;
+        MergeTask const *mt = &ps->merges[t];
+
+        Value const *xs = ps->src + mt->a;
+        Value const *ys = ps->src + mt->m;
+        usize nx = mt->m - mt->a;
+        usize ny = mt->b - mt->m;
+
+        usize i = CoRank(ty, ps->kind, xs, nx, ys, ny, mt->k0);
+        usize j = mt->k0 - i;
+        usize i1 = CoRank(ty, ps->kind, xs, nx, ys, ny, mt->k1);
+        usize j1 = mt->k1 - i1;
+
+        Value *out = ps->dst + mt->a + mt->k0;
+
+        while (i < i1 && j < j1) {
+                if (SortCompare(ty, ps->kind, &ys[j], &xs[i]) < 0) {
+                        *out++ = ys[j++];
+                } else {
+                        *out++ = xs[i++];
+                }
+        }
+
+        memcpy(out, xs + i, (i1 - i) * sizeof (Value));
+        out += i1 - i;
+        memcpy(out, ys + j, (j1 - j) * sizeof (Value));
+}
+
+static void
+ParallelSortValues(Ty *ty, Value *xs, usize n)
+{
+        usize width = vm_parallel_width(ty);
+
+        if (n < PAR_MIN || width < 2) {
+                SortValues(ty, xs, n);
+                return;
+        }
+
+        usize nruns = min(width, n / PAR_CHUNK);
+        usize *runs = mA((nruns + 1) * sizeof (usize));
+        MergeTask *merges = mA((n / PAR_MERGE + nruns) * sizeof (MergeTask));
+
+        for (usize r = 0; r <= nruns; ++r) {
+                runs[r] = n * r / nruns;
+        }
+
+        // Scratch space for the merges. It has to be visible to the GC, since
+        // partway through a round some values are only in one of the buffers.
+        Array *tmp = vAn(n);
+        Value tv = ARRAY(tmp);
+
+        memcpy(vv(*tmp), xs, n * sizeof (Value));
+        vN(*tmp) = n;
+
+        gP(&tv);
+
+        ParallelSort ps = {
+                .src = xs,
+                .dst = vv(*tmp),
+                .runs = runs,
+                .merges = merges,
+                .kind = SortKind(xs, n)
+        };
+
+        vm_parallel(ty, nruns, ParallelSortRunTask, &ps);
+
+        while (nruns > 1) {
+                usize nmerges = 0;
+                usize r = 0;
+
+                for (usize p = 0; p < nruns; p += 2) {
+                        usize a = runs[p];
+                        usize m = runs[min(p + 1, nruns)];
+                        usize b = runs[min(p + 2, nruns)];
+                        for (usize k = 0; k < b - a; k += PAR_MERGE) {
+                                merges[nmerges++] = (MergeTask) {
+                                        .a  = a,
+                                        .m  = m,
+                                        .b  = b,
+                                        .k0 = k,
+                                        .k1 = min(k + PAR_MERGE, b - a)
+                                };
+                        }
+                        runs[r++] = a;
+                }
+
+                runs[r] = n;
+                nruns = r;
+
+                vm_parallel(ty, nmerges, ParallelMergeTask, &ps);
+
+                SWAP(Value *, ps.src, ps.dst);
+        }
+
+        if (ps.src != xs) {
+                memcpy(xs, ps.src, n * sizeof (Value));
+        }
+
+        gX();
+
+        mF(merges);
+        mF(runs);
+}
+
 inline static void
 shrink(Ty *ty, Value *v)
 {
@@ -143,6 +696,8 @@ array_pop(Ty *ty, Value *array, int argc, Value *kwargs)
 {
         ASSERT_ARGC("Array.pop()", 0, 1);
 
+        GCWrite(ty, array->array);
+
         Value v;
 
         if (argc == 0) {
@@ -232,6 +787,8 @@ array_splice(Ty *ty, Value *array, int argc, Value *kwargs)
         NOGC(slice);
 
         vvPn(*slice, vv(*array->array) + i, n);
+
+        GCWrite(ty, array->array);
         memmove(
                 vv(*array->array) + i,
                 vv(*array->array) + (i + n),
@@ -487,8 +1044,7 @@ array_sort(Ty *ty, Value *array, int argc, Value *kwargs)
                 if (!CALLABLE(*by)) {
                         zP("Array.sort(): `by` not callable: %s", VSC(by));
                 }
-                ctx.f = *by;
-                rqsort(array->array->items + i, n, sizeof (Value), compare_by, &ctx);
+                SortValuesOn(ty, array->array, i, n, by);
         } else if (cmp != NULL) {
                 if (!CALLABLE(*cmp)) {
                         zP("Array.sort(): `cmp` not callable: %s", VSC(cmp));
@@ -496,7 +1052,7 @@ array_sort(Ty *ty, Value *array, int argc, Value *kwargs)
                 ctx.f = *cmp;
                 rqsort(array->array->items + i, n, sizeof (Value), compare_by2, &ctx);
         } else {
-                rqsort(array->array->items + i, n, sizeof (Value), compare_default, ty);
+                SortValues(ty, array->array->items + i, n);
         }
 
         Value *desc = NAMED("desc");
@@ -558,6 +1114,7 @@ array_take_while_mut(Ty *ty, Value *array, int argc, Value *kwargs)
                 }
         }
 
+        GCWrite(ty, array->array);
         array->array->count = keep;
         shrink(ty, array);
 
@@ -612,6 +1169,7 @@ array_drop_while_mut(Ty *ty, Value *array, int argc, Value *kwargs)
                 else
                         break;
 
+        GCWrite(ty, array->array);
         memmove(array->array->items, array->array->items + drop, (array->array->count - drop) * sizeof (Value));
         array->array->count -= drop;
         shrink(ty, array);
@@ -671,11 +1229,13 @@ array_uniq(Ty *ty, Value *array, int argc, Value *kwargs)
                 Value *v = dict_put_key_if_not_exists(ty, d.dict, k);
                 if (v->type == VALUE_NIL) {
                         *v = e;
+                        GCWrite(ty, array->array);
                         array->array->items[n++] = e;
                 }
         }
 
         gX();
+        GCWrite(ty, array->array);
         array->array->count = n;
 
         return *array;
@@ -692,6 +1252,7 @@ array_take_mut(Ty *ty, Value *array, int argc, Value *kwargs)
         if (n.type != VALUE_INTEGER)
                 zP("non-integer passed to array.take!()");
 
+        GCWrite(ty, array->array);
         array->array->count = (n.z < 0) ? 0 : min(array->array->count, n.z);
         shrink(ty, array);
 
@@ -736,6 +1297,7 @@ array_drop_mut(Ty *ty, Value *array, int argc, Value *kwargs)
 
         int d = min(array->array->count, max(n.z, 0));
 
+        GCWrite(ty, array->array);
         memmove(array->array->items, array->array->items + d, (array->array->count - d) * sizeof (Value));
         array->array->count -= d;
         shrink(ty, array);
@@ -769,6 +1331,31 @@ array_drop(Ty *ty, Value *array, int argc, Value *kwargs)
         return result;
 }
 
+/*
+ * VALUE_INTEGER or VALUE_REAL if every element of the array is an untagged
+ * Int or every element is an untagged Float, otherwise VALUE_NONE. Those are
+ * the arrays sum(), min() and max() can work through without going back to
+ * the VM for each element: nothing can have overloaded the operators they'd
+ * use on them.
+ */
+inline static int
+NumericKind(Array const *a)
+{
+        int kind = v__(*a, 0).type;
+
+        if (kind != VALUE_INTEGER && kind != VALUE_REAL) {
+                return VALUE_NONE;
+        }
+
+        for (usize i = 1; i < vN(*a); ++i) {
+                if (v__(*a, i).type != kind) {
+                        return VALUE_NONE;
+                }
+        }
+
+        return kind;
+}
+
 static Value
 array_sum(Ty *ty, Value *array, int argc, Value *kwargs)
 {
@@ -791,6 +1378,24 @@ array_sum(Ty *ty, Value *array, int argc, Value *kwargs)
                 i0 = 1;
         }
 
+        int kind = NumericKind(array->array);
+
+        if (kind == VALUE_INTEGER && sum.type == VALUE_INTEGER) {
+                u64 z = sum.z;
+                for (isize i = i0; i < vN(*array->array); ++i) {
+                        z += v__(*array->array, i).z;
+                }
+                return INTEGER(z);
+        }
+
+        if (kind == VALUE_REAL && sum.type == VALUE_REAL) {
+                double x = sum.real;
+                for (isize i = i0; i < vN(*array->array); ++i) {
+                        x += v__(*array->array, i).real;
+                }
+                return REAL(x);
+        }
+
         Value val;
 
         for (isize i = i0; i < vN(*array->array); ++i) {
@@ -911,6 +1516,7 @@ array_groups_of(Ty *ty, Value *array, int argc, Value *kwargs)
                 NOGC(group);
                 vvPn(*group, array->array->items + i, size.z);
                 OKGC(group);
+                GCWrite(ty, array->array);
                 array->array->items[n++] = ARRAY(group);
                 i += size.z;
         }
@@ -920,9 +1526,11 @@ array_groups_of(Ty *ty, Value *array, int argc, Value *kwargs)
                 NOGC(last);
                 vvPn(*last, array->array->items + i, array->array->count - i);
                 OKGC(last);
+                GCWrite(ty, array->array);
                 array->array->items[n++] = ARRAY(last);
         }
 
+        GCWrite(ty, array->array);
         array->array->count = n;
         shrink(ty, array);
 
@@ -964,9 +1572,11 @@ array_group_by(Ty *ty, Value *array, int argc, Value *kwargs)
                 }
                 gX();
                 OKGC(group.array);
+                GCWrite(ty, array->array);
                 array->array->items[len++] = group;
         }
 
+        GCWrite(ty, array->array);
         array->array->count = len;
         shrink(ty, array);
 
@@ -990,9 +1600,11 @@ array_group(Ty *ty, Value *array, int argc, Value *kwargs)
                 while (i + 1 < array->array->count && value_test_equality(ty, &array->array->items[i], &array->array->items[i + 1]))
                         vAp(group.array, array->array->items[++i]);
                 OKGC(group.array);
+                GCWrite(ty, array->array);
                 array->array->items[len++] = group;
         }
 
+        GCWrite(ty, array->array);
         array->array->count = len;
         shrink(ty, array);
 
@@ -1041,6 +1653,24 @@ array_min(Ty *ty, Value *array, int argc, Value *kwargs)
         Value min, v;
         min = array->array->items[0];
 
+        switch (NumericKind(array->array)) {
+        case VALUE_INTEGER:
+                for (int i = 1; i < array->array->count; ++i) {
+                        if (array->array->items[i].z < min.z) {
+                                min = array->array->items[i];
+                        }
+                }
+                return min;
+
+        case VALUE_REAL:
+                for (int i = 1; i < array->array->count; ++i) {
+                        if (array->array->items[i].real < min.real) {
+                                min = array->array->items[i];
+                        }
+                }
+                return min;
+        }
+
         for (int i = 1; i < array->array->count; ++i) {
                 v = array->array->items[i];
                 if (value_compare(ty, &v, &min) < 0)
@@ -1120,6 +1750,26 @@ array_max(Ty *ty, Value *array, int argc, Value *kwargs)
         Value max, v;
         max = v__(*array->array, 0);
 
+        // Same as value_compare(): a NaN compares greater than anything
+        switch (NumericKind(array->array)) {
+        case VALUE_INTEGER:
+                for (int i = 1; i < vN(*array->array); ++i) {
+                        if (v__(*array->array, i).z > max.z) {
+                                max = v__(*array->array, i);
+                        }
+                }
+                return max;
+
+        case VALUE_REAL:
+                for (int i = 1; i < vN(*array->array); ++i) {
+                        double x = v__(*array->array, i).real;
+                        if (!(x < max.real) && x != max.real) {
+                                max = v__(*array->array, i);
+                        }
+                }
+                return max;
+        }
+
         for (int i = 1; i < vN(*array->array); ++i) {
                 v = v__(*array->array, i);
                 if (value_compare(ty, &v, &max) > 0) {
@@ -1222,6 +1872,7 @@ array_map(Ty *ty, Value *array, int argc, Value *kwargs)
         for (usize i = 0; i < n; ++i) {
                 Value x = v__(*array->array, i);
                 Value y = vm_call1(ty, &f, &x);
+                GCWrite(ty, array->array);
                 *v_(*array->array, i) = y;
         }
 
@@ -1240,6 +1891,7 @@ array_enumerate(Ty *ty, Value *array, int argc, Value *kwargs)
                         INTEGER(i),
                         v__(*array->array, i)
                 );
+                GCWrite(ty, array->array);
                 *v_(*array->array, i) =  entry;
         }
 
@@ -1256,10 +1908,14 @@ array_remove(Ty *ty, Value *array, int argc, Value *kwargs)
 
         int n = array->array->count;
         int j = 0;
-        for (int i = 0; i < n; ++i)
-                if (!value_test_equality(ty, &v, &array->array->items[i]))
+        for (int i = 0; i < n; ++i) {
+                if (!value_test_equality(ty, &v, &array->array->items[i])) {
+                        GCWrite(ty, array->array);
                         array->array->items[j++] = array->array->items[i];
+                }
+        }
 
+        GCWrite(ty, array->array);
         array->array->count = j;
         shrink(ty, array);
 
@@ -1278,10 +1934,12 @@ array_filter(Ty *ty, Value *array, int argc, Value *kwargs)
         for (usize i = 0; i < n0; ++i) {
                 Value x = v__(*array->array, i);
                 if (value_apply_predicate(ty, &pred, &x)) {
+                        GCWrite(ty, array->array);
                         *v_(*array->array, n++) = x;
                 }
         }
 
+        GCWrite(ty, array->array);
         vN(*array->array) = n;
         shrink(ty, array);
 
@@ -1927,6 +2585,7 @@ array_scan_left(Ty *ty, Value *array, int argc, Value *kwargs)
         for (usize i = 1; i < n; ++i) {
                 gP(&v);
                 v = vm_eval_function(ty, &f, &v, v_(*array->array, i), NULL);
+                GCWrite(ty, array->array);
                 *v_(*array->array, i) = v;
                 gX();
         }
@@ -1961,6 +2620,7 @@ array_scan_right(Ty *ty, Value *array, int argc, Value *kwargs)
         for (isize i = vN(*array->array) - 2; i >= 0; --i) {
                 gP(&v);
                 v = vm_eval_function(ty, &f, v_(*array->array, i), &v, NULL);
+                GCWrite(ty, array->array);
                 *v_(*array->array, i) = v;
                 gX();
         }
@@ -2077,12 +2737,7 @@ array_sort_on(Ty *ty, Value *array, int argc, Value *kwargs)
         if (array->array->count == 0)
                 return *array;
 
-        SortContext ctx = {
-                .f = f,
-                .ty = ty
-        };
-
-        rqsort(array->array->items, array->array->count, sizeof (Value), compare_by, &ctx);
+        SortValuesOn(ty, array->array, 0, vN(*array->array), &f);
 
         return *array;
 }
@@ -2110,6 +2765,169 @@ array_sort_by(Ty *ty, Value *array, int argc, Value *kwargs)
         return *array;
 }
 
+static Value
+array_psort(Ty *ty, Value *array, int argc, Value *kwargs)
+{
+        char const *_name__ = "Array.psort()";
+
+        CHECK_ARGC(0);
+
+        ParallelSortValues(ty, vv(*array->array), vN(*array->array));
+
+        Value *desc = NAMED("desc");
+
+        if (desc != NULL && value_truthy(ty, desc)) {
+                array_reverse(ty, array, 0, NULL);
+        }
+
+        return *array;
+}
+
+static Value
+array_pmap(Ty *ty, Value *array, int argc, Value *kwargs)
+{
+        char const *_name__ = "Array.pmap()";
+
+        CHECK_ARGC(1);
+
+        Value f = ARG(0);
+        if (!CALLABLE(f)) {
+                zP("Array.pmap(): non-function passed: %s", VSC(&f));
+        }
+
+        // Work from a copy so that f can't pull the array out from under
+        // the other workers
+        Value xs = ARRAY(ArrayClone(ty, array->array));
+        gP(&xs);
+
+        usize n = vN(*xs.array);
+        Array *ys = vAn(n);
+        Value out = ARRAY(ys);
+        gP(&out);
+
+        for (usize i = 0; i < n; ++i) {
+                vv(*ys)[i] = NIL;
+        }
+        vN(*ys) = n;
+
+        ParallelContext pc = {
+                .f = &f,
+                .xs = vv(*xs.array),
+                .out = vv(*ys),
+                .n = n
+        };
+
+        ParallelChunks(ty, n, ParallelMapTask, &pc);
+
+        gX();
+        gX();
+
+        return out;
+}
+static Value
+array_pfilter(Ty *ty, Value *array, int argc, Value *kwargs)
+{
+        char const *_name__ = "Array.pfilter()";
+
+        CHECK_ARGC(1);
+
+        Value pred = ARG(0);
+
+        Value xs = ARRAY(ArrayClone(ty, array->array));
+        gP(&xs);
+
+        usize n = vN(*xs.array);
+
+        ParallelContext pc = {
+                .f = &pred,
+                .xs = vv(*xs.array),
+                .keep = mA(max(n, 1) * sizeof (bool)),
+                .n = n
+        };
+
+        ParallelChunks(ty, n, ParallelFilterTask, &pc);
+
+        usize m = 0;
+        for (usize i = 0; i < n; ++i) {
+                if (pc.keep[i]) {
+                        *v_(*xs.array, m++) = v__(*xs.array, i);
+                }
+        }
+
+        vN(*xs.array) = m;
+        shrink(ty, &xs);
+
+        mF(pc.keep);
+
+        gX();
+
+        return xs;
+}
+
+/*
+ * Each chunk is folded on its own and the results are then folded together,
+ * starting from init, in order. So f has to be associative, but needn't be
+ * commutative.
+ */
+static Value
+array_preduce(Ty *ty, Value *array, int argc, Value *kwargs)
+{
+        char const *_name__ = "Array.preduce()";
+
+        CHECK_ARGC(1, 2);
+
+        Value f = ARG(0);
+        if (!CALLABLE(f)) {
+                zP("Array.preduce(): non-function passed: %s", VSC(&f));
+        }
+
+        Value xs = ARRAY(ArrayClone(ty, array->array));
+        gP(&xs);
+
+        usize n = vN(*xs.array);
+        usize nchunks = ChunkCount(n);
+
+        if (n == 0) {
+                gX();
+                if (argc == 1) {
+                        zP("Array.preduce(): empty array and no initial value");
+                }
+                return ARG(1);
+        }
+
+        Array *parts = vAn(nchunks);
+        Value pv = ARRAY(parts);
+        gP(&pv);
+
+        for (usize i = 0; i < nchunks; ++i) {
+                vv(*parts)[i] = NIL;
+        }
+        vN(*parts) = nchunks;
+
+        ParallelContext pc = {
+                .f = &f,
+                .xs = vv(*xs.array),
+                .out = vv(*parts),
+                .n = n
+        };
+
+        ParallelChunks(ty, n, ParallelReduceTask, &pc);
+
+        Value acc = (argc == 2) ? ARG(1) : v__(*parts, 0);
+        gP(&acc);
+
+        for (usize i = (argc == 2) ? 0 : 1; i < nchunks; ++i) {
+                acc = vm_eval_function(ty, &f, &acc, v_(*parts, i), NULL);
+                *vvL(RootSet) = acc;
+        }
+
+        gX();
+        gX();
+        gX();
+
+        return acc;
+}
+
 static Value
 array_clone(Ty *ty, Value *array, int argc, Value *kwargs)
 {
@@ -2160,6 +2978,7 @@ DEFINE_NO_MUT(sort_on);
 DEFINE_NO_MUT(uniq);
 DEFINE_NO_MUT(zip);
 DEFINE_NO_MUT(next_permutation);
+DEFINE_NO_MUT(psort);
 
 DEFINE_METHOD_TABLE(
         array,
@@ -2208,7 +3027,12 @@ DEFINE_METHOD_TABLE(
         { .name = "nextPermutation!",  .func = array_next_permutation        },
         { .name = "partition",         .func = array_partition_no_mut        },
         { .name = "partition!",        .func = array_partition               },
+        { .name = "pfilter",           .func = array_pfilter                 },
+        { .name = "pmap",              .func = array_pmap                    },
         { .name = "pop",               .func = array_pop                     },
+        { .name = "preduce",           .func = array_preduce                 },
+        { .name = "psort",             .func = array_psort_no_mut            },
+        { .name = "psort!",            .func = array_psort                   },
         { .name = "ptr",               .func = array_ptr                     },
         { .name = "push",              .func = array_push                    },
         { .name = "remove",            .func = array_remove_no_mut           },
@@ -549,7 +549,7 @@ blob_hex(Ty *ty, Value *blob, int argc, Value *kwargs)
         static char const digits[] = "0123456789abcdef";
 
         usize n = vN(*blob->blob);
-        u8 *str = mAo(n*2, GC_STRING);
+        u8 *str = value_string_alloc(ty, n*2);
 
         for (int i = 0; i < n; ++i) {
                 u8 b = v__(*blob->blob, i);
@@ -3,6 +3,8 @@
 #include "chan.h"
 #include "dict.h"
 #include "class.h"
+#include "finalize.h"
+#include "persist.h"
 
 typedef struct {
         iptr id;
@@ -11,6 +13,12 @@ typedef struct {
 
 typedef vec(SeenEntry) SeenVec;
 
+/*
+ * Set while a receiver in another thread group copies a persistent collection
+ * that was sent by reference, so that nested ones are copied too.
+ */
+static _Thread_local bool Copying;
+
 static inline usize
 qmask(Channel const *chan)
 {
@@ -45,6 +53,23 @@ basic(Value const *v)
         }
 }
 
+static int
+persistent(Value const *v)
+{
+        if (v->gcptr == NULL) {
+                return 0;
+        }
+
+        switch (ALLOC_OF(v->gcptr)->type) {
+        case GC_PERSIST_MAP:
+        case GC_PERSIST_VEC:
+                return ALLOC_OF(v->gcptr)->type;
+
+        default:
+                return 0;
+        }
+}
+
 static iptr
 ident(Value const *v)
 {
@@ -56,6 +81,7 @@ ident(Value const *v)
         case VALUE_QUEUE:   return (iptr)v->queue;
         case VALUE_TUPLE:   return (iptr)v->items;
         case VALUE_STRING:  return (iptr)v->str0;
+        case VALUE_PTR:     return persistent(v) ? (iptr)v->gcptr : -1;
         default:            return -1;
         }
 }
@@ -78,6 +104,75 @@ emit(Ty *ty, ValueVector *out, Value v)
         svP(*out, v);
 }
 
+static void
+Pin(Ty *ty, Value const *v)
+{
+        ThreadGroup *group = ty->group;
+
+        TySpinLockLock(&group->SentLock);
+        xvP(group->Sent, *v);
+        TySpinLockUnlock(&group->SentLock);
+}
+
+/*
+ * Releases one pin on p. The receiver may be in another group, and the
+ * sender's group may have run out of threads in the meantime, in which case
+ * the last pin to go frees it.
+ */
+static void
+Unpin(ThreadGroup *group, void const *p)
+{
+        TySpinLockLock(&group->SentLock);
+
+        for (usize i = 0; i < vN(group->Sent); ++i) {
+                if (v_(group->Sent, i)->gcptr == p) {
+                        *v_(group->Sent, i) = vXx(group->Sent);
+                        break;
+                }
+        }
+
+        bool last = group->Exited && vN(group->Sent) == 0;
+
+        TySpinLockUnlock(&group->SentLock);
+
+        if (last) {
+                vm_free_group(group);
+        }
+}
+
+/*
+ * Called by the collecting thread: whatever its threads have sent by reference
+ * and nobody has received yet is still live.
+ */
+void
+chan_mark(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        TySpinLockLock(&group->SentLock);
+
+        for (usize i = 0; i < vN(group->Sent); ++i) {
+                value_mark(ty, v_(group->Sent, i));
+        }
+
+        TySpinLockUnlock(&group->SentLock);
+}
+
+/*
+ * Called when the last thread in a group exits. Returns false if something it
+ * sent is still pinned, in which case the group is freed by Unpin() instead.
+ */
+bool
+chan_group_exit(ThreadGroup *group)
+{
+        TySpinLockLock(&group->SentLock);
+        group->Exited = (vN(group->Sent) > 0);
+        bool done = !group->Exited;
+        TySpinLockUnlock(&group->SentLock);
+
+        return done;
+}
+
 static void
 prepare(Ty *ty, ValueVector *out, SeenVec *sv, Value const *v)
 {
@@ -143,17 +238,24 @@ prepare(Ty *ty, ValueVector *out, SeenVec *sv, Value const *v)
         }
 
         case VALUE_TUPLE: {
-                i32 *ids = NULL;
-                if (v->ids != NULL) {
-                        ids = xmA(v->count * sizeof (i32));
-                        memcpy(ids, v->ids, v->count * sizeof (i32));
-                }
                 Value header = {
                         .type  = v->type,
                         .tags  = v->tags,
                         .count = v->count,
-                        .ids   = ids,
                 };
+                /*
+                 * Shared layouts go by pointer. Once the layout table is full,
+                 * the ids travel as a private copy (src = 1) like a string.
+                 */
+                if (v->ids == NULL) {
+                        header.ids = NULL;
+                } else if (tuple_layout_interned(v->ids)) {
+                        header.ids = v->ids;
+                } else if ((header.ids = tuple_layout_shared(v->ids, v->count)) == NULL) {
+                        header.ids = xmA(v->count * sizeof (i32));
+                        memcpy(header.ids, v->ids, v->count * sizeof (i32));
+                        header.src = 1;
+                }
                 emit(ty, out, header);
                 for (i32 i = 0; i < v->count; ++i) {
                         prepare(ty, out, sv, &v->items[i]);
@@ -165,10 +267,10 @@ prepare(Ty *ty, ValueVector *out, SeenVec *sv, Value const *v)
                 Value header = { .type = v->type, .tags = v->tags };
                 header.src = v->dict->count;
                 emit(ty, out, header);
-                for (DictItem *it = DictFirst(v->dict); it != NULL; it = it->next) {
-                        prepare(ty, out, sv, &it->k);
-                        prepare(ty, out, sv, &it->v);
-                }
+                dfor(v->dict, {
+                        prepare(ty, out, sv, key);
+                        prepare(ty, out, sv, val);
+                });
                 prepare(ty, out, sv, &v->dict->dflt);
                 break;
         }
@@ -205,12 +307,79 @@ prepare(Ty *ty, ValueVector *out, SeenVec *sv, Value const *v)
                 break;
         }
 
+        /*
+         * Persistent collections are immutable, so they're sent by reference
+         * (gcptr) and pinned in the sender's group until the message is
+         * received or dropped. A receiver in the same group takes the pointer
+         * as is. One in another group can't hold on to blocks owned by the
+         * sender's heap, so it copies the collection element by element.
+         */
+        case VALUE_PTR: {
+                int kind = persistent(v);
+                if (kind != 0 && !Copying) {
+                        Value header = {
+                                .type  = v->type,
+                                .tags  = v->tags,
+                                .ptr   = (void *)(uptr)kind,
+                                .gcptr = v->gcptr,
+                                .extra = ty->group,
+                        };
+                        Pin(ty, v);
+                        emit(ty, out, header);
+                } else if (kind == GC_PERSIST_MAP) {
+                        PersistMap const *m = v->gcptr;
+                        ValueVector kvs = {0};
+                        persist_map_flatten(ty, m, &kvs);
+                        Value header = { .type = v->type, .tags = v->tags, .ptr = (void *)(uptr)kind };
+                        header.src = m->count;
+                        emit(ty, out, header);
+                        for (usize i = 0; i < vN(kvs); ++i) {
+                                prepare(ty, out, sv, v_(kvs, i));
+                        }
+                } else if (kind == GC_PERSIST_VEC) {
+                        PersistVec const *pv = v->gcptr;
+                        Value header = { .type = v->type, .tags = v->tags, .ptr = (void *)(uptr)kind };
+                        header.src = pv->count;
+                        emit(ty, out, header);
+                        for (usize i = 0; i < pv->count; ++i) {
+                                prepare(ty, out, sv, persist_vec_get(pv, i));
+                        }
+                } else {
+                        emit(ty, out, NIL);
+                }
+                break;
+        }
+
         default:
                 emit(ty, out, NIL);
                 break;
         }
 }
 
+static Value
+reconstruct(Ty *ty, Value *msg, usize *cursor);
+
+static Value
+CopyShared(Ty *ty, void *p)
+{
+        Value v = GCPTR(p, p);
+        ValueVector out = {0};
+        SeenVec sv = {0};
+        usize cursor = 0;
+
+        SCRATCH_SAVE();
+
+        Copying = true;
+        prepare(ty, &out, &sv, &v);
+        Copying = false;
+
+        v = reconstruct(ty, vv(out), &cursor);
+
+        SCRATCH_RESTORE();
+
+        return v;
+}
+
 static Value
 reconstruct(Ty *ty, Value *msg, usize *cursor)
 {
@@ -271,13 +440,13 @@ reconstruct(Ty *ty, Value *msg, usize *cursor)
 
         case VALUE_TUPLE: {
                 i32 n = e.count;
-                Value *items = mAo(n * sizeof (Value), GC_TUPLE);
-                i32 *ids = NULL;
-                if (e.ids != NULL) {
-                        ids = mA(n * sizeof (i32));
+                i32 *ids = e.ids;
+                if (e.src == 1) {
+                        ids = mAo(n * sizeof (i32), GC_ANY);
                         memcpy(ids, e.ids, n * sizeof (i32));
                         xmF(e.ids);
                 }
+                Value *items = mAo(n * sizeof (Value), GC_TUPLE);
                 Value r = TUPLE(items, ids, n, true);
                 r.type = e.type;
                 r.tags = e.tags;
@@ -310,6 +479,9 @@ reconstruct(Ty *ty, Value *msg, usize *cursor)
                 TyObject *obj = uAo0(size, GC_OBJECT);
                 obj->class = class_get(ty, e.class);
                 obj->nslot = nslot;
+                if (UNLIKELY(obj->class->finalizer.type != VALUE_NONE)) {
+                        finalize_register(ty, obj);
+                }
                 Value r = OBJECT(obj, e.class);
                 r.type = e.type;
                 r.tags = e.tags;
@@ -338,11 +510,350 @@ reconstruct(Ty *ty, Value *msg, usize *cursor)
                 return r;
         }
 
+        case VALUE_PTR: {
+                usize slot = *cursor - 1;
+                usize n = e.src;
+                Value r;
+                if (e.gcptr != NULL) {
+                        r = (e.extra == ty->group)
+                          ? GCPTR(e.gcptr, e.gcptr)
+                          : CopyShared(ty, e.gcptr);
+                        Unpin(e.extra, e.gcptr);
+                        r.type = e.type;
+                        r.tags = e.tags;
+                        msg[slot] = r;
+                        return r;
+                }
+                SCRATCH_SAVE();
+                if ((uptr)e.ptr == GC_PERSIST_MAP) {
+                        ValueVector kvs = {0};
+                        for (usize i = 0; i < 2 * n; ++i) {
+                                svP(kvs, reconstruct(ty, msg, cursor));
+                        }
+                        PersistMap *m = persist_map_new(ty, vv(kvs), n);
+                        r = GCPTR(m, m);
+                } else {
+                        ValueVector xs = {0};
+                        for (usize i = 0; i < n; ++i) {
+                                svP(xs, reconstruct(ty, msg, cursor));
+                        }
+                        PersistVec *v = persist_vec_new(ty, vv(xs), n);
+                        r = GCPTR(v, v);
+                }
+                SCRATCH_RESTORE();
+                r.type = e.type;
+                r.tags = e.tags;
+                msg[slot] = r;
+                return r;
+        }
+
         default:
                 return NIL;
         }
 }
 
+static void
+discard(Value *msg, usize *cursor);
+
+static Value *
+pack(Ty *ty, Value const *v)
+{
+        ValueVector out = {0};
+        SeenVec sv = {0};
+        Value *msg;
+        usize n;
+
+        WITH_SCRATCH {
+                prepare(ty, &out, &sv, v);
+                n = vN(out);
+                msg = xmA(n * sizeof (Value));
+                memcpy(msg, vv(out), n * sizeof (Value));
+        }
+
+        return msg;
+}
+
+static void
+unpack(Ty *ty, Value *msg, Value *v)
+{
+        CheckUsed(ty);
+        GC_STOP();
+
+        usize cursor = 0;
+        *v = reconstruct(ty, msg, &cursor);
+
+        GC_RESUME();
+
+        xmF(msg);
+}
+
+static void
+drop(Value *msg)
+{
+        usize cursor = 0;
+        discard(msg, &cursor);
+        xmF(msg);
+}
+
+/*
+ * Bounded channels
+ *
+ * The ring is Dmitry Vyukov's bounded MPMC queue, with sequence numbers
+ * counted in turns so that any capacity works (including 1, where Vyukov's
+ * original can't tell a full slot from an empty one). Position pos lives in
+ * slot pos % bound on lap pos / bound. A sender that has claimed pos (by
+ * moving enq from pos to pos + 1) may fill the slot once its seq is 2 * lap,
+ * and then sets it to 2 * lap + 1; a receiver that has claimed pos from deq
+ * may empty the slot once its seq is 2 * lap + 1, and then sets it to
+ * 2 * lap + 2, which is the next lap's sender's turn. So every send and
+ * receive is one CAS on its own end of the ring, and senders and receivers
+ * never contend with each other.
+ *
+ * A thread only parks when the ring is full (senders) or empty (receivers).
+ * It counts itself in parked[] and then checks again under m before waiting,
+ * and the other side checks parked[] after every successful operation and
+ * takes m before signalling, so a wakeup can't be lost in between.
+ */
+
+static inline ChanSlot *
+slot(Channel *chan, usize pos)
+{
+        return &chan->ring[pos % chan->bound];
+}
+
+// The seq a slot has when it's side's turn at pos
+static inline usize
+turn(Channel const *chan, usize pos, int side)
+{
+        return 2 * (pos / chan->bound) + (side == CHAN_RECV);
+}
+
+static bool
+ring_take(Channel *chan, int side, usize *claimed)
+{
+        _Atomic(usize) *end = (side == CHAN_RECV) ? &chan->deq : &chan->enq;
+        usize pos = atomic_load_explicit(end, memory_order_relaxed);
+
+        for (;;) {
+                usize seq = atomic_load_explicit(&slot(chan, pos)->seq, memory_order_acquire);
+                isize diff = (isize)(seq - turn(chan, pos, side));
+
+                if (diff == 0) {
+                        if (atomic_compare_exchange_weak_explicit(
+                                end,
+                                &pos,
+                                pos + 1,
+                                memory_order_relaxed,
+                                memory_order_relaxed
+                        )) {
+                                *claimed = pos;
+                                return true;
+                        }
+                } else if (diff < 0) {
+                        return false;
+                } else {
+                        pos = atomic_load_explicit(end, memory_order_relaxed);
+                }
+        }
+}
+
+static bool
+ring_push(Channel *chan, Value *msg)
+{
+        usize pos;
+
+        if (!ring_take(chan, CHAN_SEND, &pos)) {
+                return false;
+        }
+
+        ChanSlot *s = slot(chan, pos);
+        s->msg = msg;
+        atomic_store_explicit(&s->seq, turn(chan, pos, CHAN_SEND) + 1, memory_order_release);
+
+        return true;
+}
+
+static bool
+ring_pop(Channel *chan, Value **msg)
+{
+        usize pos;
+
+        if (!ring_take(chan, CHAN_RECV, &pos)) {
+                return false;
+        }
+
+        ChanSlot *s = slot(chan, pos);
+        *msg = s->msg;
+        atomic_store_explicit(&s->seq, turn(chan, pos, CHAN_RECV) + 1, memory_order_release);
+
+        return true;
+}
+
+// Whether a receiver (CHAN_RECV) or sender (CHAN_SEND) could go ahead now
+static bool
+ring_ready(Channel *chan, int side)
+{
+        _Atomic(usize) *end = (side == CHAN_RECV) ? &chan->deq : &chan->enq;
+        usize pos = atomic_load_explicit(end, memory_order_acquire);
+        usize seq = atomic_load_explicit(&slot(chan, pos)->seq, memory_order_acquire);
+
+        return (isize)(seq - turn(chan, pos, side)) >= 0;
+}
+
+static inline TyCondVar *
+ring_cond(Channel *chan, int side)
+{
+        return (side == CHAN_RECV) ? &chan->c : &chan->space;
+}
+
+static void
+ring_wake(Channel *chan, int side)
+{
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (atomic_load_explicit(&chan->parked[side], memory_order_relaxed) != 0) {
+                TyMutexLock(&chan->m);
+                TyMutexUnlock(&chan->m);
+                TyCondVarSignal(ring_cond(chan, side));
+        }
+}
+
+/*
+ * Waits until side might be able to go ahead, the channel is closed, or the
+ * deadline (a TyMonotonicTime(), or UINT64_MAX for none) passes. Returns false
+ * in the last case, without waiting.
+ */
+static bool
+ring_park(Ty *ty, Channel *chan, int side, u64 deadline)
+{
+        bool ok = true;
+
+        UnlockTy();
+        TyMutexLock(&chan->m);
+
+        atomic_fetch_add_explicit(&chan->waiters, 1, memory_order_acq_rel);
+        atomic_fetch_add_explicit(&chan->parked[side], 1, memory_order_seq_cst);
+
+        if (atomic_load(&chan->open) && !ring_ready(chan, side)) {
+                if (deadline == UINT64_MAX) {
+                        TyCondVarWait(ring_cond(chan, side), &chan->m);
+                } else {
+                        u64 now = TyMonotonicTime();
+                        if (now >= deadline) {
+                                ok = false;
+                        } else {
+                                TyCondVarTimedWaitRelative(
+                                        ring_cond(chan, side),
+                                        &chan->m,
+                                        (deadline - now + TY_1e6 - 1) / TY_1e6
+                                );
+                        }
+                }
+        }
+
+        atomic_fetch_sub_explicit(&chan->parked[side], 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&chan->waiters, 1, memory_order_acq_rel);
+
+        TyMutexUnlock(&chan->m);
+        LockTy();
+
+        return ok;
+}
+
+static inline u64
+deadline_after(u64 timeout)
+{
+        return (timeout == (u64)-1) ? UINT64_MAX : TyMonotonicTime() + TY_1e6 * timeout;
+}
+
+static bool
+ring_send(Ty *ty, Channel *chan, Value *msg, u64 timeout)
+{
+        u64 deadline = 0;
+
+        for (;;) {
+                if (!atomic_load(&chan->open)) {
+                        return false;
+                }
+
+                if (ring_push(chan, msg)) {
+                        ring_wake(chan, CHAN_RECV);
+                        return true;
+                }
+
+                if (timeout == 0) {
+                        return false;
+                }
+
+                if (deadline == 0) {
+                        deadline = deadline_after(timeout);
+                }
+
+                if (!ring_park(ty, chan, CHAN_SEND, deadline)) {
+                        return false;
+                }
+        }
+}
+
+static bool
+ring_recv(Ty *ty, Channel *chan, Value *v, u64 timeout)
+{
+        u64 deadline = 0;
+        Value *msg;
+
+        for (;;) {
+                // Read before trying so that a close can't hide a message
+                // that was sent before it
+                bool open = atomic_load(&chan->open);
+
+                if (ring_pop(chan, &msg)) {
+                        ring_wake(chan, CHAN_SEND);
+                        unpack(ty, msg, v);
+                        return true;
+                }
+
+                if (!open || timeout == 0) {
+                        return false;
+                }
+
+                if (deadline == 0) {
+                        deadline = deadline_after(timeout);
+                }
+
+                if (!ring_park(ty, chan, CHAN_RECV, deadline)) {
+                        return false;
+                }
+        }
+}
+
+Channel *
+chan_new(Ty *ty, usize bound)
+{
+        Channel *chan = mAo0(sizeof *chan, GC_CHANNEL);
+
+        atomic_init(&chan->open, true);
+        atomic_init(&chan->waiters, 0);
+        atomic_init(&chan->parked[CHAN_RECV], 0);
+        atomic_init(&chan->parked[CHAN_SEND], 0);
+        atomic_init(&chan->enq, 0);
+        atomic_init(&chan->deq, 0);
+
+        TyCondVarInit(&chan->c);
+        TyCondVarInit(&chan->space);
+        TyMutexInit(&chan->m);
+
+        if (bound > 0) {
+                chan->ring  = xmA(bound * sizeof (ChanSlot));
+                chan->bound = bound;
+                for (usize i = 0; i < bound; ++i) {
+                        atomic_init(&chan->ring[i].seq, 0);
+                        chan->ring[i].msg = NULL;
+                }
+        }
+
+        return chan;
+}
+
 static void
 enqueue(Channel *chan, Value *msg)
 {
@@ -356,7 +867,7 @@ enqueue(Channel *chan, Value *msg)
                         buf[i] = chan->items[(chan->head + i) & qmask(chan)];
                 }
 
-                mrealloc(chan->items, 0);
+                xmF(chan->items);
                 chan->items = buf;
                 chan->head  = 0;
                 chan->tail  = n;
@@ -370,16 +881,13 @@ enqueue(Channel *chan, Value *msg)
 void
 chan_send(Ty *ty, Channel *chan, Value v)
 {
-        ValueVector out = {0};
-        SeenVec sv = {0};
-        Value *msg;
-        usize n;
+        Value *msg = pack(ty, &v);
 
-        WITH_SCRATCH {
-                prepare(ty, &out, &sv, &v);
-                n = vN(out);
-                msg = xmA(n * sizeof (Value));
-                memcpy(msg, vv(out), n * sizeof (Value));
+        if (chan->ring != NULL) {
+                if (!ring_send(ty, chan, msg, (u64)-1)) {
+                        drop(msg);
+                }
+                return;
         }
 
         UnlockTy();
@@ -392,6 +900,35 @@ chan_send(Ty *ty, Channel *chan, Value v)
         LockTy();
 }
 
+/*
+ * Like chan_send(), but gives up if a bounded channel is still full after
+ * timeout ms (right away for 0) or is closed. Unbounded channels never
+ * refuse a message.
+ */
+bool
+chan_try_send(Ty *ty, Channel *chan, Value v, u64 timeout)
+{
+        if (chan->ring == NULL) {
+                chan_send(ty, chan, v);
+                return true;
+        }
+
+        // Don't bother copying the message if it's obviously not going in
+        if (!atomic_load(&chan->open) || (timeout == 0 && !ring_ready(chan, CHAN_SEND))) {
+                return false;
+        }
+
+        Value *msg = pack(ty, &v);
+
+        if (ring_send(ty, chan, msg, timeout)) {
+                return true;
+        }
+
+        drop(msg);
+
+        return false;
+}
+
 static bool
 dequeue(Ty *ty, Channel *chan, Value *v)
 {
@@ -409,15 +946,7 @@ dequeue(Ty *ty, Channel *chan, Value *v)
         TyMutexUnlock(&chan->m);
         LockTy();
 
-        CheckUsed(ty);
-        GC_STOP();
-
-        usize cursor = 0;
-        *v = reconstruct(ty, msg, &cursor);
-
-        GC_RESUME();
-
-        xmF(msg);
+        unpack(ty, msg, v);
 
         return true;
 }
@@ -425,6 +954,10 @@ dequeue(Ty *ty, Channel *chan, Value *v)
 bool
 chan_recv(Ty *ty, Channel *chan, Value *v)
 {
+        if (chan->ring != NULL) {
+                return ring_recv(ty, chan, v, (u64)-1);
+        }
+
         UnlockTy();
         TyMutexLock(&chan->m);
         atomic_fetch_add_explicit(&chan->waiters, 1, memory_order_acq_rel);
@@ -439,6 +972,10 @@ chan_recv(Ty *ty, Channel *chan, Value *v)
 bool
 chan_try_recv(Ty *ty, Channel *chan, Value *v, i64 timeout)
 {
+        if (chan->ring != NULL) {
+                return ring_recv(ty, chan, v, timeout);
+        }
+
         UnlockTy();
         TyMutexLock(&chan->m);
         atomic_fetch_add_explicit(&chan->waiters, 1, memory_order_acq_rel);
@@ -467,7 +1004,9 @@ discard(Value *msg, usize *cursor)
                 break;
 
         case VALUE_TUPLE:
-                xmF(e.ids);
+                if (e.src == 1) {
+                        xmF(e.ids);
+                }
                 for (i32 i = 0; i < e.count; ++i) {
                         discard(msg, cursor);
                 }
@@ -491,34 +1030,67 @@ discard(Value *msg, usize *cursor)
                         discard(msg, cursor);
                 }
                 break;
+
+        case VALUE_PTR:
+                if (e.gcptr != NULL) {
+                        Unpin(e.extra, e.gcptr);
+                } else if ((uptr)e.ptr == GC_PERSIST_MAP) {
+                        for (usize i = 0; i < 2 * e.src; ++i) {
+                                discard(msg, cursor);
+                        }
+                } else if ((uptr)e.ptr == GC_PERSIST_VEC) {
+                        for (usize i = 0; i < e.src; ++i) {
+                                discard(msg, cursor);
+                        }
+                }
+                break;
         }
 }
 
+void
+chan_close(Ty *ty, Channel *chan)
+{
+        UnlockTy();
+        TyMutexLock(&chan->m);
+        atomic_store(&chan->open, false);
+        TyMutexUnlock(&chan->m);
+        TyCondVarBroadcast(&chan->c);
+        TyCondVarBroadcast(&chan->space);
+        LockTy();
+}
+
 void
 chan_destroy(Ty *ty, Channel *chan)
 {
         TyMutexLock(&chan->m);
-        chan->open = false;
+        atomic_store(&chan->open, false);
         usize n = chan->cap ? qcount(chan) : 0;
         usize h = chan->head;
         chan->head = chan->tail = 0;
         TyMutexUnlock(&chan->m);
 
         TyCondVarBroadcast(&chan->c);
+        TyCondVarBroadcast(&chan->space);
 
         while (atomic_load_explicit(&chan->waiters, memory_order_acquire) != 0) {
                 ;
         }
 
         for (usize i = 0; i < n; ++i) {
-                Value *msg = chan->items[(h + i) & qmask(chan)];
-                usize cursor = 0;
-                discard(msg, &cursor);
-                xmF(msg);
+                drop(chan->items[(h + i) & qmask(chan)]);
+        }
+
+        if (chan->ring != NULL) {
+                Value *msg;
+                while (ring_pop(chan, &msg)) {
+                        drop(msg);
+                }
+                xmF(chan->ring);
         }
 
         TyMutexDestroy(&chan->m);
         TyCondVarDestroy(&chan->c);
+        TyCondVarDestroy(&chan->space);
         xmF(chan->items);
 }
 
@@ -10,6 +10,7 @@
 #include "vec.h"
 #include "itable.h"
 #include "class.h"
+#include "finalize.h"
 #include "types.h"
 #include "ty.h"
 #include "jit.h"
@@ -49,6 +50,7 @@ static char const *BuiltinClassNames[] = {
         [CLASS_TIMEOUT_ERROR]   = "TimeoutError",
         [CLASS_CANCELED_ERROR]  = "CanceledError",
         [CLASS_OS_ERROR]        = "OSError",
+        [CLASS_MEMORY_ERROR]    = "MemoryError",
         [CLASS_FLOAT]           = "Float",
         [CLASS_FUNCTION]        = "Function",
         [CLASS_GENERATOR]       = "Generator",
@@ -225,6 +227,10 @@ class_new_instance(Ty *ty, int class)
                 obj->slots[i] = NIL;
         }
 
+        if (UNLIKELY(c->finalizer.type != VALUE_NONE)) {
+                finalize_register(ty, obj);
+        }
+
         return obj;
 }
 
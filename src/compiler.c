@@ -90,6 +90,7 @@ enum {
 #define Eu1(x)   avP(STATE.code, !!(x))
 #define ES(x, b) emit_statement(ty, (x), (b))
 #define EP(p)    emit_symbol(ty, (uptr)(p))
+#define EOS()    emit_symbol(ty, (uptr)alloc0(sizeof (OpSite)))
 #define EC(x)    emit_constraint(ty, (x))
 #define EA(x)    emit_assertion(ty, (x))
 
@@ -353,6 +354,11 @@ enum {
         LV_PROTO = (1 << 3)
 };
 
+typedef struct {
+        Expr const *expr;
+        u32 link;
+} SourceSlot;
+
 bool SuggestCompletions = false;
 bool FindDefinition = false;
 int QueryLine;
@@ -373,7 +379,9 @@ static CompileState STATE;
 static ModuleVector modules;
 static vec(ProgramAnnotation) annotations;
 static vec(location_vector) location_lists;
-static vec(Expr const *) source_map;
+static vec(SourceSlot) source_map;
+static u32 source_free;
+static TySpinLock SourceLock;
 static JumpGroup PreludeAssertionOffsets;
 static Module *MainModule;
 static Module *GlobalModule;
@@ -951,8 +959,37 @@ IsRangeExpr(Expr const *expr)
 }
 
 inline static bool
-IsSimpleRange(Expr const *expr)
+IsIntExpr(Ty *ty, Expr const *expr)
+{
+        Class const *c = type_guess_class_of(ty, expr->_type);
+        return (c != NULL) && (c->i == CLASS_INT);
+}
+
+/*
+ * a.upto(b) and a.downto(b), when a and b are known to be Ints
+ */
+inline static bool
+IsCountingCall(Ty *ty, Expr const *expr)
+{
+        return (expr->type == EXPRESSION_METHOD_CALL)
+            && (
+                        s_eq(expr->method->identifier, "upto")
+                     || s_eq(expr->method->identifier, "downto")
+               )
+            && (vN(expr->method_args) == 1)
+            && (vN(expr->method_kwargs) == 0)
+            && !expr->maybe
+            && IsIntExpr(ty, expr->object)
+            && IsIntExpr(ty, v__(expr->method_args, 0));
+}
+
+inline static bool
+IsSimpleRange(Ty *ty, Expr const *expr)
 {
+        if (IsCountingCall(ty, expr)) {
+                return true;
+        }
+
         if (
                 (expr->type == EXPRESSION_MEMBER_ACCESS)
              && s_eq(expr->member->identifier, "rev")
@@ -964,10 +1001,10 @@ IsSimpleRange(Expr const *expr)
 }
 
 inline static bool
-IsRangeLoop(Stmt const *loop)
+IsRangeLoop(Ty *ty, Stmt const *loop)
 {
         return (loop->type == STATEMENT_EACH_LOOP)
-            && IsSimpleRange(loop->each.array);
+            && IsSimpleRange(ty, loop->each.array);
 
 }
 
@@ -6837,16 +6874,30 @@ emit_string(Ty *ty, char const *s)
         avPn(STATE.code, s, size);
 }
 
-inline static void
-emit_string_literal(Ty *ty, char const *s)
+/*
+ * The names in xD.strings are laid out by value_string_literal(), so the
+ * strings the VM makes out of them come with their hash already computed.
+ */
+static InternEntry *
+intern_string_literal(char const *s, usize n)
 {
         InternEntry *interned = intern_get(&xD.strings, s);
 
         if (interned->id < 0) {
-                interned = intern_put(interned, (void *)(uptr)strlen(s));
+                char *name = value_string_literal(s, n);
+                interned = intern_put_as(interned, name, (void *)(uptr)n);
+                if (interned->name != name) {
+                        xmF((StringTrailer *)name - 1);
+                }
         }
 
-        Ei32(interned->id);
+        return interned;
+}
+
+inline static void
+emit_string_literal(Ty *ty, char const *s)
+{
+        Ei32(intern_string_literal(s, strlen(s))->id);
 }
 
 #ifndef TY_NO_LOG
@@ -9342,8 +9393,7 @@ str_table_insert(Ty *ty, StrMatchSlot *table, int tsize, Expr const *p, int arm)
                 bucket = (bucket + 1) & (u32)(tsize - 1);
         }
 
-        InternEntry *ie = intern_get(&xD.strings, s);
-        if (ie->id < 0) ie = intern_put(ie, (void *)(uptr)len);
+        InternEntry *ie = intern_string_literal(s, len);
 
         table[bucket].intern_id = ie->id;
         table[bucket].arm_index = arm;
@@ -10193,7 +10243,7 @@ BeginComprehensionLoop(
         ComprPart const *part
 )
 {
-        if (IsSimpleRange(part->iter)) {
+        if (IsSimpleRange(ty, part->iter)) {
                 Expr *range = part->iter;
                 Expr *i = v_0(part->pattern->es);
                 RangeLoop loop = BeginRangeLoop(ty, 1, false, range, i);
@@ -10269,7 +10319,7 @@ EndComprehensionLoop(
         ComprPart const *part
 )
 {
-        if (IsSimpleRange(part->iter)) {
+        if (IsSimpleRange(ty, part->iter)) {
                 RangeLoop *loop = &vvX(*stack)->loop;
                 EndRangeLoop(ty, loop);
         } else {
@@ -10442,17 +10492,27 @@ BeginRangeLoop(
         bool reverse;
         bool inclusive;
 
-        if (range->type == EXPRESSION_MEMBER_ACCESS) {
-                range = range->object;
-                reverse = true;
+        Expr *start;
+        Expr *stop;
+
+        if (range->type == EXPRESSION_METHOD_CALL) {
+                reverse = s_eq(range->method->identifier, "downto");
+                inclusive = true;
+                start = range->object;
+                stop = v__(range->method_args, 0);
         } else {
-                reverse = false;
-        }
+                if (range->type == EXPRESSION_MEMBER_ACCESS) {
+                        range = range->object;
+                        reverse = true;
+                } else {
+                        reverse = false;
+                }
 
-        inclusive = (range->type == EXPRESSION_DOT_DOT_DOT);
+                inclusive = (range->type == EXPRESSION_DOT_DOT_DOT);
 
-        Expr *start = !reverse ? range->left  : range->right;
-        Expr *stop  = !reverse ? range->right : range->left;
+                start = !reverse ? range->left  : range->right;
+                stop  = !reverse ? range->right : range->left;
+        }
 
         Expr zero = { .type = EXPRESSION_INTEGER, .integer = 0,          ._type = INT_TYPE };
         Expr inf  = { .type = EXPRESSION_INTEGER, .integer = INTMAX_MAX, ._type = INT_TYPE };
@@ -10466,19 +10526,16 @@ BeginRangeLoop(
                 INSN(DEC);
         }
 
-        begin_loop(ty, want_result, 2 + n);
-        LABEL(begin);
+        u8 kind = reverse   ? RANGE_LOOP_DOWN
+                : inclusive ? RANGE_LOOP_UP_INCLUSIVE
+                :             RANGE_LOOP_UP;
 
-        INSN(DUP2_SWAP);
+        begin_loop(ty, want_result, 2 + n);
 
-        JumpPlaceholder end;
+        JumpPlaceholder end = (PLACEHOLDER_JUMP)(ty, INSTR_FOR_RANGE);
+        Eu8(kind);
 
-        switch ((reverse << 1) | inclusive) {
-        case 0: end = (PLACEHOLDER_JUMP)(ty, INSTR_JGE); break;
-        case 1: end = (PLACEHOLDER_JUMP)(ty, INSTR_JGT); break;
-        case 2:
-        case 3: end = (PLACEHOLDER_JUMP)(ty, INSTR_JLT); break;
-        }
+        LABEL(begin);
 
         emit_assignment2(ty, target, false, true);
 
@@ -10487,6 +10544,7 @@ BeginRangeLoop(
                 .stop      = stop,
                 .begin     = begin,
                 .end       = end,
+                .kind      = kind,
                 .inclusive = inclusive,
                 .reverse   = reverse
         };
@@ -10521,9 +10579,10 @@ EndRangeLoop(Ty *ty, RangeLoop *loop)
         LABEL(next);
         loop->next = next;
 
-        INSNx(!loop->reverse ? INSTR_INC : INSTR_DEC);
-
-        JUMP(loop->begin);
+        annotate("%sL%d%s", TERM1(95), loop->begin.label + 1, TERM1(0));
+        INSN(RANGE_NEXT);
+        Ei32(loop->begin.off - vN(STATE.code) - sizeof (int));
+        Eu8(loop->kind);
 
         if (loop->_while != NULL) {
                 PATCH_JUMP(loop->exit);
@@ -11258,14 +11317,26 @@ emit_expr(Ty *ty, Expr const *e, bool need_loc)
 
         case EXPRESSION_MEMBER_ACCESS:
         case EXPRESSION_SELF_ACCESS:
+        {
+                i32 slot = e->maybe ? -1 : type_record_slot(
+                        ty,
+                        e->object->_type,
+                        e->member->identifier
+                );
                 EE(e->object);
                 if (e->maybe) {
                         INSN(TRY_MEMBER_ACCESS);
+                } else if (slot != -1) {
+                        INSN(RECORD_MEMBER);
                 } else {
                         INSN(MEMBER_ACCESS);
                 }
                 EM(e->member->identifier);
+                if (slot != -1) {
+                        Ei32(slot);
+                }
                 break;
+        }
 
         case EXPRESSION_SUBSCRIPT:
                 if (e->subscript->type == EXPRESSION_LIST) {
@@ -11379,18 +11450,21 @@ emit_expr(Ty *ty, Expr const *e, bool need_loc)
                 EE(e->right);
                 INSN(BINARY_OP);
                 Ei32(intern(&xD.b_ops, e->op_name)->id);
+                EOS();
                 break;
 
         case EXPRESSION_BIT_OR:
                 EE(e->left);
                 EE(e->right);
                 INSN(BIT_OR);
+                EOS();
                 break;
 
         case EXPRESSION_BIT_AND:
                 EE(e->left);
                 EE(e->right);
                 INSN(BIT_AND);
+                EOS();
                 break;
 
         case EXPRESSION_TYPE_UNION:
@@ -11398,6 +11472,7 @@ emit_expr(Ty *ty, Expr const *e, bool need_loc)
                         EE(v__(e->es, i));
                         if (i > 0) {
                                 INSN(BIT_OR);
+                                EOS();
                         }
                 }
                 break;
@@ -11427,48 +11502,56 @@ emit_expr(Ty *ty, Expr const *e, bool need_loc)
                 EE(e->left);
                 EE(e->right);
                 INSN(ADD);
+                EOS();
                 break;
 
         case EXPRESSION_MINUS:
                 EE(e->left);
                 EE(e->right);
                 INSN(SUB);
+                EOS();
                 break;
 
         case EXPRESSION_STAR:
                 EE(e->left);
                 EE(e->right);
                 INSN(MUL);
+                EOS();
                 break;
 
         case EXPRESSION_DIV:
                 EE(e->left);
                 EE(e->right);
                 INSN(DIV);
+                EOS();
                 break;
 
         case EXPRESSION_SHL:
                 EE(e->left);
                 EE(e->right);
                 INSN(SHL);
+                EOS();
                 break;
 
         case EXPRESSION_SHR:
                 EE(e->left);
                 EE(e->right);
                 INSN(SHR);
+                EOS();
                 break;
 
         case EXPRESSION_XOR:
                 EE(e->left);
                 EE(e->right);
                 INSN(BIT_XOR);
+                EOS();
                 break;
 
         case EXPRESSION_PERCENT:
                 EE(e->left);
                 EE(e->right);
                 INSN(MOD);
+                EOS();
                 break;
 
         case EXPRESSION_AND:
@@ -11682,14 +11765,17 @@ emit_expr(Ty *ty, Expr const *e, bool need_loc)
                 if (simple) {
                         i32 *ids;
                         if (names) {
-                                ids = mA(vN(e->names) * sizeof (i32));
+                                i32Vector layout = {0};
+                                SCRATCH_SAVE();
                                 for (int i = 0; i < vN(e->names); ++i) {
                                         if (v__(e->names, i) != NULL) {
-                                                ids[i] = M_ID(v__(e->names, i));
+                                                svP(layout, M_ID(v__(e->names, i)));
                                         } else {
-                                                ids[i] = -1;
+                                                svP(layout, -1);
                                         }
                                 }
+                                ids = tuple_layout(vv(layout), vN(layout));
+                                SCRATCH_RESTORE();
                         } else {
                                 ids = NULL;
                         }
@@ -11865,7 +11951,7 @@ emit_statement(Ty *ty, Stmt const *s, bool want_result)
                 break;
 
         case STATEMENT_EACH_LOOP:
-                if (IsRangeLoop(s)) {
+                if (IsRangeLoop(ty, s)) {
                         emit_range_loop(ty, s, want_result);
                 } else {
                         emit_for_each(ty, s, want_result);
@@ -13739,6 +13825,7 @@ void
 compiler_init(Ty *ty)
 {
         tags_init(ty);
+        TySpinLockInit(&SourceLock);
 
         m0(null);
         null.type = STATEMENT_NULL;
@@ -13776,6 +13863,7 @@ compiler_init(Ty *ty)
         class_set_super(ty, CLASS_TIMEOUT_ERROR,  CLASS_RUNTIME_ERROR);
         class_set_super(ty, CLASS_CANCELED_ERROR, CLASS_RUNTIME_ERROR);
         class_set_super(ty, CLASS_OS_ERROR,       CLASS_RUNTIME_ERROR);
+        class_set_super(ty, CLASS_MEMORY_ERROR,   CLASS_RUNTIME_ERROR);
 
         class_set_super(ty, CLASS_ITER, CLASS_ITERABLE);
         class_set_super(ty, CLASS_TAG, CLASS_FUNCTION);
@@ -14357,19 +14445,43 @@ inline static char *
         return str;
 }
 
+/*
+ * Values built from AST nodes carry a u32 index into source_map so that the
+ * node (and through it, the arena it lives in) can be recovered later. Free
+ * slots are threaded through `link` as a free list, and the live slots whose
+ * node belongs to a GC arena are threaded through `link` as a per-arena chain
+ * rooted in the arena header, so both registering a node and forgetting all
+ * of an arena's nodes when it is swept are O(1) per node.
+ */
 u32
 source_register(Ty *ty, void const *src)
 {
-        for (u32 i = 0; i < vN(source_map); ++i) {
-                if (v__(source_map, i) == NULL) {
-                        *v_(source_map, i) = (Expr const *)src;
-                        return i + 1;
-                }
+        Expr const *e = src;
+        u32 id;
+
+        TySpinLockLock(&SourceLock);
+
+        if (source_free != 0) {
+                id = source_free;
+                source_free = v_(source_map, id - 1)->link;
+        } else {
+                xvP(source_map, (SourceSlot){0});
+                id = vN(source_map);
+        }
+
+        SourceSlot *slot = v_(source_map, id - 1);
+        slot->expr = e;
+        slot->link = 0;
+
+        if (e->arena != NULL) {
+                ArenaHeader *arena = e->arena;
+                slot->link = arena->sources;
+                arena->sources = id;
         }
 
-        xvP(source_map, (Expr const *)src);
+        TySpinLockUnlock(&SourceLock);
 
-        return vN(source_map);
+        return id;
 }
 
 void *
@@ -14378,21 +14490,39 @@ source_lookup(Ty *ty, u32 src)
         if (src == 0 || src > vN(source_map)) {
                 return NULL;
         } else {
-                return (void *)v__(source_map, src - 1);
+                return (void *)v_(source_map, src - 1)->expr;
         }
 }
 
 void
-ForgetSourceNodesFrom(void const *_base, usize len)
+ForgetSourceNodesFrom(void const *base)
 {
-        uptr base = (uptr)_base;
+        ArenaHeader const *arena = base;
+        u32 id = arena->sources;
+
+        if (id == 0) {
+                return;
+        }
+
+        TySpinLockLock(&SourceLock);
 
-        for (u32 i = 0; i < vN(source_map); ++i) {
-                uptr expr = (uptr)v__(source_map, i);
-                if (expr >= base && expr < base + len) {
-                        v__(source_map, i) = NULL;
+        /*
+         * The chain can outlive source_map across a CompilerReset(), so stop at
+         * the first slot that no longer belongs to this arena.
+         */
+        while (id != 0 && id <= vN(source_map)) {
+                SourceSlot *slot = v_(source_map, id - 1);
+                if (slot->expr == NULL || slot->expr->arena != base) {
+                        break;
                 }
+                u32 next = slot->link;
+                slot->expr = NULL;
+                slot->link = source_free;
+                source_free = id;
+                id = next;
         }
+
+        TySpinLockUnlock(&SourceLock);
 }
 
 #define t_(t, i) ((t_)(ty, (t), (uptr)(i)))
@@ -19283,6 +19413,11 @@ DumpProgram(
                 CASE(SKIP_CHECK)
                         READVALUE(n);
                         break;
+                CASE(FOR_RANGE)
+                CASE(RANGE_NEXT)
+                        READVALUE(n);
+                        c += 1;
+                        break;
                 CASE(TARGET_GLOBAL)
                 CASE(ASSIGN_GLOBAL)
                         READVALUE(n);
@@ -19694,6 +19829,10 @@ DumpProgram(
                 CASE(MEMBER_ACCESS)
                         READMEMBER(n);
                         break;
+                CASE(RECORD_MEMBER)
+                        READMEMBER(n);
+                        READVALUE(n);
+                        break;
                 CASE(STATIC_MEMBER_ACCESS)
                         READCLASS(i);
                 CASE(SELF_MEMBER_ACCESS)
@@ -19710,11 +19849,6 @@ DumpProgram(
                 CASE(QUESTION)
                 CASE(NEG)
                 CASE(COUNT)
-                CASE(ADD)
-                CASE(SUB)
-                CASE(MUL)
-                CASE(DIV)
-                CASE(MOD)
                 CASE(EQ)
                 CASE(NEQ)
                 CASE(CHECK_MATCH)
@@ -19741,14 +19875,22 @@ DumpProgram(
                 CASE(MUT_XOR)
                 CASE(MUT_SHL)
                 CASE(MUT_SHR)
+                        break;
+                CASE(ADD)
+                CASE(SUB)
+                CASE(MUL)
+                CASE(DIV)
+                CASE(MOD)
                 CASE(BIT_OR)
                 CASE(BIT_AND)
                 CASE(BIT_XOR)
                 CASE(SHL)
                 CASE(SHR)
+                        READVALUE_(s);
                         break;
                 CASE(BINARY_OP)
                         READVALUE_(n);
+                        READVALUE_(s);
                         DUMPSTR(intern_entry(&xD.b_ops, n)->name);
                         break;
                 CASE(UNARY_OP)
@@ -20281,6 +20423,7 @@ CompilerReset(Ty *ty)
         v0(annotations);
         v0(location_lists);
         v0(source_map);
+        source_free = 0;
         v0(PreludeAssertionOffsets);
 
         MainModule      = NULL;
@@ -1,6 +1,12 @@
 #include <string.h>
 #include <stdbool.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "ty.h"
 #include "alloc.h"
 #include "xd.h"
@@ -10,9 +16,10 @@
 #include "vm.h"
 #include "gc.h"
 #include "vec.h"
+#include "weak.h"
 
 #define INITIAL_SIZE 8
-#define NO_SUCH_SPOT SIZE_MAX
+#define NOT_FOUND    (-1)
 
 #define ENSURE_INIT(d) do {      \
         if ((d)->size == 0) {    \
@@ -20,230 +27,486 @@
         }                        \
 } while (0)
 
-#define V_IS_EMPTY(v) ((v)->type == 0)
-#define V_IS_TOMB(v)  ((v)->type == VALUE_TOMBSTONE)
+#define USED(d)    ((d)->count + (d)->tombs)
+#define DEAD(d, i) DictItemDead(&(d)->items[i])
+
+/*
+ * Slots hold an entry's index plus one, so that zero can mean empty. The
+ * narrowest width that can hold DICT_USABLE(size) + 1 is used.
+ */
+inline static usize
+IndexWidth(usize size)
+{
+        return (size <= (1ULL <<  8)) ? 1
+             : (size <= (1ULL << 16)) ? 2
+             : (size <= (1ULL << 32)) ? 4
+             :                          8;
+}
+
+/*
+ * Tables with at least SWISS_MIN slots also get a control byte per slot, laid
+ * out between the entries and the slots, and are probed a group of GROUP
+ * control bytes at a time (see SwissFind()). Below that the whole table stays
+ * in cache and plain Robin Hood probing is as fast.
+ */
+#define SWISS_MIN (1ULL << 12)
+#define GROUP     16
+
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xFE
+
+inline static bool
+Swiss(usize size)
+{
+        return size >= SWISS_MIN;
+}
+
+inline static usize
+CtrlBytes(usize size)
+{
+        // The first group is mirrored past the end so that any GROUP bytes
+        // starting at a valid position can be loaded at once
+        return Swiss(size) ? size + GROUP : 0;
+}
+
+inline static usize
+IndexBytes(usize size)
+{
+        return CtrlBytes(size) + size * IndexWidth(size);
+}
+
+inline static usize
+TableBytes(usize size)
+{
+        return DICT_USABLE(size) * sizeof (DictItem) + IndexBytes(size);
+}
 
-#define IS_EMPTY(d, i) V_IS_EMPTY(&(d)->items[i].k)
-#define IS_TOMB(d, i)  V_IS_TOMB(&(d)->items[i].k)
-#define OCCUPIED(d, i) ((i != NO_SUCH_SPOT) && !IS_EMPTY(d, i) && !IS_TOMB(d, i))
+inline static u8 *
+ctrl(Dict const *d)
+{
+        return (u8 *)d->index - CtrlBytes(d->size);
+}
 
 inline static void
-initxd(Ty *ty, Dict *d)
+layout(Dict *d, DictItem *items, usize size)
 {
-        NOGC(d);
-        d->items = mA0(sizeof (DictItem) * INITIAL_SIZE);
-        d->size  = INITIAL_SIZE;
-        OKGC(d);
+        d->items = items;
+        d->index = (u8 *)(items + DICT_USABLE(size)) + CtrlBytes(size);
+        d->size  = size;
 }
 
-inline static Value *
-val(Dict *d, usize i)
+inline static void
+reset_index(Dict *d)
 {
-        return &d->items[i].v;
+        memset(ctrl(d), CTRL_EMPTY, CtrlBytes(d->size));
+        memset(d->index, 0, d->size * IndexWidth(d->size));
 }
 
-inline static bool
-should_rehash(Dict *d)
+inline static usize
+slot(Dict const *d, usize i)
 {
-        return (4 * (d->count + d->tombs) >= 3 * d->size);
+        switch (IndexWidth(d->size)) {
+        case 1:  return ((u8  const *)d->index)[i];
+        case 2:  return ((u16 const *)d->index)[i];
+        case 4:  return ((u32 const *)d->index)[i];
+        default: return ((u64 const *)d->index)[i];
+        }
+}
+
+inline static void
+set_slot(Dict *d, usize i, usize x)
+{
+        switch (IndexWidth(d->size)) {
+        case 1:  ((u8  *)d->index)[i] = x; break;
+        case 2:  ((u16 *)d->index)[i] = x; break;
+        case 4:  ((u32 *)d->index)[i] = x; break;
+        default: ((u64 *)d->index)[i] = x; break;
+        }
 }
 
 inline static usize
-find_spot(
-        Ty *ty,
-        usize size,
-        DictItem const *items,
-        u64 h,
-        Value const *k
-) {
-        if (size == 0) {
-                return NO_SUCH_SPOT;
-        }
-
-        usize mask = size - 1;
-        usize i = h & mask;
+distance(Dict const *d, usize i, usize e)
+{
+        usize mask = d->size - 1;
+        return (i - (d->items[e].h & mask)) & mask;
+}
+
+/*
+ * Group matching: a bitmask with one set bit per matching control byte, the
+ * bit for byte i being at i << GROUP_SHIFT.
+ */
+#if defined(__SSE2__)
+#define GROUP_SHIFT 0
+
+inline static u64
+GroupMatch(u8 const *g, u8 c)
+{
+        __m128i x = _mm_loadu_si128((__m128i const *)g);
+        return (u16)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8((char)c)));
+}
+
+inline static u64
+GroupMatchFree(u8 const *g)
+{
+        return (u16)_mm_movemask_epi8(_mm_loadu_si128((__m128i const *)g));
+}
+#elif defined(__ARM_NEON)
+#define GROUP_SHIFT 2
+
+inline static u64
+NeonMask(uint8x16_t x)
+{
+        uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(x), 4);
+        return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888ULL;
+}
+
+inline static u64
+GroupMatch(u8 const *g, u8 c)
+{
+        return NeonMask(vceqq_u8(vld1q_u8(g), vdupq_n_u8(c)));
+}
+
+inline static u64
+GroupMatchFree(u8 const *g)
+{
+        return NeonMask(vcltzq_s8(vreinterpretq_s8_u8(vld1q_u8(g))));
+}
+#else
+#define GROUP_SHIFT 0
+
+inline static u64
+GroupMatch(u8 const *g, u8 c)
+{
+        u64 m = 0;
+        for (int i = 0; i < GROUP; ++i) {
+                m |= (u64)(g[i] == c) << i;
+        }
+        return m;
+}
+
+inline static u64
+GroupMatchFree(u8 const *g)
+{
+        u64 m = 0;
+        for (int i = 0; i < GROUP; ++i) {
+                m |= (u64)(g[i] >> 7) << i;
+        }
+        return m;
+}
+#endif
 
-        usize tomb = NO_SUCH_SPOT;
+#define GROUP_BIT(m) ((usize)__builtin_ctzll(m) >> GROUP_SHIFT)
 
-        while (!V_IS_EMPTY(&items[i].k)) {
-                if (items[i].h == h && v_eq(&items[i].k, k)) {
-                        return i;
+// The low bits of a hash pick the first group; the top 7 go in the control byte
+inline static u8
+H2(u64 h)
+{
+        return h >> 57;
+}
+
+inline static void
+set_ctrl(Dict *d, usize i, u8 c)
+{
+        u8 *cs = ctrl(d);
+        cs[i] = c;
+        cs[((i - GROUP) & (d->size - 1)) + GROUP] = c;
+}
+
+/*
+ * Groups are visited in triangular order (pos, pos + 1G, pos + 3G, ...) which
+ * covers every group of a power-of-two table. Only slots whose control byte
+ * matches the hash's top 7 bits are looked at, and a group with an empty slot
+ * ends the search.
+ */
+inline static isize
+SwissFind(Ty *ty, Dict const *d, u64 h, Value const *k)
+{
+        u8 const *cs = ctrl(d);
+        usize mask = d->size - 1;
+        usize pos = h & mask;
+        u8 h2 = H2(h);
+
+        for (usize stride = GROUP; ; pos = (pos + stride) & mask, stride += GROUP) {
+                u8 const *g = cs + pos;
+                for (u64 m = GroupMatch(g, h2); m != 0; m &= m - 1) {
+                        usize e = slot(d, (pos + GROUP_BIT(m)) & mask) - 1;
+                        DictItem const *it = &d->items[e];
+                        if (it->h == h && v_eq(&it->k, k)) {
+                                return e;
+                        }
                 }
-                if (tomb == -1 && V_IS_TOMB(&items[i].k)) {
-                        tomb = i;
+                if (GroupMatch(g, CTRL_EMPTY) != 0) {
+                        return NOT_FOUND;
                 }
-                i = (i + 1) & mask;
         }
-
-        return (tomb != NO_SUCH_SPOT) ? tomb : i;
 }
 
 inline static void
-linkxd(Dict *d, usize i)
+SwissPlace(Dict *d, usize e)
 {
-        if (d->items[i].next != NULL) {
-                d->items[i].next->prev = &d->items[i];
-        } else {
-                d->last = &d->items[i];
+        u8 const *cs = ctrl(d);
+        usize mask = d->size - 1;
+        u64 h = d->items[e].h;
+        usize pos = h & mask;
+
+        for (usize stride = GROUP; ; pos = (pos + stride) & mask, stride += GROUP) {
+                u64 m = GroupMatchFree(cs + pos);
+                if (m != 0) {
+                        usize i = (pos + GROUP_BIT(m)) & mask;
+                        set_ctrl(d, i, H2(h));
+                        set_slot(d, i, e + 1);
+                        return;
+                }
         }
-        if (d->items[i].prev != NULL) {
-                d->items[i].prev->next = &d->items[i];
+}
+
+inline static void
+SwissDelete(Dict *d, usize e)
+{
+        u8 const *cs = ctrl(d);
+        usize mask = d->size - 1;
+        u64 h = d->items[e].h;
+        usize pos = h & mask;
+
+        for (usize stride = GROUP; ; pos = (pos + stride) & mask, stride += GROUP) {
+                for (u64 m = GroupMatch(cs + pos, H2(h)); m != 0; m &= m - 1) {
+                        usize i = (pos + GROUP_BIT(m)) & mask;
+                        if (slot(d, i) == e + 1) {
+                                set_ctrl(d, i, CTRL_DELETED);
+                                set_slot(d, i, 0);
+                                return;
+                        }
+                }
         }
 }
 
 inline static void
-swap(Dict *d, usize i, usize j)
+initxd(Ty *ty, Dict *d)
 {
-        SWAP(DictItem, d->items[i], d->items[j]);
+        NOGC(d);
+        layout(d, mA(TableBytes(INITIAL_SIZE)), INITIAL_SIZE);
+        reset_index(d);
+        OKGC(d);
+}
 
-        if (d->items[i].next == &d->items[i]) { d->items[i].next = &d->items[j]; }
-        if (d->items[i].prev == &d->items[i]) { d->items[i].prev = &d->items[j]; }
-        if (d->items[j].next == &d->items[j]) { d->items[j].next = &d->items[i]; }
-        if (d->items[j].prev == &d->items[j]) { d->items[j].prev = &d->items[i]; }
+inline static Value *
+val(Dict *d, isize e)
+{
+        return &d->items[e].v;
+}
 
-        linkxd(d, i);
-        linkxd(d, j);
+/*
+ * Robin Hood probing over the index: an entry never sits further from its
+ * home slot than the one before it, so a lookup can stop at the first slot
+ * whose entry is closer to home than the probe has come.
+ */
+inline static isize
+find(Ty *ty, Dict const *d, u64 h, Value const *k)
+{
+        if (d->size == 0) {
+                return NOT_FOUND;
+        }
+
+        if (Swiss(d->size)) {
+                return SwissFind(ty, d, h, k);
+        }
+
+        usize mask = d->size - 1;
+        usize i = h & mask;
+
+        for (usize dist = 0; ; ++dist, i = (i + 1) & mask) {
+                usize x = slot(d, i);
+                if (x == 0 || distance(d, i, x - 1) < dist) {
+                        return NOT_FOUND;
+                }
+                DictItem const *it = &d->items[x - 1];
+                if (it->h == h && v_eq(&it->k, k)) {
+                        return x - 1;
+                }
+        }
 }
 
-inline static Value *
-robinhood(Ty *ty, Dict *d, usize i)
+inline static void
+place(Dict *d, usize e)
 {
-        usize size = d->size;
-        usize mask = size - 1;
-        DictItem *items = d->items;
+        if (Swiss(d->size)) {
+                SwissPlace(d, e);
+                return;
+        }
 
-        usize lo = items[i].h & mask;
-        usize hi = i;
+        usize mask = d->size - 1;
+        usize i = d->items[e].h & mask;
+        usize x = e + 1;
 
-        while (lo != hi) {
-                u64 lo_h = items[lo].h;
-                u64 hi_h = items[hi].h;
+        for (usize dist = 0; ; ++dist, i = (i + 1) & mask) {
+                usize y = slot(d, i);
+                if (y == 0) {
+                        set_slot(d, i, x);
+                        return;
+                }
+                usize their = distance(d, i, y - 1);
+                if (their < dist) {
+                        set_slot(d, i, x);
+                        x = y;
+                        dist = their;
+                }
+        }
+}
 
-                usize lo_ideal = lo_h & mask;
-                usize hi_ideal = hi_h & mask;
+/*
+ * Builds a table with `size` slots holding src's live entries, in order, and
+ * installs it in dst; dst and src can be the same dict. When there's nothing
+ * to compact and the size doesn't change, both halves are straight copies.
+ */
+inline static void
+retable(Ty *ty, Dict *dst, Dict const *src, usize size)
+{
+        DictItem *items = mA(TableBytes(size));
+        u8 *index = (u8 *)(items + DICT_USABLE(size));
 
-                usize lo_dist = (lo + size - lo_ideal) & mask;
-                usize hi_dist = (hi + size - hi_ideal) & mask;
+        usize count = src->count;
+        bool dense = (src->tombs == 0);
+        bool same = dense && (size == src->size);
 
-                if (hi_dist > lo_dist) {
-                        swap(d, lo, hi);
-                        if (hi == i) {
-                                i = lo;
+        if (dense) {
+                memcpy(items, src->items, count * sizeof (DictItem));
+        } else {
+                DictItem *it = items;
+                for (usize i = 0; i < USED(src); ++i) {
+                        if (!DEAD(src, i)) {
+                                *it++ = src->items[i];
                         }
                 }
+        }
 
-                lo = (lo + 1) & mask;
+        if (same) {
+                memcpy(index, ctrl(src), IndexBytes(size));
         }
 
-        return val(d, i);
+        layout(dst, items, size);
+
+        dst->count = count;
+        dst->tombs = 0;
+
+        if (!same) {
+                reset_index(dst);
+                for (usize e = 0; e < count; ++e) {
+                        place(dst, e);
+                }
+        }
 }
 
 inline static void
-rehash(Ty *ty, Dict *d, usize size)
+rehash(Ty *ty, Dict *d)
 {
-        DictItem *items = mA0(size * sizeof (DictItem));
-        DictItem *last = NULL;
+        DictItem *old = d->items;
+
+        // Only grow if compacting wouldn't leave at least half the room free
+        usize size = (2 * d->count >= DICT_USABLE(d->size))
+                   ? 2 * d->size
+                   : d->size;
+
+        retable(ty, d, d, size);
+
+        mF(old);
+}
 
-        DictItem *it = d->last;
+// Backward-shift deletion: the rest of the run is pulled one slot closer to
+// home so that no tombstones are needed in a Robin Hood index
+inline static void
+RobinDelete(Dict *d, usize e)
+{
+        usize mask = d->size - 1;
+        usize i = d->items[e].h & mask;
 
-        while (it != NULL && it->prev != NULL) {
-                it = it->prev;
+        while (slot(d, i) != e + 1) {
+                i = (i + 1) & mask;
         }
 
-        while (it != NULL) {
-                usize i = find_spot(ty, size, items, it->h, &it->k);
-                if (last != NULL) {
-                        last->next = &items[i];
+        for (;;) {
+                usize j = (i + 1) & mask;
+                usize x = slot(d, j);
+                if (x == 0 || distance(d, j, x - 1) == 0) {
+                        break;
                 }
-                items[i].k = it->k;
-                items[i].v = it->v;
-                items[i].h = it->h;
-                items[i].prev = last;
-                last = &items[i];
-                it = it->next;
+                set_slot(d, i, x);
+                i = j;
         }
 
-        mF(d->items);
-
-        d->items = items;
-        d->last  = last;
-        d->tombs = 0;
-        d->size  = size;
+        set_slot(d, i, 0);
 }
 
-inline static usize
-delete(Dict *d, usize i)
+inline static void
+delete(Ty *ty, Dict *d, usize e)
 {
-        if (d->items[i].next != NULL) {
-                d->items[i].next->prev = d->items[i].prev;
+        GCWrite(ty, d);
+
+        bool swiss = Swiss(d->size);
+
+        if (swiss) {
+                SwissDelete(d, e);
         } else {
-                d->last = d->items[i].prev;
-        }
-        if (d->items[i].prev != NULL) {
-                d->items[i].prev->next = d->items[i].next;
+                RobinDelete(d, e);
         }
 
-        m0(d->items[i]);
-        d->items[i].k.type = VALUE_TOMBSTONE;
+        m0(d->items[e]);
+        d->items[e].k.type = VALUE_TOMBSTONE;
 
         d->count -= 1;
         d->tombs += 1;
 
-        return i;
+        // A Swiss index keeps a DELETED control byte for each dead entry, and
+        // those are only cleared by a rehash, so its dead entries have to stay
+        // counted until then too
+        while (!swiss && d->tombs > 0 && DEAD(d, USED(d) - 1)) {
+                d->tombs -= 1;
+        }
 }
 
 inline static Value *
-put(Ty *ty, Dict *d, usize i, u64 h, Value k, Value v)
+put(Ty *ty, Dict *d, u64 h, Value k, Value v)
 {
         ENSURE_INIT(d);
 
-        if (should_rehash(d)) {
-                rehash(ty, d, d->size * 2);
-                i = find_spot(ty, d->size, d->items, h, &k);
+        if (USED(d) == DICT_USABLE(d->size)) {
+                rehash(ty, d);
         }
 
-        if (IS_TOMB(d, i)) {
-                d->tombs -= 1;
-        }
+        usize e = USED(d);
 
-        if (d->last != NULL) {
-                d->last->next = &d->items[i];
-        }
-
-        d->items[i].k = k;
-        d->items[i].v = v;
-        d->items[i].h = h;
-
-        d->items[i].prev = d->last;
-        d->items[i].next = NULL;
-        d->last = &d->items[i];
+        d->items[e].k = k;
+        d->items[e].v = v;
+        d->items[e].h = h;
 
         d->count += 1;
 
-        return robinhood(ty, d, i);
+        place(d, e);
+
+        return val(d, e);
 }
 
 Value *
 dict_get_value(Ty *ty, Dict *d, Value *key)
 {
         u64 h = value_hash(ty, key);
-        usize i = find_spot(ty, d->size, d->items, h, key);
+        isize e = find(ty, d, h, key);
 
-        if (OCCUPIED(d, i)) {
-                return val(d, i);
+        if (e != NOT_FOUND) {
+                weak_dict_read(ty, d, val(d, e));
+                return val(d, e);
         }
 
         if (d->dflt.type != VALUE_ZERO) {
                 GC_STOP();
-                ENSURE_INIT(d);
                 Value dflt = vm_call1(ty, &d->dflt, key);
-                i = find_spot(ty, d->size, d->items, h, key);
-                if (OCCUPIED(d, i)) {
-                        d->items[i].v = dflt;
+                e = find(ty, d, h, key);
+                if (e != NOT_FOUND) {
+                        GCWrite(ty, d);
+                        d->items[e].v = dflt;
                         GC_RESUME();
-                        return val(d, i);
+                        return val(d, e);
                 }
-                Value *v = put(ty, d, i, h, *key, dflt);
+                Value *v = put(ty, d, h, *key, dflt);
                 GC_RESUME();
                 return v;
         }
@@ -254,72 +517,68 @@ dict_get_value(Ty *ty, Dict *d, Value *key)
 bool
 dict_has_value(Ty *ty, Dict *d, Value *key)
 {
-        if (d->size == 0) {
+        if (d->count == 0) {
                 return false;
         }
 
         u64 h = value_hash(ty, key);
-        usize i = find_spot(ty, d->size, d->items, h, key);
 
-        return OCCUPIED(d, i);
+        return find(ty, d, h, key) != NOT_FOUND;
 }
 
 void
 dict_put_value(Ty *ty, Dict *d, Value key, Value value)
 {
-        ENSURE_INIT(d);
-
         u64 h = value_hash(ty, &key);
-        usize i = find_spot(ty, d->size, d->items, h, &key);
+        isize e = find(ty, d, h, &key);
 
-        if (OCCUPIED(d, i)) {
-                d->items[i].v = value;
+        if (e != NOT_FOUND) {
+                GCWrite(ty, d);
+                d->items[e].v = value;
         } else {
-                put(ty, d, i, h, key, value);
+                put(ty, d, h, key, value);
         }
 }
 
 Value *
 dict_put_value_with(Ty *ty, Dict *d, Value key, Value v, Value const *f)
 {
-        ENSURE_INIT(d);
-
         u64 h = value_hash(ty, &key);
-        usize i = find_spot(ty, d->size, d->items, h, &key);
+        isize e = find(ty, d, h, &key);
 
-        if (OCCUPIED(d, i)) {
-                d->items[i].v = vm_eval_function(ty, f, &d->items[i].v, &v, NULL);
-                return val(d, i);
+        if (e != NOT_FOUND) {
+                v = vm_eval_function(ty, f, &d->items[e].v, &v, NULL);
+                GCWrite(ty, d);
+                d->items[e].v = v;
+                return val(d, e);
         } else {
-                return put(ty, d, i, h, key, v);
+                return put(ty, d, h, key, v);
         }
 }
 
 Value *
 dict_put_key_if_not_exists(Ty *ty, Dict *d, Value key)
 {
-        ENSURE_INIT(d);
-
         u64 h = value_hash(ty, &key);
-        usize i = find_spot(ty, d->size, d->items, h, &key);
+        isize e = find(ty, d, h, &key);
 
-        if (OCCUPIED(d, i)) {
-                return val(d, i);
+        if (e != NOT_FOUND) {
+                return val(d, e);
         }
 
         Value v;
 
         if (d->dflt.type != VALUE_ZERO) {
                 v = vm_call1(ty, &d->dflt, &key);
-                i = find_spot(ty, d->size, d->items, h, &key);
-                if (OCCUPIED(d, i)) {
-                        return val(d, i);
+                e = find(ty, d, h, &key);
+                if (e != NOT_FOUND) {
+                        return val(d, e);
                 }
         } else {
                 v = NIL;
         }
 
-        return put(ty, d, i, h, key, v);
+        return put(ty, d, h, key, v);
 }
 
 Value *
@@ -353,6 +612,10 @@ dict_mark(Ty *ty, Dict *d)
                 xvP(ty->marking, &d->dflt);
         }
 
+        if (UNLIKELY(ALLOC_OF(d)->type == GC_WEAK_DICT)) {
+                return;
+        }
+
 #if defined(TY_TRACE_GC)
         if (d->size > 0) {
                 ADD_REACHED(ALLOC_OF(d->items)->size);
@@ -365,6 +628,38 @@ dict_mark(Ty *ty, Dict *d)
         });
 }
 
+/*
+ * The entries of a weak dict aren't traced by dict_mark(); weak_process()
+ * calls this repeatedly once the rest of the heap has been marked, and each
+ * call traces the entries whose keys have turned out to be reachable. Returns
+ * the number of such entries.
+ */
+usize
+dict_mark_ephemerons(Ty *ty, Dict *d)
+{
+        usize live = 0;
+
+        for (usize i = 0; i < USED(d); ++i) {
+                if (!DEAD(d, i) && value_is_marked(&d->items[i].k)) {
+                        value_mark(ty, &d->items[i].k);
+                        value_mark(ty, &d->items[i].v);
+                        live += 1;
+                }
+        }
+
+        return live;
+}
+
+void
+dict_sweep_weak(Ty *ty, Dict *d)
+{
+        for (usize i = 0; i < USED(d); ++i) {
+                if (!DEAD(d, i) && !value_is_marked(&d->items[i].k)) {
+                        delete(ty, d, i);
+                }
+        }
+}
+
 void
 dict_free(Ty *ty, Dict *d)
 {
@@ -384,6 +679,7 @@ dict_default(Ty *ty, Value *d, int argc, Value *kwargs)
                 }
         }
 
+        GCWrite(ty, d->dict);
         d->dict->dflt = ARG(0);
 
         return *d;
@@ -394,15 +690,7 @@ dict_contains(Ty *ty, Value *d, int argc, Value *kwargs)
 {
         ASSERT_ARGC("Dict.contains()", 1);
 
-        if (d->dict->size == 0) {
-                return BOOLEAN(false);
-        }
-
-        Value *key = &ARG(0);
-        u64 h = value_hash(ty, key);
-        usize i = find_spot(ty, d->dict->size, d->dict->items, h, key);
-
-        return BOOLEAN(OCCUPIED(d->dict, i));
+        return BOOLEAN(dict_has_value(ty, d->dict, &ARG(0)));
 }
 
 static Value
@@ -411,7 +699,10 @@ dict_keys(Ty *ty, Value *d, int argc, Value *kwargs)
         ASSERT_ARGC("Dict.keys()", 0);
 
         Array *keys = vAn(d->dict->count);
-        dfor(d->dict, vPx(*keys, *key));
+        dfor(d->dict, {
+                vPx(*keys, *key);
+                weak_dict_read(ty, d->dict, key);
+        });
 
         return ARRAY(keys);
 }
@@ -422,7 +713,10 @@ dict_values(Ty *ty, Value *d, int argc, Value *kwargs)
         ASSERT_ARGC("Dict.values()", 0);
 
         Array *values = vAn(d->dict->count);
-        dfor(d->dict, vPx(*values, *val));
+        dfor(d->dict, {
+                vPx(*values, *val);
+                weak_dict_read(ty, d->dict, val);
+        });
 
         return ARRAY(values);
 }
@@ -435,7 +729,11 @@ dict_items(Ty *ty, Value *d, int argc, Value *kwargs)
         Array *items = vAn(d->dict->count);
         Value result = ARRAY(items);
         gP(&result);
-        dfor(d->dict, vPx(*items, PAIR(*key, *val)));
+        dfor(d->dict, {
+                vPx(*items, PAIR(*key, *val));
+                weak_dict_read(ty, d->dict, key);
+                weak_dict_read(ty, d->dict, val);
+        });
         gX();
 
         return result;
@@ -447,9 +745,12 @@ DictClone(Ty *ty, Dict const *d)
         Dict *new = dict_new(ty);
         new->dflt = d->dflt;
 
-        NOGC(new);
-        dfor(d, dict_put_value(ty, new, *key, *val));
-        OKGC(new);
+        if (d->count > 0) {
+                NOGC(new);
+                retable(ty, new, d, d->size);
+                OKGC(new);
+                weak_dict_read(ty, d, NULL);
+        }
 
         return new;
 }
@@ -468,22 +769,11 @@ dict_same_keys(Ty *ty, Dict const *d, Dict const *u)
                 return false;
         }
 
-        for (usize i = 0; i < d->size;) {
-                if (!OCCUPIED(d, i)) {
-                        i += 1;
-                        continue;
-                }
-                usize j = find_spot(
-                        ty,
-                        u->size,
-                        u->items,
-                        d->items[i].h,
-                        &d->items[i].k
-                );
-                if (!OCCUPIED(u, j)) {
+        for (usize i = 0; i < USED(d); ++i) {
+                DictItem const *it = &d->items[i];
+                if (!DictItemDead(it) && find(ty, u, it->h, &it->k) == NOT_FOUND) {
                         return false;
                 }
-                i += 1;
         }
 
         return true;
@@ -492,28 +782,16 @@ dict_same_keys(Ty *ty, Dict const *d, Dict const *u)
 inline static void
 copy_unique(Ty *ty, Dict *diff, Dict const *d, Dict const *u)
 {
-        ENSURE_INIT(diff);
-
-        for (usize i = 0; i < d->size; ++i) {
-                if (!OCCUPIED(d, i)) {
-                        continue;
-                }
-                usize j = find_spot(
-                        ty,
-                        u->size,
-                        u->items,
-                        d->items[i].h,
-                        &d->items[i].k
-                );
-                if (!OCCUPIED(u, j)) {
-                        usize k = find_spot(
-                                ty,
-                                diff->size,
-                                diff->items,
-                                d->items[i].h,
-                                &d->items[i].k
-                        );
-                        put(ty, diff, k, d->items[i].h, d->items[i].k, d->items[i].v);
+        for (usize i = 0; i < USED(d); ++i) {
+                DictItem const *it = &d->items[i];
+                if (
+                        !DictItemDead(it)
+                     && find(ty, u, it->h, &it->k) == NOT_FOUND
+                     && find(ty, diff, it->h, &it->k) == NOT_FOUND
+                ) {
+                        put(ty, diff, it->h, it->k, it->v);
+                        weak_dict_read(ty, d, &it->k);
+                        weak_dict_read(ty, d, &it->v);
                 }
         }
 }
@@ -546,23 +824,15 @@ dict_intersect(Ty *ty, Value *d, int argc, Value *kwargs)
 
         Dict *u = DICT_ARG(0);
 
+        Dict *dict = d->dict;
+
         if (argc == 1) {
-                for (usize i = 0; i < d->dict->size;) {
-                        if (!OCCUPIED(d->dict, i)) {
-                                i += 1;
+                for (usize i = 0; i < USED(dict); ++i) {
+                        if (DEAD(dict, i)) {
                                 continue;
                         }
-                        usize j = find_spot(
-                                ty,
-                                u->size,
-                                u->items,
-                                d->dict->items[i].h,
-                                &d->dict->items[i].k
-                        );
-                        if (!OCCUPIED(u, j)) {
-                                i = delete(d->dict, i);
-                        } else {
-                                i += 1;
+                        if (find(ty, u, dict->items[i].h, &dict->items[i].k) == NOT_FOUND) {
+                                delete(ty, dict, i);
                         }
                 }
         } else {
@@ -570,29 +840,25 @@ dict_intersect(Ty *ty, Value *d, int argc, Value *kwargs)
                 if (!CALLABLE(f)) {
                         zP("the second argument to dict.intersect() must be callable");
                 }
-                for (usize i = 0; i < d->dict->size;) {
-                        if (!OCCUPIED(d->dict, i)) {
-                                i += 1;
+                for (usize i = 0; i < USED(dict); ++i) {
+                        if (DEAD(dict, i)) {
                                 continue;
                         }
-                        usize j = find_spot(
-                                ty,
-                                u->size,
-                                u->items,
-                                d->dict->items[i].h,
-                                &d->dict->items[i].k
-                        );
-                        if (!OCCUPIED(u, j)) {
-                                i = delete(d->dict, i);
+                        isize j = find(ty, u, dict->items[i].h, &dict->items[i].k);
+                        if (j == NOT_FOUND) {
+                                delete(ty, dict, i);
                         } else {
-                                d->dict->items[i].v = vm_eval_function(
+                                weak_dict_read(ty, dict, &dict->items[i].v);
+                                weak_dict_read(ty, u, &u->items[j].v);
+                                Value v = vm_eval_function(
                                         ty,
                                         &f,
-                                        &d->dict->items[i].v,
+                                        &dict->items[i].v,
                                         &u->items[j].v,
                                         NULL
                                 );
-                                i += 1;
+                                GCWrite(ty, dict);
+                                dict->items[i].v = v;
                         }
                 }
 
@@ -614,9 +880,11 @@ dict_intersect_copy(Ty *ty, Value *d, int argc, Value *kwargs)
 Dict *
 DictUpdate(Ty *ty, Dict *d, Dict const *u)
 {
-        for (usize i = 0; i < u->size; ++i) {
-                if (OCCUPIED(u, i)) {
+        for (usize i = 0; i < USED(u); ++i) {
+                if (!DEAD(u, i)) {
                         dict_put_value(ty, d, u->items[i].k, u->items[i].v);
+                        weak_dict_read(ty, u, &u->items[i].k);
+                        weak_dict_read(ty, u, &u->items[i].v);
                 }
         }
 
@@ -626,8 +894,10 @@ DictUpdate(Ty *ty, Dict *d, Dict const *u)
 Dict *
 DictUpdateWith(Ty *ty, Dict *d, Dict const *u, Value const *f)
 {
-        for (usize i = 0; i < u->size; ++i) {
-                if (OCCUPIED(u, i)) {
+        for (usize i = 0; i < USED(u); ++i) {
+                if (!DEAD(u, i)) {
+                        weak_dict_read(ty, u, &u->items[i].k);
+                        weak_dict_read(ty, u, &u->items[i].v);
                         dict_put_value_with(
                                 ty,
                                 d,
@@ -662,41 +932,38 @@ dict_subtract(Ty *ty, Value *d, int argc, Value *kwargs)
 
         Dict *u = DICT_ARG(0);
 
+        Dict *dict = d->dict;
+
         if (argc == 1) {
-                for (usize i = 0; i < u->size; ++i) {
-                        if (OCCUPIED(u, i)) {
-                                usize j = find_spot(
-                                        ty,
-                                        d->dict->size,
-                                        d->dict->items,
-                                        u->items[i].h,
-                                        &u->items[i].k
-                                );
-                                if (OCCUPIED(d->dict, j)) {
-                                        delete(d->dict, j);
-                                }
+                for (usize i = 0; i < USED(u); ++i) {
+                        if (DEAD(u, i)) {
+                                continue;
+                        }
+                        isize j = find(ty, dict, u->items[i].h, &u->items[i].k);
+                        if (j != NOT_FOUND) {
+                                delete(ty, dict, j);
                         }
                 }
         } else {
                 Value f = ARG(1);
-                for (usize i = 0; i < u->size; ++i) {
-                        if (OCCUPIED(u, i)) {
-                                usize j = find_spot(
+                for (usize i = 0; i < USED(u); ++i) {
+                        if (DEAD(u, i)) {
+                                continue;
+                        }
+                        isize j = find(ty, dict, u->items[i].h, &u->items[i].k);
+                        if (j != NOT_FOUND) {
+                                weak_dict_read(ty, dict, &dict->items[j].v);
+                                weak_dict_read(ty, u, &u->items[i].v);
+                                vm_eval_function(
                                         ty,
-                                        d->dict->size,
-                                        d->dict->items,
-                                        u->items[i].h,
-                                        &u->items[i].k
+                                        &f,
+                                        &dict->items[j].v,
+                                        &u->items[i].v,
+                                        NULL
                                 );
-                                if (OCCUPIED(d->dict, j)) {
-                                        vm_eval_function(
-                                                ty,
-                                                &f,
-                                                &d->dict->items[j].v,
-                                                &u->items[i].v,
-                                                NULL
-                                        );
-                                        delete(d->dict, j);
+                                j = find(ty, dict, u->items[i].h, &u->items[i].k);
+                                if (j != NOT_FOUND) {
+                                        delete(ty, dict, j);
                                 }
                         }
                 }
@@ -728,33 +995,24 @@ dict_get_or_put_with(Ty *ty, Value *d, int argc, Value *kwargs)
 
         Dict *dict = d->dict;
 
-        ENSURE_INIT(dict);
-
         u64   h = value_hash(ty, &key);
-        usize i = find_spot(ty, dict->size, dict->items, h, &key);
+        isize e = find(ty, dict, h, &key);
 
-        if (OCCUPIED(dict, i)) {
-                return *val(dict, i);
+        if (e != NOT_FOUND) {
+                weak_dict_read(ty, dict, val(dict, e));
+                return *val(dict, e);
         }
 
-        usize size = dict->size;
-        DictItem *items = dict->items;
-
         vmP(&key);
         Value val = vmC(&fun, 1);
 
         gP(&val);
-        if (
-                (dict->size != size)
-             || (dict->items != items)
-             || OCCUPIED(dict, i)
-        ) {
-                i = find_spot(ty, dict->size, dict->items, h, &key);
-        }
-        if (OCCUPIED(dict, i)) {
-                dict->items[i].v = val;
+        e = find(ty, dict, h, &key);
+        if (e != NOT_FOUND) {
+                GCWrite(ty, dict);
+                dict->items[e].v = val;
         } else {
-                put(ty, dict, i, h, key, val);
+                put(ty, dict, h, key, val);
         }
         gX();
 
@@ -766,10 +1024,16 @@ dict_clear(Ty *ty, Value *d, int argc, Value *kwargs)
 {
         ASSERT_ARGC("Dict.clear()", 0);
 
-        memset(d->dict->items, 0, sizeof (DictItem) * d->dict->size);
-        d->dict->last = NULL;
-        d->dict->count = 0;
-        d->dict->tombs = 0;
+        Dict *dict = d->dict;
+
+        GCWrite(ty, dict);
+
+        if (dict->size > 0) {
+                reset_index(dict);
+        }
+
+        dict->count = 0;
+        dict->tombs = 0;
 
         return *d;
 }
@@ -779,33 +1043,37 @@ dict_pop(Ty *ty, Value *d, int argc, Value *kwargs)
 {
         ASSERT_ARGC("Dict.pop()", 0, 1);
 
+        Dict *dict = d->dict;
         isize i = (argc == 1) ? INT_ARG(0) : -1;
 
         if (i < 0) {
-                i += d->dict->count;
+                i += dict->count;
         }
-        if (i < 0 || i >= d->dict->count) {
-                bP("index %jd out of range [0, %zu)", i, d->dict->count);
+        if (i < 0 || i >= dict->count) {
+                bP("index %jd out of range [0, %zu)", i, dict->count);
         }
 
-        DictItem *it;
+        usize e;
 
-        if (i < d->dict->count / 2) {
-                it = DictFirst(d->dict);
-                while (i --> 0) {
-                        it = it->next;
+        if (dict->tombs == 0) {
+                e = i;
+        } else if (i < dict->count / 2) {
+                for (e = 0; DEAD(dict, e) || i --> 0; ++e) {
+                        ;
                 }
         } else {
-                it = d->dict->last;
-                i = d->dict->count - i - 1;
-                while (i --> 0) {
-                        it = it->prev;
+                i = dict->count - i - 1;
+                for (e = USED(dict) - 1; DEAD(dict, e) || i --> 0; --e) {
+                        ;
                 }
         }
 
-        Value popped = PAIR(it->k, it->v);
+        Value popped = PAIR(dict->items[e].k, dict->items[e].v);
 
-        delete(d->dict, it - d->dict->items);
+        weak_dict_read(ty, dict, &dict->items[e].k);
+        weak_dict_read(ty, dict, &dict->items[e].v);
+
+        delete(ty, dict, e);
 
         return popped;
 }
@@ -817,20 +1085,14 @@ dict_remove(Ty *ty, Value *d, int argc, Value *kwargs)
 
         Value k = ARG(0);
         u64 h = value_hash(ty, &k);
+        isize e = find(ty, d->dict, h, &k);
 
-        usize i = find_spot(
-                ty,
-                d->dict->size,
-                d->dict->items,
-                h,
-                &k
-        );
-
-        if (!OCCUPIED(d->dict, i)) {
+        if (e == NOT_FOUND) {
                 return NIL;
         } else {
-                Value v = d->dict->items[i].v;
-                delete(d->dict, i);
+                Value v = d->dict->items[e].v;
+                weak_dict_read(ty, d->dict, &v);
+                delete(ty, d->dict, e);
                 return v;
         }
 }
@@ -843,10 +1105,12 @@ dict_keep_mut(Ty *ty, Value *d, int argc, Value *kwargs)
         Value f    = ARG(0);
         Dict *dict = d->dict;
 
-        for (usize i = 0; i < dict->size; ++i) {
-                if (!OCCUPIED(dict, i)) {
+        for (usize i = 0; i < USED(dict); ++i) {
+                if (DEAD(dict, i)) {
                         continue;
                 }
+                weak_dict_read(ty, dict, &dict->items[i].k);
+                weak_dict_read(ty, dict, &dict->items[i].v);
                 Value keep = vm_eval_function(
                         ty,
                         &f,
@@ -854,8 +1118,8 @@ dict_keep_mut(Ty *ty, Value *d, int argc, Value *kwargs)
                         &dict->items[i].v,
                         NULL
                 );
-                if (!value_truthy(ty, &keep)) {
-                        delete(dict, i);
+                if (!value_truthy(ty, &keep) && i < USED(dict) && !DEAD(dict, i)) {
+                        delete(ty, dict, i);
                 }
         }
 
@@ -873,6 +1137,8 @@ dict_keep(Ty *ty, Value *d, int argc, Value *kwargs)
         NOGC(new);
 
         dfor(d->dict, {
+                weak_dict_read(ty, d->dict, key);
+                weak_dict_read(ty, d->dict, val);
                 Value keep = vm_eval_function(ty, &f, key, val, NULL);
                 if (value_truthy(ty, &keep)) {
                         dict_put_value(ty, new, *key, *val);
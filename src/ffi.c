@@ -11,6 +11,7 @@
 #include "vm.h"
 #include "cffi.h"
 #include "class.h"
+#include "finalize.h"
 
 inline static double
 float_from(Value const *v)
@@ -454,6 +455,8 @@ cffi_auto(Ty *ty, int argc, Value *kwargs)
 
         dtor[1] = PTR(ptr.ptr);
 
+        finalize_register(ty, dtor);
+
         return TGCPTR(ptr.ptr, ptr.extra, dtor);
 }
 
@@ -0,0 +1,160 @@
+#include "ty.h"
+#include "class.h"
+#include "finalize.h"
+#include "gc.h"
+#include "value.h"
+#include "vm.h"
+#include "xd.h"
+
+void
+finalize_register(Ty *ty, void *p)
+{
+        ThreadGroup *group = ty->group;
+
+        TySpinLockLock(&group->FinalLock);
+        xvP(group->Final, p);
+        TySpinLockUnlock(&group->FinalLock);
+}
+
+inline static Value
+Finalizable(void *p)
+{
+        if (ALLOC_OF(p)->type == GC_OBJECT) {
+                TyObject *o = p;
+                return OBJECT(o, o->class->i);
+        } else {
+                return GCPTR(((Value *)p)[1].ptr, p);
+        }
+}
+
+/*
+ * Objects waiting for their finalizer are roots. Called while marking, with
+ * the world stopped or in the concurrent marker, which took FinalLock before
+ * it was forked.
+ */
+void
+finalize_mark(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        for (int i = 0; i < vN(group->FinalPending); ++i) {
+                value_mark(ty, v_(group->FinalPending, i));
+        }
+}
+
+/*
+ * Called by the collecting thread after weak_process(): references to an
+ * object are cleared before its finalizer can run, so a finalizer can't hand
+ * out an object that a weak reference has already reported as dead.
+ *
+ * Everything unreachable is queued before anything is marked, so an object
+ * that's only reachable from another one being finalized gets finalized in
+ * the same collection rather than the next one.
+ */
+bool
+finalize_process(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        TySpinLockLock(&group->FinalLock);
+
+        usize start = vN(group->FinalPending);
+        int n = 0;
+
+        for (int i = 0; i < vN(group->Final); ++i) {
+                void *p = v__(group->Final, i);
+                if (MARKED(p)) {
+                        *v_(group->Final, n++) = p;
+                } else {
+                        xvP(group->FinalPending, Finalizable(p));
+                }
+        }
+
+        group->Final.count = n;
+
+        for (usize i = start; i < vN(group->FinalPending); ++i) {
+                value_mark(ty, v_(group->FinalPending, i));
+        }
+
+        bool queued = vN(group->FinalPending) > start;
+
+        TySpinLockUnlock(&group->FinalLock);
+
+        return queued;
+}
+
+inline static void
+Finalize(Ty *ty, Value *v)
+{
+        if (v->type == VALUE_OBJECT) {
+                Value f = class_get_finalizer(ty, v->class);
+                if (f.type != VALUE_NONE) {
+                        vm_call_method(ty, v, &f, 0);
+                }
+        } else {
+                Value *dtor = v->gcptr;
+                if (dtor[0].type == VALUE_PTR) {
+                        ((void (*)(void *))dtor[0].ptr)(dtor[1].ptr);
+                } else {
+                        vmP(&dtor[1]);
+                        vmC(&dtor[0], 1);
+                }
+        }
+}
+
+/*
+ * Runs the finalizers queued by the last collection. Called at the end of
+ * DoGC() once the other threads have been released, so a slow finalizer
+ * only holds up the thread that runs it.
+ */
+void
+finalize_drain(Ty *ty)
+{
+        static _Thread_local bool draining;
+
+        ThreadGroup *group = ty->group;
+
+        if (draining || vN(group->FinalPending) == 0) {
+                return;
+        }
+
+        draining = true;
+
+        for (;;) {
+                TySpinLockLock(&group->FinalLock);
+
+                if (vN(group->FinalPending) == 0) {
+                        TySpinLockUnlock(&group->FinalLock);
+                        break;
+                }
+
+                Value v = vXx(group->FinalPending);
+
+                TySpinLockUnlock(&group->FinalLock);
+
+                gP(&v);
+
+                if (TY_CATCH_ERROR()) {
+                        char *trace = FormatTrace(ty, NULL, NULL);
+                        Value error = TY_CATCH();
+                        fprintf(
+                                stderr,
+                                "%sERROR:%s uncaught exception in finalizer:\n%s\n%s",
+                                TERM(91;1),
+                                TERM(0),
+                                VSC(&error),
+                                trace
+                        );
+                        xmF(trace);
+                } else {
+                        Finalize(ty, &v);
+                        TY_CATCH_END();
+                }
+
+                gX();
+        }
+
+        draining = false;
+}
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -104,6 +104,10 @@ extern char **environ;
 #include "class.h"
 #include "compiler.h"
 #include "types.h"
+#include "snapshot.h"
+#include "weak.h"
+#include "persist.h"
+#include "lazy.h"
 
 #ifdef __APPLE__
 #define fputc_unlocked putc_unlocked
@@ -1480,26 +1484,29 @@ BUILTIN_FUNCTION(tuple)
 
         Value tuple = vT(argc + named);
 
-        if (named > 0) {
-                NOGC(tuple.items);
-                tuple.ids = mAo((argc + named) * sizeof (int), GC_ANY);
-                OKGC(tuple.items);
-        }
-
         for (int i = 0; i < argc; ++i) {
                 tuple.items[i] = ARG(i);
-                if (tuple.ids != NULL) {
-                        tuple.ids[i] = -1;
-                }
         }
 
-        int n = argc;
+        if (named > 0) {
+                i32Vector ids = {0};
+                int n = argc;
+
+                SCRATCH_SAVE();
+
+                for (int i = 0; i < argc; ++i) {
+                        svP(ids, -1);
+                }
+
+                dfor(d, {
+                        tuple.items[n++] = *val;
+                        svP(ids, intern(&xD.members, TY_TMP_C_STR(*key))->id);
+                });
 
-        if (d != NULL) dfor(d, {
-                tuple.items[n] = *val;
-                tuple.ids[n] = intern(&xD.members, TY_TMP_C_STR(*key))->id;
-                n += 1;
-        });
+                tuple.ids = tuple_ids(ty, &tuple, vv(ids));
+
+                SCRATCH_RESTORE();
+        }
 
         return tuple;
 }
@@ -4255,26 +4262,34 @@ BUILTIN_FUNCTION(thread_create)
 
         ctx[argc] = NONE;
 
+        /*
+         * The new thread can finish before NewThread() returns. NOGC(t) keeps
+         * the handle itself around but nothing traces t->v through it, so the
+         * handle has to be a root until it's back on our stack.
+         */
+        Value v = THREAD(t);
+
+        gP(&v);
         NewThread(ty, t, ctx, NAMED("name"), HAVE_FLAG("isolated"));
+        gX();
 
-        return THREAD(t);
+        return v;
 }
 
 BUILTIN_FUNCTION(thread_channel)
 {
-        ASSERT_ARGC("thread.channel()", 0);
+        ASSERT_ARGC("thread.channel()", 0, 1);
 
-        Channel *chan = mAo(sizeof *chan, GC_CHANNEL);
+        imax bound = 0;
 
-        chan->open    = true;
-        atomic_init(&chan->waiters, 0);
-        chan->items   = NULL;
-        chan->head    = 0;
-        chan->tail    = 0;
-        chan->cap     = 0;
+        if (argc == 1 && ARG_T(0) != VALUE_NIL) {
+                bound = INT_ARG(0);
+                if (bound < 1) {
+                        zP("thread.channel(): capacity must be positive, got %"PRIiMAX, bound);
+                }
+        }
 
-        TyCondVarInit(&chan->c);
-        TyMutexInit(&chan->m);
+        Channel *chan = chan_new(ty, bound);
 
         return GCPTR(chan, chan);
 }
@@ -4291,6 +4306,18 @@ BUILTIN_FUNCTION(thread_send)
         return NIL;
 }
 
+BUILTIN_FUNCTION(thread_try_send)
+{
+        ASSERT_ARGC("thread.trySend()", 2, 3);
+
+        Channel *chan = PTR_ARG(0);
+        Value    msg  = ARG(1);
+
+        u64 timeout = (argc == 3) ? MSEC_TIMEOUT_ARG(2) : 0;
+
+        return BOOLEAN(chan_try_send(ty, chan, msg, timeout));
+}
+
 BUILTIN_FUNCTION(thread_recv)
 {
         ASSERT_ARGC("thread.recv()", 1, 2);
@@ -4311,12 +4338,7 @@ BUILTIN_FUNCTION(thread_close)
 
         Channel *chan = PTR_ARG(0);
 
-        UnlockTy();
-        TyMutexLock(&chan->m);
-        chan->open = false;
-        TyMutexUnlock(&chan->m);
-        TyCondVarBroadcast(&chan->c);
-        LockTy();
+        chan_close(ty, chan);
 
         return NIL;
 }
@@ -6588,7 +6610,8 @@ BUILTIN_FUNCTION(os_fcntl)
 #endif
 }
 
-BUILTIN_FUNCTION(os_cpu_count)
+int
+TyCPUCount(void)
 {
         int nCPU;
 #ifdef _WIN32
@@ -6610,6 +6633,13 @@ BUILTIN_FUNCTION(os_cpu_count)
 #else
         nCPU = -1;
 #endif
+        return (nCPU <= 0) ? -1 : nCPU;
+}
+
+BUILTIN_FUNCTION(os_cpu_count)
+{
+        int nCPU = TyCPUCount();
+
         return (nCPU <= 0) ? NIL : INTEGER(nCPU);
 }
 
@@ -7856,9 +7886,10 @@ BUILTIN_FUNCTION(members)
                         dict_put_member(ty, _members, key, val.object->slots[i]);
                 }
                 if (val.object->dynamic != NULL) {
-                        for (int i = 0; i < vN(val.object->dynamic->ids); ++i) {
-                                char const *key = M_NAME(v__(val.object->dynamic->ids, i));
-                                dict_put_member(ty, _members, key, v__(val.object->dynamic->values, i));
+                        struct dynamic const *d = val.object->dynamic;
+                        for (u32 i = 0; i < dynamic_count(d); ++i) {
+                                char const *key = M_NAME(dynamic_id(d, i));
+                                dict_put_member(ty, _members, key, *dynamic_value(d, i));
                         }
                 }
                 break;
@@ -8072,10 +8103,525 @@ BUILTIN_FUNCTION(doc)
 BUILTIN_FUNCTION(ty_gc)
 {
         ASSERT_ARGC("ty.gc()", 0);
-        DoGC(ty);
+        gc(ty);
         return NIL;
 }
 
+BUILTIN_FUNCTION(ty_gc_snapshot)
+{
+        ASSERT_ARGC("ty.gc.snapshot()", 1);
+
+        char const *path = TY_TMP_C_STR(ARGx(0, VALUE_STRING, VALUE_BLOB));
+
+        HeapSnapshot *snap = snapshot_open(ty, path);
+        if (snap == NULL) {
+                OSError(errno, "fopen(%s)", path);
+        }
+
+        if (!snapshot_request(ty, snap)) {
+                u64 _;
+                snapshot_close(ty, snap, &_, &_, &_);
+                bP("another heap snapshot is already in progress");
+        }
+
+        do {
+                gc(ty);
+        } while (!snapshot_done(snap));
+
+        u64 nodes;
+        u64 edges;
+        u64 bytes;
+
+        if (!snapshot_close(ty, snap, &nodes, &edges, &bytes)) {
+                OSError(errno, "write(%s)", path);
+        }
+
+        return vTn(
+                "nodes", INTEGER(nodes),
+                "edges", INTEGER(edges),
+                "bytes", INTEGER(bytes)
+        );
+}
+
+BUILTIN_FUNCTION(ty_gc_weak)
+{
+        ASSERT_ARGC("ty.gc.weak()", 1, 2);
+
+        Value target = ARG(0);
+        Value callback = (argc == 2) ? ARG(1) : NIL;
+
+        if (callback.type != VALUE_NIL && !CALLABLE(callback)) {
+                bP("callback is not callable: %s", VSC(&callback));
+        }
+
+        WeakRef *ref = weak_ref_new(ty, &target, &callback);
+
+        return GCPTR(ref, ref);
+}
+
+BUILTIN_FUNCTION(ty_gc_deref)
+{
+        ASSERT_ARGC("ty.gc.deref()", 1);
+
+        Value ref = ARGx(0, VALUE_PTR);
+
+        if (ref.gcptr == NULL || ALLOC_OF(ref.gcptr)->type != GC_WEAK) {
+                bP("expected a weak reference but got: %s", VSC(&ref));
+        }
+
+        return weak_ref_get(ty, ref.gcptr);
+}
+
+BUILTIN_FUNCTION(ty_gc_weak_dict)
+{
+        ASSERT_ARGC("ty.gc.weakDict()", 0);
+        return DICT(weak_dict_new(ty));
+}
+
+BUILTIN_FUNCTION(ty_gc_freeze)
+{
+        ASSERT_ARGC("ty.gc.freeze()", 0);
+        return INTEGER(GCFreeze(ty));
+}
+
+BUILTIN_FUNCTION(ty_gc_limit)
+{
+        ASSERT_ARGC("ty.gc.limit()", 0, 1);
+
+        Value prev = (GCHeapLimit == 0) ? NIL : INTEGER(GCHeapLimit);
+
+        if (argc == 1) {
+                Value limit = ARGx(0, VALUE_INTEGER, VALUE_NIL);
+                if (limit.type == VALUE_INTEGER && limit.z <= 0) {
+                        bP("limit must be a positive number of bytes: %"PRIiMAX, limit.z);
+                }
+                GCHeapLimit = (limit.type == VALUE_NIL) ? 0 : limit.z;
+                gc(ty);
+        }
+
+        return prev;
+}
+
+BUILTIN_FUNCTION(ty_gc_mode)
+{
+        ASSERT_ARGC("ty.gc.mode()", 0, 1);
+
+        Value slice = KWARG("slice", INTEGER);
+        Value prev  = (GCMode == GC_MODE_INCREMENTAL) ? xSz("incremental") : xSz("stop");
+
+        if (argc == 1) {
+                char const *mode = TY_TMP_C_STR(ARGx(0, VALUE_STRING));
+                if (s_eq(mode, "incremental")) {
+                        GCMode = GC_MODE_INCREMENTAL;
+                } else if (s_eq(mode, "stop")) {
+                        GCMode = GC_MODE_STOP;
+                } else {
+                        bP("unknown GC mode: %s", mode);
+                }
+        }
+
+        if (!IsNone(slice)) {
+                if (slice.z <= 0) {
+                        bP("slice must be a positive number of microseconds: %"PRIiMAX, slice.z);
+                }
+                GCSliceBudget = slice.z * 1000;
+        }
+
+        return prev;
+}
+
+inline static int
+PersistKind(Value const *v)
+{
+        if (v->type != VALUE_PTR || v->gcptr == NULL) {
+                return -1;
+        }
+
+        switch (ALLOC_OF(v->gcptr)->type) {
+        case GC_PERSIST_MAP:
+        case GC_PERSIST_VEC:
+                return ALLOC_OF(v->gcptr)->type;
+
+        default:
+                return -1;
+        }
+}
+
+static void *
+persist_arg(Ty *ty, char const *_name__, Value const *v, int kind)
+{
+        int k = PersistKind(v);
+
+        if (k == -1 || (kind != -1 && k != kind)) {
+                bP(
+                        "expected a persistent %s but got: %s",
+                        (kind == GC_PERSIST_MAP) ? "map"
+                      : (kind == GC_PERSIST_VEC) ? "vector"
+                      : "collection",
+                        VSC(v)
+                );
+        }
+
+        return v->gcptr;
+}
+
+static usize
+persist_index(Ty *ty, char const *_name__, PersistVec const *v, Value const *i, bool *ok)
+{
+        if (i->type != VALUE_INTEGER) {
+                bP("expected an integer index but got: %s", VSC(i));
+        }
+
+        imax j = (i->z < 0) ? i->z + (imax)v->count : i->z;
+        *ok = (j >= 0 && j < (imax)v->count);
+
+        return j;
+}
+
+#define PERSIST(p) GCPTR((p), (p))
+
+BUILTIN_FUNCTION(ty_persist_map)
+{
+        ASSERT_ARGC("ty.persist.map()", 0, 1);
+
+        Value src = (argc == 1) ? ARG(0) : NIL;
+
+        switch (src.type) {
+        case VALUE_NIL:
+                return PERSIST(persist_map_new(ty, NULL, 0));
+
+        case VALUE_DICT:
+        {
+                SCRATCH_SAVE();
+
+                ValueVector kvs = {0};
+                dfor(src.dict, {
+                        svP(kvs, *key);
+                        svP(kvs, *val);
+                });
+
+                PersistMap *m = persist_map_new(ty, vv(kvs), src.dict->count);
+                weak_dict_read(ty, src.dict, NULL);
+
+                SCRATCH_RESTORE();
+
+                return PERSIST(m);
+        }
+
+        default:
+                return PERSIST(persist_arg(ty, _name__, &src, GC_PERSIST_MAP));
+        }
+}
+
+BUILTIN_FUNCTION(ty_persist_vector)
+{
+        ASSERT_ARGC("ty.persist.vector()", 0, 1);
+
+        Value src = (argc == 1) ? ARG(0) : NIL;
+
+        switch (src.type) {
+        case VALUE_NIL:
+                return PERSIST(persist_vec_new(ty, NULL, 0));
+
+        case VALUE_ARRAY:
+                return PERSIST(persist_vec_new(ty, vv(*src.array), vN(*src.array)));
+
+        default:
+                return PERSIST(persist_arg(ty, _name__, &src, GC_PERSIST_VEC));
+        }
+}
+
+BUILTIN_FUNCTION(ty_persist_get)
+{
+        ASSERT_ARGC("ty.persist.get()", 2);
+
+        Value k = ARG(1);
+        Value const *x;
+        bool ok;
+
+        if (PersistKind(&ARG(0)) == GC_PERSIST_VEC) {
+                PersistVec *v = ARG(0).gcptr;
+                usize i = persist_index(ty, _name__, v, &k, &ok);
+                x = ok ? persist_vec_get(v, i) : NULL;
+        } else {
+                PersistMap *m = persist_arg(ty, _name__, &ARG(0), GC_PERSIST_MAP);
+                x = persist_map_get(ty, m, &k);
+        }
+
+        return (x == NULL) ? None : Some(*x);
+}
+
+BUILTIN_FUNCTION(ty_persist_put)
+{
+        ASSERT_ARGC("ty.persist.put()", 3);
+
+        /*
+         * Hashing and comparing keys can call back into the VM, which is free
+         * to move its stack, so don't hold on to pointers into it.
+         */
+        Value k = ARG(1);
+        Value x = ARG(2);
+        bool ok;
+
+        if (PersistKind(&ARG(0)) == GC_PERSIST_VEC) {
+                PersistVec *v = ARG(0).gcptr;
+                usize i = persist_index(ty, _name__, v, &k, &ok);
+                if (!ok) {
+                        bP("index out of range: %s", VSC(&k));
+                }
+                return PERSIST(persist_vec_put(ty, v, i, &x));
+        }
+
+        PersistMap *m = persist_arg(ty, _name__, &ARG(0), GC_PERSIST_MAP);
+
+        return PERSIST(persist_map_put(ty, m, &k, &x));
+}
+
+BUILTIN_FUNCTION(ty_persist_remove)
+{
+        ASSERT_ARGC("ty.persist.remove()", 2);
+        Value k = ARG(1);
+        PersistMap *m = persist_arg(ty, _name__, &ARG(0), GC_PERSIST_MAP);
+        return PERSIST(persist_map_remove(ty, m, &k));
+}
+
+BUILTIN_FUNCTION(ty_persist_push)
+{
+        ASSERT_ARGC("ty.persist.push()", 2);
+        Value x = ARG(1);
+        PersistVec *v = persist_arg(ty, _name__, &ARG(0), GC_PERSIST_VEC);
+        return PERSIST(persist_vec_push(ty, v, &x));
+}
+
+BUILTIN_FUNCTION(ty_persist_pop)
+{
+        ASSERT_ARGC("ty.persist.pop()", 1);
+
+        PersistVec *v = persist_arg(ty, _name__, &ARG(0), GC_PERSIST_VEC);
+
+        if (v->count == 0) {
+                bP("pop from empty vector");
+        }
+
+        return PERSIST(persist_vec_pop(ty, v));
+}
+
+BUILTIN_FUNCTION(ty_persist_slice)
+{
+        ASSERT_ARGC("ty.persist.slice()", 3);
+
+        PersistVec *v = persist_arg(ty, _name__, &ARG(0), GC_PERSIST_VEC);
+        imax n = v->count;
+        imax i = INT_ARG(1);
+        imax j = INT_ARG(2);
+
+        if (i < 0) {
+                i += n;
+        }
+
+        if (j < 0) {
+                j += n;
+        }
+
+        i = max(0, min(i, n));
+        j = max(i, min(j, n));
+
+        return PERSIST(persist_vec_slice(ty, v, i, j));
+}
+
+BUILTIN_FUNCTION(ty_persist_concat)
+{
+        ASSERT_ARGC("ty.persist.concat()", 2);
+
+        PersistVec *a = persist_arg(ty, _name__, &ARG(0), GC_PERSIST_VEC);
+        PersistVec *b = persist_arg(ty, _name__, &ARG(1), GC_PERSIST_VEC);
+
+        return PERSIST(persist_vec_concat(ty, a, b));
+}
+
+BUILTIN_FUNCTION(ty_persist_len)
+{
+        ASSERT_ARGC("ty.persist.len()", 1);
+
+        void *c = persist_arg(ty, _name__, &ARG(0), -1);
+
+        return INTEGER(
+                (ALLOC_OF(c)->type == GC_PERSIST_MAP)
+              ? ((PersistMap *)c)->count
+              : ((PersistVec *)c)->count
+        );
+}
+
+BUILTIN_FUNCTION(ty_persist_items)
+{
+        ASSERT_ARGC("ty.persist.items()", 1);
+
+        void *c = persist_arg(ty, _name__, &ARG(0), -1);
+
+        return (ALLOC_OF(c)->type == GC_PERSIST_MAP)
+             ? persist_map_items(ty, c)
+             : persist_vec_items(ty, c);
+}
+
+static LazyIter *
+lazy_arg(Ty *ty, char const *_name__, Value const *v)
+{
+        LazyIter *it = lazy_of(v);
+
+        if (it == NULL) {
+                bP("expected a lazy iterator but got: %s", VSC(v));
+        }
+
+        return it;
+}
+
+static Value
+lazy_fn_stage(Ty *ty, char const *_name__, int argc, int kind)
+{
+        LazyIter *up = lazy_arg(ty, _name__, &ARG(0));
+        Value f = ARG(1);
+
+        if (!CALLABLE(f)) {
+                bP("expected a function but got: %s", VSC(&f));
+        }
+
+        return LAZY(lazy_stage(ty, kind, up, &f, 0));
+}
+
+static Value
+lazy_int_stage(Ty *ty, char const *_name__, int argc, int kind)
+{
+        LazyIter *up = lazy_arg(ty, _name__, &ARG(0));
+        imax n = INT_ARG(1);
+
+        if (n < 0 || (kind == LAZY_CHUNK && n == 0)) {
+                bP("invalid count: %"PRIiMAX, n);
+        }
+
+        return LAZY(lazy_stage(ty, kind, up, &NIL, n));
+}
+
+BUILTIN_FUNCTION(ty_lazy_new)
+{
+        ASSERT_ARGC("ty.lazy.new()", 1);
+        return LAZY(lazy_new(ty, &ARG(0)));
+}
+
+BUILTIN_FUNCTION(ty_lazy_map)
+{
+        ASSERT_ARGC("ty.lazy.map()", 2);
+        return lazy_fn_stage(ty, _name__, argc, LAZY_MAP);
+}
+
+BUILTIN_FUNCTION(ty_lazy_filter)
+{
+        ASSERT_ARGC("ty.lazy.filter()", 2);
+        return lazy_fn_stage(ty, _name__, argc, LAZY_FILTER);
+}
+
+BUILTIN_FUNCTION(ty_lazy_flat_map)
+{
+        ASSERT_ARGC("ty.lazy.flatMap()", 2);
+        return lazy_fn_stage(ty, _name__, argc, LAZY_FLAT_MAP);
+}
+
+BUILTIN_FUNCTION(ty_lazy_take)
+{
+        ASSERT_ARGC("ty.lazy.take()", 2);
+        return lazy_int_stage(ty, _name__, argc, LAZY_TAKE);
+}
+
+BUILTIN_FUNCTION(ty_lazy_drop)
+{
+        ASSERT_ARGC("ty.lazy.drop()", 2);
+        return lazy_int_stage(ty, _name__, argc, LAZY_DROP);
+}
+
+BUILTIN_FUNCTION(ty_lazy_chunk)
+{
+        ASSERT_ARGC("ty.lazy.chunk()", 2);
+        return lazy_int_stage(ty, _name__, argc, LAZY_CHUNK);
+}
+
+BUILTIN_FUNCTION(ty_lazy_enumerate)
+{
+        ASSERT_ARGC("ty.lazy.enumerate()", 1);
+        LazyIter *up = lazy_arg(ty, _name__, &ARG(0));
+        return LAZY(lazy_stage(ty, LAZY_ENUMERATE, up, &NIL, 0));
+}
+
+BUILTIN_FUNCTION(ty_lazy_zip)
+{
+        ASSERT_ARGC_RANGE("ty.lazy.zip()", 1, INT_MAX);
+
+        LazyIter *up = lazy_arg(ty, _name__, &ARG(0));
+
+        Array *others = vA();
+        Value v = ARRAY(others);
+
+        gP(&v);
+
+        for (int i = 1; i < argc; ++i) {
+                vAp(others, LAZY(lazy_new(ty, &ARG(i))));
+        }
+
+        LazyIter *it = lazy_stage(ty, LAZY_ZIP, up, &v, 0);
+
+        gX();
+
+        return LAZY(it);
+}
+
+BUILTIN_FUNCTION(ty_lazy_next)
+{
+        ASSERT_ARGC("ty.lazy.next()", 1);
+
+        LazyIter *it = lazy_arg(ty, _name__, &ARG(0));
+        Value x;
+
+        return lazy_next(ty, it, &x) ? Some(x) : None;
+}
+
+BUILTIN_FUNCTION(ty_lazy_sum)
+{
+        ASSERT_ARGC("ty.lazy.sum()", 1, 2);
+        LazyIter *it = lazy_arg(ty, _name__, &ARG(0));
+        return lazy_sum(ty, it, (argc == 2) ? &ARG(1) : NULL);
+}
+
+BUILTIN_FUNCTION(ty_lazy_collect)
+{
+        ASSERT_ARGC("ty.lazy.collect()", 1);
+        LazyIter *it = lazy_arg(ty, _name__, &ARG(0));
+        return lazy_collect(ty, it);
+}
+
+BUILTIN_FUNCTION(ty_lazy_each)
+{
+        ASSERT_ARGC("ty.lazy.each()", 2);
+        LazyIter *it = lazy_arg(ty, _name__, &ARG(0));
+        lazy_each(ty, it, &ARG(1));
+        return NIL;
+}
+
+BUILTIN_FUNCTION(ty_lazy_count)
+{
+        ASSERT_ARGC("ty.lazy.count()", 1);
+        LazyIter *it = lazy_arg(ty, _name__, &ARG(0));
+        return INTEGER(lazy_count(ty, it));
+}
+
+BUILTIN_FUNCTION(ty_lazy_fold)
+{
+        ASSERT_ARGC("ty.lazy.fold()", 2, 3);
+
+        LazyIter *it = lazy_arg(ty, _name__, &ARG(0));
+
+        return (argc == 3)
+             ? lazy_fold(ty, it, &ARG(1), &ARG(2))
+             : lazy_fold(ty, it, NULL, &ARG(1));
+}
+
 BUILTIN_FUNCTION(ty_bt)
 {
         ASSERT_ARGC("ty.bt()", 0);
@@ -18,13 +18,144 @@ static GCRootSet ImmortalSet;
 #define A_LOAD(p)     atomic_load_explicit((p), memory_order_relaxed)
 #define A_STORE(p, x) atomic_store_explicit((p), (x), memory_order_relaxed)
 
+/*
+ * Large blocks: [usize length][struct alloc][data], where length is the size
+ * of the whole mapping. The header stays 16-byte aligned like malloc's.
+ */
+#if !defined(_WIN32)
+#define LARGE_PREFIX sizeof (usize)
+
+inline static usize
+LargeLength(usize n)
+{
+        usize page = 4096;
+        return (LARGE_PREFIX + sizeof (struct alloc) + n + page - 1) & ~(page - 1);
+}
+
+inline static usize *
+LargeBase(struct alloc *a)
+{
+        return (usize *)((char *)a - LARGE_PREFIX);
+}
+
+struct alloc *
+gc_large_alloc(usize n)
+{
+        usize len = LargeLength(n);
+
+        usize *base = mmap(
+                NULL,
+                len,
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS,
+                -1,
+                0
+        );
+
+        if (base == MAP_FAILED) {
+                return NULL;
+        }
+
+        *base = len;
+
+        return (struct alloc *)((char *)base + LARGE_PREFIX);
+}
+
+void
+gc_large_free(struct alloc *a)
+{
+        usize *base = LargeBase(a);
+        munmap(base, *base);
+}
+
+/*
+ * Moves a block across the threshold in either direction, or resizes a large
+ * one in place. Growing a large block never copies on Linux: mremap() just
+ * moves the page table entries if it can't extend the mapping where it is.
+ */
+struct alloc *
+gc_large_resize(struct alloc *a, usize n)
+{
+        struct alloc *new;
+
+        if (a == NULL) {
+                return gc_large_alloc(n);
+        }
+
+        if (!GC_IS_LARGE(a)) {
+                new = gc_large_alloc(n);
+                if (new != NULL) {
+                        memcpy(new, a, sizeof *a + min(a->size, n));
+                        ty_free(a);
+                }
+                return new;
+        }
+
+        usize *base = LargeBase(a);
+
+        if (n < GC_LARGE_OBJECT) {
+                new = ty_malloc(sizeof *a + n);
+                if (new != NULL) {
+                        memcpy(new, a, sizeof *a + n);
+                        munmap(base, *base);
+                }
+                return new;
+        }
+
+        usize len = LargeLength(n);
+
+        if (len == *base) {
+                return a;
+        }
+
+#if defined(__linux__)
+        base = mremap(base, *base, len, MREMAP_MAYMOVE);
+        if (base == MAP_FAILED) {
+                return NULL;
+        }
+        *base = len;
+        return (struct alloc *)((char *)base + LARGE_PREFIX);
+#else
+        usize have = *base - LARGE_PREFIX - sizeof *a;
+
+        new = gc_large_alloc(n);
+        if (new != NULL) {
+                memcpy(new, a, sizeof *a + min(have, n));
+                munmap(base, *base);
+        }
+        return new;
+#endif
+}
+#else
+struct alloc *
+gc_large_alloc(usize n)
+{
+        return ty_calloc(1, sizeof (struct alloc) + n);
+}
+
+void
+gc_large_free(struct alloc *a)
+{
+        ty_free(a);
+}
+
+struct alloc *
+gc_large_resize(struct alloc *a, usize n)
+{
+        return ty_realloc(a, sizeof *a + n);
+}
+#endif
+
+/*
+ * Releases whatever a dead block owns outside the GC heap. Finalizers don't
+ * run here, while the world is stopped: the blocks that have one were queued
+ * by finalize_process() and only become garbage once it has run.
+ */
 inline static void
 collect(Ty *ty, struct alloc *a)
 {
         void *p = a->data;
 
-        Value o;
-        Value finalizer;
         Regex *re;
         Thread *t;
         Generator *gen;
@@ -39,6 +170,7 @@ collect(Ty *ty, struct alloc *a)
                 break;
 
         case GC_DICT:
+        case GC_WEAK_DICT:
                 dict_free(ty, p);
                 break;
 
@@ -108,13 +240,8 @@ collect(Ty *ty, struct alloc *a)
                 break;
 
         case GC_OBJECT:
-                o = OBJECT((TyObject *)p, ((TyObject *)p)->class->i);
-                finalizer = class_get_finalizer(ty, o.class);
-                if (finalizer.type != VALUE_NONE) {
-                        vm_call_method(ty, &o, &finalizer, 0);
-                }
-                if (o.object->dynamic != NULL) {
-                        itable_release(ty, o.object->dynamic);
+                if (((TyObject *)p)->dynamic != NULL) {
+                        dynamic_release(ty, ((TyObject *)p)->dynamic);
                 }
                 break;
 
@@ -125,7 +252,7 @@ collect(Ty *ty, struct alloc *a)
                 break;
 
         case GC_ARENA:
-                ForgetSourceNodesFrom(p, a->size);
+                ForgetSourceNodesFrom(p);
                 break;
 
         case GC_FUN_INFO:
@@ -133,17 +260,6 @@ collect(Ty *ty, struct alloc *a)
                 mF(((FunUserInfo *)p)->proto);
                 mF(((FunUserInfo *)p)->name);
                 break;
-
-        case GC_FFI_AUTO:
-                finalizer = ((Value *)p)[0];
-                o = ((Value *)p)[1];
-                if (finalizer.type == VALUE_PTR) {
-                        ((void (*)(void *))finalizer.ptr)(o.ptr);
-                } else {
-                        vmP(&o);
-                        vmC(&finalizer, 1);
-                }
-                break;
         }
 }
 
@@ -179,6 +295,14 @@ GCForget(Ty *ty, AllocList *allocs, isize *used)
         }
 }
 
+void
+GCClearMarks(AllocList *allocs)
+{
+        for (usize i = 0; i < vN(*allocs); ++i) {
+                A_STORE(&v__(*allocs, i)->mark, false);
+        }
+}
+
 void
 GCSweepTy(Ty *ty)
 {
@@ -193,7 +317,7 @@ GCSweepTy(Ty *ty)
                 ) {
                         ty->memory_used -= min(a->size, ty->memory_used);
                         collect(ty, a);
-                        ty_free(a);
+                        gc_block_free(a);
                 } else {
                         A_STORE(&a->mark, false);
                         *v_(ty->allocs, n++) = a;
@@ -204,6 +328,103 @@ GCSweepTy(Ty *ty)
         vN(ty->allocs) = n;
 }
 
+/*
+ * Lazy sweeping, used at the end of an incremental cycle: instead of freeing
+ * its garbage while the world is stopped, each thread sweeps its own list a
+ * slice at a time from CheckUsed(), and the list of a thread that's blocked is
+ * swept by whichever thread wants to start the next cycle. Only [next, end) is
+ * left to sweep; blocks allocated since are appended after end and aren't
+ * looked at until the next collection. Survivors are compacted into [0, kept).
+ * The group counts the threads that are part way through, since no cycle can
+ * start until they've all finished.
+ */
+void
+GCBeginSweep(Ty *ty)
+{
+        ty->sweep.active = (vN(ty->allocs) > 0);
+        ty->sweep.next   = 0;
+        ty->sweep.end    = vN(ty->allocs);
+        ty->sweep.kept   = 0;
+
+        if (ty->sweep.active) {
+                atomic_fetch_add_explicit(&ty->group->Sweeping, 1, memory_order_relaxed);
+        }
+}
+
+bool
+GCSweepSlice(Ty *ty, u64 budget)
+{
+        if (!ty->sweep.active) {
+                return true;
+        }
+
+        u64 start = TyMonotonicTime();
+
+        GC_STOP();
+        while (ty->sweep.next < ty->sweep.end) {
+                usize stop = min(ty->sweep.next + 1024, ty->sweep.end);
+
+                while (ty->sweep.next < stop) {
+                        struct alloc *a = v__(ty->allocs, ty->sweep.next++);
+                        if (
+                                !A_LOAD(&a->mark)
+                             && (A_LOAD(&a->hard) == 0)
+                        ) {
+                                ty->memory_used -= min(a->size, ty->memory_used);
+                                collect(ty, a);
+                                gc_block_free(a);
+                        } else {
+                                A_STORE(&a->mark, false);
+                                *v_(ty->allocs, ty->sweep.kept++) = a;
+                        }
+                }
+
+                if (budget != 0 && TyMonotonicTime() - start >= budget) {
+                        break;
+                }
+        }
+        GC_RESUME();
+
+        if (ty->sweep.next < ty->sweep.end) {
+                return false;
+        }
+
+        usize tail = vN(ty->allocs) - ty->sweep.end;
+
+        memmove(
+                v_(ty->allocs, ty->sweep.kept),
+                v_(ty->allocs, ty->sweep.end),
+                tail * sizeof (struct alloc *)
+        );
+
+        vN(ty->allocs) = ty->sweep.kept + tail;
+        ty->sweep.active = false;
+
+        atomic_fetch_sub_explicit(&ty->group->Sweeping, 1, memory_order_release);
+
+        return true;
+}
+
+/*
+ * Slow paths of GCWrite() and GCWriteValue(). What they queue on ty->gray is
+ * traced by the next mark slice, or by the collection that ends the cycle.
+ */
+void
+GCShade(Ty *ty, void const *p)
+{
+        value_shade_block(ty, p);
+}
+
+void
+GCShadeValue(Ty *ty, Value const *v)
+{
+        void const *p = value_gc_block(v);
+
+        if (p == NULL || !MARKED(p)) {
+                value_shade(ty, v);
+        }
+}
+
 void
 GCSweep(Ty *ty, AllocList *allocs, isize *used)
 {
@@ -217,7 +438,7 @@ GCSweep(Ty *ty, AllocList *allocs, isize *used)
                 ) {
                         *used -= min(v__(*allocs, i)->size, *used);
                         collect(ty, v__(*allocs, i));
-                        ty_free(v__(*allocs, i));
+                        gc_block_free(v__(*allocs, i));
                 } else {
                         A_STORE(&v__(*allocs, i)->mark, false);
                         *v_(*allocs, n++) = v__(*allocs, i);
@@ -228,6 +449,58 @@ GCSweep(Ty *ty, AllocList *allocs, isize *used)
         vN(*allocs) = n;
 }
 
+/*
+ * The permanent generation. Freezing moves every block that survived the
+ * collection in progress onto group->Frozen with its mark left set, so that no
+ * later collection marks or sweeps it. After a fork(), the pages holding the
+ * frozen heap then stay shared with the parent for as long as the program
+ * itself doesn't write to them.
+ */
+void
+GCFreezeAllocs(Ty *ty, AllocList *allocs, isize *used)
+{
+        ThreadGroup *group = ty->group;
+
+        for (usize i = 0; i < vN(*allocs); ++i) {
+                struct alloc *a = v__(*allocs, i);
+                A_STORE(&a->mark, true);
+                xvP(group->Frozen, a);
+        }
+
+        group->FrozenUsed += *used;
+
+        vN(*allocs) = 0;
+        *used = 0;
+}
+
+void
+GCMarkFrozen(Ty *ty)
+{
+        AllocList const *frozen = &ty->group->Frozen;
+
+        for (usize i = 0; i < vN(*frozen); ++i) {
+                value_mark_frozen(ty, v__(*frozen, i));
+        }
+}
+
+usize
+GCFreeze(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        if (group->Cycle.active) {
+                DoGC(ty);
+        }
+
+        group->GCFreeze = true;
+
+        do {
+                DoGC(ty);
+        } while (group->GCFreeze);
+
+        return vN(group->Frozen);
+}
+
 void
 GCTakeOwnership(Ty *ty, AllocList *new)
 {
@@ -237,10 +510,66 @@ GCTakeOwnership(Ty *ty, AllocList *new)
         }
 }
 
+/*
+ * A full collection. If an incremental cycle is in flight, the collection that
+ * ends it has to keep everything allocated since the cycle started, so run a
+ * second one to pick that up too.
+ */
 void
 gc(Ty *ty)
 {
+        bool cycle = ty->group->Cycle.active;
+
         DoGC(ty);
+
+        if (cycle) {
+                DoGC(ty);
+        }
+}
+
+/*
+ * Called when an allocation of n bytes has taken this thread past its share of
+ * the heap limit. The collection hands out new shares; if the group is still
+ * over the limit after it, the allocation is taken back out of MemoryUsed and
+ * MemoryError is thrown.
+ *
+ * Throwing allocates, as do any finalizers the collection runs, so those get
+ * some slack: a thread that has just been refused can go GC_HEAP_SLACK bytes
+ * over its share before it's checked again.
+ */
+void
+GCHeapLimitExceeded(Ty *ty, usize n)
+{
+        static _Thread_local bool collecting;
+
+        if (GCHeapLimit == 0) {
+                ty->heap_budget = INT64_MAX;
+                return;
+        }
+
+        if (collecting) {
+                return;
+        }
+
+        collecting = true;
+        gc(ty);
+        collecting = false;
+
+        isize used = ty->group->HeapUsed;
+
+        if (used <= GCHeapLimit) {
+                return;
+        }
+
+        MemoryUsed -= min(n, MemoryUsed);
+        ty->heap_budget = MemoryUsed + GC_HEAP_SLACK;
+
+        MemoryError(
+                "allocation of %zu bytes exceeds the heap limit: %"PRIiMAX" of %"PRIiMAX" bytes in use",
+                n,
+                (imax)(used - n),
+                (imax)GCHeapLimit
+        );
 }
 
 void
@@ -7,62 +7,156 @@
 
 void const *InternSentinel = &InternSentinel;
 
+/*
+ * Open addressing with linear probing, kept at most half full. A table is
+ * never freed once it's been published, since a reader can still be probing
+ * it after it's been replaced; each one remembers the one it replaced so that
+ * they're at least still reachable.
+ */
+struct intern_table {
+        InternTable *prev;
+        usize mask;
+        _Atomic(InternEntry *) slots[];
+};
+
+/*
+ * What intern_get() hands back for a name that isn't in the set, to be passed
+ * to intern_put() if the caller decides to add it.
+ */
+static _Thread_local InternEntry Missing;
+
 inline static InternEntry *
-find(InternBucket const *bucket, char const *name, u64 hash)
+find(InternTable const *t, char const *name, u64 hash)
 {
-        for (usize i = 0; i < vN(*bucket); ++i) {
-                InternEntry *entry = v_(*bucket, i);
-                if (entry->hash != hash) {
-                        continue;
+        if (t == NULL) {
+                return NULL;
+        }
+
+        for (usize i = hash & t->mask;; i = (i + 1) & t->mask) {
+                InternEntry *entry = atomic_load_explicit(
+                        &t->slots[i],
+                        memory_order_acquire
+                );
+                if (entry == NULL) {
+                        return NULL;
                 }
-                if (strcmp(entry->name, name) == 0) {
+                if (entry->hash == hash && strcmp(entry->name, name) == 0) {
                         return entry;
                 }
         }
+}
+
+inline static void
+place(InternTable *t, InternEntry *entry)
+{
+        usize i = entry->hash & t->mask;
+
+        while (atomic_load_explicit(&t->slots[i], memory_order_relaxed) != NULL) {
+                i = (i + 1) & t->mask;
+        }
+
+        atomic_store_explicit(&t->slots[i], entry, memory_order_release);
+}
+
+static InternTable *
+grow(InternSet *set, InternTable *old)
+{
+        usize size = (old == NULL) ? 256 : 2 * (old->mask + 1);
+        InternTable *t = xmA(sizeof *t + size * sizeof (InternEntry *));
+
+        t->prev = old;
+        t->mask = size - 1;
+
+        for (usize i = 0; i < size; ++i) {
+                atomic_init(&t->slots[i], NULL);
+        }
+
+        for (u32 id = 0; id < set->count; ++id) {
+                place(t, intern_entry(set, id));
+        }
 
-        return NULL;
+        atomic_store_explicit(&set->table, t, memory_order_release);
+
+        return t;
 }
 
 InternEntry *
 intern_get(InternSet *set, char const *name)
 {
         u64 hash = hash64z(name);
-        InternBucket *bucket = &set->set[hash & (INTERN_TABLE_SIZE - 1)];
-
-        InternEntry *entry = find(bucket, name, hash);
+        InternTable *t = atomic_load_explicit(&set->table, memory_order_acquire);
+        InternEntry *entry = find(t, name, hash);
 
         if (entry != NULL) {
                 return entry;
         }
 
-        xvP(
-                *bucket,
-                ((InternEntry) {
-                        .name = name,
-                        .hash = hash,
-                        .id   = -(bucket + 1 - set->set),
-                        .data = set
-                })
-        );
-
-        return vvX(*bucket);
+        Missing = (InternEntry) {
+                .name = name,
+                .hash = hash,
+                .id   = -1,
+                .data = set
+        };
+
+        return &Missing;
 }
 
+/*
+ * Adds the name that intern_get() just failed to find, keeping `name` as the
+ * entry's name (or a copy of the name that was looked up, if that's NULL). If
+ * another thread got there first, its entry is returned instead and `name`
+ * still belongs to the caller.
+ */
 InternEntry *
-intern_put(InternEntry *e, void *data)
+intern_put_as(InternEntry *e, char const *name, void *data)
 {
         InternSet *set = e->data;
-        InternBucket *b = &set->set[-e->id - 1];
+        char const *key = e->name;
+        u64 hash = e->hash;
+
+        TySpinLockLock(&set->lock);
+
+        InternTable *t = atomic_load_explicit(&set->table, memory_order_relaxed);
+        InternEntry *entry = find(t, key, hash);
+
+        if (entry != NULL) {
+                TySpinLockUnlock(&set->lock);
+                return entry;
+        }
 
-        e->data = data;
-        e->id   = vN(set->index);
-        e->name = S2(e->name);
+        if (t == NULL || 2 * (set->count + 1) > t->mask + 1) {
+                t = grow(set, t);
+        }
 
-        xvP(set->index, (b->count << 8u) | (b - set->set));
+        u32 id = set->count;
+        u64 k = (u64)id + (1u << INTERN_SEGMENT0_BITS);
+        int s = 63 - __builtin_clzll(k) - INTERN_SEGMENT0_BITS;
 
-        b->count += 1;
+        if (set->entries[s] == NULL) {
+                set->entries[s] = xmA(
+                        ((usize)1 << (s + INTERN_SEGMENT0_BITS)) * sizeof (InternEntry)
+                );
+        }
 
-        return e;
+        entry = intern_entry(set, id);
+        entry->id   = id;
+        entry->name = (name != NULL) ? name : S2(key);
+        entry->hash = hash;
+        entry->data = data;
+
+        set->count += 1;
+
+        place(t, entry);
+
+        TySpinLockUnlock(&set->lock);
+
+        return entry;
+}
+
+InternEntry *
+intern_put(InternEntry *e, void *data)
+{
+        return intern_put_as(e, NULL, data);
 }
 
 /* vim: set sts=8 sw=8 expandtab: */
@@ -54,6 +54,8 @@ char JIT;
 #define OFF_TY_STACK  offsetof(Ty, stack)
 #define OFF_TY_ST     offsetof(Ty, st)
 #define OFF_TY_TLS    offsetof(Ty, tls)
+#define OFF_TY_GROUP  offsetof(Ty, group)
+#define OFF_GROUP_BLACK offsetof(ThreadGroup, GCBlack)
 #define OFF_ST_STACK  offsetof(co_state, stack)
 #define OFF_ST_FRAMES offsetof(co_state, frames)
 #define OFF_ST_RC     offsetof(co_state, rc)
@@ -65,7 +67,7 @@ char JIT;
 #define OBJ_OFF_INIT    0    // bool init
 #define OBJ_OFF_NSLOT   4    // u32 nslot
 #define OBJ_OFF_CLASS   8    // Class *class
-#define OBJ_OFF_DYN     offsetof(TyObject, dynamic) // struct itable *dynamic
+#define OBJ_OFF_DYN     offsetof(TyObject, dynamic) // struct dynamic *dynamic
 #define OBJ_OFF_SLOTS   offsetof(TyObject, slots)   // Value slots[] (flexible array)
 
 // ============================================================================
@@ -712,7 +714,7 @@ jit_rt_idbg(Ty *ty, i64 sp, char const *op)
 }
 
 static void
-jit_rt_add(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_add(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
         if (a->type == VALUE_INTEGER && b->type == VALUE_INTEGER) {
                 *result = INTEGER(a->z + b->z);
@@ -721,15 +723,12 @@ jit_rt_add(Ty *ty, Value *result, Value *a, Value *b)
 
         STAT(arith_slow);
 
-        ptrdiff_t idx = result - vv(STACK);
-        vN(STACK) = idx + 2;
-
-        Value val = vm_2op(ty, OP_ADD, a, b);
-        *v_(STACK, idx) = val;
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_ADD, site, true);
 }
 
 static void
-jit_rt_sub(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_sub(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
         if (a->type == VALUE_INTEGER && b->type == VALUE_INTEGER) {
                 *result = INTEGER(a->z - b->z);
@@ -738,15 +737,12 @@ jit_rt_sub(Ty *ty, Value *result, Value *a, Value *b)
 
         STAT(arith_slow);
 
-        ptrdiff_t idx = result - vv(STACK);
-        vN(STACK) = idx + 2;
-
-        Value val = vm_2op(ty, OP_SUB, a, b);
-        *v_(STACK, idx) = val;
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_SUB, site, true);
 }
 
 static void
-jit_rt_mul(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_mul(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
         if (a->type == VALUE_INTEGER && b->type == VALUE_INTEGER) {
                 *result = INTEGER(a->z * b->z);
@@ -755,15 +751,12 @@ jit_rt_mul(Ty *ty, Value *result, Value *a, Value *b)
 
         STAT(arith_slow);
 
-        ptrdiff_t idx = result - vv(STACK);
-        vN(STACK) = idx + 2;
-
-        Value val = vm_2op(ty, OP_MUL, a, b);
-        *v_(STACK, idx) = val;
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_MUL, site, true);
 }
 
 static void
-jit_rt_div(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_div(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
         if (a->type == VALUE_INTEGER && b->type == VALUE_INTEGER) {
                 if (b->z == 0) ZeroDividePanic(ty);
@@ -773,15 +766,12 @@ jit_rt_div(Ty *ty, Value *result, Value *a, Value *b)
 
         STAT(arith_slow);
 
-        ptrdiff_t idx = result - vv(STACK);
-        vN(STACK) = idx + 2;
-
-        Value val = vm_2op(ty, OP_DIV, a, b);
-        *v_(STACK, idx) = val;
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_DIV, site, true);
 }
 
 static void
-jit_rt_mod(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_mod(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
         if (a->type == VALUE_INTEGER && b->type == VALUE_INTEGER) {
                 if (b->z == 0) ZeroDividePanic(ty);
@@ -791,11 +781,8 @@ jit_rt_mod(Ty *ty, Value *result, Value *a, Value *b)
 
         STAT(arith_slow);
 
-        ptrdiff_t idx = result - vv(STACK);
-        vN(STACK) = idx + 2;
-
-        Value val = vm_2op(ty, OP_MOD, a, b);
-        *v_(STACK, idx) = val;
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_MOD, site, true);
 }
 
 static void
@@ -1097,13 +1084,10 @@ jit_rt_try_tuple_member(Value *tos, Value *dst, bool required, int name_id)
                 return 0;
         }
 
-        if (tos->ids != NULL) {
-                for (int i = 0; i < tos->count; ++i) {
-                        if (tos->ids[i] == name_id) {
-                                *dst = tos->items[i];
-                                return 1;
-                        }
-                }
+        int i = tuple_slot(tos, name_id);
+        if (i != -1) {
+                *dst = tos->items[i];
+                return 1;
         }
 
         if (!required) {
@@ -1291,38 +1275,38 @@ jit_rt_truthy(Ty *ty, Value *v)
 }
 
 static void
-jit_rt_bit_and(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_bit_and(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
-        TOP_OF_STACK(a + 1);
-        DoBinaryOp(ty, OP_BIT_AND, true);
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_BIT_AND, site, true);
 }
 
 static void
-jit_rt_bit_or(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_bit_or(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
-        TOP_OF_STACK(a + 1);
-        DoBinaryOp(ty, OP_BIT_OR, true);
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_BIT_OR, site, true);
 }
 
 static void
-jit_rt_bit_xor(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_bit_xor(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
-        TOP_OF_STACK(a + 1);
-        DoBinaryOp(ty, OP_BIT_XOR, true);
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_BIT_XOR, site, true);
 }
 
 static void
-jit_rt_shl(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_shl(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
-        TOP_OF_STACK(a + 1);
-        DoBinaryOp(ty, OP_BIT_SHL, true);
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_BIT_SHL, site, true);
 }
 
 static void
-jit_rt_shr(Ty *ty, Value *result, Value *a, Value *b)
+jit_rt_shr(Ty *ty, Value *result, Value *a, Value *b, OpSite *site)
 {
-        TOP_OF_STACK(a + 1);
-        DoBinaryOp(ty, OP_BIT_SHR, true);
+        TOP_OF_STACK(b);
+        DoBinaryOpAt(ty, OP_BIT_SHR, site, true);
 }
 
 // Increment a Value in-place (mirrors static IncValue in vm.c)
@@ -1341,6 +1325,27 @@ jit_rt_dec(Ty *ty, Value *v)
         DecValue(ty, v);
 }
 
+// FOR_RANGE test with non-Int bounds: stop is at v[0], the counter at v[1]
+static int
+jit_rt_range_done(Ty *ty, Value *v, int kind)
+{
+        TOP_OF_STACK(v + 1);
+        return RangeLoopDone(ty, v, v + 1, kind);
+}
+
+// RANGE_NEXT step + test with non-Int bounds
+static int
+jit_rt_range_next(Ty *ty, Value *v, int kind)
+{
+        TOP_OF_STACK(v + 1);
+        if (kind == RANGE_LOOP_DOWN) {
+                DecValue(ty, v + 1);
+        } else {
+                IncValue(ty, v + 1);
+        }
+        return RangeLoopDone(ty, v, v + 1, kind);
+}
+
 static void
 jit_rt_post_inc(Ty *ty, Value *v, Value *top)
 {
@@ -1490,14 +1495,14 @@ static void
 jit_rt_string(Ty *ty, Value *result, i32 i)
 {
         InternEntry const *interned = intern_entry(&xD.strings, i);
-        *result = STRING_NOGC(interned->name, (uptr)interned->data);
+        *result = STRING_NOGC_LITERAL(interned->name, (uptr)interned->data);
 }
 
 static void
-jit_rt_binary_op(Ty *ty, Value *top, int op)
+jit_rt_binary_op(Ty *ty, Value *top, int op, OpSite *site)
 {
         vN(STACK) = top - vv(STACK);
-        DoBinaryOp(ty, op, true);
+        DoBinaryOpAt(ty, op, site, true);
 }
 
 static void
@@ -1697,6 +1702,14 @@ jit_rt_to_string(Ty *ty, Value *val)
         CallMethod(ty, NAMES._str_, 0, 0, false, true);
 }
 
+// Write barrier for a store through p while a mark cycle is active
+static void *
+jit_rt_gc_write(Ty *ty, void *p)
+{
+        GCWrite(ty, p);
+        return p;
+}
+
 // ASSIGN_GLOBAL: set global[n] = value
 static void
 jit_rt_assign_global(Ty *ty, int n, Value *val)
@@ -2076,11 +2089,6 @@ bc_prescan(JitCtx *ctx, char const *code, int code_size)
                 case INSTR_POP:
                 case INSTR_POP2:
                 case INSTR_SWAP:
-                case INSTR_ADD:
-                case INSTR_SUB:
-                case INSTR_MUL:
-                case INSTR_DIV:
-                case INSTR_MOD:
                 case INSTR_NEG:
                 case INSTR_NOT:
                 case INSTR_EQ:
@@ -2090,11 +2098,6 @@ bc_prescan(JitCtx *ctx, char const *code, int code_size)
                 case INSTR_LEQ:
                 case INSTR_GEQ:
                 case INSTR_CMP:
-                case INSTR_BIT_AND:
-                case INSTR_BIT_OR:
-                case INSTR_BIT_XOR:
-                case INSTR_SHL:
-                case INSTR_SHR:
                 case INSTR_CHECK_MATCH:
                 case INSTR_RETURN:
                 case INSTR_RETURN_PRESERVE_CTX:
@@ -2219,6 +2222,11 @@ bc_prescan(JitCtx *ctx, char const *code, int code_size)
                         BC_SKIP(i32);
                         break;
 
+                case INSTR_RECORD_MEMBER:
+                        BC_SKIP(i32);
+                        BC_SKIP(i32);
+                        break;
+
                 case INSTR_TARGET_MEMBER:
                 case INSTR_TARGET_SELF_MEMBER:
                         BC_SKIP(i32);
@@ -2272,6 +2280,16 @@ bc_prescan(JitCtx *ctx, char const *code, int code_size)
                         break;
                 }
 
+                case INSTR_FOR_RANGE:
+                case INSTR_RANGE_NEXT: {
+                        int off;
+                        BC_READ(off);
+                        int target = (int)(ip - code) + off;
+                        if (bc_label_for(ctx, target) < 0) return false;
+                        BC_SKIP(u8);  // kind
+                        break;
+                }
+
                 case INSTR_CALL:
                         BC_SKIP(i32);  // n (argc)
                         BC_READ(nkw);
@@ -2408,9 +2426,26 @@ bc_prescan(JitCtx *ctx, char const *code, int code_size)
                 case INSTR_INCRANGE:
                         break;
 
+                case INSTR_ADD:
+                case INSTR_SUB:
+                case INSTR_MUL:
+                case INSTR_DIV:
+                case INSTR_MOD:
+                case INSTR_BIT_AND:
+                case INSTR_BIT_OR:
+                case INSTR_BIT_XOR:
+                case INSTR_SHL:
+                case INSTR_SHR:
+                        BC_SKIP(uptr);
+                        break;
+
                 case INSTR_UNARY_OP:
+                        BC_SKIP(i32);
+                        break;
+
                 case INSTR_BINARY_OP:
                         BC_SKIP(i32);
+                        BC_SKIP(uptr);
                         break;
 
                 case INSTR_MATCH_TAG: {
@@ -2955,7 +2990,7 @@ jit_rt_concat_strings(Ty *ty, Value *result, Value *base, int n)
                 Value *v = (Value *)((char *)base + i * VALUE_SIZE);
                 total += sN(*v);
         }
-        char *str = uAo(total, GC_STRING);
+        char *str = value_string_alloc_unchecked(ty, total);
         usize k = 0;
         for (int i = 0; i < n; ++i) {
                 Value *v = (Value *)((char *)base + i * VALUE_SIZE);
@@ -3061,6 +3096,39 @@ bc_emit_deref(JitCtx *ctx, int dst, int src, int src_off)
         jit_emit_label(asm, lbl_skip);
 }
 
+// Inline stores into heap blocks are only safe while no mark cycle is
+// active; otherwise take the slow path, which runs the write barrier.
+static void
+bc_emit_gc_black_guard(JitCtx *ctx, int lbl_slow)
+{
+        dasm_State **asm = &ctx->asm;
+
+        jit_emit_ldr64(asm, BC_S0, BC_TY, OFF_TY_GROUP);
+        jit_emit_ldrb(asm, BC_S0, BC_S0, OFF_GROUP_BLACK);
+        jit_emit_cbnz(asm, BC_S0, lbl_slow);
+}
+
+// Runs the write barrier on the block at reg (a Value cell) when a mark
+// cycle is active. reg is reloaded afterwards; the other scratch registers
+// are clobbered.
+static void
+bc_emit_gc_write(JitCtx *ctx, int reg)
+{
+        dasm_State **asm = &ctx->asm;
+
+        int lbl_skip = bc_next_label(ctx);
+
+        jit_emit_ldr64(asm, BC_S0, BC_TY, OFF_TY_GROUP);
+        jit_emit_ldrb(asm, BC_S0, BC_S0, OFF_GROUP_BLACK);
+        jit_emit_cbz(asm, BC_S0, lbl_skip);
+        jit_emit_mov(asm, BC_A0, BC_TY);
+        jit_emit_mov(asm, BC_A1, reg);
+        jit_emit_load_imm(asm, BC_CALL, (iptr)jit_rt_gc_write);
+        jit_emit_call_reg(asm, BC_CALL);
+        jit_emit_mov(asm, reg, BC_RET);
+        jit_emit_label(asm, lbl_skip);
+}
+
 static void
 bc_emit_interrupt_check(JitCtx *ctx)
 {
@@ -3164,6 +3232,24 @@ bc_emit_binop_helper(JitCtx *ctx, void *helper)
         ctx->sp--;
 }
 
+// Same as bc_emit_binop_helper, but the helper also gets the instruction's OpSite
+static void
+bc_emit_binop_site(JitCtx *ctx, void *helper, uptr site)
+{
+        dasm_State **asm = &ctx->asm;
+
+        jit_emit_mov(asm, BC_A0, BC_TY);
+        jit_emit_add_imm(asm, BC_A1, BC_OPS, OP_OFF(ctx->sp - 2));
+        jit_emit_mov(asm, BC_A2, BC_A1);
+        jit_emit_add_imm(asm, BC_A3, BC_OPS, OP_OFF(ctx->sp - 1));
+        jit_emit_load_imm(asm, BC_A4, site);
+
+        jit_emit_load_imm(asm, BC_CALL, (iptr)helper);
+        jit_emit_call_reg(asm, BC_CALL);
+
+        ctx->sp--;
+}
+
 static void
 bc_emit_unop_helper(JitCtx *ctx, void *helper)
 {
@@ -3178,7 +3264,7 @@ bc_emit_unop_helper(JitCtx *ctx, void *helper)
 }
 
 static void
-bc_emit_arith(JitCtx *ctx, void *helper)
+bc_emit_arith(JitCtx *ctx, void *helper, uptr site)
 {
         dasm_State **asm = &ctx->asm;
         int a_off = OP_OFF(ctx->sp - 2);
@@ -3295,7 +3381,7 @@ bc_emit_arith(JitCtx *ctx, void *helper)
 
         // Slow path
         jit_emit_label(asm, lbl_slow);
-        bc_emit_binop_helper(ctx, helper); // sp--
+        bc_emit_binop_site(ctx, helper, site); // sp--
         jit_emit_label(asm, lbl_done);
 }
 
@@ -3622,6 +3708,8 @@ bc_emit_self_member_write_fast(JitCtx *ctx, int member_id, char const *bc_ip)
         jit_emit_cmp_ri(asm, BC_S0, 0);
         jit_emit_branch_ne(asm, lbl_slow);
 
+        bc_emit_gc_black_guard(ctx, lbl_slow);
+
         // Fast path: load self.object => BC_S2, copy val to slot
         EMIT_STAT(jit_rt_stat_self_member_write_fast);
         jit_emit_ldr64(asm, BC_S2, BC_S3, VAL_OFF_OBJECT);
@@ -4392,25 +4480,40 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                         break;
                 }
 
-                CASE(ADD)
-                        bc_emit_arith(ctx, (void *)jit_rt_add);
+                CASE(ADD) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_add, site);
                         break;
+                }
 
-                CASE(SUB)
-                        bc_emit_arith(ctx, (void *)jit_rt_sub);
+                CASE(SUB) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_sub, site);
                         break;
+                }
 
-                CASE(MUL)
-                        bc_emit_arith(ctx, (void *)jit_rt_mul);
+                CASE(MUL) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_mul, site);
                         break;
+                }
 
-                CASE(DIV)
-                        bc_emit_arith(ctx, (void *)jit_rt_div);
+                CASE(DIV) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_div, site);
                         break;
+                }
 
-                CASE(MOD)
-                        bc_emit_arith(ctx, (void *)jit_rt_mod);
+                CASE(MOD) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_mod, site);
                         break;
+                }
 
                 CASE(NEG) {
                         int off = OP_OFF(ctx->sp - 1);
@@ -4868,6 +4971,88 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                         break;
                 }
 
+                CASE(FOR_RANGE)
+                CASE(RANGE_NEXT) {
+                        int n;
+                        u8 kind;
+                        BC_READ(n);
+                        int target = (int)(ip - code) + n;
+                        BC_READ(kind);
+                        if (op == INSTR_RANGE_NEXT) {
+                                IRQ_CHECK(n);
+                        }
+                        int lbl_target = bc_find_label(ctx, target);
+                        if (lbl_target < 0) BAIL("invalid jump target %d", target);
+
+                        // ops[sp-2] is the bound, ops[sp-1] the counter
+                        int stop_off = OP_OFF(ctx->sp - 2);
+                        int i_off = OP_OFF(ctx->sp - 1);
+
+                        int lbl_slow = bc_next_label(ctx);
+                        int lbl_done = bc_next_label(ctx);
+
+                        // === Integer fast path ===
+                        jit_emit_ldrb(asm, BC_S0, BC_OPS, stop_off + VAL_OFF_TYPE);
+                        jit_emit_cmp_ri(asm, BC_S0, VALUE_INTEGER);
+                        jit_emit_branch_ne(asm, lbl_slow);
+                        jit_emit_ldrb(asm, BC_S0, BC_OPS, i_off + VAL_OFF_TYPE);
+                        jit_emit_cmp_ri(asm, BC_S0, VALUE_INTEGER);
+                        jit_emit_branch_ne(asm, lbl_slow);
+
+                        jit_emit_ldr64(asm, BC_S0, BC_OPS, i_off + VAL_OFF_Z);
+                        if (op == INSTR_RANGE_NEXT) {
+                                jit_emit_load_imm(asm, BC_S1, 1);
+                                if (kind == RANGE_LOOP_DOWN) {
+                                        jit_emit_sub(asm, BC_S0, BC_S0, BC_S1);
+                                } else {
+                                        jit_emit_add(asm, BC_S0, BC_S0, BC_S1);
+                                }
+                                jit_emit_str64(asm, BC_S0, BC_OPS, i_off + VAL_OFF_Z);
+                        }
+                        jit_emit_ldr64(asm, BC_S1, BC_OPS, stop_off + VAL_OFF_Z);
+                        jit_emit_cmp_rr(asm, BC_S0, BC_S1);
+
+                        // FOR_RANGE leaves the loop when done; RANGE_NEXT
+                        // goes back to the body when not
+                        if (op == INSTR_FOR_RANGE) {
+                                switch (kind) {
+                                case RANGE_LOOP_UP:           jit_emit_branch_ge(asm, lbl_target); break;
+                                case RANGE_LOOP_UP_INCLUSIVE: jit_emit_branch_gt(asm, lbl_target); break;
+                                case RANGE_LOOP_DOWN:         jit_emit_branch_lt(asm, lbl_target); break;
+                                }
+                        } else {
+                                switch (kind) {
+                                case RANGE_LOOP_UP:           jit_emit_branch_lt(asm, lbl_target); break;
+                                case RANGE_LOOP_UP_INCLUSIVE: jit_emit_branch_le(asm, lbl_target); break;
+                                case RANGE_LOOP_DOWN:         jit_emit_branch_ge(asm, lbl_target); break;
+                                }
+                        }
+                        jit_emit_jump(asm, lbl_done);
+
+                        // === Slow path: jit_rt_range_{done,next}(ty, &ops[sp-2], kind) ===
+                        jit_emit_label(asm, lbl_slow);
+                        jit_emit_mov(asm, BC_A0, BC_TY);
+                        jit_emit_add_imm(asm, BC_A1, BC_OPS, stop_off);
+                        jit_emit_load_imm(asm, BC_A2, kind);
+                        jit_emit_load_imm(
+                                asm,
+                                BC_CALL,
+                                (op == INSTR_FOR_RANGE) ? (iptr)jit_rt_range_done
+                                                        : (iptr)jit_rt_range_next
+                        );
+                        jit_emit_call_reg(asm, BC_CALL);
+                        jit_emit_cmp_ri32(asm, BC_RET, 0);
+                        if (op == INSTR_FOR_RANGE) {
+                                jit_emit_branch_ne(asm, lbl_target);
+                        } else {
+                                jit_emit_branch_eq(asm, lbl_target);
+                        }
+
+                        jit_emit_label(asm, lbl_done);
+                        bc_set_label_sp(ctx, target, ctx->sp);
+                        break;
+                }
+
                 CASE(MEMBER_ACCESS) {
                         char const *op_ip = code + off;
                         int z;
@@ -4942,6 +5127,27 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                         break;
                 }
 
+                CASE(RECORD_MEMBER) {
+                        int z;
+                        int slot;
+                        BC_READ(z);
+                        BC_READ(slot);
+
+                        // The helper finds tuple members through their layout
+                        // index, so the slot hint isn't needed here
+                        (void)slot;
+
+                        jit_emit_mov(asm, BC_A0, BC_TY);
+                        jit_emit_add_imm(asm, BC_A1, BC_OPS, OP_OFF(ctx->sp - 1));
+                        jit_emit_mov(asm, BC_A2, BC_A1);
+                        jit_emit_load_imm(asm, BC_A3, z);
+                        jit_emit_load_imm(asm, BC_CALL, (iptr)jit_rt_member);
+                        jit_emit_call_reg(asm, BC_CALL);
+
+                        DBG("RECORD_MEMBER");
+                        break;
+                }
+
                 CASE(TRY_MEMBER_ACCESS) {
                         int z;
                         BC_READ(z);
@@ -5032,6 +5238,8 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                                                                 jit_emit_cmp_ri(asm, BC_S0, class_id);
                                                                 jit_emit_branch_ne(asm, lbl_slow);
 
+                                                                bc_emit_gc_black_guard(ctx, lbl_slow);
+
                                                                 // Fast: load obj.object => BC_S2, copy val to slot
                                                                 EMIT_STAT(jit_rt_stat_member_set_fast);
                                                                 jit_emit_ldr64(asm, BC_S2, BC_OPS, obj_off + VAL_OFF_OBJECT);
@@ -5662,6 +5870,10 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                         jit_emit_cmp_ri(asm, BC_S0, VALUE_REF);
                         jit_emit_branch_ne(asm, lbl_done);
                         jit_emit_ldr64(asm, BC_S3, BC_S3, VAL_OFF_REF);
+                        if (ip < end && (u8)*ip == INSTR_ASSIGN) {
+                                // The cell is a heap block; the local itself is not
+                                bc_emit_gc_write(ctx, BC_S3);
+                        }
                         jit_emit_jump(asm, lbl_loop);
                         jit_emit_label(asm, lbl_done);
                         if (ip < end && (u8)*ip == INSTR_ASSIGN) {
@@ -5775,6 +5987,8 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                                 jit_emit_cmp_ri(asm, BC_S0, VALUE_INTEGER);
                                 jit_emit_branch_ne(asm, lbl_slow);
 
+                                bc_emit_gc_black_guard(ctx, lbl_slow);
+
                                 // Load index
                                 jit_emit_ldr64(asm, BC_S0, BC_OPS, sub_off + VAL_OFF_Z); // idx
 
@@ -6223,25 +6437,40 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                         BC_SKIPSTR();
                         break;
 
-                CASE(BIT_AND)
-                        bc_emit_arith(ctx, (void *)jit_rt_bit_and);
+                CASE(BIT_AND) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_bit_and, site);
                         break;
+                }
 
-                CASE(BIT_OR)
-                        bc_emit_arith(ctx, (void *)jit_rt_bit_or);
+                CASE(BIT_OR) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_bit_or, site);
                         break;
+                }
 
-                CASE(BIT_XOR)
-                        bc_emit_arith(ctx, (void *)jit_rt_bit_xor);
+                CASE(BIT_XOR) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_bit_xor, site);
                         break;
+                }
 
-                CASE(SHL)
-                        bc_emit_arith(ctx, (void *)jit_rt_shl);
+                CASE(SHL) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_shl, site);
                         break;
+                }
 
-                CASE(SHR)
-                        bc_emit_arith(ctx, (void *)jit_rt_shr);
+                CASE(SHR) {
+                        uptr site;
+                        BC_READ(site);
+                        bc_emit_arith(ctx, (void *)jit_rt_shr, site);
                         break;
+                }
 
                 CASE(INC) {
                         int off = OP_OFF(ctx->sp - 1);
@@ -6463,10 +6692,13 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
 
                 CASE(BINARY_OP) {
                         int n;
+                        uptr site;
                         BC_READ(n);
+                        BC_READ(site);
                         jit_emit_mov(asm, BC_A0, BC_TY);
                         jit_emit_add_imm(asm, BC_A1, BC_OPS, OP_OFF(ctx->sp));
                         jit_emit_load_imm(asm, BC_A2, n);
+                        jit_emit_load_imm(asm, BC_A3, site);
                         jit_emit_load_imm(asm, BC_CALL, (iptr)jit_rt_binary_op);
                         jit_emit_call_reg(asm, BC_CALL);
                         ctx->sp--;
@@ -6582,6 +6814,7 @@ bc_emit(JitCtx *ctx, char const *code, int code_size)
                                 int val_off = OP_OFF(ctx->sp - 1);
                                 // Load env[n] pointer
                                 jit_emit_ldr64(asm, BC_S2, BC_ENV, n * 8);
+                                bc_emit_gc_write(ctx, BC_S2);
                                 // Copy value to *env[n]
                                 bc_copy_value(ctx, BC_S2, 0, BC_OPS, val_off);
                         } else if (ip < end && ((u8)*ip == INSTR_MUT_ADD || (u8)*ip == INSTR_MUT_SUB)) {
@@ -28,6 +28,8 @@ typedef byte_vector str;
 
 static _Thread_local vec(void const *) Visiting;
 
+static _Thread_local Value Keys[64];
+
 inline static char
 peek(void)
 {
@@ -193,13 +195,13 @@ next8x(Ty *ty)
              | (b0 << 4);
 }
 
-static Value
-string(Ty *ty)
+static void
+string_bytes(Ty *ty, byte_vector *out)
 {
         if (next() != '"')
                 FAIL;
 
-        byte_vector str = {0};
+        byte_vector str = *out;
 
         char b[8] = {0};
         i32 cp;
@@ -243,10 +245,20 @@ string(Ty *ty)
                 }
         }
 
+        *out = str;
+
         if (next() != '"')
                 FAIL;
+}
+
+static Value
+string(Ty *ty)
+{
+        byte_vector str = {0};
+
+        string_bytes(ty, &str);
 
-        n = str.count;
+        usize n = str.count;
 
         if (n == 0)
                 return STRING_NOGC(NULL, 0);
@@ -259,6 +271,46 @@ string(Ty *ty)
         return STRING(s, n);
 }
 
+/*
+ * Objects in the same document tend to have the same keys, so the last few
+ * we've seen are kept around and handed out again instead of a new copy. A
+ * reused key also brings along its cached hash, so putting it in the next
+ * object's Dict doesn't have to hash it again. The collector is stopped for
+ * the whole parse, so nothing in here can be freed from under us.
+ */
+static Value
+key(Ty *ty)
+{
+        byte_vector str = {0};
+
+        string_bytes(ty, &str);
+
+        usize n = str.count;
+
+        if (n == 0) {
+                return STRING_NOGC(NULL, 0);
+        }
+
+        u8 const *p = (u8 const *)str.items;
+        Value *k = &Keys[(n * 31 + p[0] * 7 + p[n - 1]) % countof(Keys)];
+
+        if (
+                k->type == VALUE_STRING
+             && k->bytes == n
+             && memcmp(k->str, p, n) == 0
+        ) {
+                xvF(str);
+                return *k;
+        }
+
+        char *s = value_string_alloc(ty, n);
+        memcpy(s, p, n);
+
+        xvF(str);
+
+        return (*k = STRING(s, n));
+}
+
 static Value
 array(Ty *ty)
 {
@@ -290,12 +342,12 @@ object_lol(Ty *ty)
 
         while (peek() != '\0' && peek() != '}') {
                 space();
-                Value key = string(ty);
+                Value k = key(ty);
                 space();
                 if (next() != ':')
                         FAIL;
                 Value val = value(ty);
-                dict_put_value(ty, obj, key, val);
+                dict_put_value(ty, obj, k, val);
                 space();
                 if (peek() != '}' && next() != ',')
                         FAIL;
@@ -344,14 +396,17 @@ object_xD(Ty *ty)
         if (next() != '}')
                 FAIL;
 
-        Value object = value_record(ty, vN(keys));
+        Value object = vT(vN(keys));
+        i32Vector ids = {0};
 
         for (u32 i = 0; i < vN(keys); ++i) {
                 char const *key = TY_TMP_C_STR(v__(keys, i));
-                object.ids[i]   = M_ID(key);
+                svP(ids, M_ID(key));
                 object.items[i] = v__(values, i);
         }
 
+        object.ids = tuple_ids(ty, &object, vv(ids));
+
         SCRATCH_RESTORE();
 
         return object;
@@ -569,12 +624,13 @@ encode(Ty *ty, Value const *v, str *out)
                                 xvP(*out, ',');
                         }
                         if (v->object->dynamic != NULL) {
-                                for (int i = 0; i < vN(v->object->dynamic->ids); ++i) {
-                                        char const *name = M_NAME(v__(v->object->dynamic->ids, i));
+                                struct dynamic const *d = v->object->dynamic;
+                                for (u32 i = 0; i < dynamic_count(d); ++i) {
+                                        char const *name = M_NAME(dynamic_id(d, i));
                                         xvPn(*out, name, strlen(name));
                                         xvP(*out, '"');
                                         xvP(*out, ':');
-                                        if (!encode(ty, &v->object->slots[i], out)) {
+                                        if (!encode(ty, dynamic_value(d, i), out)) {
                                                 return false;
                                         }
                                         xvP(*out, ',');
@@ -649,6 +705,8 @@ json_parse(Ty *ty, char const *s, usize n)
 
         xd = false;
 
+        memset(Keys, 0, sizeof Keys);
+
         GC_STOP();
 
         if (setjmp(jb) != 0) {
@@ -676,6 +734,8 @@ json_parse_xD(Ty *ty, char const *s, usize n)
 
         xd = true;
 
+        memset(Keys, 0, sizeof Keys);
+
         GC_STOP();
 
         if (setjmp(jb) != 0) {
@@ -800,7 +860,7 @@ typed_value(Ty *ty, Type *t0)
 
                         while (peek() != '\0' && peek() != '}') {
                                 space();
-                                Value key = string(ty);
+                                Value k = key(ty);
                                 space();
                                 if (next() != ':') {
                                         FAIL;
@@ -811,7 +871,7 @@ typed_value(Ty *ty, Type *t0)
                                 } else {
                                         val = value(ty);
                                 }
-                                dict_put_value(ty, obj, key, val);
+                                dict_put_value(ty, obj, k, val);
                                 space();
                                 if (peek() != '}' && next() != ',') {
                                         FAIL;
@@ -884,14 +944,17 @@ typed_value(Ty *ty, Type *t0)
                         FAIL;
                 }
 
-                Value object = value_record(ty, vN(keys));
+                Value object = vT(vN(keys));
+                i32Vector ids = {0};
 
                 for (u32 i = 0; i < vN(keys); ++i) {
                         char const *key = TY_TMP_C_STR(v__(keys, i));
-                        object.ids[i]   = M_ID(key);
+                        svP(ids, M_ID(key));
                         object.items[i] = v__(values, i);
                 }
 
+                object.ids = tuple_ids(ty, &object, vv(ids));
+
                 for (int i = 0; i < nfields; ++i) {
                         if (!v__(t0->required, i)) {
                                 continue;
@@ -956,6 +1019,8 @@ json_parse_typed(Ty *ty, Type *t0, char const *s, usize n)
 
         xd = true;
 
+        memset(Keys, 0, sizeof Keys);
+
         GC_STOP();
 
         if (setjmp(jb) != 0) {
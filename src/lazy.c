@@ -0,0 +1,422 @@
+#include "ty.h"
+#include "class.h"
+#include "gc.h"
+#include "lazy.h"
+#include "operators.h"
+#include "value.h"
+#include "vm.h"
+#include "xd.h"
+
+inline static LazyIter *
+Up(LazyIter const *it)
+{
+        return it->src.gcptr;
+}
+
+static LazyIter *
+NewIter(Ty *ty, int kind, Value const *src)
+{
+        LazyIter *it = mAo(sizeof *it, GC_LAZY);
+
+        it->kind = kind;
+        it->done = false;
+        it->src  = *src;
+        it->f    = NIL;
+        it->cur  = NIL;
+        it->i    = 0;
+        it->n    = 0;
+
+        return it;
+}
+
+/*
+ * Ranges are counted directly rather than through Range.__iter__, which goes
+ * by way of a generator. A Range built with a > b counts down from a - 1 to b
+ * like __iter__ does.
+ */
+static LazyIter *
+CountRange(Ty *ty, Value const *r)
+{
+        Value *a = ObjectMember(*r, NAMES.a);
+        Value *b = ObjectMember(*r, NAMES.b);
+
+        if (
+                (a == NULL || a->type != VALUE_INTEGER)
+             || (b == NULL || b->type != VALUE_INTEGER)
+        ) {
+                return NULL;
+        }
+
+        LazyIter *it = NewIter(ty, LAZY_COUNT, &NIL);
+
+        if (a->z <= b->z) {
+                it->i = a->z;
+                it->n = b->z - a->z;
+                it->f = INTEGER(1);
+        } else {
+                it->i = a->z - 1;
+                it->n = a->z - b->z;
+                it->f = INTEGER(-1);
+        }
+
+        return it;
+}
+
+LazyIter *
+lazy_new(Ty *ty, Value const *xs)
+{
+        LazyIter *it;
+        Value *vp;
+        Value ys;
+        int c;
+
+        switch (xs->type) {
+        case VALUE_ARRAY:  return NewIter(ty, LAZY_ARRAY, xs);
+        case VALUE_TUPLE:  return NewIter(ty, LAZY_TUPLE, xs);
+        case VALUE_BLOB:   return NewIter(ty, LAZY_BLOB, xs);
+        case VALUE_STRING: return NewIter(ty, LAZY_STRING, xs);
+
+        case VALUE_PTR:
+                if ((it = lazy_of(xs)) != NULL) {
+                        return it;
+                }
+                break;
+
+        case VALUE_OBJECT:
+                if (
+                        (xs->class == CLASS_RANGE || xs->class == CLASS_INC_RANGE)
+                     && (it = CountRange(ty, xs)) != NULL
+                ) {
+                        return it;
+                }
+                break;
+        }
+
+        c = ClassOf(xs);
+
+        if (c >= 0 && (vp = class_lookup_method_i(ty, c, NAMES._next_)) != NULL) {
+                gP(xs);
+                it = NewIter(ty, LAZY_NEXT, xs);
+                it->f = *vp;
+                gX();
+                return it;
+        }
+
+        if (c >= 0 && (vp = class_lookup_method_i(ty, c, NAMES._iter_)) != NULL) {
+                ys = vm_call_method(ty, xs, vp, 0);
+                gP(&ys);
+                it = lazy_new(ty, &ys);
+                gX();
+                return it;
+        }
+
+        zP("lazy(): value is not iterable: %s", VSC(xs));
+}
+
+LazyIter *
+lazy_stage(Ty *ty, int kind, LazyIter *up, Value const *f, imax n)
+{
+        Value src = LAZY(up);
+
+        gP(&src);
+        gP(f);
+
+        LazyIter *it = NewIter(ty, kind, &src);
+        it->f = *f;
+        it->n = n;
+
+        gX();
+        gX();
+
+        return it;
+}
+
+/*
+ * Sources and stages that produce one value per pull. Returns false once the
+ * stage is exhausted; after that it stays exhausted.
+ */
+bool
+lazy_next(Ty *ty, LazyIter *it, Value *out)
+{
+        Value x;
+        Value v;
+        Value t;
+        Array *a;
+        Array *zip;
+        bool ok;
+        u32 n;
+
+        if (it->done) {
+                return false;
+        }
+
+        switch (it->kind) {
+        case LAZY_ARRAY:
+                if (it->i < vN(*it->src.array)) {
+                        *out = v__(*it->src.array, it->i++);
+                        return true;
+                }
+                break;
+
+        case LAZY_TUPLE:
+                if (it->i < it->src.count) {
+                        *out = it->src.items[it->i++];
+                        return true;
+                }
+                break;
+
+        case LAZY_BLOB:
+                if (it->i < vN(*it->src.blob)) {
+                        *out = INTEGER(v__(*it->src.blob, it->i++));
+                        return true;
+                }
+                break;
+
+        case LAZY_STRING:
+                if (it->i < sN(it->src)) {
+                        n = u8_rune_sz(ss(it->src) + it->i);
+                        *out = STRING_VIEW(it->src, it->i, n);
+                        it->i += n;
+                        return true;
+                }
+                break;
+
+        case LAZY_COUNT:
+                if (it->n > 0) {
+                        *out = INTEGER(it->i);
+                        it->i += it->f.z;
+                        it->n -= 1;
+                        return true;
+                }
+                break;
+
+        case LAZY_NEXT:
+                x = vm_call_method(ty, &it->src, &it->f, 0);
+                if (TryUnwrap(&x, TAG_SOME)) {
+                        *out = x;
+                        return true;
+                }
+                if (x.type != VALUE_TAG || x.tag != TAG_NONE) {
+                        zP(
+                                "iterator returned invalid type. "
+                                "Expected None or Some(...) but got %s",
+                                VSC(&x)
+                        );
+                }
+                break;
+
+        case LAZY_MAP:
+                if (lazy_next(ty, Up(it), &x)) {
+                        *out = vm_call1(ty, &it->f, &x);
+                        return true;
+                }
+                break;
+
+        case LAZY_FILTER:
+                while (lazy_next(ty, Up(it), &x)) {
+                        gP(&x);
+                        v = vm_call1(ty, &it->f, &x);
+                        gX();
+                        if (value_truthy(ty, &v)) {
+                                *out = x;
+                                return true;
+                        }
+                }
+                break;
+
+        case LAZY_TAKE:
+                if (it->n > 0 && lazy_next(ty, Up(it), out)) {
+                        it->n -= 1;
+                        return true;
+                }
+                break;
+
+        case LAZY_DROP:
+                for (; it->n > 0; --it->n) {
+                        if (!lazy_next(ty, Up(it), &x)) {
+                                goto Done;
+                        }
+                }
+                if (lazy_next(ty, Up(it), out)) {
+                        return true;
+                }
+                break;
+
+        case LAZY_ENUMERATE:
+                if (lazy_next(ty, Up(it), &x)) {
+                        gP(&x);
+                        *out = PAIR(INTEGER(it->i), x);
+                        it->i += 1;
+                        gX();
+                        return true;
+                }
+                break;
+
+        case LAZY_ZIP:
+                zip = it->f.array;
+                t = vT(1 + vN(*zip));
+                for (usize i = 0; i < t.count; ++i) {
+                        t.items[i] = NIL;
+                }
+                gP(&t);
+                ok = lazy_next(ty, Up(it), &t.items[0]);
+                for (usize i = 0; ok && i < vN(*zip); ++i) {
+                        ok = lazy_next(ty, v__(*zip, i).gcptr, &t.items[1 + i]);
+                }
+                gX();
+                if (ok) {
+                        *out = t;
+                        return true;
+                }
+                break;
+
+        case LAZY_CHUNK:
+                a = vA();
+                v = ARRAY(a);
+                gP(&v);
+                while (vN(*a) < it->n && lazy_next(ty, Up(it), &x)) {
+                        vAp(a, x);
+                }
+                gX();
+                if (vN(*a) > 0) {
+                        *out = v;
+                        return true;
+                }
+                break;
+
+        case LAZY_FLAT_MAP:
+                for (;;) {
+                        if (it->cur.type == VALUE_PTR && lazy_next(ty, it->cur.gcptr, out)) {
+                                return true;
+                        }
+                        if (!lazy_next(ty, Up(it), &x)) {
+                                break;
+                        }
+                        GCWrite(ty, it);
+                        it->cur = NIL;
+                        v = vm_call1(ty, &it->f, &x);
+                        gP(&v);
+                        LazyIter *cur = lazy_new(ty, &v);
+                        GCWrite(ty, it);
+                        it->cur = LAZY(cur);
+                        gX();
+                }
+                break;
+        }
+
+Done:
+        GCWrite(ty, it);
+        it->done = true;
+        it->cur = NIL;
+
+        return false;
+}
+
+Value
+lazy_sum(Ty *ty, LazyIter *it, Value const *zero)
+{
+        Value sum;
+        Value x;
+
+        if (zero != NULL) {
+                sum = *zero;
+        } else if (!lazy_next(ty, it, &sum)) {
+                return NIL;
+        }
+
+        /*
+         * The running total stays on the root set while the pipeline runs;
+         * its slot is overwritten in place after each step.
+         */
+        gP(&sum);
+
+        while (lazy_next(ty, it, &x)) {
+                if (PACK_TYPES(sum.type, x.type) == PAIR_OF(VALUE_INTEGER)) {
+                        sum.z += x.z;
+                } else if (PACK_TYPES(sum.type, x.type) == PAIR_OF(VALUE_REAL)) {
+                        sum.real += x.real;
+                } else {
+                        sum = vm_2op(ty, OP_ADD, &sum, &x);
+                }
+                *vvL(RootSet) = sum;
+        }
+
+        gX();
+
+        return sum;
+}
+
+Value
+lazy_collect(Ty *ty, LazyIter *it)
+{
+        Array *a = vA();
+        Value v = ARRAY(a);
+        Value x;
+
+        gP(&v);
+
+        while (lazy_next(ty, it, &x)) {
+                vAp(a, x);
+        }
+
+        gX();
+
+        return v;
+}
+
+Value
+lazy_fold(Ty *ty, LazyIter *it, Value const *x, Value const *f)
+{
+        Value acc;
+        Value y;
+
+        if (x != NULL) {
+                acc = *x;
+        } else if (!lazy_next(ty, it, &acc)) {
+                return NIL;
+        }
+
+        gP(&acc);
+
+        while (lazy_next(ty, it, &y)) {
+                acc = vm_eval_function(ty, f, &acc, &y, NULL);
+                *vvL(RootSet) = acc;
+        }
+
+        gX();
+
+        return acc;
+}
+
+imax
+lazy_count(Ty *ty, LazyIter *it)
+{
+        imax n = 0;
+        Value x;
+
+        while (lazy_next(ty, it, &x)) {
+                n += 1;
+        }
+
+        return n;
+}
+
+void
+lazy_each(Ty *ty, LazyIter *it, Value const *f)
+{
+        Value x;
+
+        while (lazy_next(ty, it, &x)) {
+                vm_call1(ty, f, &x);
+        }
+}
+
+void
+lazy_mark(Ty *ty, LazyIter *it)
+{
+        xvP(ty->marking, &it->src);
+        xvP(ty->marking, &it->f);
+        xvP(ty->marking, &it->cur);
+}
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -37,6 +37,8 @@ typedef struct {
         Type *op0;
 } DispatchGroup;
 
+_Atomic(u32) OpEpoch;
+
 static struct {
         TyRwLock             lock;
         vec(DispatchGroup *) ops;
@@ -189,6 +191,8 @@ op_add(i32 op, i32 t1, i32 t2, i32 ref, Expr *expr)
         v0(group->cache);
         group->op0 = NULL;
 
+        atomic_fetch_add_explicit(&OpEpoch, 1, memory_order_relaxed);
+
         TyRwLockWrUnlock(&group->lock);
 }
 
@@ -253,6 +257,41 @@ SlowPath:
         return ref;
 }
 
+i32
+op_site_miss(Ty *ty, OpSite *site, i32 op, i32 t1, i32 t2)
+{
+        u32 epoch = atomic_load_explicit(&OpEpoch, memory_order_relaxed);
+        OpSiteEntry const *old = atomic_load_explicit(&site->entry, memory_order_acquire);
+        i32 ref = op_dispatch(ty, op, t1, t2);
+
+        if (old != NULL && old->epoch != epoch) {
+                old = NULL;
+        }
+
+        // Megamorphic: stop churning entries and let op_dispatch() handle it
+        if (ref == OP_NO_IMPL || (old != NULL && old->n == OP_SITE_WAYS)) {
+                return ref;
+        }
+
+        OpSiteEntry *e = xmA(sizeof *e);
+
+        if (old != NULL) {
+                *e = *old;
+        } else {
+                e->epoch = epoch;
+                e->n = 0;
+        }
+
+        e->ways[e->n].t1 = t1;
+        e->ways[e->n].t2 = t2;
+        e->ways[e->n].ref = ref;
+        e->n += 1;
+
+        atomic_store_explicit(&site->entry, e, memory_order_release);
+
+        return ref;
+}
+
 Expr *
 op_fun_info(i32 op, i32 t1, i32 t2)
 {
@@ -458,6 +497,8 @@ op_reset(U32Vector const *base)
         }
 
         vN(_2.ops) = vN(*base);
+
+        atomic_fetch_add_explicit(&OpEpoch, 1, memory_order_relaxed);
 }
 
 void
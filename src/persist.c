@@ -0,0 +1,900 @@
+#include "ty.h"
+#include "gc.h"
+#include "persist.h"
+#include "value.h"
+#include "vm.h"
+#include "xd.h"
+
+#define BITS  5
+#define WIDTH (1U << BITS)
+#define MASK  (WIDTH - 1)
+
+#define NODE(p) GCPTR((p), (p))
+
+typedef struct {
+        u64 key;
+        u64 h;
+        usize i;
+} MapEntry;
+
+inline static PersistNode *
+Child(Value const *v)
+{
+        return v->gcptr;
+}
+
+inline static bool
+IsLink(Value const *k)
+{
+        return k->type == VALUE_ZERO;
+}
+
+inline static u32
+Bit(u64 h, u32 shift)
+{
+        return 1U << ((h >> shift) & MASK);
+}
+
+inline static u32
+Index(u32 bitmap, u32 bit)
+{
+        return __builtin_popcount(bitmap & (bit - 1));
+}
+
+/*
+ * New nodes are zeroed so that they can be published (and so reached by the
+ * collector) before all of their slots have been filled in.
+ */
+static PersistNode *
+NewNode(Ty *ty, u32 n)
+{
+        PersistNode *node = mAo0(sizeof *node + n * sizeof (Value), GC_PERSIST_NODE);
+        node->n = n;
+        return node;
+}
+
+static PersistNode *
+CopyNode(Ty *ty, PersistNode const *node, u32 n)
+{
+        PersistNode *copy = NewNode(ty, n);
+        copy->bitmap = node->bitmap;
+        memcpy(copy->slots, node->slots, min(n, node->n) * sizeof (Value));
+        return copy;
+}
+
+/*
+ * Copies `node` with slot i replaced by x. `x` is usually a node that was just
+ * built and isn't reachable from anywhere else yet, so it's kept on the root
+ * set until it's been stored.
+ */
+static PersistNode *
+CopySetting(Ty *ty, PersistNode const *node, u32 n, u32 i, Value x)
+{
+        gP(&x);
+        PersistNode *copy = CopyNode(ty, node, n);
+        gX();
+
+        copy->slots[i] = x;
+
+        return copy;
+}
+
+static PersistMap *
+NewMap(Ty *ty, usize count, Value root)
+{
+        gP(&root);
+        PersistMap *m = mAo(sizeof *m, GC_PERSIST_MAP);
+        gX();
+
+        m->count = count;
+        m->root  = root;
+
+        return m;
+}
+
+static PersistVec *
+NewVec(Ty *ty, usize count, u32 shift, Value root, Value tail)
+{
+        gP(&root);
+        gP(&tail);
+        PersistVec *v = mAo(sizeof *v, GC_PERSIST_VEC);
+        gX();
+        gX();
+
+        v->count = count;
+        v->shift = shift;
+        v->root  = root;
+        v->tail  = tail;
+
+        return v;
+}
+
+static PersistNode *
+MapPair(
+        Ty *ty,
+        u32 shift,
+        Value const *k1,
+        Value const *v1,
+        u64 h1,
+        Value const *k2,
+        Value const *v2,
+        u64 h2
+)
+{
+        PersistNode *node;
+
+        if (shift >= 64) {
+                node = NewNode(ty, 4);
+                node->slots[0] = *k1;
+                node->slots[1] = *v1;
+                node->slots[2] = *k2;
+                node->slots[3] = *v2;
+                return node;
+        }
+
+        u32 b1 = Bit(h1, shift);
+        u32 b2 = Bit(h2, shift);
+
+        if (b1 == b2) {
+                Value child = NODE(MapPair(ty, shift + BITS, k1, v1, h1, k2, v2, h2));
+                gP(&child);
+                node = NewNode(ty, 2);
+                gX();
+                node->bitmap = b1;
+                node->slots[1] = child;
+                return node;
+        }
+
+        if (b1 > b2) {
+                SWAP(Value const *, k1, k2);
+                SWAP(Value const *, v1, v2);
+        }
+
+        node = NewNode(ty, 4);
+        node->bitmap = b1 | b2;
+        node->slots[0] = *k1;
+        node->slots[1] = *v1;
+        node->slots[2] = *k2;
+        node->slots[3] = *v2;
+
+        return node;
+}
+
+static PersistNode *
+MapPut(
+        Ty *ty,
+        PersistNode const *node,
+        u32 shift,
+        u64 h,
+        Value const *k,
+        Value const *v,
+        bool *added
+)
+{
+        PersistNode *copy;
+
+        if (shift >= 64) {
+                for (u32 i = 0; i < node->n; i += 2) {
+                        if (v_eq(&node->slots[i], k)) {
+                                return CopySetting(ty, node, node->n, i + 1, *v);
+                        }
+                }
+                copy = CopyNode(ty, node, node->n + 2);
+                copy->slots[node->n]     = *k;
+                copy->slots[node->n + 1] = *v;
+                *added = true;
+                return copy;
+        }
+
+        u32 bit = Bit(h, shift);
+        u32 i = 2 * Index(node->bitmap, bit);
+
+        if (!(node->bitmap & bit)) {
+                copy = NewNode(ty, node->n + 2);
+                copy->bitmap = node->bitmap | bit;
+                memcpy(copy->slots, node->slots, i * sizeof (Value));
+                memcpy(copy->slots + i + 2, node->slots + i, (node->n - i) * sizeof (Value));
+                copy->slots[i]     = *k;
+                copy->slots[i + 1] = *v;
+                *added = true;
+                return copy;
+        }
+
+        Value const *slot = &node->slots[i];
+
+        if (IsLink(&slot[0])) {
+                PersistNode *child = MapPut(ty, Child(&slot[1]), shift + BITS, h, k, v, added);
+                return CopySetting(ty, node, node->n, i + 1, NODE(child));
+        }
+
+        if (v_eq(&slot[0], k)) {
+                return CopySetting(ty, node, node->n, i + 1, *v);
+        }
+
+        u64 h2 = value_hash(ty, &slot[0]);
+        PersistNode *child = MapPair(ty, shift + BITS, &slot[0], &slot[1], h2, k, v, h);
+
+        copy = CopySetting(ty, node, node->n, i + 1, NODE(child));
+        copy->slots[i] = ZERO;
+        *added = true;
+
+        return copy;
+}
+
+static PersistNode *
+Without(Ty *ty, PersistNode const *node, u32 i, u32 bit)
+{
+        if (node->n == 2) {
+                return NULL;
+        }
+
+        PersistNode *copy = NewNode(ty, node->n - 2);
+        copy->bitmap = node->bitmap & ~bit;
+        memcpy(copy->slots, node->slots, i * sizeof (Value));
+        memcpy(copy->slots + i, node->slots + i + 2, (node->n - i - 2) * sizeof (Value));
+
+        return copy;
+}
+
+/*
+ * Returns `node` itself if `k` isn't there and NULL if removing it leaves the
+ * node empty. A child left holding a single pair is pulled up into its parent,
+ * so the trie doesn't keep long chains behind after the keys that caused them
+ * are gone.
+ */
+static PersistNode *
+MapRemove(Ty *ty, PersistNode const *node, u32 shift, u64 h, Value const *k)
+{
+        if (shift >= 64) {
+                for (u32 i = 0; i < node->n; i += 2) {
+                        if (v_eq(&node->slots[i], k)) {
+                                return Without(ty, node, i, 0);
+                        }
+                }
+                return (PersistNode *)node;
+        }
+
+        u32 bit = Bit(h, shift);
+        u32 i = 2 * Index(node->bitmap, bit);
+
+        if (!(node->bitmap & bit)) {
+                return (PersistNode *)node;
+        }
+
+        Value const *slot = &node->slots[i];
+
+        if (!IsLink(&slot[0])) {
+                return v_eq(&slot[0], k)
+                     ? Without(ty, node, i, bit)
+                     : (PersistNode *)node;
+        }
+
+        PersistNode *old = Child(&slot[1]);
+        PersistNode *child = MapRemove(ty, old, shift + BITS, h, k);
+
+        if (child == old) {
+                return (PersistNode *)node;
+        }
+
+        if (child == NULL) {
+                return Without(ty, node, i, bit);
+        }
+
+        if (child->n == 2 && !IsLink(&child->slots[0])) {
+                Value key = child->slots[0];
+                PersistNode *copy = CopySetting(ty, node, node->n, i + 1, child->slots[1]);
+                copy->slots[i] = key;
+                return copy;
+        }
+
+        return CopySetting(ty, node, node->n, i + 1, NODE(child));
+}
+
+static int
+MapEntryCompare(void const *a, void const *b)
+{
+        MapEntry const *x = a;
+        MapEntry const *y = b;
+
+        if (x->key != y->key) {
+                return (x->key < y->key) ? -1 : 1;
+        }
+
+        return (x->i < y->i) ? -1 : (x->i > y->i);
+}
+
+inline static u64
+ReverseBits(u64 x)
+{
+        x = ((x >> 1)  & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+        x = ((x >> 2)  & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+        x = ((x >> 4)  & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        x = ((x >> 8)  & 0x00FF00FF00FF00FFULL) | ((x & 0x00FF00FF00FF00FFULL) << 8);
+        x = ((x >> 16) & 0x0000FFFF0000FFFFULL) | ((x & 0x0000FFFF0000FFFFULL) << 16);
+        return (x >> 32) | (x << 32);
+}
+
+/*
+ * Builds the subtrie for es[0..n) into *dst, top-down, and returns the number
+ * of distinct keys in it. The entries are sorted on their bit-reversed hash,
+ * so the ones that share the hash bits consumed so far are always contiguous.
+ * Each node is stored into its parent before anything below it is allocated.
+ */
+static usize
+MapBuild(Ty *ty, Value *dst, MapEntry const *es, usize n, Value const *kvs, u32 shift)
+{
+        PersistNode *node;
+
+        if (shift >= 64) {
+                node = NewNode(ty, 2 * n);
+                *dst = NODE(node);
+
+                u32 count = 0;
+
+                for (usize i = 0; i < n; ++i) {
+                        Value const *k = &kvs[2 * es[i].i];
+                        Value const *v = k + 1;
+                        u32 j = 0;
+                        while (j < count && !v_eq(&node->slots[j], k)) {
+                                j += 2;
+                        }
+                        node->slots[j]     = *k;
+                        node->slots[j + 1] = *v;
+                        count = max(count, j + 2);
+                }
+
+                node->n = count;
+
+                return count / 2;
+        }
+
+        u32 bitmap = 0;
+
+        for (usize i = 0; i < n; ++i) {
+                bitmap |= Bit(es[i].h, shift);
+        }
+
+        node = NewNode(ty, 2 * __builtin_popcount(bitmap));
+        node->bitmap = bitmap;
+        *dst = NODE(node);
+
+        usize count = 0;
+
+        for (usize i = 0; i < n;) {
+                u32 bit = Bit(es[i].h, shift);
+                usize j = i + 1;
+
+                while (j < n && Bit(es[j].h, shift) == bit) {
+                        j += 1;
+                }
+
+                u32 idx = 2 * Index(bitmap, bit);
+
+                if (j - i == 1) {
+                        node->slots[idx]     = kvs[2 * es[i].i];
+                        node->slots[idx + 1] = kvs[2 * es[i].i + 1];
+                        count += 1;
+                } else {
+                        count += MapBuild(ty, &node->slots[idx + 1], es + i, j - i, kvs, shift + BITS);
+                }
+
+                i = j;
+        }
+
+        return count;
+}
+
+PersistMap *
+persist_map_new(Ty *ty, Value const *kvs, usize n)
+{
+        PersistMap *m = mAo0(sizeof *m, GC_PERSIST_MAP);
+        m->root = NIL;
+
+        if (n == 0) {
+                return m;
+        }
+
+        Value root = NODE(m);
+        gP(&root);
+
+        SCRATCH_SAVE();
+
+        MapEntry *es = smA(n * sizeof *es);
+
+        for (usize i = 0; i < n; ++i) {
+                es[i].h   = value_hash(ty, &kvs[2 * i]);
+                es[i].key = ReverseBits(es[i].h);
+                es[i].i   = i;
+        }
+
+        qsort(es, n, sizeof *es, MapEntryCompare);
+
+        m->count = MapBuild(ty, &m->root, es, n, kvs, 0);
+
+        SCRATCH_RESTORE();
+
+        gX();
+
+        return m;
+}
+
+Value const *
+persist_map_get(Ty *ty, PersistMap const *m, Value const *k)
+{
+        if (m->count == 0) {
+                return NULL;
+        }
+
+        u64 h = value_hash(ty, k);
+        PersistNode const *node = Child(&m->root);
+
+        for (u32 shift = 0;; shift += BITS) {
+                if (shift >= 64) {
+                        for (u32 i = 0; i < node->n; i += 2) {
+                                if (v_eq(&node->slots[i], k)) {
+                                        return &node->slots[i + 1];
+                                }
+                        }
+                        return NULL;
+                }
+
+                u32 bit = Bit(h, shift);
+
+                if (!(node->bitmap & bit)) {
+                        return NULL;
+                }
+
+                Value const *slot = &node->slots[2 * Index(node->bitmap, bit)];
+
+                if (!IsLink(&slot[0])) {
+                        return v_eq(&slot[0], k) ? &slot[1] : NULL;
+                }
+
+                node = Child(&slot[1]);
+        }
+}
+
+PersistMap *
+persist_map_put(Ty *ty, PersistMap const *m, Value const *k, Value const *v)
+{
+        u64 h = value_hash(ty, k);
+        PersistNode *root;
+        bool added = false;
+
+        if (m->count == 0) {
+                root = NewNode(ty, 2);
+                root->bitmap   = Bit(h, 0);
+                root->slots[0] = *k;
+                root->slots[1] = *v;
+                added = true;
+        } else {
+                root = MapPut(ty, Child(&m->root), 0, h, k, v, &added);
+        }
+
+        return NewMap(ty, m->count + added, NODE(root));
+}
+
+PersistMap *
+persist_map_remove(Ty *ty, PersistMap const *m, Value const *k)
+{
+        if (m->count == 0) {
+                return (PersistMap *)m;
+        }
+
+        u64 h = value_hash(ty, k);
+        PersistNode *old = Child(&m->root);
+        PersistNode *root = MapRemove(ty, old, 0, h, k);
+
+        if (root == old) {
+                return (PersistMap *)m;
+        }
+
+        return NewMap(ty, m->count - 1, (root == NULL) ? NIL : NODE(root));
+}
+
+static void
+MapCollect(Ty *ty, PersistNode const *node, Array *out)
+{
+        for (u32 i = 0; i < node->n; i += 2) {
+                if (IsLink(&node->slots[i])) {
+                        MapCollect(ty, Child(&node->slots[i + 1]), out);
+                } else {
+                        vAp(out, PAIR(node->slots[i], node->slots[i + 1]));
+                }
+        }
+}
+
+Value
+persist_map_items(Ty *ty, PersistMap const *m)
+{
+        Value items = ARRAY(vAn(m->count));
+
+        if (m->count > 0) {
+                gP(&items);
+                MapCollect(ty, Child(&m->root), items.array);
+                gX();
+        }
+
+        return items;
+}
+
+static void
+MapFlatten(Ty *ty, PersistNode const *node, ValueVector *out)
+{
+        for (u32 i = 0; i < node->n; i += 2) {
+                if (IsLink(&node->slots[i])) {
+                        MapFlatten(ty, Child(&node->slots[i + 1]), out);
+                } else {
+                        svP(*out, node->slots[i]);
+                        svP(*out, node->slots[i + 1]);
+                }
+        }
+}
+
+/*
+ * Appends the map's keys and values, alternating, to a scratch vector.
+ */
+void
+persist_map_flatten(Ty *ty, PersistMap const *m, ValueVector *out)
+{
+        if (m->count > 0) {
+                MapFlatten(ty, Child(&m->root), out);
+        }
+}
+
+inline static usize
+TailOffset(PersistVec const *v)
+{
+        return (v->count < WIDTH) ? 0 : ((v->count - 1) >> BITS) << BITS;
+}
+
+static PersistNode *
+LeafFor(PersistVec const *v, usize i)
+{
+        if (i >= TailOffset(v)) {
+                return Child(&v->tail);
+        }
+
+        PersistNode *node = Child(&v->root);
+
+        for (u32 level = v->shift; level > 0; level -= BITS) {
+                node = Child(&node->slots[(i >> level) & MASK]);
+        }
+
+        return node;
+}
+
+/*
+ * Builds the full subtree for xs[0..n) at `level` into *dst, top-down like
+ * MapBuild().
+ */
+static void
+VecBuild(Ty *ty, Value *dst, Value const *xs, usize n, u32 level)
+{
+        if (level == 0) {
+                PersistNode *leaf = NewNode(ty, n);
+                memcpy(leaf->slots, xs, n * sizeof (Value));
+                *dst = NODE(leaf);
+                return;
+        }
+
+        usize span = (usize)1 << level;
+        PersistNode *node = NewNode(ty, (n + span - 1) / span);
+
+        *dst = NODE(node);
+
+        for (u32 i = 0; i < node->n; ++i) {
+                usize off = i * span;
+                VecBuild(ty, &node->slots[i], xs + off, min(span, n - off), level - BITS);
+        }
+}
+
+PersistVec *
+persist_vec_new(Ty *ty, Value const *xs, usize n)
+{
+        PersistVec *v = mAo0(sizeof *v, GC_PERSIST_VEC);
+
+        Value self = NODE(v);
+        gP(&self);
+
+        usize tail = (n == 0) ? 0 : (n - 1) % WIDTH + 1;
+        usize body = n - tail;
+        u32 shift = BITS;
+
+        while (body > ((usize)1 << (shift + BITS))) {
+                shift += BITS;
+        }
+
+        v->count = n;
+        v->shift = shift;
+
+        VecBuild(ty, &v->root, xs, body, shift);
+        VecBuild(ty, &v->tail, xs + body, tail, 0);
+
+        gX();
+
+        return v;
+}
+
+Value const *
+persist_vec_get(PersistVec const *v, usize i)
+{
+        return &LeafFor(v, i)->slots[i & MASK];
+}
+
+static PersistNode *
+VecAssoc(Ty *ty, PersistNode const *node, u32 level, usize i, Value const *x)
+{
+        if (level == 0) {
+                return CopySetting(ty, node, node->n, i & MASK, *x);
+        }
+
+        u32 sub = (i >> level) & MASK;
+        PersistNode *child = VecAssoc(ty, Child(&node->slots[sub]), level - BITS, i, x);
+
+        return CopySetting(ty, node, node->n, sub, NODE(child));
+}
+
+PersistVec *
+persist_vec_put(Ty *ty, PersistVec const *v, usize i, Value const *x)
+{
+        usize off = TailOffset(v);
+
+        if (i >= off) {
+                PersistNode const *tail = Child(&v->tail);
+                PersistNode *copy = CopySetting(ty, tail, tail->n, i - off, *x);
+                return NewVec(ty, v->count, v->shift, v->root, NODE(copy));
+        }
+
+        PersistNode *root = VecAssoc(ty, Child(&v->root), v->shift, i, x);
+
+        return NewVec(ty, v->count, v->shift, NODE(root), v->tail);
+}
+
+static PersistNode *
+NewPath(Ty *ty, u32 level, PersistNode *node)
+{
+        if (level == 0) {
+                return node;
+        }
+
+        Value child = NODE(NewPath(ty, level - BITS, node));
+
+        gP(&child);
+        PersistNode *path = NewNode(ty, 1);
+        gX();
+
+        path->slots[0] = child;
+
+        return path;
+}
+
+static PersistNode *
+PushTail(Ty *ty, usize count, u32 level, PersistNode const *parent, PersistNode *tail)
+{
+        u32 sub = ((count - 1) >> level) & MASK;
+        PersistNode *child;
+
+        if (level == BITS) {
+                child = tail;
+        } else if (sub < parent->n) {
+                child = PushTail(ty, count, level - BITS, Child(&parent->slots[sub]), tail);
+        } else {
+                child = NewPath(ty, level - BITS, tail);
+        }
+
+        return CopySetting(ty, parent, max(parent->n, sub + 1), sub, NODE(child));
+}
+
+PersistVec *
+persist_vec_push(Ty *ty, PersistVec const *v, Value const *x)
+{
+        usize n = v->count;
+        PersistNode *tail = Child(&v->tail);
+
+        if (n - TailOffset(v) < WIDTH) {
+                PersistNode *copy = CopySetting(ty, tail, tail->n + 1, tail->n, *x);
+                return NewVec(ty, n + 1, v->shift, v->root, NODE(copy));
+        }
+
+        u32 shift = v->shift;
+        Value root;
+
+        if ((n >> BITS) > ((usize)1 << shift)) {
+                Value path = NODE(NewPath(ty, shift, tail));
+                gP(&path);
+                PersistNode *node = NewNode(ty, 2);
+                gX();
+                node->slots[0] = v->root;
+                node->slots[1] = path;
+                root = NODE(node);
+                shift += BITS;
+        } else {
+                root = NODE(PushTail(ty, n, shift, Child(&v->root), tail));
+        }
+
+        gP(&root);
+        PersistNode *last = NewNode(ty, 1);
+        gX();
+
+        last->slots[0] = *x;
+
+        return NewVec(ty, n + 1, shift, root, NODE(last));
+}
+
+static PersistNode *
+PopTail(Ty *ty, usize count, u32 level, PersistNode const *node)
+{
+        u32 sub = ((count - 2) >> level) & MASK;
+
+        if (level > BITS) {
+                PersistNode *child = PopTail(ty, count, level - BITS, Child(&node->slots[sub]));
+                if (child != NULL) {
+                        return CopySetting(ty, node, node->n, sub, NODE(child));
+                }
+        }
+
+        return (sub == 0) ? NULL : CopyNode(ty, node, sub);
+}
+
+PersistVec *
+persist_vec_pop(Ty *ty, PersistVec const *v)
+{
+        usize n = v->count;
+
+        if (n == 1) {
+                return persist_vec_new(ty, NULL, 0);
+        }
+
+        if (n - TailOffset(v) > 1) {
+                PersistNode const *tail = Child(&v->tail);
+                PersistNode *copy = CopyNode(ty, tail, tail->n - 1);
+                return NewVec(ty, n - 1, v->shift, v->root, NODE(copy));
+        }
+
+        PersistNode *tail = LeafFor(v, n - 2);
+        PersistNode *root = PopTail(ty, n, v->shift, Child(&v->root));
+        u32 shift = v->shift;
+
+        if (root == NULL) {
+                root = NewNode(ty, 0);
+        } else if (shift > BITS && root->n == 1) {
+                root = Child(&root->slots[0]);
+                shift -= BITS;
+        }
+
+        return NewVec(ty, n - 1, shift, NODE(root), NODE(tail));
+}
+
+/*
+ * v[i..j). Dropping elements from the tail shares the whole trie; anything else
+ * is rebuilt from the elements that are kept, in O(j - i).
+ */
+PersistVec *
+persist_vec_slice(Ty *ty, PersistVec const *v, usize i, usize j)
+{
+        if (i == 0 && j == v->count) {
+                return (PersistVec *)v;
+        }
+
+        if (i == 0 && j > TailOffset(v) && TailOffset(v) > 0) {
+                PersistNode *tail = CopyNode(ty, Child(&v->tail), j - TailOffset(v));
+                return NewVec(ty, j, v->shift, v->root, NODE(tail));
+        }
+
+        PersistVec *r;
+
+        SCRATCH_SAVE();
+
+        ValueVector xs = {0};
+
+        for (usize k = i; k < j; ++k) {
+                svP(xs, *persist_vec_get(v, k));
+        }
+
+        r = persist_vec_new(ty, vv(xs), vN(xs));
+
+        SCRATCH_RESTORE();
+
+        return r;
+}
+
+/*
+ * a followed by b. The shorter b is pushed onto a one element at a time,
+ * sharing all of a's full leaves; otherwise both are rebuilt in one pass, in
+ * O(#a + #b).
+ */
+PersistVec *
+persist_vec_concat(Ty *ty, PersistVec const *a, PersistVec const *b)
+{
+        if (b->count == 0) {
+                return (PersistVec *)a;
+        }
+
+        if (a->count == 0) {
+                return (PersistVec *)b;
+        }
+
+        PersistVec *r = (PersistVec *)a;
+
+        if (b->count < a->count) {
+                for (usize i = 0; i < b->count; ++i) {
+                        Value keep = NODE(r);
+                        gP(&keep);
+                        r = persist_vec_push(ty, r, persist_vec_get(b, i));
+                        gX();
+                }
+                return r;
+        }
+
+        SCRATCH_SAVE();
+
+        ValueVector xs = {0};
+
+        for (usize i = 0; i < a->count; i += WIDTH) {
+                PersistNode const *leaf = LeafFor(a, i);
+                svPn(xs, leaf->slots, leaf->n);
+        }
+
+        for (usize i = 0; i < b->count; i += WIDTH) {
+                PersistNode const *leaf = LeafFor(b, i);
+                svPn(xs, leaf->slots, leaf->n);
+        }
+
+        r = persist_vec_new(ty, vv(xs), vN(xs));
+
+        SCRATCH_RESTORE();
+
+        return r;
+}
+
+Value
+persist_vec_items(Ty *ty, PersistVec const *v)
+{
+        Array *a = vAn(v->count);
+
+        for (usize i = 0; i < v->count; i += WIDTH) {
+                PersistNode const *leaf = LeafFor(v, i);
+                memcpy(vv(*a) + i, leaf->slots, leaf->n * sizeof (Value));
+        }
+
+        a->count = v->count;
+
+        return ARRAY(a);
+}
+
+void
+persist_mark(Ty *ty, void *p)
+{
+        PersistNode *node;
+        PersistMap *m;
+        PersistVec *v;
+
+        switch (ALLOC_OF(p)->type) {
+        case GC_PERSIST_NODE:
+                node = p;
+                for (u32 i = 0; i < node->n; ++i) {
+                        if (node->slots[i].type != VALUE_ZERO) {
+                                xvP(ty->marking, &node->slots[i]);
+                        }
+                }
+                break;
+
+        case GC_PERSIST_MAP:
+                m = p;
+                xvP(ty->marking, &m->root);
+                break;
+
+        case GC_PERSIST_VEC:
+                v = p;
+                if (v->root.type != VALUE_ZERO) {
+                        xvP(ty->marking, &v->root);
+                }
+                if (v->tail.type != VALUE_ZERO) {
+                        xvP(ty->marking, &v->tail);
+                }
+                break;
+        }
+}
+
+/* vim: set sts=8 sw=8 expandtab: */
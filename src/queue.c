@@ -67,6 +67,8 @@ queue_pop(Ty *ty, Value *self, int argc, Value *kwargs)
 
         Queue *q = self->queue;
 
+        GCWrite(ty, q);
+
         if (_queue_count(q->head, q->tail, q->cap) == 0) {
                 bP("empty queue");
         }
@@ -84,6 +86,8 @@ queue_pop_back(Ty *ty, Value *self, int argc, Value *kwargs)
 
         Queue *q = self->queue;
 
+        GCWrite(ty, q);
+
         if (_queue_count(q->head, q->tail, q->cap) == 0) {
                 bP("empty queue");
         }
@@ -100,6 +104,8 @@ queue_try_pop(Ty *ty, Value *self, int argc, Value *kwargs)
 
         Queue *q = self->queue;
 
+        GCWrite(ty, q);
+
         if (_queue_count(q->head, q->tail, q->cap) == 0) {
                 return None;
         }
@@ -117,6 +123,8 @@ queue_try_pop_back(Ty *ty, Value *self, int argc, Value *kwargs)
 
         Queue *q = self->queue;
 
+        GCWrite(ty, q);
+
         if (_queue_count(q->head, q->tail, q->cap) == 0) {
                 return None;
         }
@@ -201,6 +209,8 @@ queue_clear(Ty *ty, Value *self, int argc, Value *kwargs)
 {
         ASSERT_ARGC("Queue.clear()", 0);
 
+        GCWrite(ty, self->queue);
+
         self->queue->head = 0;
         self->queue->tail = 0;
 
@@ -312,6 +322,8 @@ shared_queue_take(Ty *ty, Value *self, int argc, Value *kwargs)
 
         LockTy();
 
+        GCWrite(ty, q);
+
         Value v = q->items[q->head];
         q->head = (q->head + 1) % q->cap;
 
@@ -347,6 +359,8 @@ shared_queue_try_take(Ty *ty, Value *self, int argc, Value *kwargs)
                 return None;
         }
 
+        GCWrite(ty, q);
+
         Value v = q->items[q->head];
         q->head = (q->head + 1) % q->cap;
 
@@ -440,6 +454,7 @@ shared_queue_clear(Ty *ty, Value *self, int argc, Value *kwargs)
         SharedQueue *q = self->shared_queue;
 
         TyMutexLock(&q->mutex);
+        GCWrite(ty, q);
         q->head = 0;
         q->tail = 0;
         TyMutexUnlock(&q->mutex);
@@ -0,0 +1,160 @@
+#include "ty.h"
+#include "gc.h"
+#include "shape.h"
+#include "tthread.h"
+#include "value.h"
+#include "xd.h"
+
+static Shape Root = { .shared = true };
+
+/*
+ * How many shared shapes have been created. Guarded by ShapeLock.
+ */
+static usize SharedCount;
+
+/*
+ * Protects the edges of shared shapes. Everything else about a shared shape is
+ * fixed when it's created, and a private shape is only ever touched by the
+ * object that owns it.
+ */
+static TySpinLock ShapeLock;
+
+void
+shape_init(void)
+{
+        TySpinLockInit(&ShapeLock);
+}
+
+/*
+ * Copies s with `id` added in the next free slot.
+ */
+static Shape *
+Extend(Shape const *s, i32 id, bool shared)
+{
+        Shape *next = xmA(sizeof *next);
+        u32 n = s->count + 1;
+        u32 i = 0;
+
+        next->shared = shared;
+        next->count  = n;
+        next->ids    = xmA(n * sizeof (i32));
+        next->slots  = xmA(n * sizeof (u32));
+        v00(next->next);
+
+        while (i < s->count && s->ids[i] < id) {
+                i += 1;
+        }
+
+        memcpy(next->ids, s->ids, i * sizeof (i32));
+        memcpy(next->slots, s->slots, i * sizeof (u32));
+        memcpy(next->ids + i + 1, s->ids + i, (s->count - i) * sizeof (i32));
+        memcpy(next->slots + i + 1, s->slots + i, (s->count - i) * sizeof (u32));
+
+        next->ids[i]   = id;
+        next->slots[i] = s->count;
+
+        return next;
+}
+
+static void
+Grow(Shape *s, i32 id)
+{
+        u32 i = 0;
+
+        while (i < s->count && s->ids[i] < id) {
+                i += 1;
+        }
+
+        s->ids   = mrealloc(s->ids, (s->count + 1) * sizeof (i32));
+        s->slots = mrealloc(s->slots, (s->count + 1) * sizeof (u32));
+
+        memmove(s->ids + i + 1, s->ids + i, (s->count - i) * sizeof (i32));
+        memmove(s->slots + i + 1, s->slots + i, (s->count - i) * sizeof (u32));
+
+        s->ids[i]   = id;
+        s->slots[i] = s->count;
+        s->count   += 1;
+}
+
+/*
+ * The shape of an object with shape s after it gets member `id`, which it
+ * doesn't already have. The new member's slot is always s->count.
+ */
+Shape *
+shape_add(Shape *s, i32 id)
+{
+        if (!s->shared) {
+                Grow(s, id);
+                return s;
+        }
+
+        TySpinLockLock(&ShapeLock);
+
+        for (usize i = 0; i < vN(s->next); ++i) {
+                if (v_(s->next, i)->id == id) {
+                        Shape *next = v_(s->next, i)->shape;
+                        TySpinLockUnlock(&ShapeLock);
+                        return next;
+                }
+        }
+
+        if (
+                s->count >= SHAPE_MAX_SHARED
+             || vN(s->next) >= SHAPE_MAX_EDGES
+             || SharedCount >= SHAPE_MAX_TOTAL
+        ) {
+                TySpinLockUnlock(&ShapeLock);
+                return Extend(s, id, false);
+        }
+
+        Shape *next = Extend(s, id, true);
+        xvP(s->next, ((ShapeEdge){ .id = id, .shape = next }));
+        SharedCount += 1;
+
+        TySpinLockUnlock(&ShapeLock);
+
+        return next;
+}
+
+/*
+ * Returns a pointer to o's dynamic member `id`, adding it (as nil) if o doesn't
+ * have it yet.
+ */
+Value *
+dynamic_get(Ty *ty, TyObject *o, i32 id)
+{
+        struct dynamic *d = o->dynamic;
+
+        if (d == NULL) {
+                d = mA0(sizeof *d);
+                d->shape = &Root;
+                o->dynamic = d;
+        } else {
+                Value *v = dynamic_lookup(d, id);
+                if (v != NULL) {
+                        return v;
+                }
+        }
+
+        d->shape = shape_add(d->shape, id);
+        vvP(d->values, NIL);
+
+        return vvL(d->values);
+}
+
+void
+dynamic_release(Ty *ty, struct dynamic *d)
+{
+        Shape *s = d->shape;
+
+        if (!s->shared) {
+                xmF(s->ids);
+                xmF(s->slots);
+                xmF(s);
+        }
+
+        vvF(d->values);
+        mF(d);
+}
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -0,0 +1,537 @@
+#include <stdio.h>
+#include <errno.h>
+
+#include "ty.h"
+#include "value.h"
+#include "class.h"
+#include "dict.h"
+#include "gc.h"
+#include "lazy.h"
+#include "persist.h"
+#include "vm.h"
+#include "snapshot.h"
+
+static char const *RootKindNames[] = {
+        [SNAP_ROOT_SET]      = "root-set",
+        [SNAP_ROOT_TLS]      = "thread-local",
+        [SNAP_ROOT_STACK]    = "stack",
+        [SNAP_ROOT_TRY]      = "try-stack",
+        [SNAP_ROOT_THROW]    = "throw-stack",
+        [SNAP_ROOT_DROP]     = "drop-stack",
+        [SNAP_ROOT_FRAME]    = "frame",
+        [SNAP_ROOT_GLOBAL]   = "global",
+        [SNAP_ROOT_IMMORTAL] = "immortal",
+        [SNAP_ROOT_SIGNAL]   = "signal",
+        [SNAP_ROOT_TARGET]   = "target"
+};
+
+struct heap_snapshot {
+        FILE *f;
+        atomic_bool done;
+
+        u32 next;
+
+        struct {
+                void const **keys;
+                u32 *ids;
+                usize cap;
+                usize count;
+        } seen;
+
+        vec(Value) work;
+        vec(bool) classes;
+        u64 kinds;
+
+        u64 nodes;
+        u64 edges;
+        u64 bytes;
+};
+
+inline static usize
+phash(void const *p)
+{
+        return (usize)((((uptr)p) >> 4) * 0x9E3779B97F4A7C15ULL);
+}
+
+static void
+grow_seen(HeapSnapshot *snap)
+{
+        usize cap = (snap->seen.cap == 0) ? (1 << 16) : (snap->seen.cap << 1);
+        void const **keys = alloc0(cap * sizeof *keys);
+        u32 *ids = alloc0(cap * sizeof *ids);
+
+        for (usize i = 0; i < snap->seen.cap; ++i) {
+                if (snap->seen.keys[i] != NULL) {
+                        usize j = phash(snap->seen.keys[i]) & (cap - 1);
+                        while (keys[j] != NULL) {
+                                j = (j + 1) & (cap - 1);
+                        }
+                        keys[j] = snap->seen.keys[i];
+                        ids[j] = snap->seen.ids[i];
+                }
+        }
+
+        ty_free(snap->seen.keys);
+        ty_free(snap->seen.ids);
+
+        snap->seen.keys = keys;
+        snap->seen.ids = ids;
+        snap->seen.cap = cap;
+}
+
+/*
+ * Returns the id of the node at `p`, or 0 after assigning it a fresh id if
+ * this is the first time we've seen it.
+ */
+static u32
+intern_node(HeapSnapshot *snap, void const *p, u32 *id)
+{
+        if (2 * (snap->seen.count + 1) > snap->seen.cap) {
+                grow_seen(snap);
+        }
+
+        usize mask = snap->seen.cap - 1;
+        usize i = phash(p) & mask;
+
+        while (snap->seen.keys[i] != NULL) {
+                if (snap->seen.keys[i] == p) {
+                        return (*id = snap->seen.ids[i]);
+                }
+                i = (i + 1) & mask;
+        }
+
+        snap->seen.keys[i] = p;
+        snap->seen.ids[i] = *id = ++snap->next;
+        snap->seen.count += 1;
+
+        return 0;
+}
+
+inline static void const *
+fun_meta(Value const *f)
+{
+        uptr p;
+        memcpy(&p, (char const *)f->info + FUN_META, sizeof p);
+        return (void const *)p;
+}
+
+/*
+ * The heap block that identifies the object `v` refers to, or NULL if `v`
+ * doesn't own any GC memory. Classes aren't GC-allocated but they do have
+ * fields worth reporting, so they get a node too.
+ */
+static void const *
+node_of(Ty *ty, Value const *v, bool *gc)
+{
+        if ((v->type & ~VALUE_TAGGED) == VALUE_CLASS) {
+                *gc = false;
+                return class_get(ty, v->class);
+        }
+
+        *gc = true;
+
+        return value_gc_block(v);
+}
+
+inline static usize
+block_size(void const *p)
+{
+        return (p != NULL) ? ALLOC_OF(p)->size : 0;
+}
+
+static usize
+shallow_size(Value const *v, void const *node)
+{
+        usize size = block_size(node);
+
+        switch (v->type & ~VALUE_TAGGED) {
+        case VALUE_ARRAY:         size += block_size(v->array->items);        break;
+        case VALUE_DICT:          size += block_size(v->dict->items);         break;
+        case VALUE_BLOB:          size += block_size(v->blob->items);         break;
+        case VALUE_QUEUE:         size += block_size(v->queue->items);        break;
+        case VALUE_SHARED_QUEUE:  size += block_size(v->shared_queue->items); break;
+        case VALUE_TUPLE:         size += block_size(v->ids);                 break;
+        case VALUE_OBJECT:
+                if (v->object->dynamic != NULL) {
+                        size += vC(v->object->dynamic->values) * sizeof (Value);
+                }
+                break;
+        }
+
+        return size;
+}
+
+inline static void
+put_u64(FILE *f, u64 x)
+{
+        char buf[24];
+        char *p = buf + sizeof buf;
+
+        do {
+                *--p = '0' + (x % 10);
+                x /= 10;
+        } while (x != 0);
+
+        *--p = ' ';
+
+        fwrite(p, 1, buf + sizeof buf - p, f);
+}
+
+inline static void
+edge(Ty *ty, HeapSnapshot *snap, Value const *v)
+{
+        bool gc;
+        u32 id;
+
+        void const *node = node_of(ty, v, &gc);
+
+        if (node == NULL) {
+                return;
+        }
+
+        if (intern_node(snap, node, &id) == 0) {
+                xvP(snap->work, *v);
+        }
+
+        put_u64(snap->f, id);
+        snap->edges += 1;
+}
+
+/*
+ * Objects that aren't instances of any class (refs, threads, traces) are
+ * labelled by their value type instead, using negative class ids.
+ */
+static int
+node_class(Value const *v)
+{
+        Value u = *v;
+        u.type &= ~VALUE_TAGGED;
+
+        switch (u.type) {
+        case VALUE_REF:
+        case VALUE_THREAD:
+        case VALUE_TRACE:
+                return -(int)u.type;
+
+        default:
+                return ClassOf(&u);
+        }
+}
+
+static void
+emit_class(Ty *ty, HeapSnapshot *snap, int class)
+{
+        if (class < 0) {
+                if (snap->kinds & (1ULL << -class)) {
+                        return;
+                }
+                snap->kinds |= (1ULL << -class);
+                fprintf(
+                        snap->f,
+                        "C %d %s\n",
+                        class,
+                        (-class == VALUE_REF)    ? "<ref>"
+                      : (-class == VALUE_THREAD) ? "<thread>"
+                      :                            "<trace>"
+                );
+                return;
+        }
+
+        while (vN(snap->classes) <= class) {
+                xvP(snap->classes, false);
+        }
+
+        if (!v__(snap->classes, class)) {
+                *v_(snap->classes, class) = true;
+                fprintf(snap->f, "C %d %s\n", class, class_name(ty, class));
+        }
+}
+
+static void
+emit_node(Ty *ty, HeapSnapshot *snap, Value const *v)
+{
+        bool gc;
+        u32 id;
+
+        void const *node = node_of(ty, v, &gc);
+        usize size = gc ? shallow_size(v, node) : 0;
+        int class = node_class(v);
+
+        intern_node(snap, node, &id);
+        emit_class(ty, snap, class);
+
+        fprintf(snap->f, "N %"PRIu32" %d", id, class);
+        put_u64(snap->f, size);
+
+        snap->nodes += 1;
+        snap->bytes += size;
+
+        switch (v->type & ~VALUE_TAGGED) {
+        case VALUE_ARRAY:
+                for (usize i = 0; i < vN(*v->array); ++i) {
+                        edge(ty, snap, v_(*v->array, i));
+                }
+                break;
+
+        case VALUE_TUPLE:
+                for (int i = 0; i < v->count; ++i) {
+                        edge(ty, snap, &v->items[i]);
+                }
+                break;
+
+        case VALUE_DICT:
+                if (v->dict->dflt.type != VALUE_ZERO) {
+                        edge(ty, snap, &v->dict->dflt);
+                }
+                dfor(v->dict, {
+                        edge(ty, snap, key);
+                        edge(ty, snap, val);
+                });
+                break;
+
+        case VALUE_OBJECT:
+                for (u32 i = 0; i < v->object->nslot; ++i) {
+                        edge(ty, snap, &v->object->slots[i]);
+                }
+                if (v->object->dynamic != NULL) {
+                        vfor(v->object->dynamic->values, edge(ty, snap, it));
+                }
+                break;
+
+        case VALUE_CLASS:
+                vfor(class_get(ty, v->class)->s_fields.values, edge(ty, snap, it));
+                break;
+
+        case VALUE_FUNCTION:
+        case VALUE_BOUND_FUNCTION:
+        case VALUE_NATIVE_FUNCTION:
+                if (has_meta(v) && fun_meta(v) != NULL) {
+                        edge(ty, snap, fun_meta(v));
+                }
+                for (int i = 0; i < v->info[FUN_INFO_CAPTURES] + (v->type == VALUE_BOUND_FUNCTION); ++i) {
+                        if (v->env[i] != NULL) {
+                                edge(ty, snap, v->env[i]);
+                        }
+                }
+                break;
+
+        case VALUE_METHOD:
+        case VALUE_BUILTIN_METHOD:
+                edge(ty, snap, v->this);
+                break;
+
+        case VALUE_REF:
+                edge(ty, snap, v->ref);
+                break;
+
+        case VALUE_THREAD:
+                edge(ty, snap, &v->thread->v);
+                break;
+
+        case VALUE_QUEUE:
+        {
+                Queue *q = v->queue;
+                usize n = (q->items == NULL) ? 0 : _queue_count(q->head, q->tail, q->cap);
+                for (usize i = 0; i < n; ++i) {
+                        edge(ty, snap, &q->items[(q->head + i) % q->cap]);
+                }
+                break;
+        }
+
+        case VALUE_SHARED_QUEUE:
+        {
+                SharedQueue *q = v->shared_queue;
+                usize n = (q->items == NULL) ? 0 : _queue_count(q->head, q->tail, q->cap);
+                for (usize i = 0; i < n; ++i) {
+                        edge(ty, snap, &q->items[(q->head + i) % q->cap]);
+                }
+                break;
+        }
+
+        case VALUE_PTR:
+                switch (ALLOC_OF(v->gcptr)->type) {
+                case GC_VALUE:
+                case GC_FFI_AUTO:
+                        edge(ty, snap, (Value const *)v->gcptr);
+                        break;
+
+                case GC_PERSIST_NODE:
+                {
+                        PersistNode const *node = v->gcptr;
+                        for (u32 i = 0; i < node->n; ++i) {
+                                if (node->slots[i].type != VALUE_ZERO) {
+                                        edge(ty, snap, &node->slots[i]);
+                                }
+                        }
+                        break;
+                }
+
+                case GC_PERSIST_MAP:
+                        edge(ty, snap, &((PersistMap const *)v->gcptr)->root);
+                        break;
+
+                case GC_PERSIST_VEC:
+                        edge(ty, snap, &((PersistVec const *)v->gcptr)->root);
+                        edge(ty, snap, &((PersistVec const *)v->gcptr)->tail);
+                        break;
+
+                case GC_LAZY:
+                        edge(ty, snap, &((LazyIter const *)v->gcptr)->src);
+                        edge(ty, snap, &((LazyIter const *)v->gcptr)->f);
+                        edge(ty, snap, &((LazyIter const *)v->gcptr)->cur);
+                        break;
+                }
+                break;
+
+        case VALUE_TRACE:
+        {
+                ThrowCtx *ctx = v->ptr;
+                if (DetailedExceptions) {
+                        for (int i = 0; i < vN(ctx->locals); ++i) {
+                                vfor(*v_(ctx->locals, i), edge(ty, snap, it));
+                        }
+                }
+                break;
+        }
+
+        case VALUE_GENERATOR:
+        {
+                Generator *gen = v->gen;
+                co_state *st = gen->st;
+                edge(ty, snap, &gen->f);
+                if (st == NULL) {
+                        break;
+                }
+                for (int i = 0; i < vN(st->stack) + st->rc && i < vC(st->stack); ++i) {
+                        edge(ty, snap, v_(st->stack, i));
+                }
+                vfor(st->frames, edge(ty, snap, &it->f));
+                vfor(st->to_drop, edge(ty, snap, it));
+                vfor(st->gc_roots, edge(ty, snap, it));
+                for (int i = 0; i < vN(st->try_stack); ++i) {
+                        vfor(v__(st->try_stack, i)->defer, edge(ty, snap, it));
+                }
+                break;
+        }
+        }
+
+        fputc('\n', snap->f);
+}
+
+HeapSnapshot *
+snapshot_open(Ty *ty, char const *path)
+{
+        FILE *f = fopen(path, "w");
+        if (f == NULL) {
+                return NULL;
+        }
+
+        setvbuf(f, NULL, _IOFBF, MB_1);
+
+        HeapSnapshot *snap = alloc0(sizeof *snap);
+        snap->f = f;
+
+        fputs("# ty heap snapshot 1\n", f);
+
+        return snap;
+}
+
+bool
+snapshot_close(Ty *ty, HeapSnapshot *snap, u64 *nodes, u64 *edges, u64 *bytes)
+{
+        bool ok = !ferror(snap->f);
+
+        if (fclose(snap->f) != 0) {
+                ok = false;
+        }
+
+        *nodes = snap->nodes;
+        *edges = snap->edges;
+        *bytes = snap->bytes;
+
+        ty_free(snap->seen.keys);
+        ty_free(snap->seen.ids);
+        xvF(snap->work);
+        xvF(snap->classes);
+        ty_free(snap);
+
+        return ok;
+}
+
+bool
+snapshot_request(Ty *ty, HeapSnapshot *snap)
+{
+        HeapSnapshot *expected = NULL;
+        return atomic_compare_exchange_strong(&ty->group->Snapshot, &expected, snap);
+}
+
+bool
+snapshot_done(HeapSnapshot const *snap)
+{
+        return atomic_load_explicit(&snap->done, memory_order_acquire);
+}
+
+HeapSnapshot *
+snapshot_claim(Ty *ty)
+{
+        if (LIKELY(atomic_load_explicit(&ty->group->Snapshot, memory_order_relaxed) == NULL)) {
+                return NULL;
+        }
+
+        return atomic_exchange(&ty->group->Snapshot, NULL);
+}
+
+void
+snapshot_root(Ty *ty, HeapSnapshot *snap, int kind, Value const *v)
+{
+        bool gc;
+        u32 id;
+
+        void const *node = node_of(ty, v, &gc);
+
+        if (node == NULL) {
+                return;
+        }
+
+        if (intern_node(snap, node, &id) == 0) {
+                xvP(snap->work, *v);
+        }
+
+        fprintf(snap->f, "R %s %"PRIu32"\n", RootKindNames[kind], id);
+
+        while (vN(snap->work) > 0) {
+                Value next = vXx(snap->work);
+                emit_node(ty, snap, &next);
+        }
+}
+
+/*
+ * Assignment targets only hold on to the bare heap block that contains them,
+ * so there's no Value to start from; make one up from the block's type.
+ */
+void
+snapshot_root_block(Ty *ty, HeapSnapshot *snap, int kind, void const *p)
+{
+        void *gc = (void *)p;
+        Value v;
+
+        switch (ALLOC_OF(p)->type) {
+        case GC_ARRAY:  v = ARRAY(gc);                                                        break;
+        case GC_DICT:   v = DICT(gc);                                                         break;
+        case GC_BLOB:   v = BLOB(gc);                                                         break;
+        case GC_OBJECT: v = OBJECT(gc, ((TyObject *)gc)->class->i);                            break;
+        case GC_TUPLE:  v = TUPLE(gc, NULL, ALLOC_OF(p)->size / sizeof (Value), false);       break;
+        default:        v = GCPTR(gc, gc);                                                    break;
+        }
+
+        snapshot_root(ty, snap, kind, &v);
+}
+
+void
+snapshot_finish(Ty *ty, HeapSnapshot *snap)
+{
+        fflush(snap->f);
+        atomic_store_explicit(&snap->done, true, memory_order_release);
+}
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -130,6 +130,25 @@ string_grapheme_count(Ty *ty, Value *string, int argc, Value *kwargs)
         return INTEGER(length);
 }
 
+/*
+ * The pieces that chars(), split(), lines() and words() hand back are views
+ * of the string they came from, so the only thing they really allocate is the
+ * array holding them. Gathering the views in scratch space first lets that be
+ * a single allocation of the right size rather than a chain of doublings.
+ */
+static Value
+ScratchArray(Ty *ty, ValueVector const *xs)
+{
+        Array *a = vAn(vN(*xs));
+
+        if (vN(*xs) > 0) {
+                memcpy(vv(*a), vv(*xs), vN(*xs) * sizeof (Value));
+                a->count = vN(*xs);
+        }
+
+        return ARRAY(a);
+}
+
 static Value
 string_chars(Ty *ty, Value *string, int argc, Value *kwargs)
 {
@@ -140,8 +159,9 @@ string_chars(Ty *ty, Value *string, int argc, Value *kwargs)
         isize offset = 0;
         i32 state = 0;
 
-        Array *r = vA();
-        NOGC(r);
+        SCRATCH_SAVE();
+
+        ValueVector r = {0};
 
         while (size > 0) {
                 i32 rune;
@@ -159,14 +179,16 @@ string_chars(Ty *ty, Value *string, int argc, Value *kwargs)
                                 break;
                         n += m;
                 }
-                vAp(r, STRING_VIEW(*string, offset, n));
+                svP(r, STRING_VIEW(*string, offset, n));
                 size -= n;
                 offset += n;
         }
 
-        OKGC(r);
+        Value chars = ScratchArray(ty, &r);
 
-        return ARRAY(r);
+        SCRATCH_RESTORE();
+
+        return chars;
 }
 
 static Value
@@ -548,8 +570,10 @@ string_words(Ty *ty, Value *string, int argc, Value *kwargs)
 {
         ASSERT_ARGC("String.words()", 0);
 
-        struct array *a = vA();
-        NOGC(a);
+        SCRATCH_SAVE();
+
+        ValueVector a = {0};
+        Value words;
 
         isize i = 0;
         isize len = sN(*string);
@@ -599,12 +623,14 @@ string_words(Ty *ty, Value *string, int argc, Value *kwargs)
                      && (c != UTF8PROC_CATEGORY_ZP)
                 );
 
-                vAp(a, str);
+                svP(a, str);
         }
 End:
-        OKGC(a);
+        words = ScratchArray(ty, &a);
 
-        return ARRAY(a);
+        SCRATCH_RESTORE();
+
+        return words;
 }
 
 static Value
@@ -614,15 +640,17 @@ string_lines(Ty *ty, Value *string, int argc, Value *kwargs)
 
         gP(string);
 
-        struct array *a = vA();
-        NOGC(a);
+        SCRATCH_SAVE();
+
+        ValueVector a = {0};
+        Value lines;
 
         isize i = 0;
         isize len = sN(*string);
         u8 const *s = ss(*string);
 
         if (len == 0) {
-                vAp(a, *string);
+                svP(a, *string);
                 goto End;
         }
 
@@ -638,17 +666,19 @@ string_lines(Ty *ty, Value *string, int argc, Value *kwargs)
                         i += 1;
                 }
 
-                vAp(a, str);
+                svP(a, str);
 
                 if (i < len) {
                         i += 1 + (s[i] == '\r');
                 }
         }
 End:
+        lines = ScratchArray(ty, &a);
+
+        SCRATCH_RESTORE();
         gX();
-        OKGC(a);
 
-        return ARRAY(a);
+        return lines;
 }
 
 static Value
@@ -686,21 +716,19 @@ string_split(Ty *ty, Value *string, int argc, Value *kwargs)
 
         usize limit = (argc == 2) ? INT_ARG(1) : SIZE_MAX;
 
-        Value result = ARRAY(vA());
-        gP(&result);
-
         if (pattern.type == VALUE_STRING) {
                 u8 const *p = ss(pattern);
                 isize n = sN(pattern);
 
-                if (n == 0)
-                        goto End;
+                SCRATCH_SAVE();
+
+                ValueVector parts = {0};
 
                 isize i = 0;
-                while (i < len) {
+                while (n > 0 && i < len) {
                         Value str = STRING_VIEW(*string, i, 0);
 
-                        if (argc == 2 && result.array->count == ARG(1).z) {
+                        if (argc == 2 && vN(parts) == ARG(1).z) {
                                 sN(str) = len - i;
                                 i = len;
                         } else {
@@ -710,53 +738,60 @@ string_split(Ty *ty, Value *string, int argc, Value *kwargs)
                                 }
                         }
 
-                        vAp(result.array, str);
+                        svP(parts, str);
 
                         i += n;
                 }
 
-                if (i == len) {
-                        vAp(result.array, STRING_EMPTY);
+                if (n > 0 && i == len) {
+                        svP(parts, STRING_EMPTY);
                 }
-        } else {
-                pcre2_code *re = pattern.regex->pcre2;
-                isize len = sN(*string);
-                isize start = 0;
-                isize pstart = 0;
-                usize *ovec = ty_re_ovec();
 
-                while (start < len) {
-                        isize n = 0;
-                        if (
-                                (vN(*result.array) == limit)
-                             || ((n = ty_re_match(re, s, len, pstart, 0)) <= 0)
-                        ) {
-                                ovec[0] = len;
-                                ovec[1] = len + 1;
-                        }
+                Value result = ScratchArray(ty, &parts);
 
-                        vAp(result.array, STRING_VIEW(*string, start, ovec[0] - start));
+                SCRATCH_RESTORE();
 
-                        if (pattern.regex->detailed && n >= 1) {
-                                vAp(result.array, mkmatch(ty, string, ovec, n, true));
-                        } else {
-                                for (isize i = 1; i < n; ++i) {
-                                        isize s = ovec[2 * i];
-                                        isize e = ovec[2 * i + 1];
-                                        vAp(result.array, STRING_VIEW(*string, s, e - s));
-                                }
-                        }
+                return result;
+        }
+
+        Value result = ARRAY(vA());
+        gP(&result);
+
+        pcre2_code *re = pattern.regex->pcre2;
+        isize start = 0;
+        isize pstart = 0;
+        usize *ovec = ty_re_ovec();
 
-                        pstart = ovec[1] + (ovec[0] == ovec[1]);
-                        start = ovec[1];
+        while (start < len) {
+                isize n = 0;
+                if (
+                        (vN(*result.array) == limit)
+                     || ((n = ty_re_match(re, s, len, pstart, 0)) <= 0)
+                ) {
+                        ovec[0] = len;
+                        ovec[1] = len + 1;
                 }
 
-                if (start == len) {
-                        vAp(result.array, STRING_EMPTY);
+                vAp(result.array, STRING_VIEW(*string, start, ovec[0] - start));
+
+                if (pattern.regex->detailed && n >= 1) {
+                        vAp(result.array, mkmatch(ty, string, ovec, n, true));
+                } else {
+                        for (isize i = 1; i < n; ++i) {
+                                isize s = ovec[2 * i];
+                                isize e = ovec[2 * i + 1];
+                                vAp(result.array, STRING_VIEW(*string, s, e - s));
+                        }
                 }
+
+                pstart = ovec[1] + (ovec[0] == ovec[1]);
+                start = ovec[1];
+        }
+
+        if (start == len) {
+                vAp(result.array, STRING_EMPTY);
         }
 
-End:
         gX();
         return result;
 }
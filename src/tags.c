@@ -8,56 +8,124 @@
 #include "xd.h"
 #include "vec.h"
 #include "itable.h"
+#include "tags.h"
+#include "tthread.h"
 
 typedef struct class Class;
-struct tags;
 
-struct link {
-        int tag;
-        struct tags *t;
-};
+TagNode *TagNodes[TAGS_SEGMENTS];
+_Atomic(TagEdges *) TagEdgeTable;
 
-struct tags {
-        int n;
-        int tag;
-        struct tags *next;
-        vec(struct link) links;
-};
+static TySpinLock lock;
+static u32 node_count;
 
 static u32 next_id = 0;
 
-static vec(struct tags *) lists;
 static vec(char const *) names;
 static vec(struct itable) tables;
 static vec(struct itable) statics;
 static vec(Class *) classes;
 
-static struct tags *
-mklist(int tag, struct tags *next)
+inline static TagNode *
+find(TagEdges const *t, int tags, int tag)
 {
-        struct tags *t = alloc0(sizeof *t);
+        for (u32 i = tags_edge_hash(tags, tag) & t->mask;; i = (i + 1) & t->mask) {
+                TagNode *node = atomic_load_explicit(&t->slots[i], memory_order_relaxed);
+                if (node == NULL || (node->tag == tag && node->up == tags)) {
+                        return node;
+                }
+        }
+}
+
+inline static void
+place(TagEdges *t, TagNode *node)
+{
+        u32 i = tags_edge_hash(node->up, node->tag) & t->mask;
+
+        while (atomic_load_explicit(&t->slots[i], memory_order_relaxed) != NULL) {
+                i = (i + 1) & t->mask;
+        }
+
+        atomic_store_explicit(&t->slots[i], node, memory_order_release);
+}
+
+/*
+ * Readers may still be probing the old table after it's been replaced, so
+ * it's kept around rather than freed.
+ */
+static TagEdges *
+grow(TagEdges *old)
+{
+        u32 size = (old == NULL) ? 256 : 2 * (old->mask + 1);
+        TagEdges *t = xmA(sizeof *t + size * sizeof (TagNode *));
+
+        t->prev = old;
+        t->mask = size - 1;
+
+        for (u32 i = 0; i < size; ++i) {
+                atomic_init(&t->slots[i], NULL);
+        }
 
-        t->n = lists.count;
-        t->tag = tag;
-        t->next = next;
+        // Node 0 is the empty stack, which isn't anyone's child
+        for (u32 n = 1; n < node_count; ++n) {
+                place(t, tags_node(n));
+        }
 
-        xvP(lists, t);
+        atomic_store_explicit(&TagEdgeTable, t, memory_order_release);
 
         return t;
 }
 
+/*
+ * Must be called with the lock held.
+ */
+static TagNode *
+mknode(int tag, int up)
+{
+        TagEdges *t = atomic_load_explicit(&TagEdgeTable, memory_order_relaxed);
+
+        if (2 * (node_count + 1) > t->mask + 1) {
+                t = grow(t);
+        }
+
+        u32 n = node_count;
+        u32 k = n + (1u << TAGS_SEGMENT0_BITS);
+        int s = 31 - __builtin_clz(k) - TAGS_SEGMENT0_BITS;
+
+        if (TagNodes[s] == NULL) {
+                TagNodes[s] = xmA((sizeof (TagNode)) << (s + TAGS_SEGMENT0_BITS));
+        }
+
+        TagNode *node = tags_node(n);
+        node->n = n;
+        node->tag = tag;
+        node->up = up;
+
+        node_count += 1;
+
+        if (n != 0) {
+                place(t, node);
+        }
+
+        return node;
+}
+
 void
 tags_init(Ty *ty)
 {
         next_id = 0;
+        node_count = 0;
 
-        v0(lists);
         v0(names);
         v0(tables);
         v0(statics);
         v0(classes);
 
-        mklist(next_id++, NULL);
+        TySpinLockInit(&lock);
+        atomic_store_explicit(&TagEdgeTable, NULL, memory_order_relaxed);
+        grow(NULL);
+
+        mknode(next_id++, 0);
 }
 
 void
@@ -89,7 +157,9 @@ tags_new(Ty *ty, char const *tag)
 
         xvP(classes, NULL);
 
-        mklist(next_id, v_0(lists));
+        TySpinLockLock(&lock);
+        mknode(next_id, 0);
+        TySpinLockUnlock(&lock);
 
         return next_id++;
 }
@@ -97,48 +167,33 @@ tags_new(Ty *ty, char const *tag)
 bool
 tags_same(Ty *ty, int t1, int t2)
 {
-        return (lists.items[t1]->tag == lists.items[t2]->tag);
+        return (tags_node(t1)->tag == tags_node(t2)->tag);
 }
 
 int
-tags_push(Ty *ty, int tags, int tag)
+tags_push_slow(Ty *ty, int tags, int tag)
 {
-        struct tags *list = v__(lists, tags);
-
-        for (int i = 0; i < vN(list->links); ++i) {
-                struct link *link = v_(list->links, i);
-                if (link->tag == tag) {
-                        return link->t->n;
-                }
-        }
+        TySpinLockLock(&lock);
 
-        struct tags *new = mklist(tag, list);
+        TagEdges *t = atomic_load_explicit(&TagEdgeTable, memory_order_relaxed);
+        TagNode *node = find(t, tags, tag);
 
-        //XLOG("push: tags=%d tag=%d new=%d", tags, tag, new->n);
-        xvP(
-                list->links,
-                ((struct link) {
-                        .t = new,
-                        .tag = tag
-                })
-        );
+        if (node == NULL) {
+                node = mknode(tag, tags);
+        }
 
-        return new->n;
-}
+        TySpinLockUnlock(&lock);
 
-int
-tags_pop(Ty *ty, int tags)
-{
-        return v__(lists, tags)->next->n;
+        return node->n;
 }
 
 bool
 tags_try_pop(Ty *ty, u16 *tags, int tag)
 {
-        struct tags *list = v__(lists, *tags);
+        TagNode const *node = tags_node(*tags);
 
-        if (list->tag == tag) {
-                *tags = list->next->n;
+        if (node->tag == tag) {
+                *tags = node->up;
                 return true;
         } else {
                 return false;
@@ -148,7 +203,7 @@ tags_try_pop(Ty *ty, u16 *tags, int tag)
 int
 tags_first(Ty *ty, int tags)
 {
-        return v__(lists, tags)->tag;
+        return tags_node(tags)->tag;
 }
 
 /*
@@ -159,7 +214,7 @@ tags_wrap(Ty *ty, char const *s, int tags, bool color)
 {
         vec(char) cs = {0};
 
-        struct tags *list = lists.items[tags];
+        TagNode const *list = tags_node(tags);
 
         if (color && list->tag != 0) {
                 svPn(cs, TERM(94), strlen(TERM(94)));
@@ -170,7 +225,7 @@ tags_wrap(Ty *ty, char const *s, int tags, bool color)
                 char const *name = names.items[list->tag - 1];
                 svPn(cs, name, strlen(name));
                 svP(cs, '(');
-                list = list->next;
+                list = tags_node(list->up);
                 n += 1;
         }
 
@@ -202,7 +257,7 @@ tags_open(Ty *ty, int tags, bool color)
 {
         vec(char) cs = {0};
 
-        struct tags *list = lists.items[tags];
+        TagNode const *list = tags_node(tags);
 
         if (color && list->tag != 0) {
                 svPn(cs, TERM(94), strlen(TERM(94)));
@@ -212,7 +267,7 @@ tags_open(Ty *ty, int tags, bool color)
                 char const *name = names.items[list->tag - 1];
                 svPn(cs, name, strlen(name));
                 svP(cs, '(');
-                list = list->next;
+                list = tags_node(list->up);
         }
 
         if (color && vN(cs) > 0) {
@@ -229,11 +284,11 @@ tags_close(Ty *ty, int tags, bool color)
 {
         byte_vector cs = {0};
 
-        struct tags *list = v__(lists, tags);
+        TagNode const *list = tags_node(tags);
 
         i32 n = 0;
         while (list->tag != 0) {
-                list = list->next;
+                list = tags_node(list->up);
                 n += 1;
         }
 
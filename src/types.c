@@ -12262,6 +12262,34 @@ type_resolve_var(Type const *t0)
         return ResolveVar(t0);
 }
 
+/*
+ * The position of `name` in the record type t0, or -1 if t0 isn't known to be
+ * a record with that entry. A value of type t0 can have extra entries, in any
+ * order, so this is only a guess at where the value keeps it.
+ */
+int
+type_record_slot(Ty *ty, Type const *t0, char const *name)
+{
+        if (t0 == NULL) {
+                return -1;
+        }
+
+        t0 = ResolveVar(t0);
+
+        if (TypeType(t0) != TYPE_TUPLE) {
+                return -1;
+        }
+
+        for (int i = 0; i < vN(t0->names); ++i) {
+                char const *name_i = v__(t0->names, i);
+                if (name_i != NULL && s_eq(name_i, name)) {
+                        return i;
+                }
+        }
+
+        return -1;
+}
+
 Class *
 type_guess_class_of(Ty *ty, Type const *t0)
 {
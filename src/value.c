@@ -24,6 +24,9 @@
 #include "functions.h"
 #include "types.h"
 #include "highlight.h"
+#include "weak.h"
+#include "persist.h"
+#include "lazy.h"
 
 static _Thread_local vec(Dict *) show_dicts;
 static _Thread_local vec(Value *) show_tuples;
@@ -224,7 +227,10 @@ tuples_equal(Ty *ty, Value const *v1, Value const *v2)
         if (v1->count != v2->count)
                 return false;
 
-        if (v1->ids != NULL && v2->ids != NULL) {
+        /*
+         * Records with the same (interned) layout can be compared in place
+         */
+        if (v1->ids != NULL && v2->ids != NULL && v1->ids != v2->ids) {
                 return records_equal(ty, v1, v2);
         }
 
@@ -251,6 +257,135 @@ str_hash(char const *str, u32 len)
         return XXH3_64bits(str, len);
 }
 
+/*
+ * Whoever gets the StringTrailer from EMPTY to BUSY fills it in; anyone else
+ * racing with them just hashes the string themselves.
+ */
+inline static u64
+string_hash(Value const *v)
+{
+        StringTrailer *h = (v->str == v->str0) ? StringTrailerOf(v) : NULL;
+
+        if (h == NULL) {
+                return str_hash((char const *)v->str, v->bytes);
+        }
+
+        u32 state = atomic_load_explicit(&h->state, memory_order_acquire);
+
+        if (state == STRING_HASH_READY && h->bytes == v->bytes) {
+                return h->hash;
+        }
+
+        u64 hash = str_hash((char const *)v->str, v->bytes);
+
+        if (
+                state == STRING_HASH_EMPTY
+             && atomic_compare_exchange_strong_explicit(
+                        &h->state,
+                        &state,
+                        STRING_HASH_BUSY,
+                        memory_order_relaxed,
+                        memory_order_relaxed
+                )
+        ) {
+                h->hash = hash;
+                h->bytes = v->bytes;
+                atomic_store_explicit(&h->state, STRING_HASH_READY, memory_order_release);
+        }
+
+        return hash;
+}
+
+/*
+ * Lays out a string literal for the compiler's intern table: the bytes, NUL
+ * terminated, with a StringTrailer in front of them.
+ */
+char *
+value_string_literal(char const *s, u32 n)
+{
+        StringTrailer *h = ty_malloc(sizeof *h + n + 1);
+
+        if (h == NULL) {
+                panic("out of memory");
+        }
+
+        h->hash = str_hash(s, n);
+        h->bytes = n;
+        atomic_init(&h->state, STRING_HASH_READY);
+        atomic_init(&h->used, n);
+
+        memcpy(h + 1, s, n + 1);
+
+        return (char *)(h + 1);
+}
+
+/*
+ * s + x, for `s += x`. If s ends at the block's high-water mark and there's
+ * room after it, x is copied there and the mark moved past it; the Value we
+ * return shares the block with s, but nothing that can see s's bytes can see
+ * the new ones. Otherwise the result is a copy with room to spare, so a loop
+ * that keeps appending to the same string only copies it O(log n) times.
+ */
+Value
+value_string_append(Ty *ty, Value const *s, Value const *x)
+{
+        if (sN(*x) == 0) {
+                return *s;
+        }
+
+        if (sN(*s) == 0) {
+                return *x;
+        }
+
+        usize n = (usize)sN(*s) + sN(*x);
+
+        if (n > UINT32_MAX) {
+                zP("string concatenation result is too long: %zu bytes", n);
+        }
+
+        StringTrailer *t = (!s->ro && s->str0 != NULL)
+                         ? StringBlockTrailer(s->str0)
+                         : NULL;
+
+        if (t != NULL) {
+                u32 end = (u32)(s->str - s->str0) + sN(*s);
+                u32 cap = (u8 *)t - s->str0;
+
+                if (
+                        end + (usize)sN(*x) <= cap
+                     && atomic_compare_exchange_strong(&t->used, &end, end + sN(*x))
+                ) {
+                        memcpy(s->str0 + end, ss(*x), sN(*x));
+                        return (Value) {
+                                .type = VALUE_STRING,
+                                .tags = 0,
+                                .str = s->str,
+                                .bytes = n,
+                                .str0 = s->str0
+                        };
+                }
+        }
+
+        usize cap = max(2 * n, STRING_HASH_MIN);
+
+        if (cap > UINT32_MAX) {
+                cap = n;
+        }
+
+        u8 *str = value_string_alloc(ty, cap);
+
+        memcpy(str, ss(*s), sN(*s));
+        memcpy(str + sN(*s), ss(*x), sN(*x));
+
+        t = StringBlockTrailer(str);
+
+        if (t != NULL) {
+                atomic_store(&t->used, n);
+        }
+
+        return STRING(str, n);
+}
+
 inline static u64
 hash64(u64 x)
 {
@@ -346,7 +481,7 @@ hash(Ty *ty, Value const *val)
         switch (val->type & ~VALUE_TAGGED) {
         case VALUE_NIL:               return 0xDEADDEADDEADULL;
         case VALUE_BOOLEAN:           return val->boolean ? 0xABCULL : 0xDEFULL;
-        case VALUE_STRING:            return XXH3_64bits(ss(*val), sN(*val));
+        case VALUE_STRING:            return string_hash(val);
         case VALUE_INTEGER:           return hash64(val->z);
         case VALUE_REAL:              return flt_hash(val->real);
         case VALUE_ARRAY:             return ary_hash(ty, val);
@@ -727,6 +862,8 @@ show_impl(
                                         *key,
                                         *val
                                 }));
+                                weak_dict_read(ty, v.dict, key);
+                                weak_dict_read(ty, v.dict, val);
                         });
 
                         int n = vN(items);
@@ -1666,6 +1803,11 @@ value_array_mark(Ty *ty, struct array *a)
 inline static void
 mark_tuple(Ty *ty, Value const *v)
 {
+        // The items can have been marked by GCShade(), which doesn't know about ids
+        if (v->ids != NULL) {
+                MARK(v->ids);
+        }
+
         if (v->items == NULL || MARKED(v->items)) return;
 
         MARK(v->items);
@@ -1673,10 +1815,6 @@ mark_tuple(Ty *ty, Value const *v)
         for (int i = 0; i < v->count; ++i) {
                 MarkNext(ty, &v->items[i]);
         }
-
-        if (v->ids != NULL) {
-                MARK(v->ids);
-        }
 }
 
 inline static void
@@ -1695,16 +1833,15 @@ mark_string(Ty *ty, Value const *v)
         }
 }
 
+static void
+TraceBlock(Ty *ty, struct alloc *a);
+
 inline static void
-mark_generator(Ty *ty, Value const *v)
+mark_generator_state(Ty *ty, Generator *gen)
 {
-        if (MARKED(v->gen)) return;
+        MarkNext(ty, &gen->f);
 
-        MARK(v->gen);
-
-        MarkNext(ty, &v->gen->f);
-
-        co_state *st = v->gen->st;
+        co_state *st = gen->st;
 
         for (int i = 0; i < vN(st->stack) + st->rc && i < vC(st->stack); ++i) {
                 MarkNext(ty, v_(st->stack, i));
@@ -1716,8 +1853,9 @@ mark_generator(Ty *ty, Value const *v)
 
         for (int i = 0; i < vN(st->targets); ++i) {
                 Target *target = v_(st->targets, i);
-                if (target->gc != NULL) {
+                if (target->gc != NULL && !MARKED(target->gc)) {
                         MARK(target->gc);
+                        TraceBlock(ty, ALLOC_OF(target->gc));
                 }
         }
 
@@ -1737,6 +1875,16 @@ mark_generator(Ty *ty, Value const *v)
         }
 }
 
+inline static void
+mark_generator(Ty *ty, Value const *v)
+{
+        if (MARKED(v->gen)) return;
+
+        MARK(v->gen);
+
+        mark_generator_state(ty, v->gen);
+}
+
 inline static void
 mark_function(Ty *ty, Value const *v)
 {
@@ -1793,6 +1941,20 @@ mark_pointer(Ty *ty, Value const *v)
                 case GC_FFI_AUTO:
                         MarkNext(ty, ((Value *)v->gcptr));
                         break;
+
+                case GC_WEAK:
+                        weak_ref_mark(ty, v->gcptr);
+                        break;
+
+                case GC_PERSIST_NODE:
+                case GC_PERSIST_MAP:
+                case GC_PERSIST_VEC:
+                        persist_mark(ty, v->gcptr);
+                        break;
+
+                case GC_LAZY:
+                        lazy_mark(ty, v->gcptr);
+                        break;
                 }
         }
 }
@@ -1814,13 +1976,24 @@ mark_trace(Ty *ty, ThrowCtx *ctx)
         }
 }
 
+/*
+ * Values reified from AST nodes keep the arena holding those nodes alive.
+ * Everything else has src == 0, so ordinary data never touches source_map.
+ */
+static void
+mark_source(Ty *ty, u32 src)
+{
+        void **arena = source_lookup(ty, src);
+        if (arena != NULL && *arena != NULL) {
+                MARK(*arena);
+        }
+}
+
 static inline void
 _value_mark_xd(Ty *ty, Value const *v)
 {
-        void **src = source_lookup(ty, v->src);
-        if (src != NULL && *src != NULL) {
-                LOGX("*src = %p", *src);
-                MARK(*src);
+        if (UNLIKELY(v->src != 0)) {
+                mark_source(ty, v->src);
         }
 
 #ifndef TY_RELEASE
@@ -1863,17 +2036,255 @@ _value_mark_xd(Ty *ty, Value const *v)
 #endif
 }
 
+/*
+ * While an incremental cycle is being started (see StartCycle() in vm.c) the
+ * roots are only queued: tracing from them is left to value_mark_slice().
+ */
+inline static void
+Drain(Ty *ty)
+{
+        if (UNLIKELY(ty->group->Cycle.defer)) {
+                return;
+        }
+
+        while (vN(ty->marking) > 0) {
+                Value const *v = vXx(ty->marking);
+                _value_mark_xd(ty, v);
+        }
+}
+
 void
 _value_mark(Ty *ty, Value const *v)
 {
         RESET_REACHED();
 
+        if (UNLIKELY(ty->group->Cycle.defer)) {
+                MarkNext(ty, (Value *)v);
+                return;
+        }
+
         _value_mark_xd(ty, v);
+        Drain(ty);
+}
 
-        while (vN(ty->marking) > 0) {
-                v = vXx(ty->marking);
-                _value_mark_xd(ty, v);
+/*
+ * ty->marking holds pointers into the blocks being traced, which are only
+ * stable while the world is stopped: copy what they point to onto gray.
+ */
+inline static void
+Spill(Ty *ty, ValueVector *gray)
+{
+        for (usize i = 0; i < vN(ty->marking); ++i) {
+                xvP(*gray, *v__(ty->marking, i));
         }
+
+        v0(ty->marking);
+}
+
+/*
+ * Traces from gray until it's empty or budget nanoseconds have passed, and
+ * returns true if it's empty. Whatever is still queued when time runs out
+ * goes back onto gray.
+ */
+bool
+value_mark_slice(Ty *ty, ValueVector *gray, u64 budget)
+{
+        u64 start = TyMonotonicTime();
+        usize n = 0;
+
+        for (;;) {
+                Value v;
+
+                if (vN(ty->marking) > 0) {
+                        v = *vXx(ty->marking);
+                } else if (vN(*gray) > 0) {
+                        v = vXx(*gray);
+                } else {
+                        break;
+                }
+
+                _value_mark_xd(ty, &v);
+
+                if ((++n & 1023) == 0 && TyMonotonicTime() - start >= budget) {
+                        break;
+                }
+        }
+
+        Spill(ty, gray);
+
+        return vN(*gray) == 0;
+}
+
+/*
+ * Marks a single value without tracing it: what it refers to is queued on
+ * ty->gray instead. See GCShadeValue().
+ */
+void
+value_shade(Ty *ty, Value const *v)
+{
+        _value_mark_xd(ty, v);
+
+        Spill(ty, &ty->gray);
+}
+
+/*
+ * Queues what a block refers to, without touching the block itself. Only
+ * types that can be mutated after they're built need to be looked at: this is
+ * used for blocks in the permanent generation, which stay marked, and for the
+ * write barrier, which is only ever called on a block that's about to change.
+ */
+static void
+TraceBlock(Ty *ty, struct alloc *a)
+{
+        void *p = a->data;
+
+        Array *array;
+        TyObject *o;
+        Value *items;
+        Dict *d;
+        Queue *q;
+        Value **env;
+
+        switch (a->type) {
+        case GC_ARRAY:
+                array = p;
+                for (usize i = 0; i < vN(*array); ++i) {
+                        MarkNext(ty, v_(*array, i));
+                }
+                break;
+
+        case GC_TUPLE:
+                // Record fields can be assigned to
+                items = p;
+                for (usize i = 0; i < a->size / sizeof (Value); ++i) {
+                        MarkNext(ty, &items[i]);
+                }
+                break;
+
+        case GC_OBJECT:
+                o = p;
+                for (int i = 0; i < o->nslot; ++i) {
+                        MarkNext(ty, &o->slots[i]);
+                }
+                if (o->dynamic != NULL) {
+                        for (int i = 0; i < vN(o->dynamic->values); ++i) {
+                                MarkNext(ty, v_(o->dynamic->values, i));
+                        }
+                }
+                break;
+
+        case GC_DICT:
+        case GC_WEAK_DICT:
+                d = p;
+                if (d->dflt.type != VALUE_ZERO) {
+                        MarkNext(ty, &d->dflt);
+                }
+                if (a->type == GC_DICT) {
+                        dfor(d, {
+                                MarkNext(ty, key);
+                                MarkNext(ty, val);
+                        });
+                }
+                break;
+
+        case GC_QUEUE:
+        case GC_SHARED_QUEUE:
+                q = p;
+                if (q->items != NULL) {
+                        MARK(q->items);
+                        usize n = _queue_count(q->head, q->tail, q->cap);
+                        for (usize i = 0; i < n; ++i) {
+                                MarkNext(ty, &q->items[(q->head + i) % q->cap]);
+                        }
+                }
+                break;
+
+        case GC_ENV:
+                env = p;
+                for (usize i = 0; i < a->size / sizeof *env; ++i) {
+                        if (env[i] != NULL) {
+                                MARK(env[i]);
+                                MarkNext(ty, env[i]);
+                        }
+                }
+                break;
+
+        case GC_VALUE:
+        case GC_FFI_AUTO:
+                MarkNext(ty, p);
+                break;
+
+        case GC_THREAD:
+                MarkNext(ty, &((Thread *)p)->v);
+                break;
+
+        case GC_GENERATOR:
+                mark_generator_state(ty, p);
+                break;
+
+        case GC_WEAK:
+                weak_ref_mark(ty, p);
+                break;
+
+        case GC_LAZY:
+                lazy_mark(ty, p);
+                break;
+
+        default:
+                return;
+        }
+}
+
+/*
+ * Traces what a block in the permanent generation refers to: frozen blocks
+ * stay marked, so ordinary marking stops at them. Anything that can't change
+ * can only refer to blocks at least as old as it is, and those were frozen
+ * along with it.
+ */
+void
+value_mark_frozen(Ty *ty, struct alloc *a)
+{
+        TraceBlock(ty, a);
+        Drain(ty);
+}
+
+/*
+ * Marks a block that's referred to by something other than a Value, along
+ * with everything it refers to.
+ */
+void
+value_mark_block(Ty *ty, void const *p)
+{
+        if (!MARKED(p)) {
+                MARK(p);
+                TraceBlock(ty, ALLOC_OF(p));
+                Drain(ty);
+        }
+}
+
+/*
+ * Moves whatever is left on ty->marking onto gray. Used to collect the roots
+ * each thread queued while an incremental cycle was being started.
+ */
+void
+value_mark_spill(Ty *ty, ValueVector *gray)
+{
+        Spill(ty, gray);
+}
+
+/*
+ * Marks a block and queues everything it refers to on ty->gray, without
+ * tracing any further. See GCShade().
+ */
+void
+value_shade_block(Ty *ty, void const *p)
+{
+        struct alloc *a = ALLOC_OF(p);
+
+        MARK(p);
+        TraceBlock(ty, a);
+
+        Spill(ty, &ty->gray);
 }
 
 Blob *
@@ -1900,7 +2311,7 @@ value_record(Ty *ty, int n)
         Value *items = mAo(n * sizeof (Value), GC_TUPLE);
 
         NOGC(items);
-        int *ids = mAo(n * sizeof (int), GC_TUPLE);
+        int *ids = mAo(n * sizeof (int), GC_ANY);
         OKGC(items);
 
         for (int i = 0; i < n; ++i) {
@@ -1927,41 +2338,391 @@ value_named_tuple(Ty *ty, char const *first, ...)
         va_end(ap);
 
         Value *items = mAo(n * sizeof (Value), GC_TUPLE);
+        i32Vector ids = {0};
 
-        NOGC(items);
-        int *ids = mAo(n * sizeof (int), GC_TUPLE);
-        OKGC(items);
+        SCRATCH_SAVE();
 
         va_start(ap, first);
 
-        ids[0] = (first[0] == '\0') ? -1 : M_ID(first);
+        svP(ids, (first[0] == '\0') ? -1 : M_ID(first));
         items[0] = va_arg(ap, Value);
 
         for (int i = 1; i < n; ++i) {
                 char const *name = va_arg(ap, char *);
                 items[i] = va_arg(ap, Value);
-                ids[i] = (name[0] == '\0') ? -1 : M_ID(name);
+                svP(ids, (name[0] == '\0') ? -1 : M_ID(name));
         }
 
         va_end(ap);
 
-        return TUPLE(items, ids, n, false);
+        Value tuple = TUPLE(items, tuple_layout(vv(ids), n), n, false);
+
+        SCRATCH_RESTORE();
+
+        return tuple;
 }
 
-Value *
-tuple_get_i(Value const *tuple, int id)
+/*
+ * Interned tuple layouts
+ *
+ * A layout is the ids array of a record plus an index from member id to
+ * position. Each distinct sequence of ids is interned once and never freed, so
+ * its ids can serve as the `ids` of any number of tuples, on any thread,
+ * without being copied.
+ *
+ * The ids live in the data of an embedded struct alloc, so anything that only
+ * sees the ids pointer can treat them like any other block. The header is
+ * created marked, which means the collector never writes to it. Its type tells
+ * tuple_slot() whether the index is there or whether the ids were built some
+ * other way and have to be scanned.
+ *
+ * The index is a perfect hash: some multiplier sends every named id to its own
+ * bucket, so a lookup is one multiply, one load and one compare.
+ *
+ * Layouts known at compile time are always interned. Layouts built at run time
+ * (JSON objects, tuple(**kw), records with computed names) share whatever is
+ * already in the table, but only add to it until LAYOUT_DYNAMIC_MAX bytes of
+ * them exist; past that they get plain collectable ids instead, which cost a
+ * scan per lookup but go away with the tuples that use them.
+ *
+ * Lookups don't take the lock. The table is open-addressed and only ever grows:
+ * slots go from NULL to a layout once, and a bigger table is published only
+ * after it holds everything the old one did. A lookup that races with an insert
+ * can miss, in which case it takes the lock and looks again. Replaced tables
+ * are never freed since a reader may still be probing one; together they're
+ * smaller than the live table.
+ */
+typedef struct tuple_layout TupleLayout;
+
+struct tuple_layout {
+        u64 hash;
+        u32 count;
+        u32 mult;
+        u32 shift;
+        u16 *index;
+        struct alloc a;
+};
+
+typedef struct {
+        u32 size;
+        u32 count;
+        TupleLayout *_Atomic slots[];
+} LayoutTable;
+
+#define LAYOUT_OF(ids) ((TupleLayout *)((char *)ALLOC_OF(ids) - offsetof(TupleLayout, a)))
+#define LAYOUT_EMPTY   UINT16_MAX
+
+#define LAYOUT_DYNAMIC_MAX (4ULL << 20)
+
+static struct {
+        LayoutTable *_Atomic table;
+        usize dynamic;
+        TySpinLock lock;
+} Layouts;
+
+void
+tuple_layout_init(void)
+{
+        TySpinLockInit(&Layouts.lock);
+}
+
+inline static u32
+LayoutBucket(TupleLayout const *layout, i32 id)
 {
-        if (tuple->ids == NULL) {
+        return ((u32)id * layout->mult) >> layout->shift;
+}
+
+inline static u64
+LayoutHash(i32 const *ids, int n)
+{
+        u64 hash = 0x9E3779B97F4A7C15ULL ^ n;
+
+        for (int i = 0; i < n; ++i) {
+                hash = HashCombine(hash, (u64)(u32)ids[i]);
+        }
+
+        return hash;
+}
+
+/*
+ * Looks for a multiplier that gives every named id its own bucket, doubling the
+ * table a few times if none of the candidates work. A repeated id keeps its
+ * first position, the same one a linear scan would find.
+ */
+static bool
+BuildIndex(TupleLayout *layout, i32 const *ids, u16 *index, u32 max_bits)
+{
+        int n = layout->count;
+        u32 bits = 1;
+
+        while ((1u << bits) < 2 * n) {
+                bits += 1;
+        }
+
+        for (u32 seed = 0x2545F491u; bits <= max_bits; bits += 1) {
+                for (int attempt = 0; attempt < 32; ++attempt) {
+                        seed ^= seed << 13;
+                        seed ^= seed >> 17;
+                        seed ^= seed << 5;
+
+                        layout->mult  = seed | 1;
+                        layout->shift = 32 - bits;
+
+                        memset(index, 0xFF, (1u << max_bits) * sizeof (u16));
+
+                        bool perfect = true;
+
+                        for (int i = 0; i < n && perfect; ++i) {
+                                if (ids[i] == -1) {
+                                        continue;
+                                }
+                                u32 b = LayoutBucket(layout, ids[i]);
+                                if (index[b] == LAYOUT_EMPTY) {
+                                        index[b] = i;
+                                } else if (ids[index[b]] != ids[i]) {
+                                        perfect = false;
+                                }
+                        }
+
+                        if (perfect) {
+                                return true;
+                        }
+                }
+        }
+
+        return false;
+}
+
+static TupleLayout *
+NewLayout(i32 const *ids, int n, u64 hash, usize *bytes)
+{
+        u32 max_bits = 1;
+
+        while ((1u << max_bits) < 2 * n) {
+                max_bits += 1;
+        }
+
+        max_bits += 3;
+
+        bool indexed = (n < LAYOUT_EMPTY);
+
+        usize size = sizeof (TupleLayout)
+                   + n * sizeof (i32)
+                   + (indexed ? (1u << max_bits) * sizeof (u16) : 0);
+
+        TupleLayout *layout = xmA(size);
+        *bytes = size;
+
+        layout->hash  = hash;
+        layout->count = n;
+
+        layout->a.size = GC_BLOCK_SIZE(n * sizeof (i32));
+        layout->a.type = GC_TUPLE_LAYOUT;
+        atomic_init(&layout->a.mark, true);
+        atomic_init(&layout->a.hard, 0);
+
+        i32 *dst = (i32 *)layout->a.data;
+        memcpy(dst, ids, n * sizeof (i32));
+
+        layout->index = indexed ? (u16 *)(dst + n) : NULL;
+
+        if (indexed && !BuildIndex(layout, dst, layout->index, max_bits)) {
+                layout->index = NULL;
+        }
+
+        return layout;
+}
+
+static TupleLayout *
+FindLayout(LayoutTable *table, i32 const *ids, int n, u64 hash)
+{
+        if (table == NULL) {
                 return NULL;
         }
 
+        u32 mask = table->size - 1;
+
+        for (u32 i = hash & mask;; i = (i + 1) & mask) {
+                TupleLayout *layout = atomic_load_explicit(
+                        &table->slots[i],
+                        memory_order_acquire
+                );
+                if (layout == NULL) {
+                        return NULL;
+                }
+                if (
+                        (layout->hash == hash)
+                     && (layout->count == n)
+                     && (memcmp(layout->a.data, ids, n * sizeof (i32)) == 0)
+                ) {
+                        return layout;
+                }
+        }
+}
+
+static void
+PutLayout(LayoutTable *table, TupleLayout *layout)
+{
+        u32 mask = table->size - 1;
+        u32 i = layout->hash & mask;
+
+        while (atomic_load_explicit(&table->slots[i], memory_order_relaxed) != NULL) {
+                i = (i + 1) & mask;
+        }
+
+        atomic_store_explicit(&table->slots[i], layout, memory_order_release);
+        table->count += 1;
+}
+
+static LayoutTable *
+GrowLayouts(LayoutTable *old)
+{
+        u32 size = (old == NULL) ? 64 : 2 * old->size;
+        LayoutTable *table = xmA(sizeof (LayoutTable) + size * sizeof (TupleLayout *));
+
+        table->size  = size;
+        table->count = 0;
+
+        for (u32 i = 0; i < size; ++i) {
+                atomic_init(&table->slots[i], NULL);
+        }
+
+        for (u32 i = 0; old != NULL && i < old->size; ++i) {
+                TupleLayout *layout = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+                if (layout != NULL) {
+                        PutLayout(table, layout);
+                }
+        }
+
+        atomic_store_explicit(&Layouts.table, table, memory_order_release);
+
+        return table;
+}
+
+static TupleLayout *
+InternLayout(i32 const *ids, int n, bool dynamic)
+{
+        u64 hash = LayoutHash(ids, n);
+
+        TupleLayout *layout = FindLayout(
+                atomic_load_explicit(&Layouts.table, memory_order_acquire),
+                ids,
+                n,
+                hash
+        );
+
+        if (LIKELY(layout != NULL)) {
+                return layout;
+        }
+
+        TySpinLockLock(&Layouts.lock);
+
+        LayoutTable *table = atomic_load_explicit(&Layouts.table, memory_order_relaxed);
+        layout = FindLayout(table, ids, n, hash);
+
+        if (layout == NULL && (!dynamic || Layouts.dynamic < LAYOUT_DYNAMIC_MAX)) {
+                usize bytes;
+                layout = NewLayout(ids, n, hash, &bytes);
+
+                if (dynamic) {
+                        Layouts.dynamic += bytes;
+                }
+
+                if (table == NULL || table->count >= table->size / 2) {
+                        table = GrowLayouts(table);
+                }
+
+                PutLayout(table, layout);
+        }
+
+        TySpinLockUnlock(&Layouts.lock);
+
+        return layout;
+}
+
+/*
+ * The interned copy of ids[0..n), for use as the ids of a tuple with n items.
+ * Only for layouts fixed by the program text or the runtime itself; anything
+ * built from run-time data should go through tuple_ids().
+ */
+i32 *
+tuple_layout(i32 const *ids, int n)
+{
+        return (i32 *)InternLayout(ids, n, false)->a.data;
+}
+
+/*
+ * Like tuple_layout(), but returns NULL rather than intern a new layout once
+ * the run-time budget is spent.
+ */
+i32 *
+tuple_layout_shared(i32 const *ids, int n)
+{
+        TupleLayout *layout = InternLayout(ids, n, true);
+        return (layout != NULL) ? (i32 *)layout->a.data : NULL;
+}
+
+/*
+ * Ids for a tuple whose member names were only known at run time: the shared
+ * layout if there is or can be one, otherwise a collectable copy. The tuple is
+ * kept alive while the copy is allocated.
+ */
+i32 *
+tuple_ids(Ty *ty, Value const *tuple, i32 const *ids)
+{
+        i32 *layout = tuple_layout_shared(ids, tuple->count);
+
+        if (layout != NULL) {
+                return layout;
+        }
+
+        gP((Value *)tuple);
+        i32 *copy = mAo(tuple->count * sizeof (i32), GC_ANY);
+        gX();
+
+        memcpy(copy, ids, tuple->count * sizeof (i32));
+
+        return copy;
+}
+
+bool
+tuple_layout_interned(i32 const *ids)
+{
+        return (ids != NULL)
+            && (ALLOC_OF(ids)->type == GC_TUPLE_LAYOUT);
+}
+
+int
+tuple_slot(Value const *tuple, int id)
+{
+        i32 const *ids = tuple->ids;
+
+        if (ids == NULL) {
+                return -1;
+        }
+
+        if (ALLOC_OF(ids)->type == GC_TUPLE_LAYOUT) {
+                TupleLayout const *layout = LAYOUT_OF(ids);
+                if (LIKELY(layout->index != NULL)) {
+                        u16 i = layout->index[LayoutBucket(layout, id)];
+                        return (i != LAYOUT_EMPTY && ids[i] == id) ? i : -1;
+                }
+        }
+
         for (int i = 0; i < tuple->count; ++i) {
-                if (tuple->ids[i] == id) {
-                        return &tuple->items[i];
+                if (ids[i] == id) {
+                        return i;
                 }
         }
 
-        return NULL;
+        return -1;
+}
+
+Value *
+tuple_get_i(Value const *tuple, int id)
+{
+        int i = tuple_slot(tuple, id);
+        return (i == -1) ? NULL : &tuple->items[i];
 }
 
 Value *
@@ -74,9 +74,11 @@
 #include "blob.h"
 #include "queue.h"
 #include "cffi.h"
+#include "chan.h"
 #include "class.h"
 #include "compiler.h"
 #include "dict.h"
+#include "finalize.h"
 #include "functions.h"
 #include "gc.h"
 #include "intern.h"
@@ -84,12 +86,14 @@
 #include "log.h"
 #include "object.h"
 #include "operators.h"
+#include "snapshot.h"
 #include "sqlite.h"
 #include "str.h"
 #include "tags.h"
 #include "test.h"
 #include "types.h"
 #include "utf8.h"
+#include "weak.h"
 #include "xd.h"
 #include "value.h"
 #include "jit.h"
@@ -406,6 +410,10 @@ jit_profiler_tick(Ty *ty, char const *ip)
 volatile bool GC_EVERY_ALLOC = false;
 #endif
 
+int GCMode = GC_MODE_STOP;
+u64 GCSliceBudget = 1000000;
+isize GCHeapLimit = 0;
+
 
 bool PrintResult = false;
 FILE *DisassemblyOut = NULL;
@@ -446,12 +454,51 @@ vm_do_signal(int sig, siginfo_t *info, void *ctx)
 void
 MarkStorage(Ty *ty);
 
+void
+SnapshotStorage(Ty *ty, HeapSnapshot *snap);
+
 static TyThreadReturnValue
 vm_run_thread(void *p);
 
 inline static void
 DoUnaryOp(Ty *ty, int op, bool exec);
 
+/*
+ * With a heap limit set, whatever room is left under it after a collection is
+ * split evenly between the group's threads. A thread that outgrows its share
+ * ends up in GCHeapLimitExceeded(), which collects again to get a fresh total.
+ */
+inline static isize
+HeapShare(ThreadGroup const *group, usize threads)
+{
+        if (GCHeapLimit == 0) {
+                return INT64_MAX;
+        }
+
+        return max(GCHeapLimit - group->HeapUsed, 0) / (isize)max(threads, 1);
+}
+
+static void
+ShareHeap(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        isize used = group->DeadUsed + group->FrozenUsed;
+        for (int i = 0; i < vN(group->TyList); ++i) {
+                used += v__(group->TyList, i)->memory_used;
+        }
+
+        group->HeapUsed = used;
+
+        isize share = HeapShare(group, vN(group->TyList));
+        for (int i = 0; i < vN(group->TyList); ++i) {
+                Ty *other = v__(group->TyList, i);
+                other->heap_budget = (share == INT64_MAX)
+                                   ? INT64_MAX
+                                   : other->memory_used + share;
+        }
+}
+
 static void
 InitializeTy(Ty *ty, ThreadGroup *group)
 {
@@ -459,6 +506,7 @@ InitializeTy(Ty *ty, ThreadGroup *group)
 
         ExpandScratch(ty);
         ty->memory_limit = GC_INITIAL_LIMIT;
+        ty->heap_budget = HeapShare(group, vN(group->TyList) + 1);
 
         ty->st = alloc0(sizeof *ty->st);
         ty->co_top = co_active();
@@ -499,6 +547,11 @@ InitializeTy(Ty *ty, ThreadGroup *group)
 static void
 InitializeTY(TY *ty0, Ty *ty)
 {
+        intern_init(&ty0->u_ops);
+        intern_init(&ty0->b_ops);
+        intern_init(&ty0->members);
+        intern_init(&ty0->strings);
+
 #define X(op, id) intern(&ty0->b_ops, id)
         TY_BINARY_OPERATORS;
 #undef X
@@ -575,8 +628,12 @@ InitThreadGroup(ThreadGroup *group)
         TySpinLockInit(&group->Lock);
         TySpinLockInit(&group->GCLock);
         TySpinLockInit(&group->DLock);
+        TySpinLockInit(&group->WeakLock);
+        TySpinLockInit(&group->FinalLock);
+        TySpinLockInit(&group->SentLock);
         TyMutexInit(&group->GCPhaseLock);
         TyCondVarInit(&group->GCPhaseCond);
+        TyMutexInit(&group->PoolLock);
         group->GCPhase = GC_PHASE_NONE;
         return group;
 }
@@ -606,11 +663,11 @@ WaitForGCPhase(Ty *ty, int bits)
 }
 
 inline static void
-StartGC(Ty *ty)
+StartGC(Ty *ty, int phase)
 {
         TyMutexLock(&ty->group->GCPhaseLock);
         ty->group->GCReadyCount = 0;
-        ty->group->GCPhase = GC_PHASE_MARK;
+        ty->group->GCPhase = phase;
         TyMutexUnlock(&ty->group->GCPhaseLock);
         TyCondVarBroadcast(&ty->group->GCPhaseCond);
 }
@@ -638,6 +695,9 @@ NextGCPhase(Ty *ty, int phase, int n_running)
         TyCondVarBroadcast(&ty->group->GCPhaseCond);
 }
 
+inline static void
+Pace(Ty *ty);
+
 static void
 WaitGC(Ty *ty)
 {
@@ -648,9 +708,15 @@ WaitGC(Ty *ty)
 #endif
 
         ReleaseLock(ty, false);
-        int phase = WaitForGCPhase(ty, GC_PHASE_MARK | GC_PHASE_DONE);
+        int phase = WaitForGCPhase(ty, GC_PHASE_MARK | GC_PHASE_PARK | GC_PHASE_DONE);
         TakeLock(ty);
 
+        if (phase == GC_PHASE_PARK) {
+                ty->group->GCReadyCount += 1;
+                WaitForGCPhase(ty, GC_PHASE_DONE | GC_PHASE_NONE);
+                phase = GC_PHASE_DONE;
+        }
+
         if (phase == GC_PHASE_DONE) {
                 GCLOG("Finished waiting: %llu", TID);
 #ifdef TY_PROFILER
@@ -659,11 +725,17 @@ WaitGC(Ty *ty)
                 return;
         }
 
+        GCSweepSlice(ty, 0);
         MarkStorage(ty);
         ty->group->GCReadyCount += 1;
 
         WaitForGCPhase(ty, GC_PHASE_SWEEP);
-        GCSweepTy(ty);
+        if (ty->group->GCLazySweep) {
+                GCBeginSweep(ty);
+                Pace(ty);
+        } else {
+                GCSweepTy(ty);
+        }
         ty->group->GCReadyCount += 1;
 
         WaitForGCPhase(ty, GC_PHASE_DONE | GC_PHASE_NONE);
@@ -675,8 +747,476 @@ WaitGC(Ty *ty)
         dont_printf("Thread %-3llu: %lluus\n", TID, (TyThreadTime() - start) / 1000);
 }
 
+/*
+ * Threads that were running when the GC started mark their own storage, so
+ * the collecting thread has to wait for all of them to check in before it can
+ * treat the mark bits as final. After that every thread in the group is parked
+ * until NextGCPhase() and their storage can be walked freely.
+ */
+inline static void
+AwaitMarking(Ty *ty, int n_running)
+{
+        while (ty->group->GCReadyCount < n_running) {
+                ;
+        }
+}
+
+inline static void
+MarkGroupRoots(Ty *ty)
+{
+        GCMarkFrozen(ty);
+        finalize_mark(ty);
+        chan_mark(ty);
+
+        if (ty->group != &MainGroup) {
+                return;
+        }
+
+        GCLOG("Marking %zu global roots on thread %llu", vN(Globals), TID);
+        RESET_TOTAL_REACHED();
+        for (int i = 0; i < vN(Globals); ++i) {
+                value_mark(ty, v_(Globals, i));
+        }
+        LOG_REACHED(" => globals reached %llu", TotalReached);
+
+        RESET_TOTAL_REACHED();
+        GCRootSet *immortal = GCImmortalSet(ty);
+        for (int i = 0; i < vN(*immortal); ++i) {
+                value_mark(ty, v_(*immortal, i));
+        }
+        LOG_REACHED(" => immortal reached %llu", TotalReached);
+
+        for (int i = 0; i < vN(SignalGCRoots); ++i) {
+                value_mark(ty, v_(SignalGCRoots, i));
+        }
+}
+
+/*
+ * Called once every thread has swept its own storage: whatever is left is live,
+ * and all of it goes into the permanent generation (see GCFreeze()).
+ */
+static void
+FreezeHeap(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        for (int i = 0; i < vN(group->TyList); ++i) {
+                Ty *other = v__(group->TyList, i);
+                GCFreezeAllocs(ty, &other->allocs, &other->memory_used);
+        }
+
+        TySpinLockLock(&group->DLock);
+        GCFreezeAllocs(ty, &group->DeadAllocs, &group->DeadUsed);
+        TySpinLockUnlock(&group->DLock);
+
+        GCLOG("Froze heap: %zu blocks, %zd bytes", vN(group->Frozen), group->FrozenUsed);
+
+        group->GCFreeze = false;
+}
+
+static void
+TakeHeapSnapshot(Ty *ty, HeapSnapshot *snap)
+{
+        for (int i = 0; i < vN(ty->group->TyList); ++i) {
+                SnapshotStorage(v__(ty->group->TyList, i), snap);
+        }
+
+        if (ty->group == &MainGroup) {
+                for (int i = 0; i < vN(Globals); ++i) {
+                        snapshot_root(ty, snap, SNAP_ROOT_GLOBAL, v_(Globals, i));
+                }
+
+                GCRootSet *immortal = GCImmortalSet(ty);
+                for (int i = 0; i < vN(*immortal); ++i) {
+                        snapshot_root(ty, snap, SNAP_ROOT_IMMORTAL, v_(*immortal, i));
+                }
+
+                for (int i = 0; i < vN(SignalGCRoots); ++i) {
+                        snapshot_root(ty, snap, SNAP_ROOT_SIGNAL, v_(SignalGCRoots, i));
+                }
+        }
+
+        snapshot_finish(ty, snap);
+}
+
+static void
+Collect(Ty *ty, bool lazy);
+
+//====/ Incremental marking /================================================================
+//
+// In incremental mode the mark phase is spread over a series of short pauses
+// instead of happening all at once. The pause that starts a cycle only queues
+// the roots, and from then on every object allocated is born marked. Each
+// pause after that (see MarkSlice()) traces from the queue for at most
+// GCSliceBudget, and the program runs in between.
+//
+// Marking is snapshot-at-the-beginning: everything that was reachable when
+// the cycle started is kept. The program can't hide a value from the marker
+// by moving it somewhere the marker has already been, because the first time
+// it overwrites, removes or reorders anything in a block the marker hasn't
+// reached yet, the write barrier (GCWrite()) marks that block and queues what
+// it refers to on the thread's own gray list. A block that's already marked
+// had its contents queued when it was marked, and blocks born during the
+// cycle have nothing in them that needs to be kept. Values read out of weak
+// references are queued the same way (see weak_gray()).
+//
+// The VM's stores into containers go through pushtarget(), builtins call
+// GCWrite() before changing a container in place, and the JIT takes its slow
+// path for stores while a cycle is marking.
+//
+// Once the queue is empty the cycle ends with an ordinary collection. It
+// re-marks the roots, which stops as soon as it reaches a marked object,
+// traces whatever the threads have queued since the last slice, and deals
+// with weak references and finalizers as usual. Its garbage is then swept a
+// slice at a time (see GCSweepSlice()), and the next cycle doesn't start
+// until that's finished.
+//
+// While a cycle or a lazy sweep is in progress, a thread's allocation limit
+// is kept just above its heap size so that it comes back for its next slice.
+//
+
+enum {
+        GC_SLICE_BYTES = 1 << 18
+};
+
+/*
+ * Parks every other thread in the group without asking them to mark: running
+ * threads check in from WaitGC() and wait there until ResumeThreads(). The
+ * caller holds GCLock, and ResumeThreads() releases it.
+ */
+static int *
+ParkThreads(Ty *ty, int *nBlocked)
+{
+        ThreadGroup *group = ty->group;
+
+        TySpinLockLock(&group->Lock);
+
+        group->WantGC    = true;
+        JitInterruptFlag = 1;
+
+        int *blocked = mrealloc(NULL, (vN(group->ThreadList) + 1) * sizeof *blocked);
+        int nRunning = 0;
+
+        *nBlocked = 0;
+
+        for (int i = 0; i < vN(group->ThreadList); ++i) {
+                if (ty->lock == v__(group->ThreadLocks, i)) {
+                        continue;
+                }
+                TySpinLockLock(v__(group->ThreadLocks, i));
+                if (TryFlipTo(v__(group->ThreadStates, i), true)) {
+                        nRunning += 1;
+                        TySpinLockUnlock(v__(group->ThreadLocks, i));
+                } else {
+                        blocked[(*nBlocked)++] = i;
+                }
+        }
+
+        StartGC(ty, GC_PHASE_PARK);
+        AwaitMarking(ty, nRunning);
+
+        return blocked;
+}
+
+static void
+ResumeThreads(Ty *ty, int *blocked, int nBlocked)
+{
+        ty->group->WantGC = false;
+
+        EndGC(ty);
+
+        TySpinLockUnlock(&ty->group->GCLock);
+
+        UnlockThreads(ty, blocked, nBlocked);
+
+        TySpinLockUnlock(&ty->group->Lock);
+
+        free(blocked);
+}
+
+static void
+ClearAllMarks(ThreadGroup *group)
+{
+        for (int i = 0; i < vN(group->TyList); ++i) {
+                GCClearMarks(&v__(group->TyList, i)->allocs);
+        }
+
+        GCClearMarks(&group->DeadAllocs);
+}
+
+/*
+ * Moves what the write barrier has queued on each thread onto the cycle's own
+ * list. Every other thread in the group is parked.
+ */
+static void
+TakeGray(ThreadGroup *group)
+{
+        GCCycle *c = &group->Cycle;
+
+        for (int i = 0; i < vN(group->TyList); ++i) {
+                Ty *other = v__(group->TyList, i);
+                xvPv(c->gray, other->gray);
+                v0(other->gray);
+        }
+}
+
+/*
+ * A cycle can't start while any thread still has garbage left from the last
+ * one: the stale marks on its survivors would be taken for live ones and
+ * never traced through. Threads sweep their own lists from CheckUsed(), but
+ * one that's blocked can't, so this sweeps a slice of the first such list it
+ * can lock. Returns true once nothing is left to sweep.
+ */
+static bool
+SweepBlocked(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        if (atomic_load_explicit(&group->Sweeping, memory_order_acquire) == 0) {
+                return true;
+        }
+
+        if (!TySpinLockTryLock(&group->Lock)) {
+                return false;
+        }
+
+        for (int i = 0; i < vN(group->ThreadList); ++i) {
+                Ty *other = v__(group->TyList, i);
+                TySpinLock *lock = v__(group->ThreadLocks, i);
+
+                if (other == ty || !TySpinLockTryLock(lock)) {
+                        continue;
+                }
+
+                bool swept = other->sweep.active;
+                if (swept) {
+                        GCSweepSlice(other, GCSliceBudget);
+                }
+
+                TySpinLockUnlock(lock);
+
+                if (swept) {
+                        break;
+                }
+        }
+
+        TySpinLockUnlock(&group->Lock);
+
+        return atomic_load_explicit(&group->Sweeping, memory_order_acquire) == 0;
+}
+
+/*
+ * Returns false if the caller should fall back to a full collection, and true
+ * if a cycle was started or didn't need to be. The roots are only queued
+ * here, along with anything in the permanent generation; the first slice of
+ * tracing happens in the same pause.
+ */
+static bool
+StartCycle(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+        GCCycle *c = &group->Cycle;
+
+        if (!TySpinLockTryLock(&group->GCLock)) {
+                return false;
+        }
+
+        /*
+         * The caller has made sure no thread had garbage left to sweep, but
+         * another cycle may have come and gone since.
+         */
+        if (atomic_load_explicit(&group->Sweeping, memory_order_acquire) != 0) {
+                TySpinLockUnlock(&group->GCLock);
+                return true;
+        }
+
+        int nBlocked;
+        int *blocked = ParkThreads(ty, &nBlocked);
+
+        group->GCBlack = true;
+        c->active = true;
+        c->defer = true;
+
+        for (int i = 0; i < vN(group->TyList); ++i) {
+                MarkStorage(v__(group->TyList, i));
+        }
+
+        MarkGroupRoots(ty);
+
+        c->defer = false;
+
+        for (int i = 0; i < vN(group->TyList); ++i) {
+                value_mark_spill(v__(group->TyList, i), &c->gray);
+        }
+
+        GCLOG("Started incremental marking: %zu roots", vN(c->gray));
+
+        value_mark_slice(ty, &c->gray, GCSliceBudget);
+
+        ResumeThreads(ty, blocked, nBlocked);
+
+        return true;
+}
+
+/*
+ * One pause of a cycle: picks up what the threads have queued since the last
+ * one and traces for at most GCSliceBudget. Returns true once there's nothing
+ * left to trace. The caller holds GCLock, which is released here.
+ */
+static bool
+MarkSlice(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        int nBlocked;
+        int *blocked = ParkThreads(ty, &nBlocked);
+
+        TakeGray(group);
+        bool done = value_mark_slice(ty, &group->Cycle.gray, GCSliceBudget);
+
+        ResumeThreads(ty, blocked, nBlocked);
+
+        return done;
+}
+
+/*
+ * Called by Collect() once every thread has marked its roots: traces whatever
+ * is still queued, with no time limit, and turns the barrier off.
+ */
+static void
+EndCycle(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+        GCCycle *c = &group->Cycle;
+
+        TakeGray(group);
+        value_mark_slice(ty, &c->gray, UINT64_MAX);
+
+        c->active = false;
+}
+
+/*
+ * Between slices the allocation limit is pulled down to just above the
+ * current heap size so that CheckUsed() calls back in soon; the real limit is
+ * put back once this thread has no incremental work left.
+ */
+inline static void
+Pace(Ty *ty)
+{
+        if (ty->memory_limit_base == 0) {
+                ty->memory_limit_base = MemoryLimit;
+        }
+
+        MemoryLimit = MemoryUsed + GC_SLICE_BYTES;
+}
+
+inline static void
+Unpace(Ty *ty)
+{
+        if (ty->memory_limit_base != 0) {
+                MemoryLimit = ty->memory_limit_base;
+                ty->memory_limit_base = 0;
+        }
+}
+
+/*
+ * Called from CheckUsed() in incremental mode. A slice is one of: sweeping
+ * part of this thread's garbage from the last cycle, starting a new cycle,
+ * or tracing part of the heap. Once there's nothing left to trace the cycle
+ * ends with a collection whose sweep is left to the slices that follow.
+ *
+ * Returns false when the caller should fall back to a full DoGC(): no cycle
+ * could be started, or the heap has doubled before the cycle could finish.
+ */
+bool
+GCIncrementalStep(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+        GCCycle *c = &group->Cycle;
+
+        if (ty->sweep.active) {
+                if (!GCSweepSlice(ty, GCSliceBudget)) {
+                        Pace(ty);
+                        return true;
+                }
+                Unpace(ty);
+                while (MemoryUsed >= MemoryLimit) {
+                        MemoryLimit <<= 1;
+                }
+                return true;
+        }
+
+        if (!c->active) {
+                if (ty->memory_limit_base != 0) {
+                        Unpace(ty);
+                        if (MemoryUsed < MemoryLimit) {
+                                return true;
+                        }
+                }
+                if (!SweepBlocked(ty)) {
+                        if (MemoryUsed >= 2 * MemoryLimit) {
+                                return false;
+                        }
+                        Pace(ty);
+                        return true;
+                }
+                if (!StartCycle(ty)) {
+                        return false;
+                }
+                Pace(ty);
+                return true;
+        }
+
+        isize base = (ty->memory_limit_base != 0) ? ty->memory_limit_base : MemoryLimit;
+
+        if (MemoryUsed >= 2 * base) {
+                Unpace(ty);
+                return false;
+        }
+
+        if (TySpinLockTryLock(&group->GCLock)) {
+                bool done;
+
+                if (c->active) {
+                        done = MarkSlice(ty);
+                } else {
+                        done = false;
+                        TySpinLockUnlock(&group->GCLock);
+                }
+
+                if (done) {
+                        Collect(ty, true);
+                }
+        }
+
+        Pace(ty);
+
+        return true;
+}
+
+/*
+ * After fork() in the child: the other threads whose gray lists the cycle
+ * depends on are gone, so drop the cycle and the marks it has set so far.
+ */
 void
-DoGC(Ty *ty)
+GCAbandonCycle(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+        GCCycle *c = &group->Cycle;
+
+        if (c->active) {
+                ClearAllMarks(group);
+        }
+
+        c->active = false;
+        v0(c->gray);
+        v0(ty->gray);
+
+        group->GCBlack = false;
+}
+
+static void
+Collect(Ty *ty, bool lazy)
 {
         GCLOG("Trying to do GC. Used = %zu, DeadUsed = %zu", MemoryUsed, ty->group->DeadUsed);
 
@@ -743,7 +1283,7 @@ DoGC(Ty *ty)
 
         GCLOG("nBlocked = %d, nRunning = %d on thread %llu", nBlocked, nRunning, TID);
 
-        StartGC(ty);
+        StartGC(ty, GC_PHASE_MARK);
 
 #if defined(TY_GC_STATS)
         if (heap > GCMaxHeap) {
@@ -754,32 +1294,34 @@ DoGC(Ty *ty)
 
         for (int i = 0; i < nBlocked; ++i) {
                 GCLOG("Marking thread %d storage from thread %llu", blockedThreads[i], TID);
+                GCSweepSlice(v__(ty->group->TyList, blockedThreads[i]), 0);
                 MarkStorage(v__(ty->group->TyList, blockedThreads[i]));
         }
 
         GCLOG("Marking own storage on thread %llu", TID);
+        GCSweepSlice(ty, 0);
         MarkStorage(ty);
 
-        if (ty->group == &MainGroup) {
-                GCLOG("Marking %zu global roots on thread %llu", vN(Globals), TID);
-                RESET_TOTAL_REACHED();
-                for (int i = 0; i < vN(Globals); ++i) {
-                        value_mark(ty, v_(Globals, i));
-                }
-                LOG_REACHED(" => globals reached %llu", TotalReached);
+        MarkGroupRoots(ty);
 
-                RESET_TOTAL_REACHED();
-                GCRootSet *immortal = GCImmortalSet(ty);
-                for (int i = 0; i < vN(*immortal); ++i) {
-                        value_mark(ty, v_(*immortal, i));
-                }
-                LOG_REACHED(" => immortal reached %llu", TotalReached);
+        AwaitMarking(ty, nRunning);
 
-                for (int i = 0; i < vN(SignalGCRoots); ++i) {
-                        value_mark(ty, v_(SignalGCRoots, i));
-                }
+        if (UNLIKELY(ty->group->Cycle.active)) {
+                EndCycle(ty);
         }
 
+        ty->group->GCBlack = false;
+
+        weak_process(ty);
+        weak_prune(ty, finalize_process(ty));
+
+        HeapSnapshot *snap = snapshot_claim(ty);
+        if (UNLIKELY(snap != NULL)) {
+                TakeHeapSnapshot(ty, snap);
+        }
+
+        ty->group->GCLazySweep = lazy;
+
         NextGCPhase(ty, GC_PHASE_SWEEP, nRunning);
 
 #if defined(TY_GC_STATS)
@@ -792,18 +1334,35 @@ DoGC(Ty *ty)
         for (int i = 0; i < nBlocked; ++i) {
                 Ty *other = v__(ty->group->TyList, blockedThreads[i]);
                 GCLOG("Sweeping thread %llu storage from thread %llu", other->id, TID);
-                GCSweepTy(other);
+                if (lazy) {
+                        GCBeginSweep(other);
+                        Pace(other);
+                } else {
+                        GCSweepTy(other);
+                }
         }
 
         GCLOG("Sweeping own storage on thread %llu", TID);
-        GCSweepTy(ty);
+        if (lazy) {
+                GCBeginSweep(ty);
+        } else {
+                GCSweepTy(ty);
+        }
 
         GCLOG("Sweeping objects from dead threads on thread %llu", TID);
         TySpinLockLock(&ty->group->DLock);
         GCSweep(ty, &ty->group->DeadAllocs, &ty->group->DeadUsed);
         TySpinLockUnlock(&ty->group->DLock);
 
+        if (UNLIKELY(ty->group->GCFreeze)) {
+                // Running threads have to be done sweeping as well
+                AwaitMarking(ty, nRunning);
+                FreezeHeap(ty);
+        }
+
         NextGCPhase(ty, GC_PHASE_DONE, nRunning);
+        ty->group->GCLazySweep = false;
+        ShareHeap(ty);
         EndGC(ty);
 
         TySpinLockUnlock(&ty->group->GCLock);
@@ -830,6 +1389,15 @@ DoGC(Ty *ty)
 #endif
 
         dont_printf("Thread %-3llu: %.6fs\n", TID, (t1 - t0) / 1.0e9);
+
+        weak_drain(ty);
+        finalize_drain(ty);
+}
+
+void
+DoGC(Ty *ty)
+{
+        Collect(ty, false);
 }
 
 //====/ Builtin Values /======================================================================
@@ -1219,9 +1787,27 @@ inline static Value *
 inline static void
 (pushtarget)(Ty *ty, Value *v, void *gc)
 {
+        if (gc != NULL) {
+                GCWrite(ty, gc);
+        }
+
         xvP(TARGETS, ((Target) { .t = v, .gc = gc }));
 }
 
+// Re-runs the write barrier for the target just popped, for stores that
+// follow a GC point (an allocation or a call) made after it was pushed.
+inline static void
+TargetWrite(Ty *ty, Value *vp)
+{
+        void *gc = TARGETS.items[TARGETS.count].gc;
+
+        if (gc != NULL) {
+                GCWrite(ty, gc);
+        } else {
+                GCWriteValue(ty, vp);
+        }
+}
+
 inline static bool
 SpecialTarget(Ty *ty)
 {
@@ -1532,6 +2118,8 @@ co_abort(Ty *ty)
         Generator *gen = v_(STACK, n - 1)->gen;
         STACK.count = n - 1;
 
+        GCWrite(ty, gen);
+
         ty->st->stack = STACK;
         SWAP(co_state *, gen->st, ty->st);
         STACK = ty->st->stack;
@@ -1558,6 +2146,8 @@ co_yield_value(Ty *ty)
 
         Value v = pop();
 
+        GCWrite(ty, gen);
+
         ty->st->stack = STACK;
         SWAP(co_state *, gen->st, ty->st);
         STACK = ty->st->stack;
@@ -1983,6 +2573,8 @@ call_co_ex(Ty *ty, Value *v, int n, char *whence)
         xvP(CALLS, whence);
         v_(gen->st->frames, 0)->ip = whence;
 
+        GCWrite(ty, gen);
+
         ty->st->stack = STACK;
         SWAP(co_state *, gen->st, ty->st);
         STACK = ty->st->stack;
@@ -2151,6 +2743,103 @@ AddThread(Ty *ty, TyThread self)
         GC_RESUME();
 }
 
+/*
+ * Worker pools
+ *
+ * Each thread group gets at most one pool of worker threads, started the first
+ * time something in the group calls vm_parallel() with enough work to share.
+ * Workers are ordinary members of the group with their own Ty, so a task can
+ * call into the VM and allocate. Between jobs a worker is parked in the
+ * blocked state, so collections don't wait on it.
+ *
+ * The pool runs one job at a time (PoolLock). The thread that submits a job
+ * takes tasks from it too, so it can't be left waiting on workers that are
+ * slow to wake up.
+ */
+typedef struct parallel_job {
+        ParallelTask *f;
+        void *ctx;
+        usize n;
+        _Atomic(usize) next;
+        atomic_bool failed;
+        Value *err;
+} ParallelJob;
+
+struct worker_pool {
+        TyMutex mutex;
+        TyCondVar wake;
+        TyCondVar idle;
+        ParallelJob *job;
+        u64 epoch;
+        int size;
+        int running;
+        bool stop;
+};
+
+/*
+ * Once every thread in the group except the workers is gone, nothing can
+ * submit another job, so the workers are told to exit. The last one out
+ * frees the group.
+ */
+static void
+StopPoolIfIdle(ThreadGroup *group, usize remaining)
+{
+        WorkerPool *pool = group->Pool;
+
+        if (pool == NULL || group == &MainGroup || remaining != pool->size) {
+                return;
+        }
+
+        TyMutexLock(&pool->mutex);
+        pool->stop = true;
+        TyMutexUnlock(&pool->mutex);
+        TyCondVarBroadcast(&pool->wake);
+}
+
+static void
+FreePool(WorkerPool *pool)
+{
+        if (pool != NULL) {
+                TyMutexDestroy(&pool->mutex);
+                TyCondVarDestroy(&pool->wake);
+                TyCondVarDestroy(&pool->idle);
+                xmF(pool);
+        }
+}
+
+/*
+ * Called once the last thread in the group is gone and nothing it sent over a
+ * channel is still pinned (see chan_group_exit()).
+ */
+void
+vm_free_group(ThreadGroup *group)
+{
+        GCLOG("Cleaning up group %p", (void*)group);
+        TySpinLockDestroy(&group->Lock);
+        TySpinLockDestroy(&group->GCLock);
+        TySpinLockDestroy(&group->DLock);
+        TySpinLockDestroy(&group->WeakLock);
+        TySpinLockDestroy(&group->FinalLock);
+        TySpinLockDestroy(&group->SentLock);
+        TyMutexDestroy(&group->GCPhaseLock);
+        TyCondVarDestroy(&group->GCPhaseCond);
+        TyMutexDestroy(&group->PoolLock);
+        FreePool(group->Pool);
+        xvF(group->TyList);
+        xvF(group->ThreadList);
+        xvF(group->ThreadLocks);
+        xvF(group->ThreadStates);
+        xvF(group->DeadAllocs);
+        xvF(group->Frozen);
+        xvF(group->Weak);
+        xvF(group->WeakPending);
+        xvF(group->Cycle.gray);
+        xvF(group->Final);
+        xvF(group->FinalPending);
+        xvF(group->Sent);
+        xmF(group);
+}
+
 static void
 CleanupThread(void *ctx)
 {
@@ -2158,6 +2847,8 @@ CleanupThread(void *ctx)
 
         GCLOG("Cleaning up thread: %zu bytes in use. DeadUsed = %zu", MemoryUsed, ty->group->DeadUsed);
 
+        GCSweepSlice(ty, 0);
+
         TySpinLockLock(&ty->group->DLock);
         if (ty->group->DeadUsed + MemoryUsed > MemoryLimit) {
                 TySpinLockUnlock(&ty->group->DLock);
@@ -2175,6 +2866,9 @@ CleanupThread(void *ctx)
 
         GCLOG("Got threads lock on thread: %llu -- ready to clean up. Group size = %zu", TID, vN(ty->group->ThreadList));
 
+        // What the write barrier queued here is still needed by the cycle
+        xvPv(ty->group->Cycle.gray, ty->gray);
+
         for (int i = 0; i < vN(ty->group->ThreadList); ++i) {
                 if (ty->lock == v__(ty->group->ThreadLocks, i)) {
                         *v_(ty->group->ThreadList,   i) = vXx(ty->group->ThreadList);
@@ -2189,6 +2883,10 @@ CleanupThread(void *ctx)
 
         TySpinLockUnlock(&ty->group->Lock);
 
+        if (!TY_IS(WORKER)) {
+                StopPoolIfIdle(ty->group, group_remaining);
+        }
+
         for (int i = 0; i < vC(THROW_STACK); ++i) {
                 ThrowCtx *ctx = v__(THROW_STACK, i);
                 xvF(*ctx);
@@ -2230,6 +2928,7 @@ CleanupThread(void *ctx)
         xvF(ty->_2op_cache);
         xvF(ty->err);
         xvF(ty->marking);
+        xvF(ty->gray);
         xvF(ty->visiting);
         xvF(ty->scratch.arenas);
         FreeArena(&ty->arena);
@@ -2240,19 +2939,8 @@ CleanupThread(void *ctx)
         TyValueCleanup();
         TyFunctionsCleanup();
 
-        if (group_remaining == 0) {
-                GCLOG("Cleaning up group %p", (void*)ty->group);
-                TySpinLockDestroy(&ty->group->Lock);
-                TySpinLockDestroy(&ty->group->GCLock);
-                TySpinLockDestroy(&ty->group->DLock);
-                TyMutexDestroy(&ty->group->GCPhaseLock);
-                TyCondVarDestroy(&ty->group->GCPhaseCond);
-                xvF(ty->group->TyList);
-                xvF(ty->group->ThreadList);
-                xvF(ty->group->ThreadLocks);
-                xvF(ty->group->ThreadStates);
-                xvF(ty->group->DeadAllocs);
-                xmF(ty->group);
+        if (group_remaining == 0 && chan_group_exit(ty->group)) {
+                vm_free_group(ty->group);
         }
 
         GCLOG("Finished cleaning up on thread: %llu -- releasing threads lock", TID);
@@ -2333,6 +3021,232 @@ vm_run_thread(void *p)
         return TY_THREAD_OK;
 }
 
+/*
+ * Runs tasks from job until there are none left. The first error thrown by a
+ * task is kept for the submitting thread to rethrow, and no new tasks are
+ * started after it.
+ */
+static void
+RunTasks(Ty *ty, ParallelJob *job)
+{
+        usize i;
+
+        if (TY_CATCH_ERROR()) {
+                Value err = TY_CATCH();
+                if (!atomic_exchange(&job->failed, true)) {
+                        *job->err = err;
+                }
+                atomic_store_explicit(&job->next, job->n, memory_order_relaxed);
+                return;
+        }
+
+        while ((i = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < job->n) {
+                job->f(ty, job->ctx, i);
+        }
+
+        TY_CATCH_END();
+}
+
+static TyThreadReturnValue
+vm_run_worker(void *p)
+{
+        NewThreadCtx *ctx = p;
+        ThreadGroup *group = ctx->group;
+        WorkerPool *pool = group->Pool;
+
+        Ty *ty = mrealloc(NULL, sizeof *ty);
+        InitializeTy(ty, group);
+        TY_START(WORKER);
+
+        MyTy = ty;
+        MyId = ty->id = NextThreadId();
+
+        AddThread(ty, TyThreadSelf());
+
+        *ctx->created = true;
+
+        u64 epoch = 0;
+
+        UnlockTy();
+        TyMutexLock(&pool->mutex);
+
+        for (;;) {
+                while (!pool->stop && (pool->job == NULL || pool->epoch == epoch)) {
+                        TyCondVarWait(&pool->wake, &pool->mutex);
+                }
+
+                if (pool->stop) {
+                        break;
+                }
+
+                ParallelJob *job = pool->job;
+                epoch = pool->epoch;
+                pool->running += 1;
+                TyMutexUnlock(&pool->mutex);
+
+                LockTy();
+                RunTasks(ty, job);
+                UnlockTy();
+
+                TyMutexLock(&pool->mutex);
+                if (--pool->running == 0) {
+                        TyCondVarBroadcast(&pool->idle);
+                }
+        }
+
+        TyMutexUnlock(&pool->mutex);
+
+        LockTy();
+        CleanupThread(ty);
+
+        return TY_THREAD_OK;
+}
+
+/*
+ * One worker per CPU besides the one the submitting thread is on. TY_WORKERS
+ * overrides the count; TY_WORKERS=0 makes vm_parallel() run everything on the
+ * calling thread.
+ */
+static int
+PoolSize(void)
+{
+        char const *env = getenv("TY_WORKERS");
+
+        if (env != NULL && *env != '\0') {
+                return max(0, min(atoi(env), 1024));
+        }
+
+        return max(TyCPUCount() - 1, 0);
+}
+
+/*
+ * Called with PoolLock held and the caller's Ty unlocked.
+ */
+static WorkerPool *
+StartPool(ThreadGroup *group)
+{
+        WorkerPool *pool = alloc0(sizeof *pool);
+
+        TyMutexInit(&pool->mutex);
+        TyCondVarInit(&pool->wake);
+        TyCondVarInit(&pool->idle);
+
+        group->Pool = pool;
+
+        for (int i = 0, n = PoolSize(); i < n; ++i) {
+                atomic_bool created = false;
+                NewThreadCtx ctx = {
+                        .created = &created,
+                        .group = group
+                };
+                TyThread t;
+
+                if (TyThreadCreate(&t, vm_run_worker, &ctx) != 0) {
+                        break;
+                }
+
+                while (!created) {
+                        continue;
+                }
+
+                TyThreadDetach(t);
+                pool->size += 1;
+        }
+
+        return pool;
+}
+
+usize
+vm_parallel_width(Ty *ty)
+{
+        WorkerPool *pool = ty->group->Pool;
+
+        if (TY_IS(WORKER)) {
+                return 1;
+        }
+
+        return 1 + ((pool != NULL) ? pool->size : PoolSize());
+}
+
+/*
+ * Runs f(ty, ctx, i) for every i in [0, n) using the thread group's worker
+ * pool, and returns once all of them have finished. If any task throws, the
+ * first error is rethrown here after the others have stopped.
+ *
+ * Tasks run concurrently with each other and in no particular order; any
+ * Values they create must end up somewhere the caller has rooted. Calls from
+ * inside a task, and calls made while no workers are available, run every
+ * task on the calling thread.
+ */
+void
+vm_parallel(Ty *ty, usize n, ParallelTask *f, void *ctx)
+{
+        ThreadGroup *group = ty->group;
+        WorkerPool *pool;
+
+        if (n < 2 || TY_IS(WORKER)) {
+                goto Serial;
+        }
+
+        Value err = NIL;
+        ParallelJob job = {
+                .f = f,
+                .ctx = ctx,
+                .n = n,
+                .err = &err
+        };
+
+        atomic_init(&job.next, 0);
+        atomic_init(&job.failed, false);
+
+        gP(&err);
+
+        UnlockTy();
+        TyMutexLock(&group->PoolLock);
+
+        pool = (group->Pool != NULL) ? group->Pool : StartPool(group);
+
+        if (pool->size == 0) {
+                TyMutexUnlock(&group->PoolLock);
+                LockTy();
+                gX();
+                goto Serial;
+        }
+
+        TyMutexLock(&pool->mutex);
+        pool->job = &job;
+        pool->epoch += 1;
+        TyMutexUnlock(&pool->mutex);
+        TyCondVarBroadcast(&pool->wake);
+
+        LockTy();
+        RunTasks(ty, &job);
+
+        // A worker that hasn't picked the job up by now won't get to
+        UnlockTy();
+        TyMutexLock(&pool->mutex);
+        pool->job = NULL;
+        while (pool->running > 0) {
+                TyCondVarWait(&pool->idle, &pool->mutex);
+        }
+        TyMutexUnlock(&pool->mutex);
+        TyMutexUnlock(&group->PoolLock);
+        LockTy();
+
+        gX();
+
+        if (job.failed) {
+                vm_throw(ty, &err);
+        }
+
+        return;
+
+Serial:
+        for (usize i = 0; i < n; ++i) {
+                f(ty, ctx, i);
+        }
+}
+
 inline static void
 tdb_set_trap(DebugBreakpoint *breakpoint, char *ip)
 {
@@ -2995,6 +3909,8 @@ BuildKwargsDict(Ty *ty, char **ip, int nkw)
                                                 );
                                         }
                                         dict_put_value(ty, kwargs, *key, *val);
+                                        weak_dict_read(ty, v.dict, key);
+                                        weak_dict_read(ty, v.dict, val);
                                 });
                         } else if (
                                 LIKELY(
@@ -4421,7 +5337,7 @@ DoUnaryOp(Ty *ty, int op, bool exec)
 }
 
 void
-DoBinaryOp(Ty *ty, int op, bool exec)
+DoBinaryOpAt(Ty *ty, int op, OpSite *site, bool exec)
 {
         switch (op) {
         case OP_CMP: DoCmp(ty); return;
@@ -4446,7 +5362,9 @@ DoBinaryOp(Ty *ty, int op, bool exec)
         case OP_BIT_SHR: if (op_builtin_shr(ty)) return; break;
         }
 
-        int i = op_dispatch(ty, op, ClassOf(top() - 1), ClassOf(top()));
+        int i = (site != NULL)
+              ? op_dispatch_at(ty, site, op, ClassOf(top() - 1), ClassOf(top()))
+              : op_dispatch(ty, op, ClassOf(top() - 1), ClassOf(top()));
 
         if (i == -1) {
                 op_dump(op);
@@ -4476,6 +5394,12 @@ DoBinaryOp(Ty *ty, int op, bool exec)
         }
 }
 
+void
+DoBinaryOp(Ty *ty, int op, bool exec)
+{
+        DoBinaryOpAt(ty, op, NULL, exec);
+}
+
 inline static void
 DoPtrMutOp(Ty *ty, int op)
 {
@@ -4522,7 +5446,9 @@ DoMutDiv(Ty *ty, bool exec)
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_DIV, vp, &x);
+                                val = vm_2op(ty, OP_DIV, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                 }
                 xpush(*vp);
@@ -4581,7 +5507,9 @@ DoMutMod(Ty *ty, bool exec)
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_MOD, vp, &x);
+                                val = vm_2op(ty, OP_MOD, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         break;
                 }
@@ -4655,7 +5583,9 @@ DoMutMul(Ty *ty, bool exec)
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_MUL, vp, &x);
+                                val = vm_2op(ty, OP_MUL, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         break;
                 }
@@ -4732,7 +5662,9 @@ DoMutSub(Ty *ty, bool exec)
                         if ((val = vm_try_2op(ty, OP_MUT_SUB, vp, &x)).type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_SUB, vp, &x);
+                                val = vm_2op(ty, OP_SUB, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         break;
                 }
@@ -4808,13 +5740,21 @@ DoMutAdd(Ty *ty, bool exec)
                         DictUpdate(ty, vp->dict, top()->dict);
                         pop();
                         break;
+                case PAIR_OF(VALUE_STRING):
+                        val = value_string_append(ty, vp, top());
+                        TargetWrite(ty, vp);
+                        *vp = val;
+                        pop();
+                        break;
                 default:
                         x = pop();
                         val = vm_try_2op(ty, OP_MUT_ADD, vp, &x);
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_ADD, vp, &x);
+                                val = vm_2op(ty, OP_ADD, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         break;
                 }
@@ -4878,7 +5818,9 @@ DoMutAnd(Ty *ty, bool exec)
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_BIT_AND, vp, &x);
+                                val = vm_2op(ty, OP_BIT_AND, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         xpush(*vp);
                         break;
@@ -4942,7 +5884,9 @@ DoMutOr(Ty *ty, bool exec)
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_BIT_OR, vp, &x);
+                                val = vm_2op(ty, OP_BIT_OR, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         xpush(*vp);
                         break;
@@ -5006,7 +5950,9 @@ DoMutXor(Ty *ty, bool exec)
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_BIT_XOR, vp, &x);
+                                val = vm_2op(ty, OP_BIT_XOR, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         xpush(*vp);
                         break;
@@ -5066,7 +6012,9 @@ DoMutShl(Ty *ty, bool exec)
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_BIT_SHL, vp, &x);
+                                val = vm_2op(ty, OP_BIT_SHL, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         xpush(*vp);
                         break;
@@ -5126,7 +6074,9 @@ DoMutShr(Ty *ty, bool exec)
                         if (val.type != VALUE_NONE) {
                                 vp = &val;
                         } else {
-                                *vp = vm_2op(ty, OP_BIT_SHR, vp, &x);
+                                val = vm_2op(ty, OP_BIT_SHR, vp, &x);
+                                TargetWrite(ty, vp);
+                                *vp = val;
                         }
                         xpush(*vp);
                         break;
@@ -5304,15 +6254,13 @@ DoTargetMember(Ty *ty, Value v, i32 z)
                         pushtarget((Value *)(((uptr)z << 3) | 3), NULL);
                         return;
                 }
-                if (v.object->dynamic == NULL) {
-                        v.object->dynamic = mA0(sizeof (struct itable));
-                }
-                pushtarget(itable_get(ty, v.object->dynamic, z), v.object);
+                pushtarget(dynamic_get(ty, v.object, z), v.object);
                 break;
 
         case VALUE_CLASS:
                 vp = class_lookup_field(ty, v.class, z);
                 if (vp != NULL) {
+                        GCWriteValue(ty, vp);
                         pushtarget(vp, NULL);
                         return;
                 }
@@ -5464,6 +6412,7 @@ DoAssignSubscript(Ty *ty, int n, bool exec)
                         push(TAGGED(TAG_INDEX_ERR, container, subscript));
                         RaiseException(ty);
                 }
+                GCWrite(ty, container.array);
                 *v_(*container.array, subscript.z) = value;
                 break;
 
@@ -5598,7 +6547,7 @@ DoStringLiteral(Ty *ty, i32 i)
 {
         InternEntry const *interned = intern_entry(&xD.strings, i);
         push(
-                STRING_NOGC(
+                STRING_NOGC_LITERAL(
                         interned->name,
                         (uptr)interned->data
                 )
@@ -5684,8 +6633,7 @@ DoTupleLiteral(Ty *ty)
         if (k > 0) {
                 __builtin_memcpy(v.items, vv(values), k * sizeof (Value));
                 if (have_names) {
-                        v.ids = uAo(k * sizeof (i32), GC_TUPLE);
-                        __builtin_memcpy(v.ids, vv(ids), k * sizeof (i32));
+                        v.ids = tuple_ids(ty, &v, vv(ids));
                 }
         }
         SCRATCH_RESTORE();
@@ -5807,21 +6755,20 @@ Top:
 
         case VALUE_DICT:
                 off = top()[-2].off;
-                if (off == 0) {
-                        off = (DictFirst(v.dict) - v.dict->items) + 1;
+                n = v.dict->count + v.dict->tombs;
+                while (off < n && DictItemDead(&v.dict->items[off])) {
+                        off += 1;
                 }
-                if (off > v.dict->size) {
+                if (off >= n) {
                         push(NONE);
                         break;
                 }
-                item = &v.dict->items[off - 1];
-                if (item->next != NULL) {
-                        top()[-2].off = (item->next - v.dict->items) + 1;
-                } else {
-                        top()[-2].off = PTRDIFF_MAX;
-                }
+                item = &v.dict->items[off];
+                top()[-2].off = off + 1;
                 push(item->k);
                 push(item->v);
+                weak_dict_read(ty, v.dict, &item->k);
+                weak_dict_read(ty, v.dict, &item->v);
                 RC = 1;
                 pop();
                 break;
@@ -6373,7 +7320,9 @@ InstallMethods(Ty *ty, i32 c, struct itable *table, i32 n)
                 }
 
                 vp = itable_get(ty, table, i);
+                GCWriteValue(ty, vp);
                 if (vp->type == VALUE_REF) {
+                        GCWriteValue(ty, vp->ref);
                         *vp->ref = v;
                 }
                 *vp = v;
@@ -6506,6 +7455,8 @@ vm_exec(Ty *ty, char *code)
         double x;
         imax k;
 
+        OpSite *site;
+
         bool b;
 
         int i;
@@ -6638,6 +7589,7 @@ NextInstruction:
                         vp = mAo(sizeof (Value), GC_VALUE);
                         *vp = *local(ty, i);
                         *local(ty, i) = REF(vp);
+                        GCWrite(ty, ActiveFun(ty)->env);
                         ActiveFun(ty)->env[j] = vp;
                         break;
 
@@ -6779,6 +7731,30 @@ NextInstruction:
                         }
                         break;
 
+                CASE(FOR_RANGE)
+                        READJUMP(jump);
+                        n = (u8)*IP++;
+                        if (RangeLoopDone(ty, top() - 1, top(), n)) {
+                                DOJUMP(jump);
+                        }
+                        break;
+
+                CASE(RANGE_NEXT)
+                        READJUMP(jump);
+                        n = (u8)*IP++;
+                        vp = top();
+                        if (LIKELY(vp->type == VALUE_INTEGER)) {
+                                vp->z += (n == RANGE_LOOP_DOWN) ? -1 : 1;
+                        } else if (n == RANGE_LOOP_DOWN) {
+                                DecValue(ty, vp);
+                        } else {
+                                IncValue(ty, vp);
+                        }
+                        if (!RangeLoopDone(ty, top() - 1, top(), n)) {
+                                DOJUMP(jump);
+                        }
+                        break;
+
                 CASE(JII)
                         READJUMP(jump);
                         READVALUE(z);
@@ -6889,7 +7865,7 @@ NextInstruction:
                         READVALUE(n);
                         vp = local(ty, n);
                         if (vp->type == VALUE_REF) {
-                                pushtarget((Value *)vp->ptr, NULL);
+                                pushtarget((Value *)vp->ptr, vp->ptr);
                         } else {
                                 pushtarget(vp, NULL);
                         }
@@ -6901,7 +7877,7 @@ NextInstruction:
                         LOG("Loading capture: %s (%d) of %s", IP, n, VSC(ActiveFun(ty)));
                         SKIPSTR();
 #endif
-                        pushtarget(ActiveFun(ty)->env[n], NULL);
+                        pushtarget(ActiveFun(ty)->env[n], ActiveFun(ty)->env[n]);
                         break;
 
                 CASE(TARGET_MEMBER)
@@ -6972,7 +7948,9 @@ TargetMember:
                         } else {
                                 Array *rest = vA();
                                 uvPn(*rest, vv(*top()->array) + i, vN(*top()->array) - (i + j));
-                                *poptarget() = ARRAY(rest);
+                                vp = poptarget();
+                                TargetWrite(ty, vp);
+                                *vp = ARRAY(rest);
                         }
                         break;
 
@@ -6986,6 +7964,7 @@ TargetMember:
                                 i32 count = top()->count - i;
                                 Value *rest = mAo(count * sizeof (Value), GC_TUPLE);
                                 memcpy(rest, top()->items + i, count * sizeof (Value));
+                                TargetWrite(ty, vp);
                                 *vp = TUPLE(rest, NULL, count, false);
                         }
                         break;
@@ -7015,9 +7994,7 @@ TargetMember:
                                 }
 
                                 value = vT(ids.count);
-                                value.ids = uAo(value.count * sizeof (i32), GC_TUPLE);
-
-                                memcpy(value.ids, vv(ids), value.count * sizeof (i32));
+                                value.ids = tuple_ids(ty, &value, vv(ids));
 
                                 for (i32 i = 0; i < value.count; ++i) {
                                         value.items[i] = v.items[v__(indices, i)];
@@ -7025,7 +8002,9 @@ TargetMember:
 
                                 SCRATCH_RESTORE();
 
-                                *poptarget() = value;
+                                vp = poptarget();
+                                TargetWrite(ty, vp);
+                                *vp = value;
 
                                 while (*(i32 const *)IP != -1) {
                                         IP += sizeof (i32);
@@ -7421,11 +8400,9 @@ TargetMember:
                                 break;
 
                         }
-                        if (top()->ids != NULL) for (int i = 0; i < top()->count; ++i) {
-                                if (top()->ids[i] == z) {
-                                        push(top()->items[i]);
-                                        goto NextInstruction;
-                                }
+                        if ((i = tuple_slot(top(), z)) != -1) {
+                                push(top()->items[i]);
+                                goto NextInstruction;
                         }
                         if (!b) {
                                 push(NIL);
@@ -7880,11 +8857,9 @@ TargetMember:
                                 goto BadField;
                         }
 
-                        for (int i = 0; i < v.count; ++i) {
-                                if (v.ids[i] == z) {
-                                        push(v.items[i]);
-                                        goto NextInstruction;
-                                }
+                        if ((i = tuple_slot(&v, z)) != -1) {
+                                push(v.items[i]);
+                                goto NextInstruction;
                         }
 
                         if (!b) {
@@ -8025,6 +9000,26 @@ SafeMemberAccess:
                         }
                         break;
 
+                /*
+                 * `.z` on something the typechecker thinks is a record with z
+                 * at position i. The guess is checked against the tuple's own
+                 * ids, so a wrong one costs a compare.
+                 */
+                CASE(RECORD_MEMBER)
+                        READVALUE(z);
+                        READVALUE(i);
+                        vp = top();
+                        if (
+                                (vp->type == VALUE_TUPLE)
+                             && (i < vp->count)
+                             && (vp->ids != NULL)
+                             && (vp->ids[i] == z)
+                        ) {
+                                *vp = vp->items[i];
+                                break;
+                        }
+                        goto MemberAccess;
+
                 CASE(MEMBER_ACCESS)
                         READVALUE(z);
 MemberAccess:
@@ -8093,6 +9088,7 @@ BadField:
                         break;
 
                 CASE(ADD)
+                        READVALUE(site);
                         if (!op_builtin_add(ty)) {
                                 n = OP_ADD;
                                 goto BinaryOp;
@@ -8100,6 +9096,7 @@ BadField:
                         break;
 
                 CASE(SUB)
+                        READVALUE(site);
                         if (!op_builtin_sub(ty)) {
                                 n = OP_SUB;
                                 goto BinaryOp;
@@ -8107,6 +9104,7 @@ BadField:
                         break;
 
                 CASE(MUL)
+                        READVALUE(site);
                         if (!op_builtin_mul(ty)) {
                                 n = OP_MUL;
                                 goto BinaryOp;
@@ -8114,6 +9112,7 @@ BadField:
                         break;
 
                 CASE(DIV)
+                        READVALUE(site);
                         if (!op_builtin_div(ty)) {
                                 n = OP_DIV;
                                 goto BinaryOp;
@@ -8121,6 +9120,7 @@ BadField:
                         break;
 
                 CASE(MOD)
+                        READVALUE(site);
                         if (!op_builtin_mod(ty)) {
                                 n = OP_MOD;
                                 goto BinaryOp;
@@ -8128,6 +9128,7 @@ BadField:
                         break;
 
                 CASE(BIT_AND)
+                        READVALUE(site);
                         if (!op_builtin_and(ty)) {
                                 n = OP_BIT_AND;
                                 goto BinaryOp;
@@ -8135,6 +9136,7 @@ BadField:
                         break;
 
                 CASE(BIT_OR)
+                        READVALUE(site);
                         if (!op_builtin_or(ty)) {
                                 n = OP_BIT_OR;
                                 goto BinaryOp;
@@ -8142,6 +9144,7 @@ BadField:
                         break;
 
                 CASE(BIT_XOR)
+                        READVALUE(site);
                         if (!op_builtin_xor(ty)) {
                                 n = OP_BIT_XOR;
                                 goto BinaryOp;
@@ -8149,6 +9152,7 @@ BadField:
                         break;
 
                 CASE(SHR)
+                        READVALUE(site);
                         if (!op_builtin_shr(ty)) {
                                 n = OP_BIT_SHR;
                                 goto BinaryOp;
@@ -8156,6 +9160,7 @@ BadField:
                         break;
 
                 CASE(SHL)
+                        READVALUE(site);
                         if (!op_builtin_shl(ty)) {
                                 n = OP_BIT_SHL;
                                 goto BinaryOp;
@@ -8281,8 +9286,9 @@ BadField:
 
                 CASE(BINARY_OP)
                         READVALUE(n);
+                        READVALUE(site);
 BinaryOp:
-                        DoBinaryOp(ty, n, false);
+                        DoBinaryOpAt(ty, n, site, false);
                         break;
 
                 CASE(UNARY_OP)
@@ -8366,7 +9372,9 @@ BinaryOp:
                         v = pop();
 
                         vp = itable_get(ty, &class->s_fields, member_id);
+                        GCWriteValue(ty, vp);
                         if (vp->type == VALUE_REF) {
+                                GCWriteValue(ty, vp->ref);
                                 *vp->ref = v;
                         }
                         *vp = v;
@@ -8567,6 +9575,7 @@ BinaryOp:
                                 break;
                         }
                         v = pop();
+                        GCWrite(ty, v.gen);
                         xvP(FRAMES, v_0(v.gen->st->frames));
                         vvL(FRAMES)->fp = vN(STACK);
                         xvPn(STACK, v_(v.gen->st->stack, 1), vN(v.gen->st->stack) - 1);
@@ -9756,6 +10765,8 @@ vm_init(Ty *ty, int ac, char **av)
 
         NewArenaNoGC(ty, 1ULL << 25);
 
+        shape_init();
+        tuple_layout_init();
         compiler_init(ty);
         add_builtins(ty, ac, av);
 
@@ -10411,7 +11422,7 @@ MarkStorage(Ty *ty)
         for (int i = 0; i < vN(TARGETS); ++i) {
                 Target *target = v_(TARGETS, i);
                 if (target->gc != NULL) {
-                        MARK(target->gc);
+                        value_mark_block(ty, target->gc);
                 }
         }
         LOG_REACHED(" => targets reached %llu", TotalReached);
@@ -10424,6 +11435,56 @@ MarkStorage(Ty *ty)
         LOG_REACHED(" => frame fns reached %llu", TotalReached);
 }
 
+void
+SnapshotStorage(Ty *ty, HeapSnapshot *snap)
+{
+        for (int i = 0; i < vN(RootSet); ++i) {
+                snapshot_root(ty, snap, SNAP_ROOT_SET, v_(RootSet, i));
+        }
+
+        for (int i = 0; i < vN(THREAD_LOCALS); ++i) {
+                snapshot_root(ty, snap, SNAP_ROOT_TLS, v_(THREAD_LOCALS, i));
+        }
+
+        for (int i = 0; i < vN(STACK) + RC && i < vC(STACK); ++i) {
+                snapshot_root(ty, snap, SNAP_ROOT_STACK, v_(STACK, i));
+        }
+
+        for (int i = 0; i < vN(TRY_STACK); ++i) {
+                struct try *t = v__(TRY_STACK, i);
+                for (int i = 0; i < vN(t->defer); ++i) {
+                        snapshot_root(ty, snap, SNAP_ROOT_TRY, v_(t->defer, i));
+                }
+        }
+
+        for (int i = 0; i < vN(THROW_STACK); ++i) {
+                ThrowCtx *ctx = v__(THROW_STACK, i);
+                for (int i = 0; i < vN(ctx->locals); ++i) {
+                        ValueVector const *locals = v_(ctx->locals, i);
+                        for (int i = 0; i < vN(*locals); ++i) {
+                                snapshot_root(ty, snap, SNAP_ROOT_THROW, v_(*locals, i));
+                        }
+                }
+                snapshot_root(ty, snap, SNAP_ROOT_THROW, &ctx->exc);
+        }
+        snapshot_root(ty, snap, SNAP_ROOT_THROW, &ty->exc);
+
+        for (int i = 0; i < vN(DROP_STACK); ++i) {
+                snapshot_root(ty, snap, SNAP_ROOT_DROP, v_(DROP_STACK, i));
+        }
+
+        for (int i = 0; i < vN(TARGETS); ++i) {
+                Target *target = v_(TARGETS, i);
+                if (target->gc != NULL) {
+                        snapshot_root_block(ty, snap, SNAP_ROOT_TARGET, target->gc);
+                }
+        }
+
+        for (int i = 0; i < vN(FRAMES); ++i) {
+                snapshot_root(ty, snap, SNAP_ROOT_FRAME, FrameFun(ty, v_(FRAMES, i)));
+        }
+}
+
 char const *
 GetInstructionName(u8 i)
 {
@@ -10494,6 +11555,11 @@ StepInstruction(char const *ip)
                 SKIPVALUE(n);
                 SKIPVALUE(i);
                 break;
+        CASE(FOR_RANGE)
+        CASE(RANGE_NEXT)
+                SKIPVALUE(n);
+                ip += 1;
+                break;
         CASE(JLT)
         CASE(JLE)
         CASE(JGT)
@@ -10839,6 +11905,10 @@ StepInstruction(char const *ip)
         CASE(SELF_STATIC_ACCESS)
                 SKIPVALUE(n);
                 break;
+        CASE(RECORD_MEMBER)
+                SKIPVALUE(n);
+                SKIPVALUE(n);
+                break;
         CASE(TRY_GET_MEMBER)
         CASE(GET_MEMBER)
         CASE(TARGET_DYN_MEMBER)
@@ -10852,11 +11922,6 @@ StepInstruction(char const *ip)
         CASE(QUESTION)
         CASE(NEG)
         CASE(COUNT)
-        CASE(ADD)
-        CASE(SUB)
-        CASE(MUL)
-        CASE(DIV)
-        CASE(MOD)
         CASE(EQ)
         CASE(NEQ)
         CASE(CHECK_MATCH)
@@ -10879,9 +11944,24 @@ StepInstruction(char const *ip)
         CASE(MUT_MOD)
         CASE(MUT_SUB)
                  break;
+        CASE(ADD)
+        CASE(SUB)
+        CASE(MUL)
+        CASE(DIV)
+        CASE(MOD)
+        CASE(BIT_AND)
+        CASE(BIT_OR)
+        CASE(BIT_XOR)
+        CASE(SHL)
+        CASE(SHR)
+                SKIPVALUE(s);
+                break;
         CASE(UNARY_OP)
+                SKIPVALUE(n);
+                break;
         CASE(BINARY_OP)
                 SKIPVALUE(n);
+                SKIPVALUE(s);
                 break;
         CASE(DEFINE_TAG)
         {
@@ -11207,6 +12287,8 @@ tdb_step_over_x(Ty *ty, char *ip, i32 i)
         CASE(JLE)
         CASE(JLT)
         CASE(JNE)
+        CASE(FOR_RANGE)
+        CASE(RANGE_NEXT)
         CASE(JNI)
         CASE(JII)
         CASE(JUMP)
@@ -11491,7 +12573,7 @@ TyReloadModule(Ty *ty, char const *module)
                 }
         }
 
-        StartGC(ty);
+        StartGC(ty, GC_PHASE_MARK);
 
         while (ty->group->GCReadyCount < nRunning) {
                 ;
@@ -11653,9 +12735,7 @@ vm_jit_record_rest(Ty *ty, Value *tos, Value *target, i32 const *excluded_ids)
         }
 
         Value value = vT(ids.count);
-        value.ids = uAo(value.count * sizeof (i32), GC_TUPLE);
-
-        memcpy(value.ids, vv(ids), value.count * sizeof (i32));
+        value.ids = tuple_ids(ty, &value, vv(ids));
 
         for (i32 i = 0; i < value.count; ++i) {
                 value.items[i] = v.items[v__(indices, i)];
@@ -11711,8 +12791,15 @@ TyPostFork(Ty *ty)
         TySpinLockInit(&ty->group->GCLock);
         TySpinLockInit(&ty->group->Lock);
         TySpinLockInit(&ty->group->DLock);
+        TySpinLockInit(&ty->group->WeakLock);
+        TySpinLockInit(&ty->group->FinalLock);
+        TyMutexInit(&ty->group->PoolLock);
         TySpinLockInit(ty->lock);
         TySpinLockLock(ty->lock);
+        GCAbandonCycle(ty);
+
+        // The pool's workers didn't survive the fork
+        ty->group->Pool = NULL;
 }
 
 void
@@ -0,0 +1,263 @@
+#include "ty.h"
+#include "dict.h"
+#include "gc.h"
+#include "value.h"
+#include "vm.h"
+#include "weak.h"
+#include "xd.h"
+
+inline static void
+Register(Ty *ty, void *p)
+{
+        ThreadGroup *group = ty->group;
+
+        TySpinLockLock(&group->WeakLock);
+        xvP(group->Weak, p);
+        TySpinLockUnlock(&group->WeakLock);
+}
+
+WeakRef *
+weak_ref_new(Ty *ty, Value const *target, Value const *callback)
+{
+        WeakRef *ref = mAo(sizeof *ref, GC_WEAK);
+
+        ref->target   = *target;
+        ref->callback = *callback;
+
+        Register(ty, ref);
+
+        return ref;
+}
+
+Value
+weak_ref_get(Ty *ty, WeakRef const *ref)
+{
+        if (UNLIKELY(ty->group->GCBlack)) {
+                weak_gray(ty, &ref->target);
+        }
+
+        return ref->target;
+}
+
+Dict *
+weak_dict_new(Ty *ty)
+{
+        Dict *d = mAo0(sizeof (Dict), GC_WEAK_DICT);
+        Register(ty, d);
+        return d;
+}
+
+/*
+ * Read barrier for incremental mode. Marking keeps whatever was strongly
+ * reachable when the cycle started, and in that snapshot anything reachable
+ * only through weak references was left unmarked. A value read out of a weak
+ * reference while the cycle is in flight can end up anywhere, including in an
+ * object that's already been traced, so it's shaded here just like a value
+ * the write barrier is about to lose (see GCWriteValue()).
+ */
+void
+weak_gray(Ty *ty, Value const *v)
+{
+        GCShadeValue(ty, v);
+}
+
+/*
+ * weak_gray() for a key or value of d (every entry if v is NULL), or nothing
+ * if d isn't a weak dict.
+ */
+void
+weak_gray_dict(Ty *ty, Dict const *d, Value const *v)
+{
+        if (ALLOC_OF(d)->type != GC_WEAK_DICT) {
+                return;
+        }
+
+        if (v != NULL) {
+                weak_gray(ty, v);
+                return;
+        }
+
+        dfor(d, {
+                weak_gray(ty, key);
+                weak_gray(ty, val);
+        });
+}
+
+void
+weak_ref_mark(Ty *ty, WeakRef *ref)
+{
+        xvP(ty->marking, &ref->callback);
+}
+
+inline static void
+MarkLive(Ty *ty, ThreadGroup *group)
+{
+        for (int i = 0; i < vN(group->WeakPending); ++i) {
+                value_mark(ty, v_(group->WeakPending, i));
+        }
+
+        /*
+         * Tracing the value of an entry whose key is live can make more keys
+         * live, in this table or another one, so repeat until the number of
+         * live entries stops changing. Live weak targets are traced here too:
+         * a target can be reachable without owning a GC block (e.g. a plain
+         * function with metadata) and whatever it does own still needs marking.
+         */
+        usize live = 0;
+        usize prev;
+
+        do {
+                prev = live;
+                live = 0;
+
+                for (int i = 0; i < vN(group->Weak); ++i) {
+                        void *p = v__(group->Weak, i);
+
+                        if (!MARKED(p)) {
+                                continue;
+                        }
+
+                        if (ALLOC_OF(p)->type == GC_WEAK_DICT) {
+                                live += dict_mark_ephemerons(ty, p);
+                        } else {
+                                WeakRef *ref = p;
+                                if (value_is_marked(&ref->target)) {
+                                        value_mark(ty, &ref->target);
+                                        live += 1;
+                                }
+                        }
+                }
+        } while (live != prev);
+}
+
+inline static void
+Sweep(Ty *ty, ThreadGroup *group, bool prune)
+{
+        int n = 0;
+
+        for (int i = 0; i < vN(group->Weak); ++i) {
+                void *p = v__(group->Weak, i);
+
+                if (!MARKED(p)) {
+                        if (!prune) {
+                                *v_(group->Weak, n++) = p;
+                        }
+                        continue;
+                }
+
+                if (ALLOC_OF(p)->type == GC_WEAK_DICT) {
+                        dict_sweep_weak(ty, p);
+                } else {
+                        WeakRef *ref = p;
+                        if (!value_is_marked(&ref->target)) {
+                                ref->target = NIL;
+                                if (ref->callback.type != VALUE_NIL) {
+                                        xvP(group->WeakPending, ref->callback);
+                                        ref->callback = NIL;
+                                }
+                        }
+                }
+
+                *v_(group->Weak, n++) = p;
+        }
+
+        group->Weak.count = n;
+}
+
+/*
+ * Called by the collecting thread after every thread in the group has
+ * finished marking and before finalize_process(). Unmarked weak blocks stay
+ * registered: a queued finalizer may still bring them back, so it's up to
+ * weak_prune() to drop them.
+ */
+void
+weak_process(Ty *ty)
+{
+        ThreadGroup *group = ty->group;
+
+        TySpinLockLock(&group->WeakLock);
+
+        MarkLive(ty, group);
+        Sweep(ty, group, false);
+
+        TySpinLockUnlock(&group->WeakLock);
+}
+
+/*
+ * Called after finalize_process(). If it queued anything, the marking it did
+ * for the queued objects may have reached weak blocks that weak_process()
+ * skipped, so those get the same treatment now. Whatever is still unmarked
+ * is about to be swept and comes off the registry.
+ */
+void
+weak_prune(Ty *ty, bool revived)
+{
+        ThreadGroup *group = ty->group;
+
+        TySpinLockLock(&group->WeakLock);
+
+        if (revived) {
+                MarkLive(ty, group);
+        }
+
+        Sweep(ty, group, true);
+
+        TySpinLockUnlock(&group->WeakLock);
+}
+
+/*
+ * Runs the callbacks of references cleared by the last collection. Called at
+ * the end of DoGC() once the other threads have been released, so callbacks
+ * are free to allocate (and so trigger another collection) or take locks.
+ */
+void
+weak_drain(Ty *ty)
+{
+        static _Thread_local bool draining;
+
+        ThreadGroup *group = ty->group;
+
+        if (draining || vN(group->WeakPending) == 0) {
+                return;
+        }
+
+        draining = true;
+
+        for (;;) {
+                TySpinLockLock(&group->WeakLock);
+
+                if (vN(group->WeakPending) == 0) {
+                        TySpinLockUnlock(&group->WeakLock);
+                        break;
+                }
+
+                Value f = vXx(group->WeakPending);
+
+                TySpinLockUnlock(&group->WeakLock);
+
+                gP(&f);
+
+                if (TY_CATCH_ERROR()) {
+                        char *trace = FormatTrace(ty, NULL, NULL);
+                        Value error = TY_CATCH();
+                        fprintf(
+                                stderr,
+                                "%sERROR:%s uncaught exception in weak reference callback:\n%s\n%s",
+                                TERM(91;1),
+                                TERM(0),
+                                VSC(&error),
+                                trace
+                        );
+                        xmF(trace);
+                } else {
+                        vmC(&f, 0);
+                        TY_CATCH_END();
+                }
+
+                gX();
+        }
+
+        draining = false;
+}
+
+/* vim: set sts=8 sw=8 expandtab: */
@@ -131,6 +131,9 @@ usage(void)
                 "                    (- is interpreted as stdout, and @ is interpreted as stderr)         \0"
                 "    --wall        Profile based on wall time instead of CPU time                         \0"
 #endif
+                "    --heap-limit=SIZE                                                                    \0"
+                "                  Throw MemoryError instead of letting the heap grow past SIZE bytes     \0"
+                "                  (K, M and G suffixes are accepted)                                     \0"
                 "    --color=WHEN  Explicitly control when to use colored output. WHEN can be set         \0"
                 "                  to 'always', 'never', or 'auto' (default: 'auto')                      \0"
                 "    --highlight[=THEME]                                                                  \0"
@@ -448,6 +451,32 @@ OpenOutputFile(char const *path)
         return file;
 }
 
+// 512K, 64M, 2G, ...
+static bool
+ParseSize(char const *s, isize *n)
+{
+        char *end;
+        long long size = strtoll(s, &end, 10);
+
+        if (end == s || size <= 0) {
+                return false;
+        }
+
+        switch (*end) {
+        case 'K': case 'k': size <<= 10; end += 1; break;
+        case 'M': case 'm': size <<= 20; end += 1; break;
+        case 'G': case 'g': size <<= 30; end += 1; break;
+        }
+
+        if (*end != '\0') {
+                return false;
+        }
+
+        *n = size;
+
+        return true;
+}
+
 static int
 ProcessArgs(char *argv[], bool first)
 {
@@ -503,6 +532,14 @@ ProcessArgs(char *argv[], bool first)
                         goto NextOption;
                 }
 
+                char const limit[] = "--heap-limit=";
+                if (strncmp(argv[argi], limit, countof(limit) - 1) == 0) {
+                        if (!ParseSize(argv[argi] + countof(limit) - 1, &GCHeapLimit)) {
+                                goto BadOption;
+                        }
+                        goto NextOption;
+                }
+
                 char const prefix[] = "--color=";
                 if (strncmp(argv[argi], prefix, countof(prefix) - 1) == 0) {
                         char const *when = strchr(argv[argi], '=') + 1;